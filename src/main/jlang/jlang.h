@@ -30,9 +30,14 @@
 #include "jlang/stream/FileStringStream.h"
 
 #include "jlang/vm/Interpreter_v1.h"
+#include "jlang/vm/Scheduler.h"
 #include "jlang/vm/Interpreter_v2.h"
 #include "jlang/vm/Interpreter_v3.h"
+#include "jlang/vm/ExecutionPool.h"
+#include "jlang/vm/ContextPool.h"
+#include "jlang/vm/TunedInterpreter.h"
 #include "jlang/vm/Interpreter_v4.h"
+#include "jlang/vm/Interpreter_v5.h"
 
 #include "jlang/asm/Parser.h"
 #include "jlang/asm/AsmParser.h"
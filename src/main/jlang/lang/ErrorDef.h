@@ -134,6 +134,66 @@
     // vmBinary
     _Err(BinaryFile_Read_Failed)
 
+    // vmPreDecoder
+    _Err(PreDecode_Truncated_Instruction)
+    _Err(PreDecode_Invalid_Target)
+
+    // vmJitCompiler
+    _Err(Jit_Unsupported_Platform)
+    _Err(Jit_Unsupported_OpCode)
+    _Err(Jit_Alloc_Failed)
+    _Err(Jit_Unsupported_Layout)
+    _Err(Jit_Stack_Overflow)
+
+    // vmAotTranslator
+    _Err(Aot_Unsupported_OpCode)
+
+    // vmRegTranslator
+    _Err(RegVM_Unsupported_OpCode)
+    _Err(RegVM_Stack_Mismatch)
+    _Err(RegVM_Stack_Overflow)
+    _Err(RegVM_Unsupported_Layout)
+
+    // vmVerifier
+    _Err(Verify_Unsupported_OpCode)
+    _Err(Verify_Invalid_Operand)
+    _Err(Verify_Invalid_Target)
+    _Err(Verify_Fall_Off_End)
+    _Err(Verify_Stack_Mismatch)
+    _Err(Verify_Stack_Underflow)
+    _Err(Verify_Stack_Overflow)
+
+    // vmTunedInterpreter
+    _Err(Tuned_Variant_Out_Of_Range)
+
+    // vmSafepoint
+    _Err(Safepoint_Out_Of_Fuel)
+    _Err(Safepoint_Paused)
+    _Err(Safepoint_Aborted)
+    _Err(Safepoint_Yielded)
+    _Err(Safepoint_Not_Suspended)
+
+    // vmStackGuard
+    _Err(StackGuard_Overflow)
+
+    // vmStack
+    _Err(Stack_Grow_Unverified)
+    _Err(Stack_Not_Growable)
+
+    // ExecutionPool
+    _Err(Pool_Image_Alloc_Failed)
+    _Err(Pool_Invalid_Entry)
+    _Err(Pool_Context_Create_Failed)
+    _Err(Pool_Not_Started)
+    _Err(Pool_Stopped)
+
+    // vmSnapshot
+    _Err(Snapshot_Invalid)
+    _Err(Snapshot_File_Failed)
+    _Err(Snapshot_Layout_Mismatch)
+    _Err(Snapshot_Image_Mismatch)
+    _Err(Snapshot_Stack_Too_Small)
+
     #undef _Err
 
 #endif
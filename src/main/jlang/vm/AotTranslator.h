@@ -0,0 +1,536 @@
+#ifndef JLANG_VM_AOTTRANSLATOR_H
+#define JLANG_VM_AOTTRANSLATOR_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/vm/Interpreter.h"
+#include "jlang/vm/PreDecoder.h"
+#include "jlang/vm/SuperInsn.h"
+#include "jlang/lang/Error.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <stdarg.h>
+#include <string.h>
+#include <assert.h>
+
+#include <string>
+#include <vector>
+#include <algorithm>
+
+namespace jlang {
+namespace v3 {
+
+struct vmAotCallMode {
+    enum Type {
+        // Each call target becomes a C++ function, VM call/ret are C++ call/return.
+        Native,
+        // One C++ function, VM ret jumps back by a switch on the return site id.
+        Dispatch,
+        Last
+    };
+};
+
+struct vmAotOptions {
+    std::string         name;           // Namespace of the generated code
+    std::string         source;         // Source file name, only for the comment
+    int                 callMode;       // vmAotCallMode::Type
+    int64_t             inputOffset;    // Image offset of the input immediate, or -1
+
+    vmAotOptions() : name("jlang_aot"), source("(image)"),
+                     callMode(vmAotCallMode::Native), inputOffset(-1) {}
+};
+
+//
+// Translate the pre-decoded records to a C++ translation unit, it's the
+// generic form of the hand-coded execute_inline(): each basic block gets
+// a label and each VM call becomes either a C++ function call or a jump
+// with a computed return-site dispatch.
+//
+// The generated code keeps the interpreter's stack and frame layout, so
+// its results can be checked against the interpreter. The entry is:
+//
+//   uint32_t <name>::run(void * stack, uint32_t input);
+//
+// where the input replaces the immediate at options.inputOffset (the
+// slot patched by vmBinaryFile::setInput()).
+//
+class AotTranslator {
+private:
+    const vmDecodedImage &  decoded_;
+    const vmAotOptions &    options_;
+    const vmInstruction *   insns_;
+    size_t                  insnCount_;
+    std::string             out_;
+
+    static std::string format(const char * fmt, ...) {
+        char buf[512];
+        va_list args;
+        va_start(args, fmt);
+        vsnprintf(buf, sizeof(buf), fmt, args);
+        va_end(args);
+        return std::string(buf);
+    }
+
+    static bool isCall(uint8_t opcode) {
+        return (opcode == OpCode::call || opcode == OpCode::call_near ||
+                opcode == OpCode::call_short || opcode == OpCode::call_long);
+    }
+
+    static bool isJump(uint8_t opcode) {
+        return (opcode == OpCode::jmp || opcode == OpCode::jmp_near ||
+                opcode == OpCode::jmp_short || opcode == OpCode::jmp_long);
+    }
+
+    static bool isReturn(uint8_t opcode) {
+        return (opcode >= OpCode::ret && opcode <= OpCode::ret_eax_n);
+    }
+
+    // Can the control fall through to the next record ?
+    static bool isFallThrough(uint8_t opcode) {
+        return !(isJump(opcode) || isReturn(opcode) || opcode == OpCode::exit);
+    }
+
+    static const char * getOpCodeName(uint8_t opcode) {
+        const vmInsnTemplate * insnTpl = SuperInsnTemplates::get(opcode);
+        if (insnTpl != nullptr)
+            return insnTpl->name;
+        switch (opcode) {
+        case OpCode::error:         return "error";
+        case OpCode::move:          return "move";
+        case OpCode::move_to_eax:   return "move_to_eax";
+        case OpCode::cmp:           return "cmp";
+        case OpCode::jl:            return "jl";
+        case OpCode::nop:           return "nop";
+        case OpCode::nop_n:         return "nop_n";
+        case OpCode::exit:          return "exit";
+        default:                    return "unknown";
+        }
+    }
+
+    size_t indexOf(const vmInstruction * insn) const {
+        return (size_t)(insn - insns_);
+    }
+
+    std::string label(size_t index) const {
+        return format("L_%08X", insns_[index].offset);
+    }
+
+    std::string funcName(size_t index) const {
+        return format("func_%08X", insns_[index].offset);
+    }
+
+    std::string slot(const char * type, int32_t index) const {
+        return format("*((%s *)fp + (%d))", type, index);
+    }
+
+    // The immediate, or the input argument if it's the input slot.
+    std::string imm32(const vmInstruction & insn) const {
+        if (options_.inputOffset >= (int64_t)insn.offset &&
+            options_.inputOffset < (int64_t)insn.offset + insn.length)
+            return "input";
+        else
+            return format("0x%08Xu", insn.imm.u32);
+    }
+
+    std::string condition(const vmInstruction & insn) const {
+        bool isSigned = (insn.opcode == OpCode::cmp_i32 || insn.opcode == OpCode::cmp_imm_i32);
+        bool isImm = (insn.opcode == OpCode::cmp_imm_i32 || insn.opcode == OpCode::cmp_imm_u32);
+        const char * type = isSigned ? "int32_t" : "uint32_t";
+        std::string v1 = slot(type, insn.index);
+        std::string v2 = isImm ? (isSigned ? format("(%d)", insn.imm.i32) : imm32(insn))
+                               : slot(type, insn.index2);
+        switch (insn.cond) {
+        case OpCode::jz:        return "(" + v1 + " == 0 && " + v2 + " == 0)";
+        case OpCode::jnz:       return "(" + v1 + " != 0 && " + v2 + " != 0)";
+        case OpCode::je:        return "(" + v1 + " == " + v2 + ")";
+        case OpCode::jne:       return "(" + v1 + " != " + v2 + ")";
+        case OpCode::jl:
+        case OpCode::jl_near:
+        case OpCode::jl_short:
+        case OpCode::jl_long:   return "(" + v1 + " < " + v2 + ")";
+        case OpCode::jle:       return "(" + v1 + " <= " + v2 + ")";
+        case OpCode::jg:        return "(" + v1 + " > " + v2 + ")";
+        case OpCode::jge:       return "(" + v1 + " >= " + v2 + ")";
+        case OpCode::js:        return "(" + v1 + " > 0)";
+        case OpCode::jns:       return "(" + v1 + " <= 0)";
+        case OpCode::jmp:
+        case OpCode::jmp_near:
+        case OpCode::jmp_short:
+        case OpCode::jmp_long:  return "true";
+        default:                return "false";
+        }
+    }
+
+    void line(const std::string & text) {
+        out_ += "    " + text + "\n";
+    }
+
+    //
+    // Collect the records reachable from start, the call targets are not
+    // followed if followCalls is false, they are added to the functions.
+    //
+    void collect(size_t start, bool followCalls, std::vector<bool> & reachable,
+                 std::vector<size_t> & functions) const {
+        std::vector<size_t> worklist;
+        worklist.push_back(start);
+        while (!worklist.empty()) {
+            size_t index = worklist.back();
+            worklist.pop_back();
+            if (index >= insnCount_ || reachable[index])
+                continue;
+            reachable[index] = true;
+
+            const vmInstruction & insn = insns_[index];
+            if (insn.target != nullptr) {
+                size_t target = indexOf(insn.target);
+                if (isCall(insn.opcode) && !followCalls) {
+                    if (std::find(functions.begin(), functions.end(), target) == functions.end())
+                        functions.push_back(target);
+                }
+                else {
+                    worklist.push_back(target);
+                }
+            }
+            if (isFallThrough(insn.opcode))
+                worklist.push_back(index + 1);
+        }
+    }
+
+    //
+    // Emit the records of one C++ function, in the order of the image.
+    //
+    int emitBody(const std::vector<bool> & reachable, size_t start, bool isNative) {
+        std::vector<size_t> order;
+        for (size_t i = 0; i < insnCount_; ++i) {
+            if (reachable[i])
+                order.push_back(i);
+        }
+
+        std::vector<bool> needLabel(insnCount_, false);
+        if (order.empty() || order[0] != start) {
+            needLabel[start] = true;
+            line("goto " + label(start) + ";");
+        }
+        for (size_t n = 0; n < order.size(); ++n) {
+            const vmInstruction & insn = insns_[order[n]];
+            if (insn.target != nullptr && (!isCall(insn.opcode) || !isNative))
+                needLabel[indexOf(insn.target)] = true;
+            if (isCall(insn.opcode) && !isNative)
+                needLabel[order[n] + 1] = true;
+            if (isFallThrough(insn.opcode) &&
+                ((n + 1) >= order.size() || order[n + 1] != order[n] + 1))
+                needLabel[order[n] + 1] = true;
+        }
+
+        std::vector<size_t> returnSites;
+        if (!isNative) {
+            for (size_t n = 0; n < order.size(); ++n) {
+                if (isCall(insns_[order[n]].opcode))
+                    returnSites.push_back(order[n] + 1);
+            }
+        }
+
+        for (size_t n = 0; n < order.size(); ++n) {
+            size_t index = order[n];
+            const vmInstruction & insn = insns_[index];
+
+            if (needLabel[index])
+                out_ += label(index) + ":\n";
+            line(format("// %08X:  %s", insn.offset, getOpCodeName(insn.opcode)));
+
+            switch (insn.opcode) {
+            case OpCode::push:
+                line("*(uint32_t *)sp = " + slot("uint32_t", insn.index) + "; sp += 4;");
+                break;
+            case OpCode::push_i32:
+                line("*(uint32_t *)sp = " + imm32(insn) + "; sp += 4;");
+                break;
+            case OpCode::push_i64:
+                line(format("*(uint64_t *)sp = 0x%016llXull; sp += 8;",
+                            (unsigned long long)insn.imm.u64));
+                break;
+            case OpCode::push_i32_0:
+                line("*(uint32_t *)sp = 0; sp += 4;");
+                break;
+            case OpCode::push_i64_0:
+                line("*(uint64_t *)sp = 0; sp += 8;");
+                break;
+            case OpCode::pop:
+            case OpCode::pop_i32:
+                line("sp -= 4;");
+                break;
+            case OpCode::pop_i64:
+                line("sp -= 8;");
+                break;
+            case OpCode::add_sp:
+                line(format("sp += %d;", insn.index));
+                break;
+            case OpCode::add_sp_4:
+                line("sp += 4;");
+                break;
+            case OpCode::load_eax:
+                line("eax = " + imm32(insn) + ";");
+                break;
+            case OpCode::store:
+                line(slot("uint32_t", insn.index) + " = " + imm32(insn) + ";");
+                break;
+            case OpCode::copy_from_eax:
+                line(slot("uint32_t", insn.index) + " = eax;");
+                break;
+            case OpCode::cmp_i32:
+            case OpCode::cmp_u32:
+            case OpCode::cmp_imm_i32:
+            case OpCode::cmp_imm_u32:
+                line("flags = " + condition(insn) + ";");
+                break;
+            case OpCode::jl_near:
+            case OpCode::jl_short:
+            case OpCode::jl_long:
+                line("if (flags) goto " + label(indexOf(insn.target)) + ";");
+                break;
+            case OpCode::jmp:
+            case OpCode::jmp_near:
+            case OpCode::jmp_short:
+            case OpCode::jmp_long:
+                line("goto " + label(indexOf(insn.target)) + ";");
+                break;
+            case OpCode::call:
+            case OpCode::call_near:
+            case OpCode::call_short:
+            case OpCode::call_long: {
+                size_t target = indexOf(insn.target);
+                if (isNative) {
+                    line("AOT_PUSH_FRAME(0);");
+                    line("AOT_SAVE(); " + funcName(target) + "(s); if (s.exited) return; AOT_LOAD();");
+                }
+                else {
+                    size_t siteId = std::find(returnSites.begin(), returnSites.end(), index + 1)
+                                    - returnSites.begin() + 1;
+                    line(format("AOT_PUSH_FRAME(%u);", (uint32_t)siteId));
+                    line("goto " + label(target) + ";");
+                }
+                break;
+            }
+            case OpCode::ret:
+            case OpCode::ret_n_sm:
+            case OpCode::ret_n:
+            case OpCode::ret_eax:
+            case OpCode::ret_eax_n: {
+                if (insn.opcode == OpCode::ret_eax || insn.opcode == OpCode::ret_eax_n)
+                    line("eax = " + imm32(insn) + ";");
+                int32_t localSize = (insn.opcode == OpCode::ret) ? 0 :
+                                    (insn.opcode == OpCode::ret_eax) ? 0 : insn.index;
+                line(format("AOT_POP_FRAME(%d);", localSize));
+                if (isNative) {
+                    line("AOT_SAVE(); return;");
+                }
+                else {
+                    line("switch (AOT_RETURN_SITE()) {");
+                    for (size_t k = 0; k < returnSites.size(); ++k) {
+                        line(format("case %u: goto %s;", (uint32_t)(k + 1),
+                                    label(returnSites[k]).c_str()));
+                    }
+                    line("default: goto Execute_Finished;");
+                    line("}");
+                }
+                break;
+            }
+            case OpCode::error:
+            case OpCode::move:
+            case OpCode::move_to_eax:
+            case OpCode::cmp:
+            case OpCode::jl:
+            case OpCode::nop:
+            case OpCode::nop_n:
+                break;
+            case OpCode::inc:
+                line(slot("uint32_t", insn.index) + " += 1;");
+                break;
+            case OpCode::dec:
+                line(slot("uint32_t", insn.index) + " -= 1;");
+                break;
+            case OpCode::add:
+                line(slot("uint32_t", insn.index) + " += " + slot("uint32_t", insn.index2) + ";");
+                break;
+            case OpCode::add_imm:
+                line(slot("uint32_t", insn.index) + " += " + imm32(insn) + ";");
+                break;
+            case OpCode::add_eax:
+                line("eax += " + slot("uint32_t", insn.index) + ";");
+                break;
+            case OpCode::add_eax_imm:
+                line("eax += " + imm32(insn) + ";");
+                break;
+            case OpCode::sub:
+                line(slot("uint32_t", insn.index) + " -= " + slot("uint32_t", insn.index2) + ";");
+                break;
+            case OpCode::sub_imm:
+                line(slot("uint32_t", insn.index) + " -= " + imm32(insn) + ";");
+                break;
+            case OpCode::sub_eax:
+                line("eax -= " + slot("uint32_t", insn.index) + ";");
+                break;
+            case OpCode::sub_eax_imm:
+                line("eax -= " + imm32(insn) + ";");
+                break;
+            case OpCode::exit:
+                if (isNative)
+                    line("s.exited = true; AOT_SAVE(); return;");
+                else
+                    line("goto Execute_Finished;");
+                break;
+            default:
+                return Error::Aot_Unsupported_OpCode;
+            }
+
+            if (isFallThrough(insn.opcode) &&
+                ((n + 1) >= order.size() || order[n + 1] != index + 1))
+                line("goto " + label(index + 1) + ";");
+        }
+        return Error::Ok;
+    }
+
+    AotTranslator(const vmDecodedImage & decoded, const vmAotOptions & options)
+        : decoded_(decoded), options_(options), insns_(decoded.data()),
+          insnCount_(decoded.size() + 1) {}
+
+    int translate() {
+        const std::string & ns = options_.name;
+        bool isNative = (options_.callMode == vmAotCallMode::Native);
+        size_t entry = indexOf(decoded_.entry());
+
+        out_ += "//\n";
+        out_ += "// Generated by jlang-aot from " + options_.source + ", don't edit.\n";
+        out_ += format("// Call mode: %s.\n", isNative ? "native" : "dispatch");
+        out_ += "//\n";
+        out_ += "#ifndef JLANG_AOT_" + ns + "_H\n";
+        out_ += "#define JLANG_AOT_" + ns + "_H\n\n";
+        out_ += "#include <stdint.h>\n";
+        out_ += "#include <stddef.h>\n\n";
+        out_ += "namespace " + ns + " {\n\n";
+
+        out_ += "#define AOT_PUSH_FRAME(site) \\\n"
+                "    do { *(unsigned char **)sp = fp; \\\n"
+                "         *(uintptr_t *)(sp + sizeof(void *)) = (uintptr_t)(site); \\\n"
+                "         sp += sizeof(void *) * 2; fp = sp; } while (0)\n";
+        out_ += "#define AOT_POP_FRAME(localSize) \\\n"
+                "    do { sp -= (localSize) + sizeof(void *) * 2; \\\n"
+                "         fp = *(unsigned char **)sp; } while (0)\n";
+        out_ += "#define AOT_RETURN_SITE() \\\n"
+                "    (*(uintptr_t *)(sp + sizeof(void *)))\n";
+
+        if (isNative) {
+            out_ += "#define AOT_SAVE() \\\n"
+                    "    do { s.sp = sp; s.fp = fp; s.eax = eax; s.flags = flags; } while (0)\n";
+            out_ += "#define AOT_LOAD() \\\n"
+                    "    do { sp = s.sp; fp = s.fp; eax = s.eax; flags = s.flags; } while (0)\n\n";
+            out_ += "struct State {\n"
+                    "    unsigned char * sp;\n"
+                    "    unsigned char * fp;\n"
+                    "    uint32_t        eax;\n"
+                    "    bool            flags;\n"
+                    "    bool            exited;\n"
+                    "    uint32_t        input;\n"
+                    "};\n\n";
+
+            std::vector<size_t> functions;
+            functions.push_back(entry);
+            std::vector<std::vector<bool> > bodies;
+            for (size_t n = 0; n < functions.size(); ++n) {
+                std::vector<bool> reachable(insnCount_, false);
+                collect(functions[n], false, reachable, functions);
+                bodies.push_back(reachable);
+            }
+
+            for (size_t n = 0; n < functions.size(); ++n) {
+                out_ += "static void " + funcName(functions[n]) + "(State & s);\n";
+            }
+            out_ += "\n";
+
+            for (size_t n = 0; n < functions.size(); ++n) {
+                out_ += "static void " + funcName(functions[n]) + "(State & s)\n{\n";
+                line("unsigned char * sp;");
+                line("unsigned char * fp;");
+                line("uint32_t eax;");
+                line("bool flags;");
+                line("const uint32_t input = s.input;");
+                line("AOT_LOAD();");
+                line("(void)input;");
+                out_ += "\n";
+                int ec = emitBody(bodies[n], functions[n], true);
+                if (ec != Error::Ok)
+                    return ec;
+                out_ += "}\n\n";
+            }
+
+            out_ += "static inline uint32_t run(void * stack, uint32_t input)\n{\n";
+            line("State s;");
+            line("unsigned char * sp = (unsigned char *)stack;");
+            line("unsigned char * fp = sp;");
+            line("uint32_t eax = 0;");
+            line("bool flags = false;");
+            line("s.exited = false;");
+            line("s.input = input;");
+            out_ += "\n";
+            line("// Push call program entry.");
+            line("AOT_PUSH_FRAME(0);");
+            line("AOT_SAVE();");
+            line(funcName(entry) + "(s);");
+            line("return s.eax;");
+            out_ += "}\n\n";
+            out_ += "#undef AOT_SAVE\n";
+            out_ += "#undef AOT_LOAD\n";
+        }
+        else {
+            std::vector<bool> reachable(insnCount_, false);
+            std::vector<size_t> functions;
+            collect(entry, true, reachable, functions);
+
+            out_ += "\nstatic inline uint32_t run(void * stack, uint32_t input)\n{\n";
+            line("unsigned char * sp = (unsigned char *)stack;");
+            line("unsigned char * fp = sp;");
+            line("uint32_t eax = 0;");
+            line("bool flags = false;");
+            line("(void)input;");
+            out_ += "\n";
+            line("// Push call program entry.");
+            line("AOT_PUSH_FRAME(0);");
+            out_ += "\n";
+            int ec = emitBody(reachable, entry, false);
+            if (ec != Error::Ok)
+                return ec;
+            out_ += "\nExecute_Finished:\n";
+            line("return eax;");
+            out_ += "}\n\n";
+        }
+
+        out_ += "#undef AOT_PUSH_FRAME\n";
+        out_ += "#undef AOT_POP_FRAME\n";
+        out_ += "#undef AOT_RETURN_SITE\n\n";
+        out_ += "} // namespace " + ns + "\n\n";
+        out_ += "#endif // JLANG_AOT_" + ns + "_H\n";
+        return Error::Ok;
+    }
+
+public:
+    static int translate(const vmDecodedImage & decoded, const vmAotOptions & options,
+                         std::string & source) {
+        if (!decoded.isInited())
+            return Error::Error_NullPtr;
+
+        AotTranslator translator(decoded, options);
+        int ec = translator.translate();
+        if (ec == Error::Ok)
+            source.swap(translator.out_);
+        return ec;
+    }
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_AOTTRANSLATOR_H
@@ -0,0 +1,256 @@
+#ifndef JLANG_VM_CONTEXTPOOL_H
+#define JLANG_VM_CONTEXTPOOL_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+#include "jlang/vm/Interpreter_v3.h"
+#include "jlang/lang/Error.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include <vector>
+#include <mutex>
+
+namespace jlang {
+namespace v3 {
+
+struct vmContextPoolStats {
+    size_t      created;
+    size_t      idle;
+    size_t      busy;
+    uint64_t    acquires;
+    // The acquires that found no idle context and created one.
+    uint64_t    misses;
+    // The max resident stack bytes of a context, seen by trim().
+    size_t      highWater;
+    // The max resident stack bytes of a context, seen by the last trim().
+    size_t      lastHighWater;
+    // The stack bytes that are given back to the OS by trim().
+    uint64_t    trimmedBytes;
+    // The result of verify() on the created contexts, they run in the
+    // checked loops if the image fails it.
+    int         verifyResult;
+
+    vmContextPoolStats()
+        : created(0), idle(0), busy(0), acquires(0), misses(0),
+          highWater(0), lastHighWater(0), trimmedBytes(0),
+          verifyResult(Error::Ok) {}
+};
+
+//
+// The pool of the pre-created contexts of one image, for the workloads that
+// run a short invocation per request.
+//
+// Creating a context allocates and clears its stacks and pre-decodes the
+// image, which costs more than a short run. The pool does it once per
+// context, acquire() and release() are O(1): release() only rewinds the
+// stacks and the registers, the records of the image are kept.
+//
+// The stacks of the idle contexts keep the pages that they touched,
+// trim() records their high-water marks and gives the pages beyond the
+// keep size back to the OS.
+//
+template <typename BasicType = uintptr_t, typename Layout = vmDefaultLayout>
+class vmContextPool {
+public:
+    typedef BasicType                               basic_type;
+    typedef Layout                                  layout_type;
+    typedef size_t                                  size_type;
+    typedef ExecutionContext<basic_type, Layout>    context_type;
+    typedef vmContextPool<basic_type, Layout>       this_type;
+
+    static const size_type kDefaultStackSize = context_type::kDefaultStackSize;
+    static const size_type kDefaultKeepSize = 64 * 1024;
+
+private:
+    void *                      imageStart_;
+    size_t                      imageSize_;
+    void *                      imageEntry_;
+    size_type                   stackSize_;
+    size_type                   keepSize_;
+
+    std::mutex                  lock_;
+    std::vector<context_type *> contexts_;
+    std::vector<context_type *> idle_;
+    vmContextPoolStats          stats_;
+
+    context_type * createContext(int & ec) {
+        context_type * context = new context_type();
+        context->setImageInfo(imageStart_, imageSize_, imageEntry_);
+        context->create(stackSize_);
+        if (!context->isInited()) {
+            delete context;
+            ec = Error::Pool_Context_Create_Failed;
+            return nullptr;
+        }
+        ec = context->predecode();
+        if (ec != Error::Ok) {
+            delete context;
+            return nullptr;
+        }
+        // The image that fails the verification still runs in the checked
+        // loops, the result is reported by getStats().
+        int verifyResult = context->verify();
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            stats_.verifyResult = verifyResult;
+        }
+        return context;
+    }
+
+public:
+    vmContextPool()
+        : imageStart_(nullptr), imageSize_(0), imageEntry_(nullptr),
+          stackSize_(kDefaultStackSize), keepSize_(kDefaultKeepSize) {}
+    ~vmContextPool() {
+        destroy();
+    }
+
+    bool isInited() const { return (imageStart_ != nullptr); }
+
+    size_type getStackSize() const { return stackSize_; }
+
+    size_type getKeepSize() const { return keepSize_; }
+    void setKeepSize(size_type keepSize) {
+        keepSize_ = keepSize;
+    }
+
+    //
+    // Bind the pool to the image and pre-create count contexts. The image
+    // must stay valid and unchanged until the pool is destroyed.
+    //
+    int create(void * imageStart, size_t imageSize, void * imageEntry,
+               size_t count, size_type stackSize = kDefaultStackSize) {
+        destroy();
+        imageStart_ = imageStart;
+        imageSize_ = imageSize;
+        imageEntry_ = imageEntry;
+        stackSize_ = stackSize;
+        return reserve(count);
+    }
+
+    void destroy() {
+        std::lock_guard<std::mutex> guard(lock_);
+        // The busy contexts must be released before.
+        assert(idle_.size() == contexts_.size());
+        for (size_t i = 0; i < contexts_.size(); ++i) {
+            delete contexts_[i];
+        }
+        contexts_.clear();
+        idle_.clear();
+        stats_ = vmContextPoolStats();
+        imageStart_ = nullptr;
+        imageSize_ = 0;
+        imageEntry_ = nullptr;
+    }
+
+    //
+    // Create the idle contexts until there are count contexts.
+    //
+    int reserve(size_t count) {
+        for (;;) {
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+                if (contexts_.size() >= count)
+                    return Error::Ok;
+            }
+            int ec;
+            context_type * context = createContext(ec);
+            if (context == nullptr)
+                return ec;
+            std::lock_guard<std::mutex> guard(lock_);
+            contexts_.push_back(context);
+            idle_.push_back(context);
+        }
+    }
+
+    //
+    // Check out a context that's ready to run from the entry, a new context
+    // is created if there is no idle one. Return nullptr if it fails.
+    //
+    context_type * acquire() {
+        assert(isInited());
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            stats_.acquires++;
+            if (!idle_.empty()) {
+                context_type * context = idle_.back();
+                idle_.pop_back();
+                return context;
+            }
+            stats_.misses++;
+        }
+        // Create it out of the lock, it's slow.
+        int ec;
+        context_type * context = createContext(ec);
+        if (context != nullptr) {
+            std::lock_guard<std::mutex> guard(lock_);
+            contexts_.push_back(context);
+        }
+        return context;
+    }
+
+    //
+    // Return the context to the pool, it's rewound for the next acquire().
+    //
+    void release(context_type * context) {
+        assert(context != nullptr);
+        context->reset();
+        context->rebindImage(imageEntry_);
+        std::lock_guard<std::mutex> guard(lock_);
+        idle_.push_back(context);
+    }
+
+    //
+    // Record the high-water marks of the idle contexts, and give their stack
+    // pages beyond the keep size back to the OS. Return the bytes that are
+    // given back.
+    //
+    // The contexts are trimmed one at a time under the lock, so acquire()
+    // waits for one context at most, and it still finds the other idle
+    // contexts instead of creating new ones. acquire() takes the last idle
+    // context, the trim goes from the first one.
+    //
+    size_type trim() {
+        size_type highWater = 0;
+        size_type trimmed = 0;
+        for (size_t i = 0; ; ++i) {
+            std::lock_guard<std::mutex> guard(lock_);
+            if (i >= idle_.size())
+                break;
+            context_type * context = idle_[i];
+            size_type resident = context->getStackResidentSize();
+            if (resident > highWater)
+                highWater = resident;
+            // Both the stacks keep their keep size.
+            if (resident > keepSize_ * 2)
+                trimmed += context->trimStacks(keepSize_);
+        }
+
+        std::lock_guard<std::mutex> guard(lock_);
+        stats_.lastHighWater = highWater;
+        if (highWater > stats_.highWater)
+            stats_.highWater = highWater;
+        stats_.trimmedBytes += trimmed;
+        return trimmed;
+    }
+
+    vmContextPoolStats getStats() {
+        std::lock_guard<std::mutex> guard(lock_);
+        vmContextPoolStats stats = stats_;
+        stats.created = contexts_.size();
+        stats.idle = idle_.size();
+        stats.busy = contexts_.size() - idle_.size();
+        return stats;
+    }
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_CONTEXTPOOL_H
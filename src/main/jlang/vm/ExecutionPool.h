@@ -0,0 +1,529 @@
+#ifndef JLANG_VM_EXECUTIONPOOL_H
+#define JLANG_VM_EXECUTIONPOOL_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+#include "jlang/vm/Interpreter_v3.h"
+#include "jlang/support/StopWatch.h"
+#include "jlang/lang/Error.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif // _WIN32
+
+namespace jlang {
+namespace v3 {
+
+//
+// The image that's loaded once and shared by all the contexts of a pool.
+// It's turned to read-only when it's frozen, so a context that writes to
+// it faults at once, instead of racing with the other contexts.
+//
+// The entry is a function that takes its arguments from the entry frame,
+// they're pushed by the context and the image is never patched.
+//
+class vmSharedImage {
+private:
+    void *  data_;
+    size_t  size_;
+    size_t  allocSize_;
+    size_t  entryOffset_;
+    bool    frozen_;
+
+public:
+    vmSharedImage() : data_(nullptr), size_(0), allocSize_(0),
+                      entryOffset_(0), frozen_(false) {}
+    ~vmSharedImage() {
+        this->deallocate();
+    }
+
+    bool isInited() const { return (data_ != nullptr); }
+    bool isFrozen() const { return frozen_; }
+
+    void * data() const { return data_; }
+    size_t size() const { return size_; }
+
+    void * entry() const {
+        return (void *)((char *)data_ + entryOffset_);
+    }
+
+    //
+    // Copy the image, the entry is the offset of the function that's run.
+    //
+    int load(const void * binary, size_t size, size_t entryOffset) {
+        if (binary == nullptr || size == 0)
+            return Error::BinaryFile_Read_Failed;
+        if (entryOffset >= size)
+            return Error::Pool_Invalid_Entry;
+
+        this->deallocate();
+
+        size_t allocSize = (size + 4095) & ~(size_t)4095;
+#if defined(_WIN32)
+        void * memory = ::VirtualAlloc(NULL, allocSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (memory == NULL)
+            return Error::Pool_Image_Alloc_Failed;
+#else
+        void * memory = ::mmap(NULL, allocSize, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            return Error::Pool_Image_Alloc_Failed;
+#endif // _WIN32
+        memcpy(memory, binary, size);
+        data_ = memory;
+        size_ = size;
+        allocSize_ = allocSize;
+        entryOffset_ = entryOffset;
+        return Error::Ok;
+    }
+
+    //
+    // Load the built-in image, the image mode is USE_FIBONACCI_IMAGE or
+    // USE_FIBONACCI_IMAGE_FAST. The entry is the function fib(n), not the
+    // main at offset 0.
+    //
+    template <typename Layout>
+    int loadBuiltin(int imageMode) {
+        typedef vmFibonacciImage<Layout> image_type;
+        if (imageMode == USE_FIBONACCI_IMAGE)
+            return load(&image_type::kBinary[0], image_type::kImageSize, image_type::kFuncOffset);
+        else if (imageMode == USE_FIBONACCI_IMAGE_FAST)
+            return load(&image_type::kBinaryFast[0], image_type::kImageSize, image_type::kFuncOffset);
+        else
+            return Error::BinaryFile_Read_Failed;
+    }
+
+    //
+    // Turn the image to read-only, it can't be loaded again until it's
+    // deallocated.
+    //
+    int freeze() {
+        if (!isInited())
+            return Error::Pool_Image_Alloc_Failed;
+        if (frozen_)
+            return Error::Ok;
+#if defined(_WIN32)
+        DWORD oldProtect;
+        if (!::VirtualProtect(data_, allocSize_, PAGE_READONLY, &oldProtect))
+            return Error::Pool_Image_Alloc_Failed;
+#else
+        if (::mprotect(data_, allocSize_, PROT_READ) != 0)
+            return Error::Pool_Image_Alloc_Failed;
+#endif // _WIN32
+        frozen_ = true;
+        return Error::Ok;
+    }
+
+    void deallocate() {
+        if (data_) {
+#if defined(_WIN32)
+            ::VirtualFree(data_, 0, MEM_RELEASE);
+#else
+            ::munmap(data_, allocSize_);
+#endif
+            data_ = nullptr;
+        }
+        size_ = 0;
+        allocSize_ = 0;
+        entryOffset_ = 0;
+        frozen_ = false;
+    }
+};
+
+//
+// One invocation of the shared image, it's owned by the caller and must
+// live until it's done. The arguments are pushed in order, the last one
+// is the arg0 of the entry.
+//
+template <typename BasicType = uintptr_t>
+class vmInvocation {
+public:
+    typedef BasicType               basic_type;
+    typedef vmReturn<basic_type>    return_type;
+
+    static const size_t kMaxArgs = 8;
+
+private:
+    uint32_t            args_[kMaxArgs];
+    size_t              argCount_;
+    int                 ec_;
+    return_type         ret_;
+    std::atomic<bool>   done_;
+
+public:
+    vmInvocation(uint32_t input = 0) : argCount_(1), ec_(Error::Ok), done_(false) {
+        args_[0] = input;
+    }
+    ~vmInvocation() {}
+
+    // The input of the entry that takes one argument.
+    uint32_t getInput() const { return args_[0]; }
+    void setInput(uint32_t input) {
+        args_[0] = input;
+        argCount_ = 1;
+    }
+
+    size_t getArgCount() const { return argCount_; }
+    uint32_t getArg(size_t index) const {
+        assert(index < argCount_);
+        return args_[index];
+    }
+
+    void setArgs(const uint32_t * args, size_t count) {
+        assert(count <= kMaxArgs);
+        for (size_t i = 0; i < count; ++i) {
+            args_[i] = args[i];
+        }
+        argCount_ = count;
+    }
+
+    int getErrorCode() const { return ec_; }
+    return_type & getReturn() { return ret_; }
+    const return_type & getReturn() const { return ret_; }
+
+    bool isDone() const { return done_.load(std::memory_order_acquire); }
+
+    void finish(int ec) {
+        ec_ = ec;
+        done_.store(true, std::memory_order_release);
+    }
+
+    void reset() {
+        ec_ = Error::Ok;
+        done_.store(false, std::memory_order_relaxed);
+    }
+};
+
+//
+// The throughput of a pool since it's started, or since resetStats().
+//
+struct vmPoolStats {
+    uint64_t    completed;
+    size_t      workers;
+    double      seconds;
+    double      busySeconds;
+
+    vmPoolStats() : completed(0), workers(0), seconds(0.0), busySeconds(0.0) {}
+
+    // The invocations per second.
+    double throughput() const {
+        return (seconds > 0.0) ? ((double)completed / seconds) : 0.0;
+    }
+
+    // The busy time of the workers per the wall time, in [0, 1].
+    double utilization() const {
+        double total = seconds * (double)workers;
+        return (total > 0.0) ? (busySeconds / total) : 0.0;
+    }
+};
+
+//
+// Run the invocations of one shared image on a pool of OS threads.
+//
+// The image is loaded once and frozen, every worker owns its private
+// ExecutionContext, with its own stack and pre-decoded records, and the
+// input of an invocation is pushed to the stack of the context. So the
+// contexts share nothing that's written while they run, only the queue of
+// the invocations is locked, once per batch.
+//
+template <typename BasicType = uintptr_t, typename Layout = vmDefaultLayout>
+class ExecutionPool {
+public:
+    typedef BasicType                               basic_type;
+    typedef Layout                                  layout_type;
+    typedef ExecutionContext<basic_type, Layout>    context_type;
+    typedef vmInvocation<basic_type>                invocation_type;
+    typedef vmReturn<basic_type>                    return_type;
+    typedef ExecutionPool<basic_type, Layout>       this_type;
+
+    // The max count of the invocations that a worker takes at once.
+    static const size_t kMaxBatch = 16;
+
+    static const size_t kDefaultStackSize = 1048576U;
+
+private:
+    struct Worker {
+        this_type *             owner;
+        size_t                  index;
+        context_type            context;
+        std::thread             thread;
+        std::atomic<uint64_t>   completed;
+        std::atomic<uint64_t>   busyNanos;
+
+        Worker(this_type * owner, size_t index)
+            : owner(owner), index(index), completed(0), busyNanos(0) {}
+    };
+
+    vmSharedImage                   image_;
+    std::vector<Worker *>           workers_;
+    std::mutex                      lock_;
+    std::condition_variable         wakeup_;
+    std::condition_variable         finished_;
+    std::deque<invocation_type *>   queue_;
+    size_t                          pending_;
+    bool                            stopping_;
+    StopWatch                       clock_;
+
+    static int invoke(context_type & context, invocation_type * job) {
+        return_type & ret = job->getReturn();
+        ret.setDataType(return_type::Basic);
+        ret.setValue(0);
+
+        // The run that's stopped by an error, like the overflow of the stack,
+        // leaves its frames and registers behind, so it's rewound every time.
+        context.reset();
+        for (size_t i = 0; i < job->getArgCount(); ++i) {
+            context.pushArg(job->getArg(i));
+        }
+        return context.run_predecoded(ret);
+    }
+
+    void workerMain(Worker * worker) {
+        invocation_type * batch[kMaxBatch];
+        StopWatch sw;
+        for (;;) {
+            size_t count = 0;
+            {
+                std::unique_lock<std::mutex> guard(lock_);
+                wakeup_.wait(guard, [this] {
+                    return (!queue_.empty() || stopping_);
+                });
+                if (stopping_)
+                    break;
+                // Leave the rest of the queue to the other workers.
+                size_t share = (queue_.size() + workers_.size() - 1) / workers_.size();
+                size_t limit = (share < kMaxBatch) ? share : kMaxBatch;
+                while (count < limit && !queue_.empty()) {
+                    batch[count++] = queue_.front();
+                    queue_.pop_front();
+                }
+            }
+
+            sw.start();
+            for (size_t i = 0; i < count; ++i) {
+                int ec = invoke(worker->context, batch[i]);
+                batch[i]->finish(ec);
+            }
+            sw.stop();
+            worker->completed.fetch_add(count, std::memory_order_relaxed);
+            worker->busyNanos.fetch_add((uint64_t)(sw.getElapsedTime() * 1e9),
+                                        std::memory_order_relaxed);
+
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+                pending_ -= count;
+            }
+            finished_.notify_all();
+        }
+    }
+
+    //
+    // Freeze the loaded image, and create and start the workers.
+    //
+    int startWorkers(size_t workerCount, size_t stackSize) {
+        if (workerCount == 0)
+            workerCount = std::thread::hardware_concurrency();
+        if (workerCount == 0)
+            workerCount = 1;
+
+        int ec = image_.freeze();
+        if (ec != Error::Ok)
+            return ec;
+
+        for (size_t i = 0; i < workerCount; ++i) {
+            Worker * worker = new Worker(this, i);
+            context_type & context = worker->context;
+            context.setImageInfo(image_.data(), image_.size(), image_.entry());
+            context.create(stackSize);
+            if (context.isInited())
+                ec = context.predecode();
+            else
+                ec = Error::Pool_Context_Create_Failed;
+            if (ec != Error::Ok) {
+                delete worker;
+                stop();
+                return ec;
+            }
+            workers_.push_back(worker);
+        }
+
+        stopping_ = false;
+        for (size_t i = 0; i < workerCount; ++i) {
+            Worker * worker = workers_[i];
+            worker->thread = std::thread(&this_type::workerMain, this, worker);
+        }
+        clock_.reset();
+        return Error::Ok;
+    }
+
+public:
+    ExecutionPool() : pending_(0), stopping_(false) {}
+    ~ExecutionPool() {
+        stop();
+    }
+
+    bool isStarted() const { return !workers_.empty(); }
+
+    size_t getWorkerCount() const { return workers_.size(); }
+
+    const vmSharedImage & getImage() const { return image_; }
+
+    //
+    // Load and freeze the image, and start the workers, the count is the
+    // count of the CPUs by default. The entry is the offset of the function
+    // that the invocations run.
+    //
+    int start(const void * binary, size_t size, size_t entryOffset,
+              size_t workerCount = 0, size_t stackSize = kDefaultStackSize) {
+        if (isStarted())
+            return Error::Ok;
+        int ec = image_.load(binary, size, entryOffset);
+        if (ec != Error::Ok)
+            return ec;
+        return startWorkers(workerCount, stackSize);
+    }
+
+    //
+    // Start the workers on the function fib(n) of the built-in image.
+    //
+    int start(int imageMode = USE_FIBONACCI_IMAGE, size_t workerCount = 0,
+              size_t stackSize = kDefaultStackSize) {
+        if (isStarted())
+            return Error::Ok;
+        int ec = image_.template loadBuiltin<Layout>(imageMode);
+        if (ec != Error::Ok)
+            return ec;
+        return startWorkers(workerCount, stackSize);
+    }
+
+    //
+    // Stop the workers after their running batches. The invocations that
+    // are still queued never run, they're done with Error::Pool_Stopped,
+    // so wait() and waitAll() return.
+    //
+    void stop() {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            stopping_ = true;
+        }
+        wakeup_.notify_all();
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            if (workers_[i]->thread.joinable())
+                workers_[i]->thread.join();
+            delete workers_[i];
+        }
+        workers_.clear();
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            while (!queue_.empty()) {
+                queue_.front()->finish(Error::Pool_Stopped);
+                queue_.pop_front();
+            }
+            pending_ = 0;
+        }
+        finished_.notify_all();
+        image_.deallocate();
+    }
+
+    //
+    // Queue the invocation, it's run by the first idle worker.
+    //
+    int submit(invocation_type * job) {
+        assert(job != nullptr);
+        if (!isStarted())
+            return Error::Pool_Not_Started;
+        job->reset();
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            queue_.push_back(job);
+            pending_++;
+        }
+        wakeup_.notify_one();
+        return Error::Ok;
+    }
+
+    //
+    // Queue the invocations at once.
+    //
+    int submit(invocation_type * jobs, size_t count) {
+        assert(jobs != nullptr || count == 0);
+        if (!isStarted())
+            return Error::Pool_Not_Started;
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            for (size_t i = 0; i < count; ++i) {
+                jobs[i].reset();
+                queue_.push_back(&jobs[i]);
+            }
+            pending_ += count;
+        }
+        wakeup_.notify_all();
+        return Error::Ok;
+    }
+
+    //
+    // Wait until the invocation is done, return its error code.
+    //
+    int wait(invocation_type * job) {
+        assert(job != nullptr);
+        if (!job->isDone()) {
+            std::unique_lock<std::mutex> guard(lock_);
+            finished_.wait(guard, [job] { return job->isDone(); });
+        }
+        return job->getErrorCode();
+    }
+
+    //
+    // Wait until all the queued invocations are done.
+    //
+    void waitAll() {
+        std::unique_lock<std::mutex> guard(lock_);
+        finished_.wait(guard, [this] { return (pending_ == 0); });
+    }
+
+    vmPoolStats getStats() const {
+        vmPoolStats stats;
+        uint64_t busyNanos = 0;
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            stats.completed += workers_[i]->completed.load(std::memory_order_relaxed);
+            busyNanos += workers_[i]->busyNanos.load(std::memory_order_relaxed);
+        }
+        stats.workers = workers_.size();
+        stats.seconds = clock_.peekElapsedTime();
+        stats.busySeconds = (double)busyNanos / 1e9;
+        return stats;
+    }
+
+    void resetStats() {
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            workers_[i]->completed.store(0, std::memory_order_relaxed);
+            workers_[i]->busyNanos.store(0, std::memory_order_relaxed);
+        }
+        clock_.reset();
+    }
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_EXECUTIONPOOL_H
@@ -11,6 +11,11 @@
 #include <assert.h>
 #include <string.h>
 
+#if !defined(_WIN32)
+#include <unistd.h>
+#include <sys/mman.h>
+#endif // !_WIN32
+
 #include <cstdint>
 #include <list>
 #include <memory>
@@ -36,6 +41,28 @@
 
 //////////////////////////////////////////////////////////////
 
+/* Is support computed goto (labels as values) ? */
+#ifndef USE_COMPUTED_GOTO
+#if defined(__GNUC__) || defined(__clang__)
+#define USE_COMPUTED_GOTO       1
+#else
+#define USE_COMPUTED_GOTO       0
+#endif
+#endif // USE_COMPUTED_GOTO
+
+//////////////////////////////////////////////////////////////
+
+/* Reserve the VM stacks with mmap() between two guard regions ? */
+#ifndef USE_VM_STACK_GUARD
+#if defined(_WIN32)
+#define USE_VM_STACK_GUARD      0
+#else
+#define USE_VM_STACK_GUARD      1
+#endif
+#endif // USE_VM_STACK_GUARD
+
+//////////////////////////////////////////////////////////////
+
 #define MakeComboType(t1, t2)   (((t1) * 16) | (t2))
 
 #define VM_STACK_PUSH(sp, type) \
@@ -282,6 +309,20 @@ public:
         idiv,
         push_all,
         pop_all,
+        vload,
+        vstore,
+        vsplat,
+        valu,
+        vcmp,
+        vblend,
+        vshuffle,
+        vreduce,
+        mem_copy,
+        mem_set,
+        mem_cmp,
+        mem_chr,
+        call_native,
+        yield,
         exit,
         last,
 
@@ -462,6 +503,33 @@ struct vmReg {
         reg64_first = rsp,
         reg64_last = r15,
 
+        // 128 bit vector register
+        xmm0,  xmm1,  xmm2,  xmm3,  xmm4,  xmm5,  xmm6,  xmm7,
+        xmm8,  xmm9,  xmm10, xmm11, xmm12, xmm13, xmm14, xmm15,
+        xmm16, xmm17, xmm18, xmm19, xmm20, xmm21, xmm22, xmm23,
+        xmm24, xmm25, xmm26, xmm27, xmm28, xmm29, xmm30, xmm31,
+
+        reg128_first = xmm0,
+        reg128_last = xmm31,
+
+        // 256 bit vector register
+        ymm0,  ymm1,  ymm2,  ymm3,  ymm4,  ymm5,  ymm6,  ymm7,
+        ymm8,  ymm9,  ymm10, ymm11, ymm12, ymm13, ymm14, ymm15,
+        ymm16, ymm17, ymm18, ymm19, ymm20, ymm21, ymm22, ymm23,
+        ymm24, ymm25, ymm26, ymm27, ymm28, ymm29, ymm30, ymm31,
+
+        reg256_first = ymm0,
+        reg256_last = ymm31,
+
+        // 512 bit vector register
+        zmm0,  zmm1,  zmm2,  zmm3,  zmm4,  zmm5,  zmm6,  zmm7,
+        zmm8,  zmm9,  zmm10, zmm11, zmm12, zmm13, zmm14, zmm15,
+        zmm16, zmm17, zmm18, zmm19, zmm20, zmm21, zmm22, zmm23,
+        zmm24, zmm25, zmm26, zmm27, zmm28, zmm29, zmm30, zmm31,
+
+        reg512_first = zmm0,
+        reg512_last = zmm31,
+
         kMaxRegs = 32,
 
         last = reg64_last
@@ -1419,6 +1487,15 @@ public:
         return regs_[regIndex].eax.u32;
     }
 
+    //
+    // The register slots from regIndex, call_native reads the arguments
+    // from them in place.
+    //
+    const Register * getRegs(uint32_t regIndex) const {
+        assert(regIndex >= 0 && regIndex < kMaxRegs);
+        return &regs_[regIndex];
+    }
+
 #if defined(WIN64) || defined(_WIN64) || defined(_M_X64) || defined(_M_AMD64) \
  || defined(__amd64__) || defined(__x86_64__) || defined(__aarch64__)
     uint64_t getRegValue64(uint64_t regIndex) {
@@ -2495,6 +2572,15 @@ public:
     }
 };
 
+//
+// The stack of a context. If USE_VM_STACK_GUARD is on, the stack is
+// reserved with mmap() and only committed by the kernel when it's touched,
+// and there is a guard region of kGuardSize bytes at both ends, see
+// vmStackGuard.
+//
+// The growable stack is a small heap block instead, it's moved to a larger
+// block by grow() when the context finds it's nearly full.
+//
 template <typename BasicType, bool IsBackwardPtr = false>
 class vmStack {
 public:
@@ -2502,17 +2588,70 @@ public:
     typedef size_t              size_type;
     typedef vmFrame<basic_type> frame_type;
 
+    static const size_type kGuardSize = 64 * 1024;
+
 private:
     unsigned char * sp_;
     unsigned char * sp_first_;
     unsigned char * sp_last_;
     frame_type *    frame_;
     size_type       capacity_;
+    unsigned char * reserved_;
+    size_type       reservedSize_;
+    size_type       maxCapacity_;
+    bool            growable_;
+
+    static unsigned char * allocateBlock(size_type size) {
+#if defined(_WIN32)
+        return (unsigned char *)_aligned_malloc(size, 64);
+#else
+        void * block = nullptr;
+        if (posix_memalign(&block, 64, size) != 0)
+            return nullptr;
+        return (unsigned char *)block;
+#endif // _WIN32
+    }
+
+    static void freeBlock(unsigned char * block) {
+#if defined(_WIN32)
+        _aligned_free(block);
+#else
+        free(block);
+#endif
+    }
+
+    void release() {
+#if USE_VM_STACK_GUARD
+        if (reserved_) {
+            ::munmap(reserved_, reservedSize_);
+            reserved_ = nullptr;
+            reservedSize_ = 0;
+            sp_first_ = nullptr;
+        }
+#endif
+        if (sp_first_) {
+            freeBlock(sp_first_);
+            sp_first_ = nullptr;
+        }
+        growable_ = false;
+    }
+
+    void setBuffer(unsigned char * first, size_type capacity) {
+        sp_first_ = first;
+        sp_last_ = sp_first_ + capacity;
+        if (isBackwardPtr())
+            sp_ = sp_last_ - sizeof(basic_type);
+        else
+            sp_ = sp_first_;
+        capacity_ = capacity;
+    }
 
 public:
     vmStack(frame_type * frame = nullptr, size_type capacity = 0)
         : sp_(nullptr), sp_first_(nullptr), sp_last_(nullptr),
-          frame_(frame), capacity_(capacity) {
+          frame_(frame), capacity_(capacity),
+          reserved_(nullptr), reservedSize_(0),
+          maxCapacity_(capacity), growable_(false) {
     }
     ~vmStack() {
         destroy();
@@ -2574,43 +2713,239 @@ public:
     unsigned char * first() const { return sp_first_; }
     unsigned char * last() const { return sp_last_; }
 
+    //
+    // Is the range [address, address + len) in the stack buffer ?
+    //
+    bool contains(const void * address, size_type len) const {
+        const unsigned char * p = (const unsigned char *)address;
+        if (sp_first_ == nullptr || p < sp_first_ || p > sp_last_)
+            return false;
+        return (len <= (size_type)(sp_last_ - p));
+    }
+
+    //
+    // Is the stack between the guard regions ?
+    //
+    bool isGuarded() const { return (reserved_ != nullptr); }
+
+    //
+    // The whole reserved range, the guard regions and the stack.
+    //
+    unsigned char * reservedFirst() const { return reserved_; }
+    unsigned char * reservedLast() const { return (reserved_ + reservedSize_); }
+
+    //
+    // Map size bytes of the file at offset onto the bottom of the stack,
+    // copy-on-write: the start of the forward stack, or the end of the
+    // backward stack. The stack must be reserved with mmap(), the offset
+    // and the size must be page aligned. Return false if it isn't mapped,
+    // the stack is unchanged then.
+    //
+    bool mapBottom(int fd, uint64_t offset, size_type size) {
+#if USE_VM_STACK_GUARD
+        if (reserved_ == nullptr || size == 0 || size > capacity_)
+            return false;
+        size_type pageSize = (size_type)::sysconf(_SC_PAGESIZE);
+        if ((offset % pageSize) != 0 || (size % pageSize) != 0)
+            return false;
+        unsigned char * target = isBackwardPtr() ? (sp_last_ - size) : sp_first_;
+        void * memory = ::mmap((void *)target, size, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_FIXED, fd, (off_t)offset);
+        return (memory != MAP_FAILED);
+#else
+        (void)fd;
+        (void)offset;
+        (void)size;
+        return false;
+#endif // USE_VM_STACK_GUARD
+    }
+
     inline void create(size_type capacity) {
+        release();
+#if USE_VM_STACK_GUARD
+        // The pages are zero-filled, and committed when they're touched.
+        size_type pageSize = (size_type)::sysconf(_SC_PAGESIZE);
+        capacity = (capacity + pageSize - 1) & ~(pageSize - 1);
+        size_type reservedSize = capacity + kGuardSize * 2;
+        void * memory = ::mmap(NULL, reservedSize, PROT_NONE,
+                               MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+        if (memory == MAP_FAILED)
+            return;
+        if (::mprotect((unsigned char *)memory + kGuardSize, capacity,
+                       PROT_READ | PROT_WRITE) != 0) {
+            ::munmap(memory, reservedSize);
+            return;
+        }
+        reserved_ = (unsigned char *)memory;
+        reservedSize_ = reservedSize;
+        setBuffer(reserved_ + kGuardSize, capacity);
+#else
+        unsigned char * first = allocateBlock(capacity);
+        if (first == nullptr)
+            return;
+#ifndef NDEBUG
+        memset((void *)first, 0, sizeof(char) * capacity);
+#endif
+        setBuffer(first, capacity);
+#endif // USE_VM_STACK_GUARD
+        maxCapacity_ = capacity_;
+    }
+
+    //
+    // Create the growable stack, it starts with initialCapacity bytes, and
+    // grows up to maxCapacity bytes.
+    //
+    inline void createGrowable(size_type initialCapacity, size_type maxCapacity) {
+        release();
+        unsigned char * first = allocateBlock(initialCapacity);
+        if (first == nullptr)
+            return;
+        // It isn't cleared, the pages are touched when the stack grows into
+        // them. The register VM that reads the bottom as zero doesn't run on it.
+        setBuffer(first, initialCapacity);
+        maxCapacity_ = (maxCapacity > initialCapacity) ? maxCapacity : initialCapacity;
+        growable_ = true;
+    }
+
+    bool isGrowable() const { return growable_; }
+    size_type maxCapacity() const { return maxCapacity_; }
+
+    //
+    // Move the used bytes of the growable stack to a larger block, so that
+    // there are minFree bytes free at least. used is counted from the bottom
+    // of the stack, delta is the distance that the bytes are moved. Return
+    // false if the stack would be larger than its max capacity.
+    //
+    bool grow(size_type used, size_type minFree, ptrdiff_t & delta) {
+        assert(growable_);
+        assert(used <= capacity_);
+        size_type capacity = capacity_ * 2;
+        while (capacity - used < minFree) {
+            capacity *= 2;
+        }
+        if (capacity > maxCapacity_) {
+            if (maxCapacity_ - used < minFree || maxCapacity_ <= capacity_)
+                return false;
+            capacity = maxCapacity_;
+        }
+
+        unsigned char * first = allocateBlock(capacity);
+        if (first == nullptr)
+            return false;
+        if (isBackwardPtr()) {
+            memcpy((void *)(first + capacity - used), (const void *)(sp_last_ - used), used);
+            delta = (first + capacity) - sp_last_;
+        }
+        else {
+            memcpy((void *)first, (const void *)sp_first_, used);
+            delta = first - sp_first_;
+        }
+
+        unsigned char * sp = sp_ + delta;
+        freeBlock(sp_first_);
+        sp_first_ = first;
+        sp_last_ = first + capacity;
+        sp_ = sp;
+        capacity_ = capacity;
+        return true;
+    }
+
+    //
+    // The bytes of the stack that are backed by the physical pages, the
+    // stack grows from one end, so it's the high-water mark of the stack
+    // since it's created or trimmed.
+    //
+    size_type residentSize() const {
 #if defined(_WIN32)
-        if (sp_first_) {
-            _aligned_free(sp_first_);
+        return capacity_;
+#else
+        if (sp_first_ == nullptr)
+            return 0;
+        uintptr_t pageSize = (uintptr_t)::sysconf(_SC_PAGESIZE);
+        uintptr_t start = ((uintptr_t)sp_first_ + pageSize - 1) & ~(pageSize - 1);
+        uintptr_t end = (uintptr_t)sp_last_ & ~(pageSize - 1);
+        if (end <= start)
+            return capacity_;
+
+        // The partial pages at both ends are counted as resident.
+        size_type resident = (size_type)((start - (uintptr_t)sp_first_) +
+                                         ((uintptr_t)sp_last_ - end));
+#if defined(__APPLE__)
+        char pages[256];
+#else
+        unsigned char pages[256];
+#endif
+        const uintptr_t chunkSize = pageSize * sizeof(pages);
+        for (uintptr_t addr = start; addr < end; addr += chunkSize) {
+            uintptr_t size = ((end - addr) < chunkSize) ? (end - addr) : chunkSize;
+            if (::mincore((void *)addr, (size_t)size, pages) != 0)
+                return capacity_;
+            size_t count = (size_t)(size / pageSize);
+            for (size_t i = 0; i < count; ++i) {
+                if (pages[i] & 1)
+                    resident += (size_type)pageSize;
+            }
         }
-        sp_first_ = (unsigned char *)_aligned_malloc(capacity, 64);
+        return resident;
+#endif // _WIN32
+    }
+
+    //
+    // Give the pages beyond keepSize bytes from the bottom of the stack
+    // back to the OS, they're zero-filled when they're touched again. The
+    // stack must be empty, or its used part must be in keepSize. Return the
+    // bytes that are given back.
+    //
+    size_type trim(size_type keepSize) {
+#if defined(_WIN32)
+        (void)keepSize;
+        return 0;
 #else
-        if (sp_first_) {
-            free(sp_first_);
+        if (sp_first_ == nullptr || keepSize >= capacity_)
+            return 0;
+        uintptr_t pageSize = (uintptr_t)::sysconf(_SC_PAGESIZE);
+        uintptr_t start, end;
+        if (isBackwardPtr()) {
+            start = ((uintptr_t)sp_first_ + pageSize - 1) & ~(pageSize - 1);
+            end = ((uintptr_t)sp_last_ - keepSize) & ~(pageSize - 1);
         }
-        int ret = posix_memalign((void **)&sp_first_, 64, capacity);
+        else {
+            start = ((uintptr_t)sp_first_ + keepSize + pageSize - 1) & ~(pageSize - 1);
+            end = (uintptr_t)sp_last_ & ~(pageSize - 1);
+        }
+        if (end <= start)
+            return 0;
+        if (::madvise((void *)start, (size_t)(end - start), MADV_DONTNEED) != 0)
+            return 0;
+        return (size_type)(end - start);
 #endif // _WIN32
+    }
 
-#ifndef NDEBUG
-        memset((void *)sp_first_, 0, sizeof(char) * capacity);
-#endif
-        sp_last_ = sp_first_ + capacity;
+    //
+    // Move the stack pointer, sp must be in the stack buffer.
+    //
+    void setCurrent(unsigned char * sp) {
+        assert(sp >= sp_first_ && sp <= sp_last_);
+        sp_ = sp;
+    }
+
+    //
+    // Drop everything on the stack.
+    //
+    void reset() {
         if (isBackwardPtr())
             sp_ = sp_last_ - sizeof(basic_type);
         else
             sp_ = sp_first_;
-        capacity_ = capacity;
     }
 
     inline void destroy() {
         sp_ = nullptr;
-        if (sp_first_) {
-#if defined(_WIN32)
-            _aligned_free(sp_first_);
-#else
-            free(sp_first_);
-#endif
-            sp_first_ = nullptr;
-        }
+        release();
         sp_last_ = nullptr;
         frame_ = nullptr;
         capacity_ = 0;
+        maxCapacity_ = 0;
     }
 
     void back() {
@@ -2966,9 +3301,62 @@ public:
     typedef BasicType   basic_type;
     typedef size_t      size_type;
 
+private:
+    unsigned char * first_;
+    unsigned char * last_;
+    size_type       capacity_;
+
 public:
-    vmHeap() {}
-    ~vmHeap() {}
+    vmHeap() : first_(nullptr), last_(nullptr), capacity_(0) {}
+    ~vmHeap() {
+        destroy();
+    }
+
+    bool isInited() const { return (first_ != nullptr); }
+
+    unsigned char * first() const { return first_; }
+    unsigned char * last() const { return last_; }
+    size_type capacity() const { return capacity_; }
+
+    inline void create(size_type capacity) {
+        destroy();
+        if (capacity == 0)
+            return;
+#if defined(_WIN32)
+        first_ = (unsigned char *)_aligned_malloc(capacity, 64);
+#else
+        if (posix_memalign((void **)&first_, 64, capacity) != 0)
+            first_ = nullptr;
+#endif // _WIN32
+        if (first_ == nullptr)
+            return;
+        memset((void *)first_, 0, sizeof(char) * capacity);
+        last_ = first_ + capacity;
+        capacity_ = capacity;
+    }
+
+    inline void destroy() {
+        if (first_) {
+#if defined(_WIN32)
+            _aligned_free(first_);
+#else
+            free(first_);
+#endif
+            first_ = nullptr;
+        }
+        last_ = nullptr;
+        capacity_ = 0;
+    }
+
+    //
+    // Is the range [address, address + len) in the heap buffer ?
+    //
+    bool contains(const void * address, size_type len) const {
+        const unsigned char * p = (const unsigned char *)address;
+        if (first_ == nullptr || p < first_ || p > last_)
+            return false;
+        return (len <= (size_type)(last_ - p));
+    }
 };
 
 template <typename BasicType = uintptr_t>
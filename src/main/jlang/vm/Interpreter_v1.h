@@ -7,6 +7,13 @@
 #endif
 
 #include "jlang/vm/Interpreter.h"
+#include "jlang/vm/Quickener.h"
+#include "jlang/vm/LazyFlags.h"
+#include "jlang/vm/VectorOps.h"
+#include "jlang/vm/MemOps.h"
+#include "jlang/vm/NativeCall.h"
+#include "jlang/vm/Safepoint.h"
+#include "jlang/vm/StackGuard.h"
 #include "jlang/lang/Error.h"
 #include "jlang/system/Console.h"
 
@@ -23,6 +30,7 @@
 #include <list>
 #include <memory>
 #include <atomic>
+#include <type_traits>
 
 using namespace std;
 
@@ -361,10 +369,23 @@ private:
     vmHeap<basic_type>      heap_;
     engine_type *           engine_;
 
+    void *                  imageStart_;
+    size_t                  imageSize_;
+    void *                  imageEntry_;
+    vmBinImage              quickImage_;
+    bool                    quickening_;
+    vmLazyFlags             flags_;
+    vmVectorRegs            vregs_;
+    const vmNativeTable *   natives_;
+    vmSafepoint             safepoint_;
+
     static std::atomic<vmThreadId> thread_id_cnt;
 
 public:
-    vmThreadBase(engine_type * engine = nullptr) : id_(0), engine_(engine) {
+    vmThreadBase(engine_type * engine = nullptr)
+        : id_(0), engine_(engine),
+          imageStart_(nullptr), imageSize_(0), imageEntry_(nullptr),
+          quickening_(false), natives_(nullptr) {
         frame_.setStack(&stack_);
         stack_.setFrame(&frame_);
     }
@@ -374,11 +395,33 @@ public:
 
     bool isInited() const { return (id_ != 0); }
 
+    vmStack<basic_type> & getStack() { return stack_; }
+    vmHeap<basic_type> & getHeap() { return heap_; }
+
     engine_type * getEngine() { return engine_; }
     void setEngine(engine_type * engine) {
         engine_ = engine;
     }
 
+    const vmNativeTable * getNativeTable() const { return natives_; }
+    void setNativeTable(const vmNativeTable * natives) {
+        natives_ = natives;
+    }
+
+    //
+    // The fuel metering and the interrupts, see vmSafepoint. The other host
+    // threads may only call requestPause() and requestAbort().
+    //
+    vmSafepoint & getSafepoint() { return safepoint_; }
+
+    void requestPause() {
+        safepoint_.requestPause();
+    }
+
+    void requestAbort() {
+        safepoint_.requestAbort();
+    }
+
     vmThreadId getId() { return id_; }
     void setId(vmThreadId id) {
         id_ = id;
@@ -400,8 +443,162 @@ public:
 #endif
     }
 
+    JM_FORCEINLINE uint32_t getQuickValue(uint32_t regIndex, uint32_t) {
+        return frame_.getRegValue32(regIndex);
+    }
+
+    JM_FORCEINLINE uint32_t getQuickImm(uint32_t) {
+        uint32_t value = frame_.getUInt32();
+        frame_.nextUInt32();
+        return value;
+    }
+
+#if defined(WIN64) || defined(_WIN64) || defined(_M_X64) || defined(_M_AMD64) \
+ || defined(__amd64__) || defined(__x86_64__) || defined(__aarch64__)
+    JM_FORCEINLINE uint64_t getQuickValue(uint32_t regIndex, uint64_t) {
+        return frame_.getRegValue64(regIndex);
+    }
+
+    JM_FORCEINLINE uint64_t getQuickImm(uint64_t) {
+        uint64_t value = frame_.getUInt64();
+        frame_.nextUInt64();
+        return value;
+    }
+#endif
+
+    //
+    // The typed compare of the quickened image, the operand types and the
+    // registers are verified when it's quickened, see Quickener.
+    //
+    //   [cmp_*_cond][condJmp][dataType][reg][reg or imm]
+    //
+    template <typename T, int CondType, bool IsImm>
+    JM_FORCEINLINE bool quick_cmp() {
+        typedef typename std::make_unsigned<T>::type U;
+        frame_.next(3);
+        T value1 = (T)getQuickValue(vmReg::getIndex((reg_t)frame_.get()), U());
+        frame_.next();
+        T value2;
+        if (IsImm) {
+            value2 = (T)getQuickImm(U());
+        }
+        else {
+            value2 = (T)getQuickValue(vmReg::getIndex((reg_t)frame_.get()), U());
+            frame_.next();
+        }
+        flags_.setCompare<T>(value1, value2);
+        return op_cmp<T, CondType>(value1, value2);
+    }
+
+    //
+    // Save the operands of the generic cmp in the flags, the 8-bit and
+    // 16-bit operands are promoted to 32-bit.
+    //
+    void setCmpFlags(uint32_t dataType, uint64_t value1, uint64_t value2) {
+        switch (dataType) {
+        case vmDataType::Int8:
+            flags_.setCompare<int32_t>((int8_t)value1, (int8_t)value2);
+            break;
+        case vmDataType::UInt8:
+            flags_.setCompare<uint32_t>((uint8_t)value1, (uint8_t)value2);
+            break;
+        case vmDataType::Int16:
+            flags_.setCompare<int32_t>((int16_t)value1, (int16_t)value2);
+            break;
+        case vmDataType::UInt16:
+            flags_.setCompare<uint32_t>((uint16_t)value1, (uint16_t)value2);
+            break;
+        case vmDataType::Int32:
+            flags_.setCompare<int32_t>((int32_t)value1, (int32_t)value2);
+            break;
+        case vmDataType::UInt32:
+            flags_.setCompare<uint32_t>((uint32_t)value1, (uint32_t)value2);
+            break;
+        case vmDataType::Int64:
+            flags_.setCompare<int64_t>((int64_t)value1, (int64_t)value2);
+            break;
+        case vmDataType::UInt64:
+            flags_.setCompare<uint64_t>(value1, value2);
+            break;
+        case vmDataType::Pointer:
+            flags_.setCompare<uint64_t>((uintptr_t)value1, (uintptr_t)value2);
+            break;
+        default:
+            assert(false);
+            flags_.clear();
+            break;
+        }
+    }
+
+    //
+    // Save the result of inc, dec, add or sub in the flags, the result is
+    // in the width of the register.
+    //
+    void setResultFlags(reg_t reg, uint64_t value) {
+        switch (vmReg::getType(reg)) {
+        case vmRegType::r8:
+        case vmRegType::r8_high:
+            flags_.setResult<uint8_t>((uint8_t)value);
+            break;
+        case vmRegType::r16:
+            flags_.setResult<uint16_t>((uint16_t)value);
+            break;
+        case vmRegType::r32:
+            flags_.setResult<uint32_t>((uint32_t)value);
+            break;
+        default:
+            flags_.setResult<uint64_t>(value);
+            break;
+        }
+    }
+
+    //
+    // The vector operands must be the vector registers of the same width.
+    //
+    static bool verifyVectorRegs(reg_t reg1, reg_t reg2, reg_t reg3, reg_t reg4) {
+        if (!vmVectorRegs::isVectorReg(reg1) || !vmVectorRegs::isVectorReg(reg2) ||
+            !vmVectorRegs::isVectorReg(reg3) || !vmVectorRegs::isVectorReg(reg4))
+            return false;
+        size_t bytes = vmVectorRegs::getBytes(reg1);
+        return (vmVectorRegs::getBytes(reg2) == bytes &&
+                vmVectorRegs::getBytes(reg3) == bytes &&
+                vmVectorRegs::getBytes(reg4) == bytes);
+    }
+
+    //
+    // The range of a bulk memory instruction or a vector load/store must be
+    // in the stack or in the heap of the thread, it's verified once for the
+    // whole range, not once per byte.
+    //
+    bool verifyMemRange(const void * address, size_t len) const {
+        return (stack_.contains(address, len) || heap_.contains(address, len));
+    }
+
+    //
+    // Write the result of vreduce, mem_cmp or mem_chr to the 32-bit or
+    // 64-bit register.
+    //
+    bool setScalarReg(reg_t reg, uint64_t value) {
+        switch (vmReg::getType(reg)) {
+        case vmRegType::r32:
+            frame_.setRegValue32(vmReg::getIndex(reg), (uint32_t)value);
+            return true;
+#if defined(WIN64) || defined(_WIN64) || defined(_M_X64) || defined(_M_AMD64) \
+ || defined(__amd64__) || defined(__x86_64__) || defined(__aarch64__)
+        case vmRegType::r64:
+            frame_.setRegValue64(vmReg::getIndex(reg), value);
+            return true;
+#endif
+        default:
+            return false;
+        }
+    }
+
     void setImageInfo(void * imageStart, size_t imageSize,
                       void * imageEntry) {
+        imageStart_ = imageStart;
+        imageSize_ = imageSize;
+        imageEntry_ = imageEntry;
         frame_.setting(imageStart, imageSize, imageEntry);
     }
 
@@ -410,23 +607,139 @@ public:
         return this_type::thread_id_cnt.load();
     }
 
-    vmThreadId create(bool isMainThread, size_type stackSize) {
+    vmThreadId create(bool isMainThread, size_type stackSize, size_type heapSize = 0) {
         vmThreadId id = increaseThreadId();
         stack_.create(stackSize);
+        heap_.create(heapSize);
         id_ = id;
         return id;
     }
 
     void destroy() {
         stack_.destroy();
+        heap_.destroy();
         id_ = 0;
     }
 
+#define V1_QUICK_CMP_CASE(kind, type, cond) \
+                case QuickOpCode::kind##_##cond: \
+                    condition = quick_cmp<type, vmCondType::cond, false>(); \
+                    break;
+
+#define V1_QUICK_CMP_IMM_CASE(kind, type, cond) \
+                case QuickOpCode::kind##_##cond: \
+                    condition = quick_cmp<type, vmCondType::cond, true>(); \
+                    break;
+
+#if USE_VM_SAFEPOINTS
+#define V1_SAFEPOINT(cost) \
+                    if (unlikely(safepoint_.charge(cost))) { \
+                        ec = stopAtSafepoint(); \
+                        if (ec != Error::Ok) \
+                            goto Execute_Finished; \
+                    }
+#else
+#define V1_SAFEPOINT(cost)
+#endif // USE_VM_SAFEPOINTS
+
+// A backward branch costs the bytes of code it jumps back over.
+#define V1_BACKWARD_SAFEPOINT(jmp_fp) \
+                    if (frame_.getFP() <= (jmp_fp)) { \
+                        V1_SAFEPOINT((int32_t)((jmp_fp) - frame_.getFP()) + 1); \
+                    }
+
+    //
+    // Handle the interrupt at a safepoint, return Error::Ok to go on. The
+    // paused context and the context that's out of fuel can be resumed.
+    //
+    int stopAtSafepoint() {
+        switch (safepoint_.poll()) {
+        case vmInterrupt::Pause:
+            safepoint_.setSuspended(true);
+            return Error::Safepoint_Paused;
+        case vmInterrupt::OutOfFuel:
+            safepoint_.setSuspended(true);
+            return Error::Safepoint_Out_Of_Fuel;
+        case vmInterrupt::Yield:
+            safepoint_.setSuspended(true);
+            return Error::Safepoint_Yielded;
+        case vmInterrupt::Abort:
+            stack_.reset();
+            frame_.setting(imageStart_, imageSize_, imageEntry_);
+            return Error::Safepoint_Aborted;
+        default:
+            return Error::Ok;
+        }
+    }
+
+    //
+    // The suspended context is dropped when it's run again from the entry.
+    //
+    void discardSuspended() {
+        if (!safepoint_.isSuspended())
+            return;
+        safepoint_.setSuspended(false);
+        stack_.reset();
+        quickening_ = false;
+        frame_.setting(imageStart_, imageSize_, imageEntry_);
+    }
+
+    //
+    // Run from the entry, the top-level ret of the last run leaves the
+    // frame at the end.
+    //
     int run(return_type & retValue) {
+        discardSuspended();
+        frame_.setting(imageStart_, imageSize_, imageEntry_);
+        return execute_guarded(retValue, false);
+    }
+
+    //
+    // Continue the context that's stopped at a safepoint.
+    //
+    int resumeRun(return_type & retValue) {
+        assert(isInited());
+        if (!safepoint_.isSuspended())
+            return Error::Safepoint_Not_Suspended;
+        safepoint_.setSuspended(false);
+        int ec = execute_guarded(retValue, true);
+        if (quickening_ && !safepoint_.isSuspended()) {
+            quickening_ = false;
+            frame_.setting(imageStart_, imageSize_, imageEntry_);
+        }
+        return ec;
+    }
+
+    //
+    // Run the loop, a hit on the guard regions of the stack returns
+    // Error::StackGuard_Overflow, the frames of the stopped run are
+    // dropped then.
+    //
+    int execute_guarded(return_type & retValue, bool isResume) {
+#if USE_VM_STACK_GUARD
+        vmStackGuard::Scope scope;
+        scope.add(stack_);
+        if (sigsetjmp(scope.jumpBuffer(), 0) != 0) {
+            stack_.reset();
+            quickening_ = false;
+            frame_.setting(imageStart_, imageSize_, imageEntry_);
+            return Error::StackGuard_Overflow;
+        }
+#endif
+        return execute(retValue, isResume);
+    }
+
+    int execute(return_type & retValue, bool isResume) {
         assert(isInited());
+        int ec = Error::Ok;
         if (frame_.isInited() && stack_.isInited()) {
-            // Call program entry.
-            stack_.push_callstack(nullptr);
+            if (!isResume) {
+                // Call program entry.
+                stack_.push_callstack(nullptr);
+                flags_.clear();
+            }
+            // The result of the last quickened cmp, test by the jcc_* forms.
+            bool condition = false;
             // Main loop
             while (!frame_.isEof()) {
                 uint32_t offset = frame_.getFPOffset();
@@ -439,6 +752,8 @@ public:
 
                 case OpCode::push:
                     {
+                        if (quickening_ && Quickener::quicken(frame_.getFP()))
+                            break;
                         frame_.next();
                         unsigned char type = frame_.get();
                         frame_.next();
@@ -533,6 +848,8 @@ public:
 
                 case OpCode::pop:
                     {
+                        if (quickening_ && Quickener::quicken(frame_.getFP()))
+                            break;
                         frame_.next();
                         unsigned char type = frame_.get();
                         frame_.next();
@@ -584,6 +901,8 @@ public:
 
                 case OpCode::load:
                     {
+                        if (quickening_ && Quickener::quicken(frame_.getFP()))
+                            break;
                         frame_.next();
                         reg_t reg = (reg_t)frame_.get();
                         frame_.next();
@@ -603,6 +922,8 @@ public:
 
                 case OpCode::move:
                     {
+                        if (quickening_ && Quickener::quicken(frame_.getFP()))
+                            break;
                         frame_.next();
                         reg_t reg1 = (reg_t)frame_.get();
                         frame_.next();
@@ -631,6 +952,8 @@ public:
 
                 case OpCode::cmp:
                     {
+                        if (quickening_ && Quickener::quicken(frame_.getFP()))
+                            break;
                         frame_.next();
                         unsigned char cmpType = frame_.get();
                         if (cmpType == vmComboType::Reg_Reg) {
@@ -649,28 +972,9 @@ public:
                             Console::trace("%08X:  cmp  [reg], [reg] (%u - %u)",
                                           offset, reg1, reg2);
 
-                            // Condition jump code: jz, jnz, je, jne, jg, jge, jl, jle.
-                            unsigned char condJmp = frame_.get();
-                            assert(condJmp >= OpCode::cond_jmp_first &&
-                                   condJmp <= OpCode::cond_jmp_last);
-
-                            bool condition = frame_.condCmp_rr(reg1, reg2, dataType, condJmp);
-                            if (!condition) {
-                                Console::trace("%08X:  jmp  condition [false, opcode = %u]",
-                                              frame_.getFPOffset(), (uint32_t)condJmp);
-                                frame_.next();
-                                unsigned char jumpType = frame_.get();
-                                frame_.next();
-
-                                SKIP_JMP_TYPE(offset, frame_, jumpType);
-                            }
-                            else {
-                                Console::trace("%08X:  jmp  condition [true, opcode = %u]",
-                                              frame_.getFPOffset(), (uint32_t)condJmp);
-                                opcode = condJmp;
-                                offset = frame_.getFPOffset();
-                                goto JMP_START;
-                            }
+                            // The condition jumps evaluate the flags.
+                            setCmpFlags(dataType, (uint64_t)frame_.getRegValue(reg1),
+                                        (uint64_t)frame_.getRegValue(reg2));
                         }
                         else if (cmpType == vmComboType::Reg_Imm) {
                             frame_.next();
@@ -698,28 +1002,9 @@ public:
                             Console::trace("%08X:  cmp  [reg], [imm] (%u - 0x%08X)",
                                           offset, reg, value.uval);
 #endif
-                            // Condition jump code: jz, jnz, je, jne, jg, jge, jl, jle.
-                            unsigned char condJmp = frame_.get();
-                            assert(condJmp >= OpCode::cond_jmp_first &&
-                                   condJmp <= OpCode::cond_jmp_last);
-
-                            bool condition = frame_.condCmp_ri(reg, value.uval, dataType, condJmp);
-                            if (!condition) {
-                                Console::trace("%08X:  jmp  condition [false, opcode = %u]",
-                                              frame_.getFPOffset(), (uint32_t)condJmp);
-                                frame_.next();
-                                unsigned char jumpType = frame_.get();
-                                frame_.next();
-
-                                SKIP_JMP_TYPE(offset, frame_, jumpType);
-                            }
-                            else {
-                                Console::trace("%08X:  jmp  condition [true, opcode = %u]",
-                                              frame_.getFPOffset(), (uint32_t)condJmp);
-                                opcode = condJmp;
-                                offset = frame_.getFPOffset();
-                                goto JMP_START;
-                            }
+                            // The condition jumps evaluate the flags.
+                            setCmpFlags(dataType, (uint64_t)frame_.getRegValue(reg),
+                                        (uint64_t)value.uval);
                         }
                         else {
                             frame_.next();
@@ -727,7 +1012,35 @@ public:
                         break;
                     }
 
+                case OpCode::jz:
+                case OpCode::jnz:
+                case OpCode::je:
+                case OpCode::jne:
+                case OpCode::jl:
+                case OpCode::jle:
+                case OpCode::jg:
+                case OpCode::jge:
+                case OpCode::js:
+                case OpCode::jns:
+                    {
+                        if (flags_.test(opcode)) {
+                            Console::trace("%08X:  jmp  condition [true, opcode = %u]",
+                                          offset, (uint32_t)opcode);
+                            goto JMP_START;
+                        }
+                        Console::trace("%08X:  jmp  condition [false, opcode = %u]",
+                                      offset, (uint32_t)opcode);
+                        frame_.next();
+                        unsigned char jumpType = frame_.get();
+                        frame_.next();
+
+                        SKIP_JMP_TYPE(offset, frame_, jumpType);
+                        break;
+                    }
+
                 case OpCode::jmp:
+                    if (quickening_ && Quickener::quicken(frame_.getFP()))
+                        break;
 JMP_START:
                     {
                         unsigned char * jmp_fp = frame_.getFP();
@@ -793,11 +1106,14 @@ JMP_START:
                             }
                         }
                         Console::trace("\n");
+                        V1_BACKWARD_SAFEPOINT(jmp_fp);
                         break;
                     }
 
                 case OpCode::call:
                     {
+                        if (quickening_ && Quickener::quicken(frame_.getFP()))
+                            break;
                         unsigned char * call_fp = frame_.getFP();
                         frame_.next();
                         unsigned char callType = frame_.get();
@@ -852,6 +1168,7 @@ JMP_START:
                             }
                         }
                         Console::trace("\n");
+                        V1_SAFEPOINT(vmSafepoint::kCallCost);
                         break;
                     }
 
@@ -873,10 +1190,13 @@ JMP_START:
 
                 case OpCode::inc:
                     {
+                        if (quickening_ && Quickener::quicken(frame_.getFP()))
+                            break;
                         frame_.next();
                         reg_t reg = (reg_t)frame_.get();
                         frame_.next();
                         uintptr_t value = frame_.incRegValue(reg);
+                        setResultFlags(reg, (uint64_t)value);
                         if (vmReg::getType(reg) >= vmRegType::r64) {
                             Console::trace("%08X:  inc  [reg] - (%u, %u), value = 0x%016X",
                                           offset, vmReg::getType(reg), vmReg::getIndex(reg),
@@ -892,10 +1212,13 @@ JMP_START:
 
                 case OpCode::dec:
                     {
+                        if (quickening_ && Quickener::quicken(frame_.getFP()))
+                            break;
                         frame_.next();
                         reg_t reg = (reg_t)frame_.get();
                         frame_.next();
                         uintptr_t value = frame_.decRegValue(reg);
+                        setResultFlags(reg, (uint64_t)value);
                         if (vmReg::getType(reg) >= vmRegType::r64) {
                             Console::trace("%08X:  dec  [reg] - (%u, %u), value = 0x%016X",
                                           offset, vmReg::getType(reg), vmReg::getIndex(reg),
@@ -911,6 +1234,8 @@ JMP_START:
 
                 case OpCode::add:
                     {
+                        if (quickening_ && Quickener::quicken(frame_.getFP()))
+                            break;
                         frame_.next();
                         unsigned char addType = frame_.get();
                         if (addType == vmComboType::Reg_Reg) {
@@ -920,6 +1245,7 @@ JMP_START:
                             reg_t reg2 = (reg_t)frame_.get();
                             frame_.next();
                             uintptr_t value = frame_.addRegValue(reg1, reg2);
+                            setResultFlags(reg1, (uint64_t)value);
                             if (vmReg::getType(reg1) >= vmRegType::r64) {
                                 Console::trace("%08X:  add  [reg, reg] - (%u, %u), value = 0x%016X",
                                               offset, vmReg::getIndex(reg1), vmReg::getIndex(reg2),
@@ -941,6 +1267,7 @@ JMP_START:
                             frame_.nextValueByReg(vmReg::getType(reg));
 
                             uintptr_t newValue = frame_.addRegValue_ri(reg, value.uval);
+                            setResultFlags(reg, (uint64_t)newValue);
                             if (vmReg::getType(reg) >= vmRegType::r64) {
                                 Console::trace("%08X:  add  [reg, imm] - (%u), value = 0x%016X",
                                               offset, vmReg::getIndex(reg),
@@ -960,6 +1287,8 @@ JMP_START:
 
                 case OpCode::sub:
                     {
+                        if (quickening_ && Quickener::quicken(frame_.getFP()))
+                            break;
                         frame_.next();
                         unsigned char subType = frame_.get();
                         if (subType == vmComboType::Reg_Reg) {
@@ -969,6 +1298,7 @@ JMP_START:
                             reg_t reg2 = (reg_t)frame_.get();
                             frame_.next();
                             uintptr_t value = frame_.subRegValue(reg1, reg2);
+                            setResultFlags(reg1, (uint64_t)value);
                             if (vmReg::getType(reg1) >= vmRegType::r64) {
                                 Console::trace("%08X:  sub  [reg, reg] - (%u, %u), value = 0x%016X",
                                               offset, vmReg::getIndex(reg1), vmReg::getIndex(reg2),
@@ -990,6 +1320,7 @@ JMP_START:
                             frame_.nextValueByReg(vmReg::getType(reg));
 
                             uintptr_t newValue = frame_.subRegValue_ri(reg, value.uval);
+                            setResultFlags(reg, (uint64_t)newValue);
                             if (vmReg::getType(reg) >= vmRegType::r64) {
                                 Console::trace("%08X:  sub  [reg, imm] - (%u), value = 0x%016X",
                                               offset, vmReg::getIndex(reg),
@@ -1038,11 +1369,531 @@ JMP_START:
                         break;
                     }
 
+                //
+                // The quickened forms, see Quickener. The operand types and
+                // registers are verified when they are quickened.
+                //
+                case OpCode::push_i32:
+                    {
+                        frame_.next(2);
+                        stack_.push_uint32(frame_.getUInt32());
+                        frame_.nextUInt32();
+                        break;
+                    }
+
+                case OpCode::push_i64:
+                    {
+                        frame_.next(2);
+                        stack_.push_uint64(frame_.getUInt64());
+                        frame_.nextUInt64();
+                        break;
+                    }
+
+                case OpCode::pop_i32:
+                    {
+                        frame_.next(2);
+                        uint32_t value;
+                        stack_.pop_uint32(value);
+                        break;
+                    }
+
+                case OpCode::pop_i64:
+                    {
+                        frame_.next(2);
+                        uint64_t value;
+                        stack_.pop_uint64(value);
+                        break;
+                    }
+
+                case QuickOpCode::push_r32:
+                    {
+                        frame_.next(2);
+                        uint32_t regIndex = vmReg::getIndex((reg_t)frame_.get());
+                        stack_.push_uint32(frame_.getRegValue32(regIndex));
+                        frame_.next();
+                        break;
+                    }
+
+                case QuickOpCode::pop_r32:
+                    {
+                        frame_.next(2);
+                        uint32_t regIndex = vmReg::getIndex((reg_t)frame_.get());
+                        uint32_t value;
+                        stack_.pop_uint32(value);
+                        frame_.setRegValue32(regIndex, value);
+                        frame_.next();
+                        break;
+                    }
+
+                case QuickOpCode::load_r32:
+                    {
+                        frame_.next();
+                        uint32_t regIndex = vmReg::getIndex((reg_t)frame_.get());
+                        frame_.next();
+                        frame_.loadRegValue32(regIndex);
+                        break;
+                    }
+
+                case QuickOpCode::move_r32:
+                    {
+                        frame_.next();
+                        uint32_t regIndex1 = vmReg::getIndex((reg_t)frame_.get());
+                        frame_.next();
+                        uint32_t regIndex2 = vmReg::getIndex((reg_t)frame_.get());
+                        frame_.next();
+                        frame_.moveRegValue32(regIndex1, regIndex2);
+                        break;
+                    }
+
+                case QuickOpCode::inc_r32:
+                    {
+                        frame_.next();
+                        uint32_t regIndex = vmReg::getIndex((reg_t)frame_.get());
+                        frame_.next();
+                        flags_.setResult<uint32_t>(frame_.incRegValue32(regIndex));
+                        break;
+                    }
+
+                case QuickOpCode::dec_r32:
+                    {
+                        frame_.next();
+                        uint32_t regIndex = vmReg::getIndex((reg_t)frame_.get());
+                        frame_.next();
+                        flags_.setResult<uint32_t>(frame_.decRegValue32(regIndex));
+                        break;
+                    }
+
+                case QuickOpCode::add_r32:
+                    {
+                        frame_.next(2);
+                        uint32_t regIndex1 = vmReg::getIndex((reg_t)frame_.get());
+                        frame_.next();
+                        uint32_t regIndex2 = vmReg::getIndex((reg_t)frame_.get());
+                        frame_.next();
+                        flags_.setResult<uint32_t>(frame_.addRegValue32(regIndex1, regIndex2));
+                        break;
+                    }
+
+                case QuickOpCode::sub_r32:
+                    {
+                        frame_.next(2);
+                        uint32_t regIndex1 = vmReg::getIndex((reg_t)frame_.get());
+                        frame_.next();
+                        uint32_t regIndex2 = vmReg::getIndex((reg_t)frame_.get());
+                        frame_.next();
+                        flags_.setResult<uint32_t>(frame_.subRegValue32(regIndex1, regIndex2));
+                        break;
+                    }
+
+                // The typed compares, no data type or condition switch.
+                VM_FOR_EACH_COND(V1_QUICK_CMP_CASE,     cmp_i32,     int32_t)
+                VM_FOR_EACH_COND(V1_QUICK_CMP_CASE,     cmp_u32,     uint32_t)
+                VM_FOR_EACH_COND(V1_QUICK_CMP_IMM_CASE, cmp_imm_i32, int32_t)
+                VM_FOR_EACH_COND(V1_QUICK_CMP_IMM_CASE, cmp_imm_u32, uint32_t)
+
+#if defined(WIN64) || defined(_WIN64) || defined(_M_X64) || defined(_M_AMD64) \
+ || defined(__amd64__) || defined(__x86_64__) || defined(__aarch64__)
+                VM_FOR_EACH_COND(V1_QUICK_CMP_CASE,     cmp_i64,     int64_t)
+                VM_FOR_EACH_COND(V1_QUICK_CMP_CASE,     cmp_u64,     uint64_t)
+                VM_FOR_EACH_COND(V1_QUICK_CMP_IMM_CASE, cmp_imm_i64, int64_t)
+                VM_FOR_EACH_COND(V1_QUICK_CMP_IMM_CASE, cmp_imm_u64, uint64_t)
+#endif
+
+                case QuickOpCode::jcc_near:
+                    {
+                        unsigned char * jmp_fp = frame_.getFP();
+                        frame_.next(2);
+                        if (condition) {
+                            frame_.jumpNear(jmp_fp, frame_.getInt8());
+                            V1_BACKWARD_SAFEPOINT(jmp_fp);
+                        }
+                        else {
+                            frame_.nextInt8();
+                        }
+                        break;
+                    }
+
+                case QuickOpCode::jcc_short:
+                    {
+                        unsigned char * jmp_fp = frame_.getFP();
+                        frame_.next(2);
+                        if (condition) {
+                            frame_.jumpShort(jmp_fp, frame_.getInt16());
+                            V1_BACKWARD_SAFEPOINT(jmp_fp);
+                        }
+                        else {
+                            frame_.nextInt16();
+                        }
+                        break;
+                    }
+
+                case QuickOpCode::jcc_long:
+                    {
+                        unsigned char * jmp_fp = frame_.getFP();
+                        frame_.next(2);
+                        if (condition) {
+                            frame_.jumpLong(jmp_fp, frame_.getInt32());
+                            V1_BACKWARD_SAFEPOINT(jmp_fp);
+                        }
+                        else {
+                            frame_.nextInt32();
+                        }
+                        break;
+                    }
+
+                case OpCode::jmp_near:
+                    {
+                        unsigned char * jmp_fp = frame_.getFP();
+                        frame_.next(2);
+                        frame_.jumpNear(jmp_fp, frame_.getInt8());
+                        V1_BACKWARD_SAFEPOINT(jmp_fp);
+                        break;
+                    }
+
+                case OpCode::jmp_short:
+                    {
+                        unsigned char * jmp_fp = frame_.getFP();
+                        frame_.next(2);
+                        frame_.jumpShort(jmp_fp, frame_.getInt16());
+                        V1_BACKWARD_SAFEPOINT(jmp_fp);
+                        break;
+                    }
+
+                case OpCode::jmp_long:
+                    {
+                        unsigned char * jmp_fp = frame_.getFP();
+                        frame_.next(2);
+                        frame_.jumpLong(jmp_fp, frame_.getInt32());
+                        V1_BACKWARD_SAFEPOINT(jmp_fp);
+                        break;
+                    }
+
+                case OpCode::call_short:
+                    {
+                        unsigned char * call_fp = frame_.getFP();
+                        frame_.next(2);
+                        frame_.callShort(call_fp, 2 + sizeof(int16_t), frame_.getInt16());
+                        V1_SAFEPOINT(vmSafepoint::kCallCost);
+                        break;
+                    }
+
+                case OpCode::call_long:
+                    {
+                        unsigned char * call_fp = frame_.getFP();
+                        frame_.next(2);
+                        frame_.callLong(call_fp, 2 + sizeof(int32_t), frame_.getInt32());
+                        V1_SAFEPOINT(vmSafepoint::kCallCost);
+                        break;
+                    }
+
                 case OpCode::nop:
                     frame_.next();
                     Console::trace("%08X:  nop", offset);
                     break;
 
+                //
+                // The vector instructions, the width is the width of the
+                // vector registers, see VectorOps.
+                //
+                case OpCode::vload:
+                    {
+                        // vload vreg, [reg]
+                        reg_t vreg = (reg_t)frame_.getFP()[1];
+                        reg_t reg = (reg_t)frame_.getFP()[2];
+                        frame_.next(3);
+                        if (!vmVectorRegs::isVectorReg(vreg)) {
+                            Console::trace("%08X:  vload\tError: Invalid vector register.\n", offset);
+                            break;
+                        }
+                        const void * address = (const void *)frame_.getRegValue(reg);
+                        if (!verifyMemRange(address, vmVectorRegs::getBytes(vreg))) {
+                            Console::trace("%08X:  vload\tError: Invalid memory range.\n", offset);
+                            break;
+                        }
+                        memcpy(vregs_.get(vreg), address, vmVectorRegs::getBytes(vreg));
+                        Console::trace("%08X:  vload  [vreg] - (%u, %u), address = %p",
+                                      offset, vmReg::getType(vreg), vmReg::getIndex(vreg), address);
+                        break;
+                    }
+
+                case OpCode::vstore:
+                    {
+                        // vstore [reg], vreg
+                        reg_t reg = (reg_t)frame_.getFP()[1];
+                        reg_t vreg = (reg_t)frame_.getFP()[2];
+                        frame_.next(3);
+                        if (!vmVectorRegs::isVectorReg(vreg)) {
+                            Console::trace("%08X:  vstore\tError: Invalid vector register.\n", offset);
+                            break;
+                        }
+                        void * address = (void *)frame_.getRegValue(reg);
+                        if (!verifyMemRange(address, vmVectorRegs::getBytes(vreg))) {
+                            Console::trace("%08X:  vstore\tError: Invalid memory range.\n", offset);
+                            break;
+                        }
+                        memcpy(address, vregs_.get(vreg), vmVectorRegs::getBytes(vreg));
+                        Console::trace("%08X:  vstore [vreg] - (%u, %u), address = %p",
+                                      offset, vmReg::getType(vreg), vmReg::getIndex(vreg), address);
+                        break;
+                    }
+
+                case OpCode::vsplat:
+                    {
+                        // vsplat laneType, vreg, reg
+                        unsigned char * ip = frame_.getFP();
+                        uint32_t laneType = ip[1];
+                        reg_t vreg = (reg_t)ip[2];
+                        reg_t reg = (reg_t)ip[3];
+                        frame_.next(4);
+                        if (!vmVectorRegs::isVectorReg(vreg) || laneType >= vmLaneType::Last) {
+                            Console::trace("%08X:  vsplat\tError: Invalid operands.\n", offset);
+                            break;
+                        }
+                        uint64_t value = (uint64_t)frame_.getRegValue(reg);
+                        vmVectorOps::splat(laneType, vregs_.get(vreg), value,
+                                           vmVectorRegs::getBytes(vreg));
+                        Console::trace("%08X:  vsplat [vreg] - (%u, %u), value = 0x%016llX",
+                                      offset, vmReg::getType(vreg), vmReg::getIndex(vreg),
+                                      (unsigned long long)value);
+                        break;
+                    }
+
+                case OpCode::valu:
+                case OpCode::vcmp:
+                    {
+                        // valu vecOp, laneType, vd, va, vb
+                        // vcmp vecCmp, laneType, vd, va, vb
+                        unsigned char * ip = frame_.getFP();
+                        uint32_t op = ip[1];
+                        uint32_t laneType = ip[2];
+                        reg_t vd = (reg_t)ip[3];
+                        reg_t va = (reg_t)ip[4];
+                        reg_t vb = (reg_t)ip[5];
+                        frame_.next(6);
+                        uint32_t opLast = (opcode == OpCode::valu) ? (uint32_t)vmVecOp::Last
+                                                                 : (uint32_t)vmVecCmp::Last;
+                        if (!verifyVectorRegs(vd, va, vb, vb) || op >= opLast ||
+                            laneType >= vmLaneType::Last) {
+                            Console::trace("%08X:  %s\tError: Invalid operands.\n", offset,
+                                          (opcode == OpCode::valu) ? "valu" : "vcmp");
+                            break;
+                        }
+                        size_t bytes = vmVectorRegs::getBytes(vd);
+                        if (opcode == OpCode::valu)
+                            vmVectorOps::alu(op, laneType, vregs_.get(vd), vregs_.get(va),
+                                             vregs_.get(vb), bytes);
+                        else
+                            vmVectorOps::cmp(op, laneType, vregs_.get(vd), vregs_.get(va),
+                                             vregs_.get(vb), bytes);
+                        Console::trace("%08X:  %s [vreg] - (%u, %u), op = %u, lane = %u",
+                                      offset, (opcode == OpCode::valu) ? "valu" : "vcmp",
+                                      vmReg::getType(vd), vmReg::getIndex(vd), op, laneType);
+                        break;
+                    }
+
+                case OpCode::vblend:
+                    {
+                        // vblend vd, vmask, va, vb
+                        unsigned char * ip = frame_.getFP();
+                        reg_t vd = (reg_t)ip[1];
+                        reg_t vm = (reg_t)ip[2];
+                        reg_t va = (reg_t)ip[3];
+                        reg_t vb = (reg_t)ip[4];
+                        frame_.next(5);
+                        if (!verifyVectorRegs(vd, vm, va, vb)) {
+                            Console::trace("%08X:  vblend\tError: Invalid operands.\n", offset);
+                            break;
+                        }
+                        vmVectorOps::blend(vregs_.get(vd), vregs_.get(vm), vregs_.get(va),
+                                           vregs_.get(vb), vmVectorRegs::getBytes(vd));
+                        Console::trace("%08X:  vblend [vreg] - (%u, %u)",
+                                      offset, vmReg::getType(vd), vmReg::getIndex(vd));
+                        break;
+                    }
+
+                case OpCode::vshuffle:
+                    {
+                        // vshuffle laneType, vd, va, vidx
+                        unsigned char * ip = frame_.getFP();
+                        uint32_t laneType = ip[1];
+                        reg_t vd = (reg_t)ip[2];
+                        reg_t va = (reg_t)ip[3];
+                        reg_t vidx = (reg_t)ip[4];
+                        frame_.next(5);
+                        if (!verifyVectorRegs(vd, va, vidx, vidx) || laneType >= vmLaneType::Last) {
+                            Console::trace("%08X:  vshuffle\tError: Invalid operands.\n", offset);
+                            break;
+                        }
+                        vmVectorOps::shuffle(laneType, vregs_.get(vd), vregs_.get(va),
+                                             vregs_.get(vidx), vmVectorRegs::getBytes(vd));
+                        Console::trace("%08X:  vshuffle [vreg] - (%u, %u)",
+                                      offset, vmReg::getType(vd), vmReg::getIndex(vd));
+                        break;
+                    }
+
+                case OpCode::vreduce:
+                    {
+                        // vreduce vecOp, laneType, reg, va
+                        unsigned char * ip = frame_.getFP();
+                        uint32_t op = ip[1];
+                        uint32_t laneType = ip[2];
+                        reg_t reg = (reg_t)ip[3];
+                        reg_t va = (reg_t)ip[4];
+                        frame_.next(5);
+                        if (!vmVectorRegs::isVectorReg(va) || op >= vmVecOp::Last ||
+                            laneType >= vmLaneType::Last) {
+                            Console::trace("%08X:  vreduce\tError: Invalid operands.\n", offset);
+                            break;
+                        }
+                        uint64_t value = vmVectorOps::reduce(op, laneType, vregs_.get(va),
+                                                             vmVectorRegs::getBytes(va));
+                        if (!setScalarReg(reg, value)) {
+                            Console::trace("%08X:  vreduce\tError: Invalid scalar register.\n", offset);
+                            break;
+                        }
+                        Console::trace("%08X:  vreduce [reg] - (%u, %u), value = 0x%016llX",
+                                      offset, vmReg::getType(reg), vmReg::getIndex(reg),
+                                      (unsigned long long)value);
+                        break;
+                    }
+
+                //
+                // The bulk memory instructions, the address and the length
+                // operands are registers, see MemOps.
+                //
+                case OpCode::mem_copy:
+                case OpCode::mem_set:
+                    {
+                        // mem_copy [reg_dest], [reg_src], reg_len
+                        // mem_set  [reg_dest], reg_value, reg_len
+                        unsigned char * ip = frame_.getFP();
+                        reg_t regDest = (reg_t)ip[1];
+                        reg_t regSrc = (reg_t)ip[2];
+                        reg_t regLen = (reg_t)ip[3];
+                        frame_.next(4);
+                        void * dest = (void *)frame_.getRegValue(regDest);
+                        size_t len = (size_t)frame_.getRegValue(regLen);
+                        if (!verifyMemRange(dest, len)) {
+                            Console::trace("%08X:  %s\tError: Invalid memory range.\n", offset,
+                                          (opcode == OpCode::mem_copy) ? "mem_copy" : "mem_set");
+                            break;
+                        }
+                        if (opcode == OpCode::mem_copy) {
+                            const void * src = (const void *)frame_.getRegValue(regSrc);
+                            if (!verifyMemRange(src, len)) {
+                                Console::trace("%08X:  mem_copy\tError: Invalid memory range.\n", offset);
+                                break;
+                            }
+                            vmMemOps::copy(dest, src, len);
+                            Console::trace("%08X:  mem_copy [reg] - %p, %p, len = %u",
+                                          offset, dest, src, (uint32_t)len);
+                        }
+                        else {
+                            uint8_t value = (uint8_t)frame_.getRegValue(regSrc);
+                            vmMemOps::set(dest, value, len);
+                            Console::trace("%08X:  mem_set  [reg] - %p, value = %u, len = %u",
+                                          offset, dest, (uint32_t)value, (uint32_t)len);
+                        }
+                        break;
+                    }
+
+                case OpCode::mem_cmp:
+                    {
+                        // mem_cmp reg_result, [reg_ptr1], [reg_ptr2], reg_len
+                        unsigned char * ip = frame_.getFP();
+                        reg_t regResult = (reg_t)ip[1];
+                        reg_t regPtr1 = (reg_t)ip[2];
+                        reg_t regPtr2 = (reg_t)ip[3];
+                        reg_t regLen = (reg_t)ip[4];
+                        frame_.next(5);
+                        const void * ptr1 = (const void *)frame_.getRegValue(regPtr1);
+                        const void * ptr2 = (const void *)frame_.getRegValue(regPtr2);
+                        size_t len = (size_t)frame_.getRegValue(regLen);
+                        if (!verifyMemRange(ptr1, len) || !verifyMemRange(ptr2, len)) {
+                            Console::trace("%08X:  mem_cmp\tError: Invalid memory range.\n", offset);
+                            break;
+                        }
+                        // The result is -1, 0 or 1, the flags are "cmp result, 0".
+                        int32_t result = vmMemOps::compare(ptr1, ptr2, len);
+                        if (!setScalarReg(regResult, (uint64_t)(int64_t)result)) {
+                            Console::trace("%08X:  mem_cmp\tError: Invalid result register.\n", offset);
+                            break;
+                        }
+                        flags_.setCompare<int32_t>(result, 0);
+                        Console::trace("%08X:  mem_cmp [reg] - %p, %p, len = %u, result = %d",
+                                      offset, ptr1, ptr2, (uint32_t)len, result);
+                        break;
+                    }
+
+                case OpCode::mem_chr:
+                    {
+                        // mem_chr reg_result, [reg_ptr], reg_value, reg_len
+                        unsigned char * ip = frame_.getFP();
+                        reg_t regResult = (reg_t)ip[1];
+                        reg_t regPtr = (reg_t)ip[2];
+                        reg_t regValue = (reg_t)ip[3];
+                        reg_t regLen = (reg_t)ip[4];
+                        frame_.next(5);
+                        const void * ptr = (const void *)frame_.getRegValue(regPtr);
+                        uint8_t value = (uint8_t)frame_.getRegValue(regValue);
+                        size_t len = (size_t)frame_.getRegValue(regLen);
+                        if (!verifyMemRange(ptr, len)) {
+                            Console::trace("%08X:  mem_chr\tError: Invalid memory range.\n", offset);
+                            break;
+                        }
+                        // The result is the offset of the byte, or len if it's not
+                        // found, the flags are "cmp result, len", jl is found.
+                        size_t found = vmMemOps::find(ptr, value, len);
+                        if (!setScalarReg(regResult, (uint64_t)found)) {
+                            Console::trace("%08X:  mem_chr\tError: Invalid result register.\n", offset);
+                            break;
+                        }
+                        flags_.setCompare<uint64_t>((uint64_t)found, (uint64_t)len);
+                        Console::trace("%08X:  mem_chr [reg] - %p, value = %u, len = %u, result = %u",
+                                      offset, ptr, (uint32_t)value, (uint32_t)len, (uint32_t)found);
+                        break;
+                    }
+
+                case OpCode::call_native:
+                    {
+                        // call_native index16, the arguments are r0 .. r5, the
+                        // result is rax, see vmNativeTable.
+                        frame_.next();
+                        uint32_t index = frame_.getUInt16();
+                        frame_.next(sizeof(uint16_t));
+                        const vmNativeEntry * native =
+                            (natives_ != nullptr) ? natives_->get(index) : nullptr;
+                        if (native == nullptr) {
+                            Console::trace("%08X:  call_native\t"
+                                          "Error: Unknown native function. index = %u\n",
+                                          offset, index);
+                            break;
+                        }
+                        uintptr_t result = vmNativeTable::call(*native,
+                                               frame_.getRegs(vmNativeTable::kFirstArgReg));
+#if defined(WIN64) || defined(_WIN64) || defined(_M_X64) || defined(_M_AMD64) \
+ || defined(__amd64__) || defined(__x86_64__) || defined(__aarch64__)
+                        frame_.setRegValue64(vmRegId::rax, (uint64_t)result);
+#else
+                        frame_.setRegValue32(vmRegId::eax, (uint32_t)result);
+#endif
+                        Console::trace("%08X:  call_native %u (%s), result = 0x%016llX",
+                                      offset, index, native->name.c_str(),
+                                      (unsigned long long)result);
+                        break;
+                    }
+
+                case OpCode::yield:
+                    {
+                        // Give up the rest of the time slice, the context is
+                        // resumed at the next instruction.
+                        frame_.next();
+                        Console::trace("%08X:  yield", offset);
+                        safepoint_.setSuspended(true);
+                        ec = Error::Safepoint_Yielded;
+                        goto Execute_Finished;
+                    }
+
                 case OpCode::exit:
                     frame_.next();
                     Console::trace("%08X:  end", offset);
@@ -1060,48 +1911,160 @@ Execute_Finished:
             (void)(0);
         }
 
-        return 0;
+        return ec;
+    }
+
+#undef V1_QUICK_CMP_CASE
+#undef V1_QUICK_CMP_IMM_CASE
+#undef V1_SAFEPOINT
+#undef V1_BACKWARD_SAFEPOINT
+
+    //
+    // Run on a private copy of the image, the generic instructions of the
+    // copy are quickened the first time they run, see Quickener. The image
+    // is shared by the contexts and never written.
+    //
+    // The copy is made on every run, because the input is patched into the
+    // image before the run.
+    //
+    int run_quickened(return_type & retValue) {
+        assert(isInited());
+        if (imageStart_ == nullptr || imageSize_ == 0)
+            return Error::Error_NullPtr;
+
+        // The call targets must be aligned for 16 bytes, the copy is
+        // aligned for 256 bytes as the image.
+        discardSuspended();
+        quickImage_.allocate(imageSize_);
+        if (quickImage_.data() == nullptr)
+            return Error::Error_NullPtr;
+        memcpy(quickImage_.data(), imageStart_, imageSize_);
+        quickImage_.setEntryOffset((size_t)((char *)imageEntry_ - (char *)imageStart_));
+
+        frame_.setting(quickImage_.data(), quickImage_.size(), quickImage_.entry());
+        quickening_ = true;
+        int ec = execute_guarded(retValue, false);
+        // The suspended context keeps running on the copy when it's resumed.
+        if (!safepoint_.isSuspended()) {
+            quickening_ = false;
+            frame_.setting(imageStart_, imageSize_, imageEntry_);
+        }
+        return ec;
     }
 };
 
 template <typename BasicType>
 std::atomic<vmThreadId> vmThreadBase<BasicType>::thread_id_cnt(0);
 
+template <typename BasicType>
+class vmScheduler;
+
+//
+// The state of a green thread on its vmScheduler.
+//
+// Resumed is a resume() that comes while the thread is running, the thread
+// runs again when it stops at the safepoint, instead of being suspended.
+//
+struct vmThreadStatus {
+    enum Type {
+        Created,
+        Ready,
+        Running,
+        Resumed,
+        Suspended,
+        Finished,
+        Last
+    };
+};
+
 template <typename BasicType = uintptr_t>
 class vmThread : public vmThreadBase<BasicType> {
 public:
     typedef BasicType                       basic_type;
     typedef vmThreadBase<basic_type>        base_type;
     typedef typename base_type::size_type   size_type;
+    typedef typename base_type::return_type return_type;
+    typedef vmScheduler<basic_type>         scheduler_type;
     typedef vmThread<basic_type>            this_type;
 
     static const size_type kDefaultStackSize = 2 * 1048576U;
 
+private:
+    scheduler_type *        scheduler_;
+    std::atomic<uint32_t>   status_;
+    bool                    quickened_;
+    int                     exitCode_;
+    return_type             retValue_;
+
 public:
-    vmThread() : vmThreadBase<basic_type>() {}
+    vmThread() : vmThreadBase<basic_type>(),
+        scheduler_(nullptr), status_(vmThreadStatus::Created),
+        quickened_(true), exitCode_(Error::Ok) {}
     virtual ~vmThread() {
     }
 
     bool isMainThread() const { return false; }
 
     vmThreadId create(size_type stackSize = kDefaultStackSize) {
-        return create(false, stackSize);
+        return base_type::create(false, stackSize);
     }
 
+    scheduler_type * getScheduler() const { return scheduler_; }
+    void setScheduler(scheduler_type * scheduler) {
+        scheduler_ = scheduler;
+    }
+
+    uint32_t getStatus() const { return status_.load(std::memory_order_acquire); }
+    void setStatus(uint32_t status) {
+        status_.store(status, std::memory_order_release);
+    }
+    bool changeStatus(uint32_t expected, uint32_t status) {
+        return status_.compare_exchange_strong(expected, status,
+                                               std::memory_order_acq_rel);
+    }
+
+    bool isFinished() const { return (getStatus() == vmThreadStatus::Finished); }
+
+    // Run on the quickened copy of the image, it's the default.
+    bool isQuickened() const { return quickened_; }
+    void setQuickened(bool quickened) {
+        quickened_ = quickened;
+    }
+
+    // The result of the run, valid when the thread is finished.
+    int getExitCode() const { return exitCode_; }
+    void setExitCode(int exitCode) {
+        exitCode_ = exitCode;
+    }
+
+    return_type & getReturn() { return retValue_; }
+
+    //
+    // Run the thread on its scheduler, see vmScheduler.
+    //
     void start() {
-        //startThread();
+        if (scheduler_ != nullptr)
+            scheduler_->spawn(this);
     }
 
+    //
+    // Abort the thread at its next safepoint.
+    //
     void stop() {
-        //stopThread();
+        this->requestAbort();
+        resume();
     }
 
+    //
+    // Pause the thread at its next safepoint.
+    //
     void suspend() {
-        //suspendThread();
+        this->requestPause();
     }
 
     void resume() {
-        //resumeThread();
+        if (scheduler_ != nullptr)
+            scheduler_->wake(this);
     }
 
     void terminate(uint32_t exitCode) {
@@ -1168,6 +2131,7 @@ public:
 private:
     vmBinaryFile binary_;
     context_type    context_;
+    vmNativeTable   natives_;
 
 public:
     ExecutionEngine() {}
@@ -1177,6 +2141,11 @@ public:
 
     bool isInited() const { return (context_.getId() != 0); }
 
+    //
+    // The host functions of call_native, register them before run().
+    //
+    vmNativeTable & getNativeTable() { return natives_; }
+
     int create() {
         int ec = binary_.loadFromFile("test.bin");
         if (ec <= 0) {
@@ -1201,6 +2170,7 @@ public:
     bool createContext() {
         if (!context_.isInited()) {
             context_.create();
+            context_.setNativeTable(&natives_);
         }
 
         return context_.isInited();
@@ -1217,6 +2187,21 @@ public:
         int ec = context_.run(ret);
         return ec;
     }
+
+    int run_quickened(return_type & ret) {
+        binary_.setInput(ret.getValue());
+        int ec = context_.run_quickened(ret);
+        return ec;
+    }
+
+    //
+    // Continue the run that's stopped at a safepoint, see vmSafepoint.
+    //
+    int resumeRun(return_type & ret) {
+        return context_.resumeRun(ret);
+    }
+
+    vmSafepoint & getSafepoint() { return context_.getSafepoint(); }
 };
 
 template <typename BasicType = uintptr_t>
@@ -1243,6 +2228,11 @@ public:
         int ec = engine_.run(ret);
         return ec;
     }
+
+    int run_quickened(return_type & ret) {
+        int ec = engine_.run_quickened(ret);
+        return ec;
+    }
 };
 
 } // namespace v1
@@ -6,25 +6,18 @@
 #pragma once
 #endif
 
-//////////////////////////////////////////////////////////////
-
-#ifndef JLANG_VM_ARGS_DEFINE_H
-
-/* If is forward stack pointer ? */
-#ifndef USE_FORWARD_STACK_PTR
-#define USE_FORWARD_STACK_PTR   1
-#endif
-
-#ifndef FRAME_STACK_SIZEOF
-#define FRAME_STACK_SIZEOF      ((sizeof(void *) * 2) / sizeof(uint32_t))
-#endif
-
-#endif // JLANG_VM_ARGS_DEFINE_H
-
-//////////////////////////////////////////////////////////////
-
-#include "jlang/vm/ArgsDefine.h"
 #include "jlang/vm/Interpreter.h"
+#include "jlang/vm/StackLayout.h"
+#include "jlang/vm/PreDecoder.h"
+#include "jlang/vm/SuperInsn.h"
+#include "jlang/vm/TypedInsn.h"
+#include "jlang/vm/JitCompiler.h"
+#include "jlang/vm/TraceJit.h"
+#include "jlang/vm/RegTranslator.h"
+#include "jlang/vm/Verifier.h"
+#include "jlang/vm/StackGuard.h"
+#include "jlang/vm/Safepoint.h"
+#include "jlang/vm/Snapshot.h"
 #include "jlang/lang/Error.h"
 #include "jlang/system/Console.h"
 
@@ -35,6 +28,7 @@
 #include <list>
 #include <memory>
 #include <atomic>
+#include <type_traits>
 
 using namespace std;
 
@@ -45,7 +39,7 @@ namespace v3 {
 // 00000000:    add_sp_4
 // 00000001:    push_u32 0x00000014 (int32)
 // 00000006:    call 0x00000010 (short offset 0x0008)
-// 00000009:    pop_u32
+// 00000009:    pop_u64  (pop var0 and arg0)
 // 0000000A:    ret
 
 // 0000000B:    nop; nop; nop; nop; nop;
@@ -69,16 +63,33 @@ namespace v3 {
 
 // 00000030:    ret eax, 0x00000001 (uint32)
 //
+// The frame slot operands are encoded for the stack layout, the fast image
+// computes fib(n - 2) first, and returns with the short ret_n.
+//
+
+//
+// The function fib(n) at kFuncOffset can be the entry too, the caller
+// pushes a pad slot and n, see ExecutionContext::pushArg().
+//
+template <typename Layout>
+struct vmFibonacciImage {
+    static const size_t kImageSize = 64;
+    static const size_t kFuncOffset = 0x10;
 
-static const unsigned char fibonacciBinary32[] = {
+    static const unsigned char kBinary[kImageSize];
+    static const unsigned char kBinaryFast[kImageSize];
+};
+
+template <typename Layout>
+const unsigned char vmFibonacciImage<Layout>::kBinary[kImageSize] = {
     // 00000000:    add_sp_4
     OpCode::add_sp_4,
     // 00000001:    push_u32 0x00000014 (int32)
     OpCode::push_u32, 0x14, 0x00, 0x00, 0x00,
     // 00000006:    call 0x00000010 (short offset 0x0007)
     OpCode::call_short, 0x07, 0x00,
-    // 00000009:    pop_u32
-    OpCode::pop_u32,
+    // 00000009:    pop_u64  (pop var0 and arg0)
+    OpCode::pop_u64,
     // 0000000A:    ret
     OpCode::ret,
 
@@ -88,28 +99,28 @@ static const unsigned char fibonacciBinary32[] = {
     OpCode::nop,  OpCode::nop, OpCode::nop,
 
     // 00000010:    cmp_imm_u32 arg0, 0x00000003
-    OpCode::cmp_imm_u32, __arg0, 0x03, 0x00, 0x00, 0x00,
+    OpCode::cmp_imm_u32, Layout::kArg0, 0x03, 0x00, 0x00, 0x00,
     // 00000016:    jl_near 0x00000030 (near offset 0x18)
     OpCode::jl_near, 0x18,
 
     // 00000018:    add_sp_4
     OpCode::add_sp_4,
     // 00000019:    push arg0  (var1)
-    OpCode::push, __arg0,
+    OpCode::push, Layout::kArg0,
     // 0000001B:    dec var1
-    OpCode::dec,  __var1,
+    OpCode::dec,  Layout::kVar1,
     // 0000001D:    call 0x00000010 (near offset 0xF1)
     OpCode::call_near, 0xF1,
 
     // 0000001F:    copy_from var0, eax
-    OpCode::copy_from_eax, __var0,
+    OpCode::copy_from_eax, Layout::kVar0,
     // 00000021:    dec var1
-    OpCode::dec,  __var1,
+    OpCode::dec,  Layout::kVar1,
     // 00000023:    call 0x00000010 (near offset 0xEB)
     OpCode::call_near, 0xEB,
 
     // 00000025:    add eax, var0
-    OpCode::add_eax, __var0,
+    OpCode::add_eax, Layout::kVar0,
     // 00000027:    ret_n 8  (pop var0, var1)
     OpCode::ret_n, 0x08, 0x00,
 
@@ -129,15 +140,16 @@ static const unsigned char fibonacciBinary32[] = {
     OpCode::exit
 };
 
-static const unsigned char fibonacciBinary32_fast[] = {
+template <typename Layout>
+const unsigned char vmFibonacciImage<Layout>::kBinaryFast[kImageSize] = {
     // 00000000:    add_sp_4
     OpCode::add_sp_4,
     // 00000001:    push_u32 0x00000014 (int32)
     OpCode::push_u32, 0x14, 0x00, 0x00, 0x00,
     // 00000006:    call 0x00000010 (short offset 0x0007)
     OpCode::call_short, 0x07, 0x00,
-    // 00000009:    pop_u32
-    OpCode::pop_u32,
+    // 00000009:    pop_u64  (pop var0 and arg0)
+    OpCode::pop_u64,
     // 0000000A:    ret
     OpCode::ret,
 
@@ -147,28 +159,28 @@ static const unsigned char fibonacciBinary32_fast[] = {
     OpCode::nop,  OpCode::nop, OpCode::nop,
 
     // 00000010:    cmp_imm_u32 arg0, 0x00000003
-    OpCode::cmp_imm_u32, __arg0, 0x03, 0x00, 0x00, 0x00,
+    OpCode::cmp_imm_u32, Layout::kArg0, 0x03, 0x00, 0x00, 0x00,
     // 00000016:    jl_short 0x00000030 (near offset 0x18)
     OpCode::jl_near, 0x18,
 
     // 00000018:    add_sp_4
     OpCode::add_sp_4,
     // 00000019:    push arg0  (var1)
-    OpCode::push, __arg0,
+    OpCode::push, Layout::kArg0,
     // 0000001B:    sub var1, 0x00000002
-    OpCode::sub_imm, __var1, 0x02, 0x00, 0x00, 0x00,
+    OpCode::sub_imm, Layout::kVar1, 0x02, 0x00, 0x00, 0x00,
     // 00000021:    call 0x00000010 (near offset 0xED)
     OpCode::call_near, 0xED,
 
     // 00000023:    copy_from var0, eax
-    OpCode::copy_from_eax, __var0,
+    OpCode::copy_from_eax, Layout::kVar0,
     // 00000025:    dec var1
-    OpCode::inc,  __var1,
+    OpCode::inc,  Layout::kVar1,
     // 00000027:    call 0x00000010 (near offset 0xE7)
     OpCode::call_near, 0xE7,
 
     // 00000029:    add eax, var0
-    OpCode::add_eax, __var0,
+    OpCode::add_eax, Layout::kVar0,
     // 0000002B:    ret_n 8  (pop var0, var1)
     OpCode::ret_n_sm, 0x08,
 
@@ -195,11 +207,28 @@ public:
     ~vmBinaryFile() {}
 
     int loadFromFile(const char * filename) {
-        static const size_t kImageSize = sizeof(fibonacciBinary32);
-        image_.allocate(kImageSize);
+        return loadBuiltin<vmDefaultLayout>(USE_FIBONACCI_IMAGE);
+    }
+
+    //
+    // Load the built-in image that encoded for the stack layout, the image
+    // mode is USE_FIBONACCI_IMAGE or USE_FIBONACCI_IMAGE_FAST.
+    //
+    template <typename Layout>
+    int loadBuiltin(int imageMode) {
+        typedef vmFibonacciImage<Layout> image_type;
+        const unsigned char * binary;
+        if (imageMode == USE_FIBONACCI_IMAGE)
+            binary = &image_type::kBinary[0];
+        else if (imageMode == USE_FIBONACCI_IMAGE_FAST)
+            binary = &image_type::kBinaryFast[0];
+        else
+            return 0;
+
+        image_.allocate(image_type::kImageSize);
         void * imageData = image_.data();
         if (imageData) {
-            memcpy(imageData, (const void *)&fibonacciBinary32[0], kImageSize);
+            memcpy(imageData, (const void *)binary, image_type::kImageSize);
         }
         image_.setEntryOffset(0);
         return 1;
@@ -739,40 +768,41 @@ public:
     uint8_t * readU8Pointer(uint8_t * val) { return readPointer<uint8_t *>(); }
 
     // BackwardPtr
-    void writeInt8(int8_t val)     { putInt8(val);    nextInt8();    }
-    void writeUInt8(uint8_t val)   { putUInt8(val);   nextUInt8();   }
-    void writeInt16(int16_t val)   { putInt16(val);   nextInt16();   }
-    void writeUInt16(uint16_t val) { putUInt16(val);  nextUInt16();  }
-    void writeInt32(int32_t val)   { putInt32(val);   nextInt32();   }
-    void writeUInt32(uint32_t val) { putUInt32(val);  nextUInt32();  }
-    void writeInt64(int64_t val)   { putInt64(val);   nextInt64();   }
-    void writeUInt64(uint64_t val) { putUInt64(val);  nextUInt64();  }
-    void writePointer(void * val)  { putPointer(val); nextPointer(); }
+    void writeInt8(int8_t val)     { nextInt8();    putInt8(val);    }
+    void writeUInt8(uint8_t val)   { nextUInt8();   putUInt8(val);   }
+    void writeInt16(int16_t val)   { nextInt16();   putInt16(val);   }
+    void writeUInt16(uint16_t val) { nextUInt16();  putUInt16(val);  }
+    void writeInt32(int32_t val)   { nextInt32();   putInt32(val);   }
+    void writeUInt32(uint32_t val) { nextUInt32();  putUInt32(val);  }
+    void writeInt64(int64_t val)   { nextInt64();   putInt64(val);   }
+    void writeUInt64(uint64_t val) { nextUInt64();  putUInt64(val);  }
+    void writePointer(void * val)  { nextPointer(); putPointer(val); }
 
     template <typename U = void *>
     void writePointer(U val) {
-        putPointer<U>(val);
         nextPointer<U>();
+        putPointer<U>(val);
     }
 
     void writeIPointer(int8_t * val)   { writePointer<int8_t *>(val);  }
     void writeU8Pointer(uint8_t * val) { writePointer<uint8_t *>(val); }
 
-    // BackwardPtr
-    void push_Int8(int8_t val)     { putInt8(val);    nextInt8();    }
-    void push_UInt8(uint8_t val)   { putUInt8(val);   nextUInt8();   }
-    void push_Int16(int16_t val)   { putInt16(val);   nextInt16();   }
-    void push_UInt16(uint16_t val) { putUInt16(val);  nextUInt16();  }
-    void push_Int32(int32_t val)   { putInt32(val);   nextInt32();   }
-    void push_UInt32(uint32_t val) { putUInt32(val);  nextUInt32();  }
-    void push_Int64(int64_t val)   { putInt64(val);   nextInt64();   }
-    void push_UInt64(uint64_t val) { putUInt64(val);  nextUInt64();  }
-    void push_Pointer(void * val)  { putPointer(val); nextPointer(); }
+    // BackwardPtr, sp points to the last pushed item, so a push moves first
+    // and a pop reads first, the items of the different sizes never overlap.
+    void push_Int8(int8_t val)     { nextInt8();    putInt8(val);    }
+    void push_UInt8(uint8_t val)   { nextUInt8();   putUInt8(val);   }
+    void push_Int16(int16_t val)   { nextInt16();   putInt16(val);   }
+    void push_UInt16(uint16_t val) { nextUInt16();  putUInt16(val);  }
+    void push_Int32(int32_t val)   { nextInt32();   putInt32(val);   }
+    void push_UInt32(uint32_t val) { nextUInt32();  putUInt32(val);  }
+    void push_Int64(int64_t val)   { nextInt64();   putInt64(val);   }
+    void push_UInt64(uint64_t val) { nextUInt64();  putUInt64(val);  }
+    void push_Pointer(void * val)  { nextPointer(); putPointer(val); }
 
     template <typename U = void *>
     void push_Pointer(U val) {
-        putPointer<U>(val);
         nextPointer<U>();
+        putPointer<U>(val);
     }
 
     void push_I8Pointer(int8_t * val)  { push_Pointer<int8_t *>(val);  }
@@ -798,20 +828,21 @@ public:
 #endif
 
     // BackwardPtr
-    int8_t   pop_Int8()    { backInt8();    return getInt8(); }
-    uint8_t  pop_UInt8()   { backUInt8();   return getUInt8(); }
-    int16_t  pop_Int16()   { backInt16();   return getInt16(); }
-    uint16_t pop_UInt16()  { backUInt16();  return getUInt16(); }
-    int32_t  pop_Int32()   { backInt32();   return getInt32(); }
-    uint32_t pop_UInt32()  { backUInt32();  return getUInt32(); }
-    int64_t  pop_Int64()   { backInt64();   return getInt64(); }
-    uint64_t pop_UInt64()  { backUInt64();  return getUInt64(); }
-    void *   pop_Pointer() { backPointer(); return getPointer(); }
+    int8_t   pop_Int8()    { int8_t   value = getInt8();    backInt8();    return value; }
+    uint8_t  pop_UInt8()   { uint8_t  value = getUInt8();   backUInt8();   return value; }
+    int16_t  pop_Int16()   { int16_t  value = getInt16();   backInt16();   return value; }
+    uint16_t pop_UInt16()  { uint16_t value = getUInt16();  backUInt16();  return value; }
+    int32_t  pop_Int32()   { int32_t  value = getInt32();   backInt32();   return value; }
+    uint32_t pop_UInt32()  { uint32_t value = getUInt32();  backUInt32();  return value; }
+    int64_t  pop_Int64()   { int64_t  value = getInt64();   backInt64();   return value; }
+    uint64_t pop_UInt64()  { uint64_t value = getUInt64();  backUInt64();  return value; }
+    void *   pop_Pointer() { void *   value = getPointer(); backPointer(); return value; }
 
     template <typename U = void *>
     U pop_Pointer() {
+        U value = getPointer<U>();
         backPointer<U>();
-        return getPointer<U>();
+        return value;
     }
 
     int8_t *  pop_I8Pointer(int8_t * val)  { return pop_Pointer<int8_t *>();  }
@@ -898,15 +929,21 @@ public:
 
 typedef ForwardPtr  vmImagePtr;
 
-#if USE_FORWARD_STACK_PTR
-typedef ForwardPtr  vmStackPtr;
-typedef ForwardPtr  vmFramePtr;
-#else
-typedef BackwardPtr vmStackPtr;
-typedef BackwardPtr vmFramePtr;
-#endif
+//
+// The stack and frame pointer types of the stack layout.
+//
+template <typename Layout>
+struct vmStackPtrTraits {
+    typedef typename std::conditional<Layout::kIsForward,
+                                      ForwardPtr, BackwardPtr>::type stack_ptr;
+    typedef stack_ptr frame_ptr;
+};
 
+template <typename Layout>
 struct vmContextRegs {
+    typedef typename vmStackPtrTraits<Layout>::stack_ptr vmStackPtr;
+    typedef typename vmStackPtrTraits<Layout>::frame_ptr vmFramePtr;
+
     vmImagePtr  ip_;
     vmStackPtr  sp_;
     vmFramePtr  fp_;
@@ -928,37 +965,66 @@ struct vmContextRegs {
     }
 };
 
-template <typename BasicType>
+template <typename BasicType, typename Layout>
 class ExecutionEngine;
 
-template <typename BasicType = uintptr_t>
+template <typename BasicType = uintptr_t, typename Layout = vmDefaultLayout>
 class ExecutionContext : public IExecutionContext<BasicType>,
-                         public vmContextRegs {
+                         public vmContextRegs<Layout> {
 public:
-    typedef BasicType                       basic_type;
-    typedef IExecutionContext<basic_type>   base_type;
-    typedef size_t                          size_type;
-    typedef ExecutionEngine<basic_type>     engine_type;
-    typedef vmReturn<basic_type>            return_type;
-    typedef vmContextRegs                   ctx_reg_type;
-    typedef ExecutionContext<basic_type>    this_type;
+    typedef BasicType                               basic_type;
+    typedef Layout                                  layout_type;
+    typedef IExecutionContext<basic_type>           base_type;
+    typedef size_t                                  size_type;
+    typedef ExecutionEngine<basic_type, Layout>     engine_type;
+    typedef vmReturn<basic_type>                    return_type;
+    typedef vmContextRegs<Layout>                   ctx_reg_type;
+    typedef ExecutionContext<basic_type, Layout>    this_type;
+
+    typedef typename ctx_reg_type::vmStackPtr       vmStackPtr;
+    typedef typename ctx_reg_type::vmFramePtr       vmFramePtr;
+
+    using ctx_reg_type::ip_;
+    using ctx_reg_type::sp_;
+    using ctx_reg_type::fp_;
+    using ctx_reg_type::regs_;
+    using ctx_reg_type::flags;
 
     static const size_type kDefaultStackSize = 8 * 1048576U;
+    static const size_type kDefaultGrowableSize = 8 * 1024U;
+    static const size_type kMaxHandlers = 256;
+
+    // The native tiers (JIT, trace JIT and register VM) are built for the
+    // forward stack with the full frame header.
+    static const bool kIsNativeLayout =
+        std::is_same<Layout, vmStackLayout<true, false> >::value;
 
 private:
-#if USE_FORWARD_STACK_PTR
-    vmStack<basic_type, false>  stack_;
-    vmStack<basic_type, false>  callstack_;
-#else
-    vmStack<basic_type, true> stack_;
-    vmStack<basic_type, true> callstack_;
-#endif
+    vmStack<basic_type, !Layout::kIsForward>    stack_;
+    vmStack<basic_type, !Layout::kIsForward>    callstack_;
     vmImageInfo<basic_type> image_;
     vmHeap<basic_type>      heap_;
+    vmDecodedImage          decoded_;
+    vmJitCode               jitCode_;
+    vmRegImage              regImage_;
+    TraceMonitor            traceMonitor_;
+    vmVerifyInfo            verifyInfo_;
+    vmSafepoint             safepoint_;
     engine_type *           engine_;
 
+    // A call grows the stack when its frame is pushed beyond the mark.
+    unsigned char *         growMark_;
+    // The records are translated for the loop of the growable stack.
+    bool                    decodedGrowable_;
+
+    // The hash of the image, it's computed by the first snapshot.
+    uint64_t                imageHash_;
+
 public:
-    ExecutionContext(engine_type * engine = nullptr) : engine_(engine) {}
+    ExecutionContext(engine_type * engine = nullptr)
+        : engine_(engine), decodedGrowable_(false), imageHash_(0) {
+        updateGrowMark();
+    }
     virtual ~ExecutionContext() {
         destroy();
     }
@@ -979,16 +1045,261 @@ public:
     void setImageInfo(void * imageStart, size_t imageSize,
                       void * imageEntry) {
         image_.setting(imageStart, imageSize, imageEntry);
+        verifyInfo_.clear();
+        imageHash_ = 0;
+        updateGrowMark();
     }
 
     void create(size_type stackSize = kDefaultStackSize) {
         stack_.create(stackSize);
         callstack_.create(stackSize);
+        updateGrowMark();
+    }
+
+    //
+    // Create the context with the growable stack, it starts with
+    // initialSize bytes and grows up to maxSize bytes on the calls. The
+    // image must be verified, the calls keep the max frame size of the image
+    // free. The image is pre-decoded after it, and runs by run_predecoded()
+    // only, the other loops don't grow the stack.
+    //
+    void createGrowable(size_type initialSize = kDefaultGrowableSize,
+                        size_type maxSize = kDefaultStackSize) {
+        stack_.createGrowable(initialSize, maxSize);
+        callstack_.createGrowable(getCallStackSize(initialSize), getCallStackSize(maxSize));
+        updateGrowMark();
+    }
+
+    bool isGrowable() const { return stack_.isGrowable(); }
+
+    vmHeap<basic_type> & getHeap() { return heap_; }
+
+    void createHeap(size_type heapSize) {
+        heap_.create(heapSize);
+    }
+
+    size_type getStackCapacity() const { return stack_.capacity(); }
+
+    //
+    // The tops of the stack and the call stack, a run pushes its entry
+    // frame there.
+    //
+    unsigned char * getStackTop() const { return stack_.current(); }
+    unsigned char * getCallStackTop() const { return callstack_.current(); }
+
+    //
+    // Push an argument of the entry function, the arguments stay below the
+    // entry frame of every run until clearArgs(). An image that's shared by
+    // the contexts takes its input from here, it's never patched.
+    //
+    void pushArg(uint32_t value) {
+        vmStackPtr sp(stack_.current());
+        sp.push_UInt32(value);
+        stack_.setCurrent(sp.ptr());
+    }
+
+    void clearArgs() {
+        stack_.reset();
+    }
+
+    //
+    // The bytes of the arguments that are pushed by pushArg(), the backward
+    // stack starts below its bottom slot.
+    //
+    size_type getArgSize() const {
+        if (stack_.isBackwardPtr())
+            return (stack_.size() - sizeof(basic_type));
+        else
+            return stack_.size();
+    }
+
+    //
+    // Rewind the context for the next run, it's O(1): the stacks are only
+    // rewound, not freed or cleared, and the image, its pre-decoded records
+    // and the verify info are kept.
+    //
+    void reset() {
+        stack_.reset();
+        callstack_.reset();
+        ctx_reg_type::clear();
+        safepoint_.setSuspended(false);
+    }
+
+    //
+    // The safepoints of run_pausable(), see vmSafepoint.
+    //
+    vmSafepoint & getSafepoint() { return safepoint_; }
+
+    bool isSuspended() const { return safepoint_.isSuspended(); }
+
+    //
+    // Set the entry of the image again, the image must be same one.
+    //
+    void rebindImage(void * imageEntry) {
+        assert((unsigned char *)imageEntry >= image_.getStart() &&
+               (unsigned char *)imageEntry < image_.getLimit());
+        image_.setPtr(imageEntry);
+    }
+
+    //
+    // The resident bytes of the stacks, it's their high-water mark since
+    // they're created or trimmed.
+    //
+    size_type getStackResidentSize() const {
+        return (stack_.residentSize() + callstack_.residentSize());
+    }
+
+    //
+    // Give the stack pages beyond keepSize back to the OS, the context
+    // must not be running. Return the bytes that are given back.
+    //
+    size_type trimStacks(size_type keepSize) {
+        return (stack_.trim(keepSize) + callstack_.trim(keepSize));
+    }
+
+    //
+    // Cache the arg frame and the heap of the context to the snapshot: the
+    // stack below the entry frame (the arguments pushed by pushArg()), the
+    // heap, the entry and the identity of the image. The context that's
+    // suspended at a safepoint is saved with its registers and the stack up
+    // to its sp, it's resumed from there when it's restored. The context
+    // must not be running.
+    //
+    int saveSnapshot(vmSnapshot & snapshot) {
+        if (!isInited())
+            return Error::Snapshot_Invalid;
+        bool paused = safepoint_.isSuspended();
+        size_type argsUsed = (size_type)getStackOffset(stack_.current());
+        size_type stackUsed = paused ? (size_type)getStackOffset(sp_.ptr()) : argsUsed;
+        size_type heapUsed = 0;
+        if (heap_.isInited()) {
+            heapUsed = heap_.capacity();
+            while (heapUsed > 0 && heap_.first()[heapUsed - 1] == 0) {
+                heapUsed--;
+            }
+        }
+
+        vmSnapshotHeader * header = snapshot.allocate(stackUsed, heapUsed);
+        unsigned char * blob = (unsigned char *)header;
+        header->layout = getSnapshotLayout();
+        header->basicSize = (uint32_t)sizeof(basic_type);
+        header->imageSize = (uint64_t)(image_.getLimit() - image_.getStart());
+        header->imageHash = getImageHash();
+        header->entryOffset = (uint64_t)(image_.getPtr() - image_.getStart());
+
+        unsigned char * section = blob + header->stackOffset;
+        if (Layout::kIsForward)
+            memcpy((void *)section, (const void *)stack_.first(), stackUsed);
+        else
+            memcpy((void *)(section + header->stackSection - stackUsed),
+                   (const void *)(stack_.last() - stackUsed), stackUsed);
+
+        header->argsUsed = argsUsed;
+        if (paused) {
+            header->ipOffset = (uint64_t)(ip_.ptr() - image_.getStart());
+            header->spOffset = stackUsed;
+            header->fpOffset = getStackOffset(fp_.ptr());
+            header->eax = (uint64_t)regs_.uval;
+            header->flags = (uint64_t)flags.uval;
+            unsigned char * copyBottom = Layout::kIsForward ? section : (section + header->stackSection);
+            unsigned char * stackBottom = Layout::kIsForward ? stack_.first() : stack_.last();
+            save_frames(fp_.ptr(), copyBottom - stackBottom);
+        }
+
+        header->heapCapacity = heap_.capacity();
+        if (heapUsed > 0)
+            memcpy((void *)(blob + header->heapOffset), (const void *)heap_.first(), heapUsed);
+        return Error::Ok;
+    }
+
+    //
+    // Restore the arg frame and the heap of the snapshot, and rebind the
+    // entry, the next run starts from there. The snapshot of a paused
+    // context restores its frames and registers too, the context is
+    // suspended then, and resume() goes on from the safepoint. The image
+    // of the context must be the image of the snapshot, and the stack must
+    // be created. The stack section of a blob file is mapped copy-on-write
+    // onto the stack, when the stack is reserved with mmap(), otherwise
+    // it's copied. The heap is copied.
+    //
+    int restoreSnapshot(const vmSnapshot & snapshot) {
+        if (!snapshot.isValid())
+            return Error::Snapshot_Invalid;
+        const vmSnapshotHeader & header = snapshot.header();
+        if (header.layout != getSnapshotLayout() || header.basicSize != sizeof(basic_type))
+            return Error::Snapshot_Layout_Mismatch;
+        uint64_t imageSize = (uint64_t)(image_.getLimit() - image_.getStart());
+        if (!image_.isInited() || header.imageSize != imageSize ||
+            header.entryOffset >= imageSize || header.imageHash != getImageHash())
+            return Error::Snapshot_Image_Mismatch;
+        if (!stack_.isInited())
+            return Error::Snapshot_Stack_Too_Small;
+
+        size_type stackUsed = (size_type)header.stackUsed;
+        if (stackUsed > stack_.capacity()) {
+            ptrdiff_t delta;
+            if (!stack_.isGrowable() || !stack_.grow(0, stackUsed, delta))
+                return Error::Snapshot_Stack_Too_Small;
+            updateGrowMark();
+        }
+        if (header.heapCapacity > 0) {
+            if (heap_.capacity() != header.heapCapacity)
+                heap_.create((size_type)header.heapCapacity);
+            else
+                memset((void *)heap_.first(), 0, heap_.capacity());
+            if (!heap_.isInited())
+                return Error::Snapshot_Invalid;
+            memcpy((void *)heap_.first(), (const void *)snapshot.getHeapSection(),
+                   (size_t)header.heapUsed);
+        }
+        else {
+            heap_.destroy();
+        }
+
+        reset();
+        if (stackUsed > 0) {
+            bool mapped = false;
+            if (snapshot.getFile() >= 0) {
+                mapped = stack_.mapBottom(snapshot.getFile(), header.stackOffset,
+                                          (size_type)header.stackSection);
+            }
+            if (!mapped) {
+                const unsigned char * section = snapshot.getStackSection();
+                if (Layout::kIsForward)
+                    memcpy((void *)stack_.first(), (const void *)section, stackUsed);
+                else
+                    memcpy((void *)(stack_.last() - stackUsed),
+                           (const void *)(section + header.stackSection - stackUsed), stackUsed);
+            }
+        }
+        stack_.setCurrent(getStackPtr((size_type)header.argsUsed));
+        image_.setPtr(image_.getStart() + header.entryOffset);
+
+        if (header.ipOffset != vmSnapshotHeader::kNullOffset) {
+            unsigned char * fp = getStackPtr((size_type)header.fpOffset);
+            if (!restore_frames(fp, (uint64_t)header.argsUsed)) {
+                reset();
+                return Error::Snapshot_Invalid;
+            }
+            ip_.set(image_.getStart() + header.ipOffset);
+            sp_.set(getStackPtr(stackUsed));
+            fp_.set(fp);
+            regs_.uval = header.eax;
+            flags.uval = header.flags;
+            safepoint_.setSuspended(true);
+        }
+        return Error::Ok;
     }
 
     void destroy() {
         callstack_.destroy();
         stack_.destroy();
+        heap_.destroy();
+        jitCode_.deallocate();
+        traceMonitor_.clear();
+        verifyInfo_.clear();
+        regImage_.clear();
+        decoded_.deallocate();
         image_.clear();
     }
 
@@ -1015,26 +1326,277 @@ public:
             return (sp.ptr() >= stack_.last());
     }
 
+    // Is the free space of the stack less than the size ?
+    bool sp_isOverflow(vmStackPtr & sp, size_t size) const {
+        if (stack_.isBackwardPtr())
+            return (sp.ptr() < stack_.first() + size);
+        else
+            return (sp.ptr() > stack_.last() - size);
+    }
+
     int32_t getArgIndex(int8_t index) {
-#if USE_FORWARD_STACK_PTR
-        return (index + (FRAME_STACK_SIZEOF + 1));
-#else
-        return (index - FRAME_STACK_SIZEOF);
-#endif
+        if (Layout::kIsForward)
+            return (index + (Layout::kFrameHeaderSlots + 1));
+        else
+            return (index - Layout::kFrameHeaderSlots);
     }
 
-    JM_FORCEINLINE void push_callstack(vmStackPtr & sp, vmFramePtr & fp, void * returnIP) {
-        sp.push_Pointer(fp.ptr());
+    //
+    // Push the frame header, the saved fp and the return IP. The compact
+    // frame header saves the distance from the caller's fp to the new fp.
+    //
+    JM_FORCEINLINE void push_frame_header(vmStackPtr & sp, vmFramePtr & fp, void * returnIP) {
+        if (Layout::kIsCompactFrame) {
+            sp.push_UInt32((uint32_t)Layout::kFrameHeaderSize +
+                           (uint32_t)(Layout::kIsForward ? (sp.ptr() - fp.ptr())
+                                                         : (fp.ptr() - sp.ptr())));
+        }
+        else {
+            sp.push_Pointer(fp.ptr());
+        }
         sp.push_Pointer(returnIP);
+    }
+
+    JM_FORCEINLINE void * pop_frame_header(vmStackPtr & sp, vmFramePtr & fp) {
+        void * returnIP = sp.pop_Pointer();
+        if (Layout::kIsCompactFrame) {
+            uint32_t distance = sp.pop_UInt32();
+            fp.back((int)distance);
+        }
+        else {
+            void * framePointer = sp.pop_Pointer();
+            fp.set(framePointer);
+        }
+        return returnIP;
+    }
+
+    JM_FORCEINLINE void push_callstack(vmStackPtr & sp, vmFramePtr & fp, void * returnIP) {
+        push_frame_header(sp, fp, returnIP);
         fp.set(sp.ptr());
         assert(!sp_isOverflow(sp));
     }
 
+    //
+    // The call of the pre-decoded loop. Only the Growable loop checks the
+    // grow mark.
+    //
+    template <bool Growable>
+    JM_FORCEINLINE void push_callstack(vmStackPtr & sp, vmFramePtr & fp, void * returnIP) {
+        push_frame_header(sp, fp, returnIP);
+        fp.set(sp.ptr());
+        if (Growable && unlikely(sp_isBeyondGrowMark(sp))) {
+            ptrdiff_t move = grow_stack(sp.ptr(), fp.ptr());
+            sp.set(sp.ptr() + move);
+            fp.set(fp.ptr() + move);
+        }
+        assert(!sp_isOverflow(sp));
+    }
+
+    //
+    // The mark is never reached if the stack isn't growable.
+    //
+    JM_FORCEINLINE bool sp_isBeyondGrowMark(vmStackPtr & sp) const {
+        if (Layout::kIsForward)
+            return (sp.ptr() > growMark_);
+        else
+            return (sp.ptr() < growMark_);
+    }
+
+    void updateGrowMark() {
+        if (stack_.isGrowable() && verifyInfo_.verified) {
+            size_type reserve = verifyInfo_.maxFrameSize;
+            if (Layout::kIsForward)
+                growMark_ = stack_.last() - reserve;
+            else
+                growMark_ = stack_.first() + reserve;
+        }
+        else {
+            if (Layout::kIsForward)
+                growMark_ = (unsigned char *)(~(uintptr_t)0);
+            else
+                growMark_ = nullptr;
+        }
+    }
+
+    //
+    // Rebase the saved fp of the frame headers from fp to the entry frame,
+    // after the stack is moved by delta bytes. The compact frame header
+    // saves a distance, it needn't be rebased.
+    //
+    void rebase_frames(unsigned char * frame, ptrdiff_t delta) {
+        if (Layout::kIsCompactFrame)
+            return;
+        while (frame != nullptr) {
+            // The header is the saved fp and the return IP, see push_frame_header().
+            vmStackPtr slot(frame);
+            void * returnIP = slot.pop_Pointer();
+            if (Layout::kIsForward)
+                slot.backPointer();
+            unsigned char * savedFP = (unsigned char *)slot.getPointer() + delta;
+            slot.putPointer(savedFP);
+            frame = (returnIP != nullptr) ? savedFP : nullptr;
+        }
+    }
+
+    //
+    // The slots of the frame header below the frame, see push_frame_header(),
+    // the saved fp is the distance in the compact frame header.
+    //
+    static unsigned char * getReturnIPSlot(unsigned char * frame) {
+        return (Layout::kIsForward ? (frame - sizeof(void *)) : frame);
+    }
+
+    static unsigned char * getSavedFPSlot(unsigned char * frame) {
+        return (Layout::kIsForward ? (frame - Layout::kFrameHeaderSize) : (frame + sizeof(void *)));
+    }
+
+    static unsigned char * getCallerFrame(unsigned char * frame, uint32_t distance) {
+        return (Layout::kIsForward ? (frame - distance) : (frame + distance));
+    }
+
+    //
+    // Save the frame headers from fp to the entry frame as offsets, into the
+    // copy of the stack that's delta bytes from the stack, see
+    // vmSnapshotHeader.
+    //
+    void save_frames(unsigned char * frame, ptrdiff_t delta) {
+        while (frame != nullptr) {
+            unsigned char * ipSlot = getReturnIPSlot(frame);
+            unsigned char * returnIP = *(unsigned char **)ipSlot;
+            *(uintptr_t *)(ipSlot + delta) = (returnIP != nullptr) ?
+                (uintptr_t)(returnIP - image_.getStart()) : vmSnapshotHeader::kNullSlot;
+
+            unsigned char * fpSlot = getSavedFPSlot(frame);
+            unsigned char * callerFrame;
+            if (Layout::kIsCompactFrame) {
+                callerFrame = getCallerFrame(frame, *(uint32_t *)fpSlot);
+            }
+            else {
+                callerFrame = *(unsigned char **)fpSlot;
+                *(uintptr_t *)(fpSlot + delta) = (uintptr_t)getStackOffset(callerFrame);
+            }
+            frame = (returnIP != nullptr) ? callerFrame : nullptr;
+        }
+    }
+
+    //
+    // Turn the offsets of the frame headers from fp to the entry frame back
+    // to the pointers, return false if they're out of the image or the
+    // stack. Every caller frame must be below its callee, and the entry
+    // frame must be above the arg frame.
+    //
+    bool restore_frames(unsigned char * frame, uint64_t argsUsed) {
+        uint64_t imageSize = (uint64_t)(image_.getLimit() - image_.getStart());
+        while (frame != nullptr) {
+            uint64_t frameOffset = getStackOffset(frame);
+            if (frameOffset < argsUsed + (uint64_t)Layout::kFrameHeaderSize)
+                return false;
+
+            unsigned char * ipSlot = getReturnIPSlot(frame);
+            uintptr_t ipOffset = *(uintptr_t *)ipSlot;
+            unsigned char * returnIP = nullptr;
+            if (ipOffset != vmSnapshotHeader::kNullSlot) {
+                if ((uint64_t)ipOffset >= imageSize)
+                    return false;
+                returnIP = image_.getStart() + ipOffset;
+            }
+            *(unsigned char **)ipSlot = returnIP;
+
+            unsigned char * fpSlot = getSavedFPSlot(frame);
+            uint64_t callerOffset;
+            if (Layout::kIsCompactFrame) {
+                uint32_t distance = *(uint32_t *)fpSlot;
+                if ((uint64_t)distance > frameOffset)
+                    return false;
+                callerOffset = frameOffset - distance;
+            }
+            else {
+                callerOffset = (uint64_t)*(uintptr_t *)fpSlot;
+            }
+            if (callerOffset > frameOffset - (uint64_t)Layout::kFrameHeaderSize)
+                return false;
+            unsigned char * callerFrame = getStackPtr(callerOffset);
+            if (!Layout::kIsCompactFrame)
+                *(unsigned char **)fpSlot = callerFrame;
+            frame = (returnIP != nullptr) ? callerFrame : nullptr;
+        }
+        return true;
+    }
+
+    static uint32_t getSnapshotLayout() {
+        return ((Layout::kIsForward ? vmSnapshotHeader::kIsForward : 0) |
+                (Layout::kIsCompactFrame ? vmSnapshotHeader::kIsCompactFrame : 0));
+    }
+
+    uint64_t getImageHash() {
+        if (imageHash_ == 0 && image_.isInited()) {
+            imageHash_ = vmSnapshot::hashImage(image_.getStart(),
+                                               (size_t)(image_.getLimit() - image_.getStart()));
+        }
+        return imageHash_;
+    }
+
+    //
+    // The offset of the pointer from the bottom of the stack, or kNullOffset
+    // if it isn't in the stack.
+    //
+    uint64_t getStackOffset(unsigned char * ptr) const {
+        if (ptr == nullptr || ptr < stack_.first() || ptr > stack_.last())
+            return vmSnapshotHeader::kNullOffset;
+        if (Layout::kIsForward)
+            return (uint64_t)(ptr - stack_.first());
+        else
+            return (uint64_t)(stack_.last() - ptr);
+    }
+
+    unsigned char * getStackPtr(uint64_t offset) const {
+        if (offset > (uint64_t)stack_.capacity())
+            return nullptr;
+        if (Layout::kIsForward)
+            return (stack_.first() + offset);
+        else
+            return (stack_.last() - offset);
+    }
+
+    //
+    // The pre-decoded loop of a growable stack doesn't use the call stack,
+    // it's reserved with half of the stack size, plus the bottom slots.
+    //
+    static size_type getCallStackSize(size_type stackSize) {
+        return (stackSize / 2 + 16);
+    }
+
+    static void raise_stack_overflow() {
+#if USE_VM_STACK_GUARD
+        vmStackGuard::raiseOverflow();
+#else
+        assert(false);
+        ::abort();
+#endif
+    }
+
+    //
+    // Move the growable stack to a larger block, and rebase the frames,
+    // return the distance that the stack is moved by. The overflow of the
+    // max size stops the run like a hit on the guard region. The pointers
+    // are passed by value, so the loops keep their sp and fp in the registers.
+    //
+    JM_NOINLINE ptrdiff_t grow_stack(unsigned char * sp, unsigned char * fp) {
+        ptrdiff_t move = 0;
+        size_type used;
+        if (Layout::kIsForward)
+            used = (size_type)(sp - stack_.first());
+        else
+            used = (size_type)(stack_.last() - sp);
+        if (!stack_.grow(used, verifyInfo_.maxFrameSize, move))
+            raise_stack_overflow();
+        rebase_frames(fp + move, move);
+        updateGrowMark();
+        return move;
+    }
+
     JM_FORCEINLINE void * pop_callstack(vmStackPtr & sp, vmFramePtr & fp) {
-        void * returnIP = sp.pop_Pointer();
-        void * framePointer = sp.pop_Pointer();
-        fp.set(framePointer);
-        return returnIP;
+        return pop_frame_header(sp, fp);
     }
 
     JM_FORCEINLINE void * pop_callstack(vmStackPtr & sp, vmFramePtr & fp, uint16_t localSize) {
@@ -1045,8 +1607,7 @@ public:
 
     JM_FORCEINLINE void inline_push_callstack(vmStackPtr & sp, vmFramePtr & fp, vmStackPtr & cp,
                                               void * returnIP, int retType) {
-        sp.push_Pointer(fp.ptr());
-        sp.push_Pointer(returnIP);
+        push_frame_header(sp, fp, returnIP);
         cp.push_Int32(retType);
         fp.set(sp.ptr());
         assert(!sp_isOverflow(sp));
@@ -1054,10 +1615,8 @@ public:
 
     JM_FORCEINLINE void * inline_pop_callstack(vmStackPtr & sp, vmFramePtr & fp,
                                                vmStackPtr & cp, int & retType) {
-        void * returnIP = sp.pop_Pointer();
-        void * framePointer = sp.pop_Pointer();
+        void * returnIP = pop_frame_header(sp, fp);
         retType = cp.pop_Int32();
-        fp.set(framePointer);
         return returnIP;
     }
 
@@ -1141,172 +1700,187 @@ public:
     //
     // error inst.
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_error(vmImagePtr & ip) {
-        Console::trace("%08X:  error", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  error", getIpOffset(ip));
         ip.next();
     }
 
     //
     // push arg0 (int32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_push(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         int8_t index = ip.getValue<0, int8_t>();
         int32_t value = fp.getArgValueUInt32(index);
         sp.writeInt32(value);
 
-        Console::trace("%08X:  push args[%d]  (0x%08X, int32)",
-                      getIpOffset(ip), getArgIndex(index), value);
+        if (Traced) Console::trace("%08X:  push args[%d]  (0x%08X, int32)",
+                                  getIpOffset(ip), getArgIndex(index), value);
         ip.next(1 + sizeof(int8_t));
     }
 
     //
     // push 0x00000008 (int32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_push_i32(vmImagePtr & ip, vmStackPtr & sp) {
         int32_t value = ip.getValue<0, int32_t>();
         sp.writeInt32(value);
-        Console::trace("%08X:  push_i32 0x%08X (int32)", getIpOffset(ip), value);
+        if (Traced) Console::trace("%08X:  push_i32 0x%08X (int32)", getIpOffset(ip), value);
         ip.next(1 + sizeof(int32_t));
     }
 
     //
     // push 0x00000000 00000008 (int64)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_push_i64(vmImagePtr & ip, vmStackPtr & sp) {
         int64_t value = ip.getValue<0, int64_t>();
         sp.writeInt64(value);
-        Console::trace("%08X:  push_i64 0x%016X (int64)", getIpOffset(ip), value);
+        if (Traced) Console::trace("%08X:  push_i64 0x%016X (int64)", getIpOffset(ip), value);
         ip.next(1 + sizeof(int64_t));
     }
 
     //
     // push_0 (int32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_push_i32_0(vmImagePtr & ip, vmStackPtr & sp) {
         int32_t value = 0;
         sp.writeInt32(value);
-        Console::trace("%08X:  push_i32_0 (int32)", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  push_i32_0 (int32)", getIpOffset(ip));
         ip.next();
     }
 
     //
     // push_0 (int64)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_push_i64_0(vmImagePtr & ip, vmStackPtr & sp) {
         int64_t value = 0;
         sp.writeInt64(value);
-        Console::trace("%08X:  push_i64_0 (int64)", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  push_i64_0 (int64)", getIpOffset(ip));
         ip.next();
     }
 
     //
     // pop uint32
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_pop(vmImagePtr & ip, vmStackPtr & sp) {
-        sp.backUInt32();
-        uint32_t value = sp.getUInt32();
-        Console::trace("%08X:  pop  (0x%08X)", getIpOffset(ip), value);
+        uint32_t value = sp.pop_UInt32();
+        if (Traced) Console::trace("%08X:  pop  (0x%08X)", getIpOffset(ip), value);
         ip.next();
     }
 
     //
     // pop int32
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_pop_i32(vmImagePtr & ip, vmStackPtr & sp) {
-        sp.backInt32();
-        int32_t value = sp.getInt32();
-        Console::trace("%08X:  pop_i32  (0x%08X)", getIpOffset(ip), value);
+        int32_t value = sp.pop_Int32();
+        if (Traced) Console::trace("%08X:  pop_i32  (0x%08X)", getIpOffset(ip), value);
         ip.next();
     }
 
     //
     // pop int64
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_pop_i64(vmImagePtr & ip, vmStackPtr & sp) {
-        sp.backInt64();
-        int64_t value = sp.getInt64();
-        Console::trace("%08X:  pop_i64  (0x%016X)", getIpOffset(ip), value);
+        int64_t value = sp.pop_Int64();
+        if (Traced) Console::trace("%08X:  pop_i64  (0x%016X)", getIpOffset(ip), value);
         ip.next();
     }
 
     //
     // add_sp 16
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add_sp(vmImagePtr & ip, vmStackPtr & sp) {
         uint8_t localSize = ip.getValue<0, uint8_t>();
         sp.next(localSize);
 
-        Console::trace("%08X:  add_sp %u", getIpOffset(ip), (uint32_t)localSize);
+        if (Traced) Console::trace("%08X:  add_sp %u", getIpOffset(ip), (uint32_t)localSize);
         ip.next(1 + sizeof(uint8_t));
     }
 
     //
     // add_sp_4
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add_sp_4(vmImagePtr & ip, vmStackPtr & sp) {
         sp.next(sizeof(uint32_t));
-        Console::trace("%08X:  add_sp_4", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  add_sp_4", getIpOffset(ip));
         ip.next();
     }
 
     //
     // load eax, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_load_eax(vmImagePtr & ip, vmStackPtr & sp, Register & regs) {
         uint32_t value = ip.getValue<0, uint32_t>();
         regs.eax.u32 = value;
-        Console::trace("%08X:  load eax, 0x%08X", getIpOffset(ip), value);
+        if (Traced) Console::trace("%08X:  load eax, 0x%08X", getIpOffset(ip), value);
         ip.next(1 + sizeof(uint32_t));
     }
 
     //
     // store arg0, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_store(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         int8_t index = ip.getValue<0, int8_t>();
         uint32_t value = ip.getValue<0, uint32_t, uint32_t, 2>();
         fp.putArgValueUInt32(index, value);
-        Console::trace("%08X:  load args[%d], 0x%08X",
-                      getIpOffset(ip), getArgIndex(index), value);
+        if (Traced) Console::trace("%08X:  load args[%d], 0x%08X",
+                                  getIpOffset(ip), getArgIndex(index), value);
         ip.next(1 + sizeof(int8_t) + sizeof(uint32_t));
     }
 
     //
     // move arg0, arg1
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_move(vmImagePtr & ip, vmStackPtr & sp) {
-        Console::trace("%08X:  move args[%d], args[%d]", getIpOffset(ip), 0, 1);
+        if (Traced) Console::trace("%08X:  move args[%d], args[%d]", getIpOffset(ip), 0, 1);
         ip.next();
     }
 
     //
     // move eax, arg1
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_move_to_eax(vmImagePtr & ip, vmStackPtr & sp) {
-        Console::trace("%08X:  move eax, args[%d]", getIpOffset(ip), 0);
+        if (Traced) Console::trace("%08X:  move eax, args[%d]", getIpOffset(ip), 0);
         ip.next();
     }
 
     //
     // copy arg0, eax
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_copy_from_eax(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp, Register & regs) {
         int8_t index = ip.getValue<0, int8_t>();
         uint32_t value = regs.eax.u32;
         fp.putArgValueUInt32(index, value);
-        Console::trace("%08X:  copy args[%d], eax = (0x%08X)",
-                      getIpOffset(ip), getArgIndex(index), value);
+        if (Traced) Console::trace("%08X:  copy args[%d], eax = (0x%08X)",
+                                  getIpOffset(ip), getArgIndex(index), value);
         ip.next(1 + sizeof(int8_t));
     }
 
+    template <bool Traced = true>
     JM_FORCEINLINE void op_cmp(vmImagePtr & ip, vmStackPtr & sp) {
-        Console::trace("%08X:  cmp", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  cmp", getIpOffset(ip));
         ip.next();
     }
 
     //
     // cmp arg0, arg1 (int32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_cmp_i32(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index1 = ip.getValue<0, int8_t>();
@@ -1315,23 +1889,26 @@ public:
         int32_t value2 = fp.getArgValueInt32(index2);
         ip.next(1 + sizeof(int8_t) * 2);
 
-        Console::trace("%08X:  cmp  args[%d], args[%d] - (%d, %d) (int32)",
-                      offset, getArgIndex(index1), getArgIndex(index2),
-                      value1, value2);
+        if (Traced) Console::trace("%08X:  cmp  args[%d], args[%d] - (%d, %d) (int32)",
+                                  offset, getArgIndex(index1), getArgIndex(index2),
+                                  value1, value2);
 
         unsigned char jmpType = ip.getUInt8();
         bool condition = this_type::getCondition(value1, value2, jmpType);
         flags.u32.low = (uint32_t)condition;
-        if (likely(!condition))
-            Console::trace("%08X:  cmp  condition [false]", offset);
-        else
-            Console::trace("%08X:  cmp  condition [true]", offset);
+        if (Traced) {
+            if (likely(!condition))
+                Console::trace("%08X:  cmp  condition [false]", offset);
+            else
+                Console::trace("%08X:  cmp  condition [true]", offset);
+        }
         return condition;
     }
 
     //
     // cmp arg0, arg1 (uint32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_cmp_u32(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index1 = ip.getValue<0, int8_t>();
@@ -1340,23 +1917,26 @@ public:
         uint32_t value2 = fp.getArgValueUInt32(index2);
         ip.next(1 + sizeof(int8_t) * 2);
 
-        Console::trace("%08X:  cmp  args[%d], args[%d] - (%u, %u) (uint32)",
-                      offset, getArgIndex(index1), getArgIndex(index2),
-                      value1, value2);
+        if (Traced) Console::trace("%08X:  cmp  args[%d], args[%d] - (%u, %u) (uint32)",
+                                  offset, getArgIndex(index1), getArgIndex(index2),
+                                  value1, value2);
 
         unsigned char jmpType = ip.getUInt8();
         bool condition = this_type::getCondition(value1, value2, jmpType);
         flags.u32.low = (uint32_t)condition;
-        if (likely(!condition))
-            Console::trace("%08X:  cmp  condition [false]", offset);
-        else
-            Console::trace("%08X:  cmp  condition [true]", offset);
+        if (Traced) {
+            if (likely(!condition))
+                Console::trace("%08X:  cmp  condition [false]", offset);
+            else
+                Console::trace("%08X:  cmp  condition [true]", offset);
+        }
         return condition;
     }
 
     //
     // cmp arg0, 0x00000008 (int32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_cmp_imm_i32(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1364,22 +1944,25 @@ public:
         int32_t value2 = ip.getValue<0, int32_t, int32_t, 2>();
         ip.next(1 + sizeof(int8_t) + sizeof(int32_t));
 
-        Console::trace("%08X:  cmp  args[%d], 0x%08X (int32)",
-                      offset, getArgIndex(index), value2);
+        if (Traced) Console::trace("%08X:  cmp  args[%d], 0x%08X (int32)",
+                                  offset, getArgIndex(index), value2);
 
         unsigned char jmpType = ip.getUInt8();
         bool condition = this_type::getCondition(value1, value2, jmpType);
         flags.u32.low = (uint32_t)condition;
-        if (likely(!condition))
-            Console::trace("%08X:  cmp  condition [false]", offset);
-        else
-            Console::trace("%08X:  cmp  condition [true]", offset);
+        if (Traced) {
+            if (likely(!condition))
+                Console::trace("%08X:  cmp  condition [false]", offset);
+            else
+                Console::trace("%08X:  cmp  condition [true]", offset);
+        }
         return condition;
     }
 
     //
     // cmp arg0, 0x00000008 (uint32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_cmp_imm_u32(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1387,39 +1970,43 @@ public:
         uint32_t value2 = ip.getValue<0, uint32_t, uint32_t, 2>();
         ip.next(1 + sizeof(int8_t) + sizeof(uint32_t));
 
-        Console::trace("%08X:  cmp  args[%d], 0x%08X (uint32)",
-                      offset, getArgIndex(index), value2);
+        if (Traced) Console::trace("%08X:  cmp  args[%d], 0x%08X (uint32)",
+                                  offset, getArgIndex(index), value2);
 
         unsigned char jmpType = ip.getUInt8();
         bool condition = this_type::getCondition(value1, value2, jmpType);
         flags.u32.low = (uint32_t)condition;
-        if (likely(!condition))
-            Console::trace("%08X:  cmp  condition [false]", offset);
-        else
-            Console::trace("%08X:  cmp  condition [true]", offset);
+        if (Traced) {
+            if (likely(!condition))
+                Console::trace("%08X:  cmp  condition [false]", offset);
+            else
+                Console::trace("%08X:  cmp  condition [true]", offset);
+        }
         return condition;
     }
 
+    template <bool Traced = true>
     JM_FORCEINLINE void op_jl(vmImagePtr & ip) {
-        Console::trace("%08X:  jl", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  jl", getIpOffset(ip));
         ip.next();
     }
 
     //
     // jl_near 0x06
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_jl_near(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int8_t jmpOffset = ip.getValue<0, int8_t>();
         if (likely(flags.u32.low != (uint32_t)true)) {
             ip.next(1 + sizeof(int8_t));
             uint32_t jmpEntry = getIpOffset(ip) + jmpOffset;
-            Console::trace("%08X:  jl   0x%08X (near)", offset, jmpEntry);
+            if (Traced) Console::trace("%08X:  jl   0x%08X (near)", offset, jmpEntry);
             return false;
         }
         else {
             ip.next(1L + sizeof(int8_t) + jmpOffset);
-            Console::trace("%08X:  jl   0x%08X (near)", offset, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  jl   0x%08X (near)", offset, getIpOffset(ip));
             return true;
         }
     }
@@ -1427,18 +2014,19 @@ public:
     //
     // jl_short 0x16, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_jl_short(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int16_t jmpOffset = ip.getValue<0, int16_t>();
         if (likely(flags.u32.low != (uint32_t)true)) {
             ip.next(1 + sizeof(int16_t));
             uint32_t jmpEntry = getIpOffset(ip) + jmpOffset;
-            Console::trace("%08X:  jl   0x%08X (short)", offset, jmpEntry);
+            if (Traced) Console::trace("%08X:  jl   0x%08X (short)", offset, jmpEntry);
             return false;
         }
         else {
             ip.next(1L + sizeof(int16_t) + jmpOffset);
-            Console::trace("%08X:  jl   0x%08X (short)", offset, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  jl   0x%08X (short)", offset, getIpOffset(ip));
             return true;
         }
     }
@@ -1446,18 +2034,19 @@ public:
     //
     // jl_long 0x29, 0x00, 0x00, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_jl_long(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int32_t jmpOffset = ip.getValue<0, int32_t>();
         if (likely(flags.u32.low != (uint32_t)true)) {
             ip.next(1 + sizeof(int32_t));
             uint32_t jmpEntry = getIpOffset(ip) + jmpOffset;
-            Console::trace("%08X:  jl   0x%08X (long)", offset, jmpEntry);
+            if (Traced) Console::trace("%08X:  jl   0x%08X (long)", offset, jmpEntry);
             return false;
         }
         else {
             ip.next(1L + sizeof(int8_t) + jmpOffset);
-            Console::trace("%08X:  jl   0x%08X (long)", offset, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  jl   0x%08X (long)", offset, getIpOffset(ip));
             return true;
         }
     }
@@ -1465,46 +2054,51 @@ public:
     //
     // jmp 0x00102030 (ptr32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_jmp(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         uint32_t jmpEntry = ip.getValue<0, uint32_t>();
         ip.set(image_.getStart() + jmpEntry);
-        Console::trace("%08X:  jmp  0x%08X (ptr32)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  jmp  0x%08X (ptr32)", offset, getIpOffset(ip));
     }
 
     //
     // jmp_near 0x08
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_jmp_near(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int8_t jmpOffset = ip.getValue<0, int8_t>();
         ip.next(1L + sizeof(int8_t) + jmpOffset);
-        Console::trace("%08X:  jmp  0x%08X (near)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  jmp  0x%08X (near)", offset, getIpOffset(ip));
     }
 
     //
     // jmp_short 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_jmp_short(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int16_t jmpOffset = ip.getValue<0, int16_t>();
         ip.next(1L + sizeof(int16_t) + jmpOffset);
-        Console::trace("%08X:  jmp  0x%08X (short)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  jmp  0x%08X (short)", offset, getIpOffset(ip));
     }
 
     //
     // jmp_long 0x18, 0x00, 0x00, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_jmp_long(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int32_t jmpOffset = ip.getValue<0, int32_t>();
         ip.next(1L + sizeof(int32_t) + jmpOffset);
-        Console::trace("%08X:  jmp  0x%08X (long)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  jmp  0x%08X (long)", offset, getIpOffset(ip));
     }
 
     //
     // call 0x00102030 (ptr32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_call(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         uint32_t callEntry = ip.getValue<0, uint32_t>();
@@ -1517,12 +2111,13 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X (ptr32)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X (ptr32)", offset, getIpOffset(ip));
     }
 
     //
     // call_near 0x08
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_call_near(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t callOffset = ip.getValue<0, int8_t>();
@@ -1535,12 +2130,13 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X (near)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X (near)", offset, getIpOffset(ip));
     }
 
     //
     // call_short 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_call_short(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int16_t callOffset = ip.getValue<0, int16_t>();
@@ -1553,12 +2149,13 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X (short)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X (short)", offset, getIpOffset(ip));
     }
 
     //
     // call_long 0x18, 0x00, 0x00, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_call_long(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int32_t callOffset = ip.getValue<0, int32_t>();
@@ -1571,24 +2168,25 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X (long)",
-                      offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X (long)",
+                                  offset, getIpOffset(ip));
     }
 
     //
     // ret
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_ret(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         void * returnIP = pop_callstack(sp, fp);
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret  0x%08X", offset, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  ret  0x%08X", offset, getIpOffset(ip));
             return false;
         }
         else {
-            Console::trace("%08X:  ret  (done)", offset);
+            if (Traced) Console::trace("%08X:  ret  (done)", offset);
             return true;
         }
     }
@@ -1596,6 +2194,7 @@ public:
     //
     // ret_n_sm 0x08
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_ret_n_sm(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         uint8_t localSize = ip.getValue<0, uint8_t>();
@@ -1603,12 +2202,12 @@ public:
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret_n_sm [%u] 0x%08X",
-                          offset, (uint32_t)localSize, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  ret_n_sm [%u] 0x%08X",
+                                      offset, (uint32_t)localSize, getIpOffset(ip));
             return false;
         }
         else {
-            Console::trace("%08X:  ret_n_sm [%u] (done)", offset, (uint32_t)localSize);
+            if (Traced) Console::trace("%08X:  ret_n_sm [%u] (done)", offset, (uint32_t)localSize);
             return true;
         }
     }
@@ -1616,6 +2215,7 @@ public:
     //
     // ret_n 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_ret_n(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         uint16_t localSize = ip.getValue<0, uint16_t>();
@@ -1623,12 +2223,12 @@ public:
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret_n [%u] 0x%08X",
-                          offset, (uint32_t)localSize, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  ret_n [%u] 0x%08X",
+                                      offset, (uint32_t)localSize, getIpOffset(ip));
             return false;
         }
         else {
-            Console::trace("%08X:  ret_n [%u] (done)", offset, (uint32_t)localSize);
+            if (Traced) Console::trace("%08X:  ret_n [%u] (done)", offset, (uint32_t)localSize);
             return true;
         }
     }
@@ -1636,6 +2236,7 @@ public:
     //
     // ret_eax 0x00000001
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_ret_eax(vmImagePtr & ip, vmStackPtr & sp,
                                    vmFramePtr & fp, Register & regs) {
         uint32_t offset = getIpOffset(ip);
@@ -1646,12 +2247,12 @@ public:
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret_eax 0x%08X (eax = 0x%08X)",
-                          offset, getIpOffset(ip), value);
+            if (Traced) Console::trace("%08X:  ret_eax 0x%08X (eax = 0x%08X)",
+                                      offset, getIpOffset(ip), value);
             return false;
         }
         else {
-            Console::trace("%08X:  ret_eax (done) (eax = 0x%08X)", offset, value);
+            if (Traced) Console::trace("%08X:  ret_eax (done) (eax = 0x%08X)", offset, value);
             return true;
         }
     }
@@ -1659,6 +2260,7 @@ public:
     //
     // ret_eax_n 0x08, 0x00, 0x00000001
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_ret_eax_n(vmImagePtr & ip, vmStackPtr & sp,
                                      vmFramePtr & fp, Register & regs) {
         uint32_t offset = getIpOffset(ip);
@@ -1670,13 +2272,13 @@ public:
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret_eax_n [%u] 0x%08X (eax = 0x%08X)",
-                          offset, (uint32_t)localSize, getIpOffset(ip), value);
+            if (Traced) Console::trace("%08X:  ret_eax_n [%u] 0x%08X (eax = 0x%08X)",
+                                      offset, (uint32_t)localSize, getIpOffset(ip), value);
             return false;
         }
         else {
-            Console::trace("%08X:  ret_eax_n [%u] (eax = 0x%08X) (done)",
-                          offset, (uint32_t)localSize, value);
+            if (Traced) Console::trace("%08X:  ret_eax_n [%u] (eax = 0x%08X) (done)",
+                                      offset, (uint32_t)localSize, value);
             return true;
         }
     }
@@ -1684,6 +2286,7 @@ public:
     //
     // inline_call_near 0x08
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_inline_call_near(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp,
                                             vmStackPtr & cp, int retType) {
         uint32_t offset = getIpOffset(ip);
@@ -1697,12 +2300,13 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X (near)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X (near)", offset, getIpOffset(ip));
     }
 
     //
     // inline_call_short 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_inline_call_short(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp,
                                              vmStackPtr & cp, int retType) {
         uint32_t offset = getIpOffset(ip);
@@ -1716,12 +2320,13 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X (short)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X (short)", offset, getIpOffset(ip));
     }
 
     //
     // inline_call_long 0x18, 0x00, 0x00, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_inline_call_long(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp,
                                             vmStackPtr & cp, int retType) {
         uint32_t offset = getIpOffset(ip);
@@ -1735,12 +2340,13 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X (long)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X (long)", offset, getIpOffset(ip));
     }
 
     //
     // ret
     //
+    template <bool Traced = true>
     JM_FORCEINLINE int op_inline_ret(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp,
                                      vmStackPtr & cp, bool & done) {
         uint32_t offset = getIpOffset(ip);
@@ -1750,11 +2356,11 @@ public:
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret  0x%08X", offset, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  ret  0x%08X", offset, getIpOffset(ip));
             done = false;
         }
         else {
-            Console::trace("%08X:  ret  (done)", offset);
+            if (Traced) Console::trace("%08X:  ret  (done)", offset);
             done = true;
         }
 
@@ -1764,6 +2370,7 @@ public:
     //
     // ret_n 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE int op_inline_ret_n(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp,
                                        vmStackPtr & cp, bool & done) {
         uint32_t offset = getIpOffset(ip);
@@ -1774,12 +2381,12 @@ public:
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret_n [%u] 0x%08X",
-                          offset, (uint32_t)localSize, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  ret_n [%u] 0x%08X",
+                                      offset, (uint32_t)localSize, getIpOffset(ip));
             done = false;
         }
         else {
-            Console::trace("%08X:  ret_n [%u] (done)", offset, (uint32_t)localSize);
+            if (Traced) Console::trace("%08X:  ret_n [%u] (done)", offset, (uint32_t)localSize);
             done = true;
         }
 
@@ -1789,6 +2396,7 @@ public:
     //
     // ret_eax 0x00000001
     //
+    template <bool Traced = true>
     JM_FORCEINLINE int op_inline_ret_eax(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp,
                                          vmStackPtr & cp, Register & regs, bool & done) {
         uint32_t offset = getIpOffset(ip);
@@ -1800,12 +2408,12 @@ public:
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret_eax 0x%08X (eax = 0x%08X)",
-                          offset, getIpOffset(ip), value);
+            if (Traced) Console::trace("%08X:  ret_eax 0x%08X (eax = 0x%08X)",
+                                      offset, getIpOffset(ip), value);
             done = false;
         }
         else {
-            Console::trace("%08X:  ret_eax (done) (eax = 0x%08X)", offset, value);
+            if (Traced) Console::trace("%08X:  ret_eax (done) (eax = 0x%08X)", offset, value);
             done = true;
         }
 
@@ -1815,23 +2423,26 @@ public:
     //
     // nop
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_nop(vmImagePtr & ip) {
-        Console::trace("%08X:  nop", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  nop", getIpOffset(ip));
         ip.next();
     }
 
     //
     // nop_n 0x08
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_nop_n(vmImagePtr & ip) {
         uint8_t skip_n = ip.getValue<0, uint8_t>();
-        Console::trace("%08X:  nop_n %u", getIpOffset(ip), (uint32_t)skip_n);
+        if (Traced) Console::trace("%08X:  nop_n %u", getIpOffset(ip), (uint32_t)skip_n);
         ip.next(1 + sizeof(uint8_t) + skip_n);
     }
 
     //
     // inc arg0
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_inc(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1839,14 +2450,15 @@ public:
         value++;
         fp.putArgValueUInt32(index, value);
 
-        Console::trace("%08X:  inc  arg[%d]  (0x%08X)",
-                      offset, getArgIndex(index), value);
+        if (Traced) Console::trace("%08X:  inc  arg[%d]  (0x%08X)",
+                                  offset, getArgIndex(index), value);
         ip.next(1 + sizeof(int8_t));
     }
 
     //
     // dec arg0
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_dec(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1854,14 +2466,15 @@ public:
         value--;
         fp.putArgValueUInt32(index, value);
 
-        Console::trace("%08X:  dec  args[%d]  (0x%08X)",
-                      offset, getArgIndex(index), value);
+        if (Traced) Console::trace("%08X:  dec  args[%d]  (0x%08X)",
+                                  offset, getArgIndex(index), value);
         ip.next(1 + sizeof(int8_t));
     }
 
     //
     // add arg0, arg1
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index1 = ip.getValue<0, int8_t>();
@@ -1872,15 +2485,16 @@ public:
         uint32_t newValue = value1 + value2;
         fp.putArgValueUInt32(index1, newValue);
 
-        Console::trace("%08X:  add  args[%d], args[%d] = (0x%08X)",
-                      offset, getArgIndex(index1), getArgIndex(index2),
-                      newValue);
+        if (Traced) Console::trace("%08X:  add  args[%d], args[%d] = (0x%08X)",
+                                  offset, getArgIndex(index1), getArgIndex(index2),
+                                  newValue);
         ip.next(1 + sizeof(int8_t) * 2);
     }
 
     //
     // add arg0, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add_imm(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1890,14 +2504,15 @@ public:
         uint32_t newValue = value1 + value2;
         fp.putArgValueUInt32(index, newValue);
 
-        Console::trace("%08X:  add  args[%d], 0x%08X = (0x%08X)",
-                      offset, getArgIndex(index), value2, newValue);
+        if (Traced) Console::trace("%08X:  add  args[%d], 0x%08X = (0x%08X)",
+                                  offset, getArgIndex(index), value2, newValue);
         ip.next(1 + sizeof(int8_t) + sizeof(uint32_t));
     }
 
     //
     // add eax, arg0
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add_eax(vmImagePtr & ip, vmFramePtr & fp, Register & regs) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1906,14 +2521,15 @@ public:
         uint32_t newValue = regs.eax.u32 + value;
         regs.eax.u32 = newValue;
 
-        Console::trace("%08X:  add  eax, args[%d] = (0x%08X)",
-                      offset, getArgIndex(index), newValue);
+        if (Traced) Console::trace("%08X:  add  eax, args[%d] = (0x%08X)",
+                                  offset, getArgIndex(index), newValue);
         ip.next(1 + sizeof(int8_t));
     }
 
     //
     // add eax, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add_eax_imm(vmImagePtr & ip, Register & regs) {
         uint32_t offset = getIpOffset(ip);
         uint32_t value = ip.getValue<0, uint32_t, uint32_t>();
@@ -1921,14 +2537,15 @@ public:
         uint32_t newValue = regs.eax.u32 + value;
         regs.eax.u32 = newValue;
 
-        Console::trace("%08X:  add  eax, 0x%08X = (0x%08X)",
-                      offset, value, newValue);
+        if (Traced) Console::trace("%08X:  add  eax, 0x%08X = (0x%08X)",
+                                  offset, value, newValue);
         ip.next(1 + sizeof(uint32_t));
     }
 
     //
     // sub arg0, arg1
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_sub(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index1 = ip.getValue<0, int8_t>();
@@ -1938,15 +2555,16 @@ public:
         uint32_t newValue = value1 - value2;
         fp.putArgValueUInt32(index1, newValue);
 
-        Console::trace("%08X:  sub  args[%d], args[%d] = (0x%08X)",
-                      offset, getArgIndex(index1), getArgIndex(index2),
-                      newValue);
+        if (Traced) Console::trace("%08X:  sub  args[%d], args[%d] = (0x%08X)",
+                                  offset, getArgIndex(index1), getArgIndex(index2),
+                                  newValue);
         ip.next(1 + sizeof(int8_t) * 2);
     }
 
     //
     // sub arg0, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_sub_imm(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1956,14 +2574,15 @@ public:
         uint32_t newValue = value1 - value2;
         fp.putArgValueUInt32(index, newValue);
 
-        Console::trace("%08X:  sub  args[%d], 0x%08X = (0x%08X)",
-                      offset, getArgIndex(index), value2, newValue);
+        if (Traced) Console::trace("%08X:  sub  args[%d], 0x%08X = (0x%08X)",
+                                  offset, getArgIndex(index), value2, newValue);
         ip.next(1 + sizeof(int8_t) + sizeof(uint32_t));
     }
 
     //
     // sub eax, arg0
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_sub_eax(vmImagePtr & ip, vmFramePtr & fp, Register & regs) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1971,14 +2590,15 @@ public:
         uint32_t newValue = regs.eax.u32 - value;
         regs.eax.u32 = newValue;
 
-        Console::trace("%08X:  sub  eax, args[%d] = (0x%08X)",
-                      offset, getArgIndex(index), newValue);
+        if (Traced) Console::trace("%08X:  sub  eax, args[%d] = (0x%08X)",
+                                  offset, getArgIndex(index), newValue);
         ip.next(1 + sizeof(int8_t));
     }
 
     //
     // add eax, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_sub_eax_imm(vmImagePtr & ip, Register & regs) {
         uint32_t offset = getIpOffset(ip);
         uint32_t value = ip.getValue<0, uint32_t>();
@@ -1986,49 +2606,118 @@ public:
         uint32_t newValue = regs.eax.u32 - value;
         regs.eax.u32 = newValue;
 
-        Console::trace("%08X:  sub  eax, 0x%08X = (0x%08X)",
-                      offset, value, newValue);
+        if (Traced) Console::trace("%08X:  sub  eax, 0x%08X = (0x%08X)",
+                                  offset, value, newValue);
         ip.next(1 + sizeof(uint32_t));
     }
 
     //
     // Exit the program
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_exit(vmImagePtr & ip, return_type & retValue) {
-        Console::trace("%08X:  end", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  end", getIpOffset(ip));
         ip.next();
     }
 
     //
     // Unknown opcode.
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_unknown(vmImagePtr & ip, unsigned char opcode) {
-        Console::trace("%08X:  Error: Unknown opcode: %u", getIpOffset(ip), (uint32_t)opcode);
+        if (Traced) Console::trace("%08X:  Error: Unknown opcode: %u", getIpOffset(ip), (uint32_t)opcode);
         ip.next();
     }
 
+#if USE_VM_SAFEPOINTS
+#define V3_SAFEPOINT(cost) \
+                    if (Pausable && unlikely(safepoint_.charge(cost))) { \
+                        ec = stopAtSafepoint(ip, sp, fp, regs); \
+                        if (ec != Error::Ok) \
+                            return ec; \
+                    }
+#else
+#define V3_SAFEPOINT(cost)
+#endif // USE_VM_SAFEPOINTS
+
+// A backward branch costs the bytes of code it jumps back over.
+#define V3_BACKWARD_SAFEPOINT(insn) \
+                    if (Pausable && ip.ptr() <= (insn)) { \
+                        V3_SAFEPOINT((int32_t)((insn) - ip.ptr()) + 1); \
+                    }
+
     //
-    // Execute the vm bytecode.
+    // Handle the interrupt at a safepoint, return Error::Ok to go on. The
+    // paused context and the context that's out of fuel save their
+    // registers, they can be resumed or saved to a snapshot.
     //
-    int execute(return_type & retVal) {
-        int ec = 0;
-        if (isInited()) {
-            register vmImagePtr ip;
-            register vmStackPtr sp;
-            register vmFramePtr fp;
-            register Register   regs;
+    int stopAtSafepoint(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp, Register & regs) {
+        int ec;
+        switch (safepoint_.poll()) {
+        case vmInterrupt::Pause:
+            ec = Error::Safepoint_Paused;
+            break;
+        case vmInterrupt::OutOfFuel:
+            ec = Error::Safepoint_Out_Of_Fuel;
+            break;
+        case vmInterrupt::Yield:
+            ec = Error::Safepoint_Yielded;
+            break;
+        case vmInterrupt::Abort:
+            reset();
+            return Error::Safepoint_Aborted;
+        default:
+            return Error::Ok;
+        }
+        ip_.set(ip.ptr());
+        sp_.set(sp.ptr());
+        fp_.set(fp.ptr());
+        regs_ = regs;
+        safepoint_.setSuspended(true);
+        return ec;
+    }
 
-            // Init environment
-            ip.set(image_.getPtr());
-            sp.set(stack_.current());
-            fp.set(stack_.current());
-            regs.uval = 0;
+    //
+    // Execute the vm bytecode.
+    //
+    int execute(return_type & retVal) {
+        return execute_impl<false>(retVal, false);
+    }
 
-            // Push call program entry.
-            push_callstack(sp, fp, nullptr);
+    //
+    // Execute the vm bytecode. If Pausable is true, the calls and the
+    // backward branches are the safepoints, and the resumed run starts from
+    // the registers that are saved at the safepoint.
+    //
+    template <bool Pausable>
+    int execute_impl(return_type & retVal, bool isResume) {
+        int ec = 0;
+        if (isInited()) {
+            register vmImagePtr ip;
+            register vmStackPtr sp;
+            register vmFramePtr fp;
+            register Register   regs;
+
+            if (Pausable && isResume) {
+                ip.set(ip_.ptr());
+                sp.set(sp_.ptr());
+                fp.set(fp_.ptr());
+                regs = regs_;
+            }
+            else {
+                // Init environment
+                ip.set(image_.getPtr());
+                sp.set(stack_.current());
+                fp.set(stack_.current());
+                regs.uval = 0;
+
+                // Push call program entry.
+                push_callstack(sp, fp, nullptr);
+            }
 
             // Main loop
             while (ip.ptr() < image_.getLimit()) {
+                unsigned char * insn = ip.ptr();
                 unsigned char opcode = ip.getUInt8();
                 switch (opcode) {
                 case OpCode::error:
@@ -2121,46 +2810,57 @@ public:
 
                 case OpCode::jl_near:
                     op_jl_near(ip);
+                    V3_BACKWARD_SAFEPOINT(insn);
                     break;
 
                 case OpCode::jl_short:
                     op_jl_short(ip);
+                    V3_BACKWARD_SAFEPOINT(insn);
                     break;
 
                 case OpCode::jl_long:
                     op_jl_long(ip);
+                    V3_BACKWARD_SAFEPOINT(insn);
                     break;
 
                 case OpCode::jmp:
                     op_jmp(ip);
+                    V3_BACKWARD_SAFEPOINT(insn);
                     break;
 
                 case OpCode::jmp_near:
                     op_jmp_near(ip);
+                    V3_BACKWARD_SAFEPOINT(insn);
                     break;
 
                 case OpCode::jmp_short:
                     op_jmp_short(ip);
+                    V3_BACKWARD_SAFEPOINT(insn);
                     break;
 
                 case OpCode::jmp_long:
                     op_jmp_long(ip);
+                    V3_BACKWARD_SAFEPOINT(insn);
                     break;
 
                 case OpCode::call:
                     op_call(ip, sp, fp);
+                    V3_SAFEPOINT(vmSafepoint::kCallCost);
                     break;
 
                 case OpCode::call_near:
                     op_call_near(ip, sp, fp);
+                    V3_SAFEPOINT(vmSafepoint::kCallCost);
                     break;
 
                 case OpCode::call_short:
                     op_call_short(ip, sp, fp);
+                    V3_SAFEPOINT(vmSafepoint::kCallCost);
                     break;
 
                 case OpCode::call_long:
                     op_call_long(ip, sp, fp);
+                    V3_SAFEPOINT(vmSafepoint::kCallCost);
                     break;
 
                 case OpCode::ret:
@@ -2272,242 +2972,2206 @@ Execute_Finished:
         return ec;
     }
 
-    enum {
-        ret_first,
-        ret_00,
-        ret_01,
-        ret_02,
-        ret_last
-    };
+#undef V3_SAFEPOINT
+#undef V3_BACKWARD_SAFEPOINT
 
-    int execute_inline(return_type & retVal) {
+#if USE_COMPUTED_GOTO
+
+#define VM_DISPATCH_NEXT()                              \
+    do {                                                \
+        if (likely(!Checked || ip.ptr() < ipLimit))     \
+            goto *dispatchTable[ip.getUInt8()];         \
+        else                                            \
+            goto Execute_Finished;                      \
+    } while (0)
+
+#define VM_DISPATCH_CALL()                              \
+    do {                                                \
+        if (likely(!checkFrame || !sp_isOverflow(sp, maxFrameSize))) \
+            VM_DISPATCH_NEXT();                         \
+        else                                            \
+            goto Stack_Overflow;                        \
+    } while (0)
+
+#define VM_DISPATCH_RET(isDone)                         \
+    do {                                                \
+        if (likely(!(isDone)))                          \
+            VM_DISPATCH_NEXT();                         \
+        else                                            \
+            goto Execute_Finished;                      \
+    } while (0)
+
+    //
+    // Execute the vm bytecode, direct-threaded dispatch (computed goto).
+    //
+    // Every handler jumps to the next handler by itself, so the indirect
+    // branch is replicated at the end of each handler instead of being
+    // shared by a single switch, it gives the branch predictor one
+    // history per opcode.
+    //
+    // If Checked is false, the image must be verified, the ip isn't checked
+    // against the end of image, and the stack space for the whole frame is
+    // checked once per call instead, or never if the frame is less than the
+    // guard region of the stack.
+    //
+    // The handlers don't trace. If handlerTable is not null, only fill the
+    // handler addresses and return, see fillThreadedTable().
+    //
+    template <bool Checked>
+    int execute_threaded_impl(return_type & retVal, const void ** handlerTable = nullptr) {
         int ec = 0;
+        if (handlerTable != nullptr) {
+            // GCC 12 takes the labels for the local variables, but their
+            // addresses never dangle.
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 12)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdangling-pointer"
+#endif
+            for (size_t i = 0; i < kMaxHandlers; ++i) {
+                handlerTable[i] = &&Op_unknown;
+            }
+
+            handlerTable[OpCode::error]         = &&Op_error;
+            handlerTable[OpCode::push]          = &&Op_push;
+            handlerTable[OpCode::push_i32]      = &&Op_push_i32;
+            handlerTable[OpCode::push_i64]      = &&Op_push_i64;
+            handlerTable[OpCode::push_i32_0]    = &&Op_push_i32_0;
+            handlerTable[OpCode::push_i64_0]    = &&Op_push_i64_0;
+            handlerTable[OpCode::pop]           = &&Op_pop;
+            handlerTable[OpCode::pop_i32]       = &&Op_pop_i32;
+            handlerTable[OpCode::pop_i64]       = &&Op_pop_i64;
+            handlerTable[OpCode::add_sp]        = &&Op_add_sp;
+            handlerTable[OpCode::add_sp_4]      = &&Op_add_sp_4;
+            handlerTable[OpCode::load_eax]      = &&Op_load_eax;
+            handlerTable[OpCode::store]         = &&Op_store;
+            handlerTable[OpCode::move]          = &&Op_move;
+            handlerTable[OpCode::move_to_eax]   = &&Op_move_to_eax;
+            handlerTable[OpCode::copy_from_eax] = &&Op_copy_from_eax;
+            handlerTable[OpCode::cmp]           = &&Op_cmp;
+            handlerTable[OpCode::cmp_i32]       = &&Op_cmp_i32;
+            handlerTable[OpCode::cmp_u32]       = &&Op_cmp_u32;
+            handlerTable[OpCode::cmp_imm_i32]   = &&Op_cmp_imm_i32;
+            handlerTable[OpCode::cmp_imm_u32]   = &&Op_cmp_imm_u32;
+            handlerTable[OpCode::jl]            = &&Op_jl;
+            handlerTable[OpCode::jl_near]       = &&Op_jl_near;
+            handlerTable[OpCode::jl_short]      = &&Op_jl_short;
+            handlerTable[OpCode::jl_long]       = &&Op_jl_long;
+            handlerTable[OpCode::jmp]           = &&Op_jmp;
+            handlerTable[OpCode::jmp_near]      = &&Op_jmp_near;
+            handlerTable[OpCode::jmp_short]     = &&Op_jmp_short;
+            handlerTable[OpCode::jmp_long]      = &&Op_jmp_long;
+            handlerTable[OpCode::call]          = &&Op_call;
+            handlerTable[OpCode::call_near]     = &&Op_call_near;
+            handlerTable[OpCode::call_short]    = &&Op_call_short;
+            handlerTable[OpCode::call_long]     = &&Op_call_long;
+            handlerTable[OpCode::ret]           = &&Op_ret;
+            handlerTable[OpCode::ret_n_sm]      = &&Op_ret_n_sm;
+            handlerTable[OpCode::ret_n]         = &&Op_ret_n;
+            handlerTable[OpCode::ret_eax]       = &&Op_ret_eax;
+            handlerTable[OpCode::ret_eax_n]     = &&Op_ret_eax_n;
+            handlerTable[OpCode::nop]           = &&Op_nop;
+            handlerTable[OpCode::nop_n]         = &&Op_nop_n;
+            handlerTable[OpCode::inc]           = &&Op_inc;
+            handlerTable[OpCode::dec]           = &&Op_dec;
+            handlerTable[OpCode::add]           = &&Op_add;
+            handlerTable[OpCode::add_imm]       = &&Op_add_imm;
+            handlerTable[OpCode::add_eax]       = &&Op_add_eax;
+            handlerTable[OpCode::add_eax_imm]   = &&Op_add_eax_imm;
+            handlerTable[OpCode::sub]           = &&Op_sub;
+            handlerTable[OpCode::sub_imm]       = &&Op_sub_imm;
+            handlerTable[OpCode::sub_eax]       = &&Op_sub_eax;
+            handlerTable[OpCode::sub_eax_imm]   = &&Op_sub_eax_imm;
+            handlerTable[OpCode::exit]          = &&Op_exit;
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 12)
+#pragma GCC diagnostic pop
+#endif
+            return ec;
+        }
+
         if (isInited()) {
             register vmImagePtr ip;
             register vmStackPtr sp;
             register vmFramePtr fp;
-            register vmStackPtr cp;
             register Register   regs;
 
+            // The handler addresses are the same for all the contexts,
+            // the table is filled once by the first run.
+            static const void * dispatchTable[kMaxHandlers];
+            static const bool dispatchTableFilled = fillThreadedTable<Checked>(dispatchTable);
+            (void)dispatchTableFilled;
+
+            unsigned char * ipLimit = image_.getLimit();
+            size_t maxFrameSize = verifyInfo_.maxFrameSize;
+            assert(Checked || verifyInfo_.verified);
+            // The frame that's less than the guard region faults on the guard.
+            bool checkFrame = !Checked && !(stack_.isGuarded() &&
+                                            maxFrameSize <= stack_.kGuardSize);
+
             // Init environment
             ip.set(image_.getPtr());
             sp.set(stack_.current());
             fp.set(stack_.current());
-            cp.set(callstack_.current());
             regs.uval = 0;
 
             // Push call program entry.
-            inline_push_callstack(sp, fp, cp, nullptr, ret_first);
+            push_callstack(sp, fp, nullptr);
 
-            // Main loop
-            bool done;
-            do {
-                op_add_sp_4(ip, sp);
-                op_push_i32(ip, sp);
-                op_inline_call_short(ip, sp, fp, cp, ret_00);
-                goto fibonacci_n;
-fibonacci_ret_00:
-                {
-                    op_pop_i32(ip, sp);
-                    int retType = op_inline_ret(ip, sp, fp, cp, done);
-                    if (likely(done)) {
-                        retVal.setDataType(return_type::Basic);
-                        retVal.setValue(regs.eax.u32);
-                        break;
-                    }
-                    else {
-                        Console::trace("Error: Unknown error.");
-                    }
-                    goto Execute_Finished;
-                }
-fibonacci_n:
-                op_cmp_imm_i32(ip, sp, fp);
-                bool is_large = op_jl_near(ip);
-                if (likely(!is_large)) {
-                    op_add_sp_4(ip, sp);
-                    op_push(ip, sp, fp);
-                    op_dec(ip, fp);
-                    op_inline_call_near(ip, sp, fp, cp, ret_01);
-                    goto fibonacci_n;
-fibonacci_ret_01:
-                    op_copy_from_eax(ip, sp, fp, regs);
-                    op_dec(ip, fp);
-                    op_inline_call_near(ip, sp, fp, cp, ret_02);
-                    goto fibonacci_n;
-fibonacci_ret_02:
-                    op_add_eax(ip, fp, regs);
-                    int retType = op_inline_ret_n(ip, sp, fp, cp, done);
-                    if (retType == ret_01)
-                        goto fibonacci_ret_01;
-                    else if (retType == ret_02)
-                        goto fibonacci_ret_02;
-                    else
-                        goto fibonacci_ret_00;
-                }
-                else {
-                    int retType = op_inline_ret_eax(ip, sp, fp, cp, regs, done);
-                    if (retType == ret_01)
-                        goto fibonacci_ret_01;
-                    else if (retType == ret_02)
-                        goto fibonacci_ret_02;
-                    else
-                        goto fibonacci_ret_00;
-                }
-            } while (1);
-        }
+            // Enter the first handler
+            VM_DISPATCH_CALL();
 
-Execute_Finished:
-        return ec;
-    }
+Op_error:
+            op_error<false>(ip);
+            VM_DISPATCH_NEXT();
 
-    int run(return_type & retVal) {
-        ip_.set(image_.getPtr());
-        sp_.set(stack_.current());
-        fp_.set(stack_.current());
-        return execute(retVal);
-    }
+Op_push:
+            op_push<false>(ip, sp, fp);
+            VM_DISPATCH_NEXT();
 
-    int run_inline(return_type & retVal) {
-        ip_.set(image_.getPtr());
-        sp_.set(stack_.current());
-        fp_.set(stack_.current());
-        return execute_inline(retVal);
-    }
-};
+Op_push_i32:
+            op_push_i32<false>(ip, sp);
+            VM_DISPATCH_NEXT();
 
-template <typename BasicType = uintptr_t>
-class ExecutionEngine {
-public:
-    typedef BasicType                       basic_type;
-    typedef size_t                          size_type;
-    typedef ExecutionContext<basic_type>    context_type;
-    typedef vmReturn<basic_type>            return_type;
-    typedef ExecutionEngine<basic_type>     this_type;
+Op_push_i64:
+            op_push_i64<false>(ip, sp);
+            VM_DISPATCH_NEXT();
 
-private:
-    vmBinaryFile binary_;
-    context_type context_;
+Op_push_i32_0:
+            op_push_i32_0<false>(ip, sp);
+            VM_DISPATCH_NEXT();
 
-public:
-    ExecutionEngine() {}
-    virtual ~ExecutionEngine() {
-        destroy();
-    }
+Op_push_i64_0:
+            op_push_i64_0<false>(ip, sp);
+            VM_DISPATCH_NEXT();
 
-    bool isInited() const { return (context_.getId() != 0); }
+Op_pop:
+            op_pop<false>(ip, sp);
+            VM_DISPATCH_NEXT();
 
-    int create() {
-        int ec = binary_.loadFromFile("test.bin");
-        if (ec <= 0) {
-            return Error::BinaryFile_Read_Failed;
-        }
+Op_pop_i32:
+            op_pop_i32<false>(ip, sp);
+            VM_DISPATCH_NEXT();
 
-        context_.setImageInfo(binary_.getImagePtr(), binary_.getImageSize(),
-                              binary_.getImageEntry());
+Op_pop_i64:
+            op_pop_i64<false>(ip, sp);
+            VM_DISPATCH_NEXT();
 
-        bool success = createContext();
-        if (!success) {
-            return Error::MainProcess_Create_Failed;
-        }
+Op_add_sp:
+            op_add_sp<false>(ip, sp);
+            VM_DISPATCH_NEXT();
 
-        return (int)success;
-    }
+Op_add_sp_4:
+            op_add_sp_4<false>(ip, sp);
+            VM_DISPATCH_NEXT();
 
-    void destroy() {
-        destroyContext();
-    }
+Op_load_eax:
+            op_load_eax<false>(ip, sp, regs);
+            VM_DISPATCH_NEXT();
 
-    bool createContext() {
-        if (!context_.isInited()) {
-            context_.create();
-        }
+Op_store:
+            op_store<false>(ip, sp, fp);
+            VM_DISPATCH_NEXT();
 
-        return context_.isInited();
-    }
+Op_move:
+            op_move<false>(ip, sp);
+            VM_DISPATCH_NEXT();
 
-    void destroyContext() {
-        if (context_.isInited()) {
-            context_.destroy();
-        }
-    }
+Op_move_to_eax:
+            op_move_to_eax<false>(ip, sp);
+            VM_DISPATCH_NEXT();
 
-    int run(return_type & ret) {
-        binary_.setInput(ret.getValue());
-        int ec = context_.run(ret);
-        return ec;
-    }
+Op_copy_from_eax:
+            op_copy_from_eax<false>(ip, sp, fp, regs);
+            VM_DISPATCH_NEXT();
 
-    int run_inline(return_type & ret) {
-        binary_.setInput(ret.getValue());
-        int ec = context_.run_inline(ret);
+Op_cmp:
+            op_cmp<false>(ip, sp);
+            VM_DISPATCH_NEXT();
+
+Op_cmp_i32:
+            op_cmp_i32<false>(ip, sp, fp);
+            VM_DISPATCH_NEXT();
+
+Op_cmp_u32:
+            op_cmp_u32<false>(ip, sp, fp);
+            VM_DISPATCH_NEXT();
+
+Op_cmp_imm_i32:
+            op_cmp_imm_i32<false>(ip, sp, fp);
+            VM_DISPATCH_NEXT();
+
+Op_cmp_imm_u32:
+            op_cmp_imm_u32<false>(ip, sp, fp);
+            VM_DISPATCH_NEXT();
+
+Op_jl:
+            op_jl<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jl_near:
+            op_jl_near<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jl_short:
+            op_jl_short<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jl_long:
+            op_jl_long<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jmp:
+            op_jmp<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jmp_near:
+            op_jmp_near<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jmp_short:
+            op_jmp_short<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jmp_long:
+            op_jmp_long<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_call:
+            op_call<false>(ip, sp, fp);
+            VM_DISPATCH_CALL();
+
+Op_call_near:
+            op_call_near<false>(ip, sp, fp);
+            VM_DISPATCH_CALL();
+
+Op_call_short:
+            op_call_short<false>(ip, sp, fp);
+            VM_DISPATCH_CALL();
+
+Op_call_long:
+            op_call_long<false>(ip, sp, fp);
+            VM_DISPATCH_CALL();
+
+Op_ret:
+            VM_DISPATCH_RET(op_ret<false>(ip, sp, fp));
+
+Op_ret_n_sm:
+            VM_DISPATCH_RET(op_ret_n_sm<false>(ip, sp, fp));
+
+Op_ret_n:
+            VM_DISPATCH_RET(op_ret_n<false>(ip, sp, fp));
+
+Op_ret_eax:
+            VM_DISPATCH_RET(op_ret_eax<false>(ip, sp, fp, regs));
+
+Op_ret_eax_n:
+            VM_DISPATCH_RET(op_ret_eax_n<false>(ip, sp, fp, regs));
+
+Op_nop:
+            op_nop<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_nop_n:
+            op_nop_n<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_inc:
+            op_inc<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_dec:
+            op_dec<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_add:
+            op_add<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_add_imm:
+            op_add_imm<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_add_eax:
+            op_add_eax<false>(ip, fp, regs);
+            VM_DISPATCH_NEXT();
+
+Op_add_eax_imm:
+            op_add_eax_imm<false>(ip, regs);
+            VM_DISPATCH_NEXT();
+
+Op_sub:
+            op_sub<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_sub_imm:
+            op_sub_imm<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_sub_eax:
+            op_sub_eax<false>(ip, fp, regs);
+            VM_DISPATCH_NEXT();
+
+Op_sub_eax_imm:
+            op_sub_eax_imm<false>(ip, regs);
+            VM_DISPATCH_NEXT();
+
+Op_exit:
+            op_exit<false>(ip, retVal);
+            goto Execute_Finished;
+
+Op_unknown:
+            op_unknown<false>(ip, ip.getUInt8());
+            VM_DISPATCH_NEXT();
+
+Stack_Overflow:
+            ec = Error::Verify_Stack_Overflow;
+
+Execute_Finished:
+            retVal.setDataType(return_type::Basic);
+            retVal.setValue(regs.eax.u32);
+        }
         return ec;
     }
-};
 
-template <typename BasicType = uintptr_t>
-class Interpreter {
-public:
-    typedef BasicType                   basic_type;
-    typedef ExecutionEngine<basic_type> engine_type;
-    typedef vmReturn<basic_type>        return_type;
-    typedef Interpreter<basic_type>     this_type;
+#undef VM_DISPATCH_NEXT
+#undef VM_DISPATCH_CALL
+#undef VM_DISPATCH_RET
 
-private:
-    engine_type engine_;
+    template <bool Checked>
+    bool fillThreadedTable(const void ** handlerTable) {
+        return_type dummy;
+        execute_threaded_impl<Checked>(dummy, handlerTable);
+        return true;
+    }
 
-public:
-    Interpreter() {}
-    ~Interpreter() {}
+    int execute_threaded(return_type & retVal) {
+        return execute_threaded_impl<true>(retVal);
+    }
 
-    int create() {
-        int ec = engine_.create();
-        return ec;
+    //
+    // Execute the verified image without the bounds checks, the image that
+    // isn't verified runs in the checked loop.
+    //
+    int execute_verified(return_type & retVal) {
+        if (verifyInfo_.verified)
+            return execute_threaded_impl<false>(retVal);
+        else
+            return execute_threaded_impl<true>(retVal);
     }
 
-    int run(return_type & ret) {
-        int ec = engine_.run(ret);
-        return ec;
+#else // !USE_COMPUTED_GOTO
+
+    //
+    // Computed goto is not supported, fallback to the switch dispatch.
+    //
+    int execute_threaded(return_type & retVal) {
+        return execute(retVal);
     }
 
-    int run_inline(return_type & ret) {
-        int ec = engine_.run_inline(ret);
-        return ec;
+    int execute_verified(return_type & retVal) {
+        return execute(retVal);
     }
-};
 
-} // namespace v3
-} // namespace jlang
+#endif // USE_COMPUTED_GOTO
+
+#define VM_INSN_PROFILE() \
+    do { if (Profiling) profile->record(ip); } while (0)
+
+#if USE_COMPUTED_GOTO
+#define VM_INSN_CASE(op)        Insn_##op:
+#define VM_SUPER_INSN_CASE(op)  Insn_##op:
+#define VM_TYPED_HANDLER(kind, type, cond) \
+    handlerTable[TypedOpCode::kind##_##cond] = &&Typed_##kind##_##cond;
+#define VM_TYPED_CMP_CASE(kind, type, cond) \
+    Typed_##kind##_##cond: { \
+        flags.u32.low = (uint32_t)jlang::op_cmp<type, vmCondType::cond>( \
+            (type)fp.getArgValueUInt32(ip->index), (type)fp.getArgValueUInt32(ip->index2)); \
+        ip++; \
+        VM_INSN_NEXT(); \
+    }
+#define VM_TYPED_CMP_IMM_CASE(kind, type, cond) \
+    Typed_##kind##_##cond: { \
+        flags.u32.low = (uint32_t)jlang::op_cmp<type, vmCondType::cond>( \
+            (type)fp.getArgValueUInt32(ip->index), (type)ip->imm.u32); \
+        ip++; \
+        VM_INSN_NEXT(); \
+    }
+#define VM_INSN_DEFAULT()       Insn_unknown:
+#define VM_INSN_NEXT() \
+    do { VM_INSN_PROFILE(); goto *(ip->handler); } while (0)
+#else
+#define VM_INSN_CASE(op)        case OpCode::op:
+#define VM_SUPER_INSN_CASE(op)  case SuperOpCode::op:
+#define VM_INSN_DEFAULT()       default:
+#define VM_INSN_NEXT()          goto Insn_Dispatch
+#endif
+
+    //
+    // Execute the pre-decoded records, indirect-threaded dispatch.
+    //
+    // The operands are read from the widened record fields and the targets
+    // were resolved at load time, if handlerTable is not null, only fill
+    // the handler addresses that used by the PreDecoder and return.
+    //
+    // If Profiling is true, every dispatch is recorded to the profile, the
+    // handler addresses of the two versions can't be mixed. If Growable is
+    // true, the calls grow the growable stack, it's the loop of the
+    // growable stack only, see createGrowable().
+    //
+    template <bool Profiling, bool Growable = false>
+    int execute_predecoded_impl(return_type & retVal, const void ** handlerTable,
+                                vmOpcodeProfile * profile) {
+        int ec = 0;
+        if (handlerTable != nullptr) {
+#if USE_COMPUTED_GOTO
+            // GCC 12 takes the labels for the local variables, but their
+            // addresses never dangle.
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 12)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdangling-pointer"
+#endif
+            for (size_t i = 0; i < kMaxHandlers; ++i) {
+                handlerTable[i] = &&Insn_unknown;
+            }
+
+            handlerTable[OpCode::error]         = &&Insn_error;
+            handlerTable[OpCode::push]          = &&Insn_push;
+            handlerTable[OpCode::push_i32]      = &&Insn_push_i32;
+            handlerTable[OpCode::push_i64]      = &&Insn_push_i64;
+            handlerTable[OpCode::push_i32_0]    = &&Insn_push_i32_0;
+            handlerTable[OpCode::push_i64_0]    = &&Insn_push_i64_0;
+            handlerTable[OpCode::pop]           = &&Insn_pop;
+            handlerTable[OpCode::pop_i32]       = &&Insn_pop_i32;
+            handlerTable[OpCode::pop_i64]       = &&Insn_pop_i64;
+            handlerTable[OpCode::add_sp]        = &&Insn_add_sp;
+            handlerTable[OpCode::add_sp_4]      = &&Insn_add_sp_4;
+            handlerTable[OpCode::load_eax]      = &&Insn_load_eax;
+            handlerTable[OpCode::store]         = &&Insn_store;
+            handlerTable[OpCode::move]          = &&Insn_move;
+            handlerTable[OpCode::move_to_eax]   = &&Insn_move_to_eax;
+            handlerTable[OpCode::copy_from_eax] = &&Insn_copy_from_eax;
+            handlerTable[OpCode::cmp]           = &&Insn_cmp;
+            handlerTable[OpCode::cmp_i32]       = &&Insn_cmp_i32;
+            handlerTable[OpCode::cmp_u32]       = &&Insn_cmp_u32;
+            handlerTable[OpCode::cmp_imm_i32]   = &&Insn_cmp_imm_i32;
+            handlerTable[OpCode::cmp_imm_u32]   = &&Insn_cmp_imm_u32;
+            handlerTable[OpCode::jl]            = &&Insn_jl;
+            handlerTable[OpCode::jl_near]       = &&Insn_jl_near;
+            handlerTable[OpCode::jl_short]      = &&Insn_jl_short;
+            handlerTable[OpCode::jl_long]       = &&Insn_jl_long;
+            handlerTable[OpCode::jmp]           = &&Insn_jmp;
+            handlerTable[OpCode::jmp_near]      = &&Insn_jmp_near;
+            handlerTable[OpCode::jmp_short]     = &&Insn_jmp_short;
+            handlerTable[OpCode::jmp_long]      = &&Insn_jmp_long;
+            handlerTable[OpCode::call]          = &&Insn_call;
+            handlerTable[OpCode::call_near]     = &&Insn_call_near;
+            handlerTable[OpCode::call_short]    = &&Insn_call_short;
+            handlerTable[OpCode::call_long]     = &&Insn_call_long;
+            handlerTable[OpCode::ret]           = &&Insn_ret;
+            handlerTable[OpCode::ret_n_sm]      = &&Insn_ret_n_sm;
+            handlerTable[OpCode::ret_n]         = &&Insn_ret_n;
+            handlerTable[OpCode::ret_eax]       = &&Insn_ret_eax;
+            handlerTable[OpCode::ret_eax_n]     = &&Insn_ret_eax_n;
+            handlerTable[OpCode::nop]           = &&Insn_nop;
+            handlerTable[OpCode::nop_n]         = &&Insn_nop_n;
+            handlerTable[OpCode::inc]           = &&Insn_inc;
+            handlerTable[OpCode::dec]           = &&Insn_dec;
+            handlerTable[OpCode::add]           = &&Insn_add;
+            handlerTable[OpCode::add_imm]       = &&Insn_add_imm;
+            handlerTable[OpCode::add_eax]       = &&Insn_add_eax;
+            handlerTable[OpCode::add_eax_imm]   = &&Insn_add_eax_imm;
+            handlerTable[OpCode::sub]           = &&Insn_sub;
+            handlerTable[OpCode::sub_imm]       = &&Insn_sub_imm;
+            handlerTable[OpCode::sub_eax]       = &&Insn_sub_eax;
+            handlerTable[OpCode::sub_eax_imm]   = &&Insn_sub_eax_imm;
+            handlerTable[OpCode::exit]          = &&Insn_exit;
+
+            // Generated by SuperInsnGenerator, begin.
+            handlerTable[SuperOpCode::add_sp_push_dec_call] = &&Insn_add_sp_push_dec_call;
+            handlerTable[SuperOpCode::cmp_imm_jl] = &&Insn_cmp_imm_jl;
+            handlerTable[SuperOpCode::copy_eax_dec_call] = &&Insn_copy_eax_dec_call;
+            handlerTable[SuperOpCode::add_eax_ret_n] = &&Insn_add_eax_ret_n;
+            // Generated by SuperInsnGenerator, end.
+
+#if USE_TYPED_HANDLERS
+            VM_FOR_EACH_COND(VM_TYPED_HANDLER, cmp_i32,     int32_t)
+            VM_FOR_EACH_COND(VM_TYPED_HANDLER, cmp_u32,     uint32_t)
+            VM_FOR_EACH_COND(VM_TYPED_HANDLER, cmp_imm_i32, int32_t)
+            VM_FOR_EACH_COND(VM_TYPED_HANDLER, cmp_imm_u32, uint32_t)
+#endif
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 12)
+#pragma GCC diagnostic pop
+#endif
+#else
+            // The switch dispatch don't use the handler address.
+            for (size_t i = 0; i < kMaxHandlers; ++i) {
+                handlerTable[i] = nullptr;
+            }
+#endif
+            return ec;
+        }
 
-#ifndef JLANG_VM_ARGS_DEFINE_H
-
-#undef __arg0
-#undef __arg1
-#undef __arg2
-#undef __arg3
-#undef __arg4
-#undef __arg5
-#undef __arg6
-#undef __arg7
-#undef __arg8
-#undef __arg9
-
-#undef __var0
-#undef __var1
-#undef __var2
-#undef __var3
-#undef __var4
-#undef __var5
-#undef __var6
-#undef __var7
-#undef __var8
-#undef __var9
-#undef __var10
-#undef __var11
-#undef __var12
-#undef __var13
-#undef __var14
-#undef __var15
-
-#endif // JLANG_VM_ARGS_DEFINE_H
+        if (isInited() && decoded_.isInited()) {
+            register const vmInstruction * ip;
+            register vmStackPtr sp;
+            register vmFramePtr fp;
+            register Register   regs;
+
+            // Init environment
+            ip = decoded_.entry();
+            sp.set(stack_.current());
+            fp.set(stack_.current());
+            regs.uval = 0;
+
+            // Push call program entry.
+            push_callstack<Growable>(sp, fp, nullptr);
+
+#if USE_COMPUTED_GOTO
+            // Enter the first handler
+            VM_INSN_NEXT();
+#else
+Insn_Dispatch:
+            VM_INSN_PROFILE();
+            switch (ip->opcode) {
+#endif
+            VM_INSN_CASE(push) {
+                uint32_t value = fp.getArgValueUInt32(ip->index);
+                sp.writeUInt32(value);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(push_i32) {
+                sp.writeInt32(ip->imm.i32);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(push_i64) {
+                sp.writeInt64(ip->imm.i64);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(push_i32_0) {
+                sp.writeInt32(0);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(push_i64_0) {
+                sp.writeInt64(0);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(pop)
+            VM_INSN_CASE(pop_i32) {
+                sp.backUInt32();
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(pop_i64) {
+                sp.backUInt64();
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(add_sp) {
+                sp.next(ip->index);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(add_sp_4) {
+                sp.next(sizeof(uint32_t));
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(load_eax) {
+                regs.eax.u32 = ip->imm.u32;
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(store) {
+                fp.putArgValueUInt32(ip->index, ip->imm.u32);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(copy_from_eax) {
+                fp.putArgValueUInt32(ip->index, regs.eax.u32);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(cmp_i32) {
+                int32_t value1 = fp.getArgValueInt32(ip->index);
+                int32_t value2 = fp.getArgValueInt32(ip->index2);
+                flags.u32.low = (uint32_t)this_type::getCondition(value1, value2, ip->cond);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(cmp_u32) {
+                uint32_t value1 = fp.getArgValueUInt32(ip->index);
+                uint32_t value2 = fp.getArgValueUInt32(ip->index2);
+                flags.u32.low = (uint32_t)this_type::getCondition(value1, value2, ip->cond);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(cmp_imm_i32) {
+                int32_t value1 = fp.getArgValueInt32(ip->index);
+                int32_t value2 = ip->imm.i32;
+                flags.u32.low = (uint32_t)this_type::getCondition(value1, value2, ip->cond);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(cmp_imm_u32) {
+                uint32_t value1 = fp.getArgValueUInt32(ip->index);
+                uint32_t value2 = ip->imm.u32;
+                flags.u32.low = (uint32_t)this_type::getCondition(value1, value2, ip->cond);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(jl_near)
+            VM_INSN_CASE(jl_short)
+            VM_INSN_CASE(jl_long) {
+                if (likely(flags.u32.low != (uint32_t)true))
+                    ip++;
+                else
+                    ip = ip->target;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(jmp)
+            VM_INSN_CASE(jmp_near)
+            VM_INSN_CASE(jmp_short)
+            VM_INSN_CASE(jmp_long) {
+                ip = ip->target;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(call)
+            VM_INSN_CASE(call_near)
+            VM_INSN_CASE(call_short)
+            VM_INSN_CASE(call_long) {
+                push_callstack<Growable>(sp, fp, (void *)(ip + 1));
+                ip = ip->target;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(ret) {
+                ip = (const vmInstruction *)pop_callstack(sp, fp);
+                if (likely(ip != nullptr))
+                    VM_INSN_NEXT();
+                else
+                    goto Execute_Finished;
+            }
+
+            VM_INSN_CASE(ret_n_sm)
+            VM_INSN_CASE(ret_n) {
+                ip = (const vmInstruction *)pop_callstack(sp, fp, (uint16_t)ip->index);
+                if (likely(ip != nullptr))
+                    VM_INSN_NEXT();
+                else
+                    goto Execute_Finished;
+            }
+
+            VM_INSN_CASE(ret_eax) {
+                regs.eax.u32 = ip->imm.u32;
+                ip = (const vmInstruction *)pop_callstack(sp, fp);
+                if (likely(ip != nullptr))
+                    VM_INSN_NEXT();
+                else
+                    goto Execute_Finished;
+            }
+
+            VM_INSN_CASE(ret_eax_n) {
+                regs.eax.u32 = ip->imm.u32;
+                ip = (const vmInstruction *)pop_callstack(sp, fp, (uint16_t)ip->index);
+                if (likely(ip != nullptr))
+                    VM_INSN_NEXT();
+                else
+                    goto Execute_Finished;
+            }
+
+            VM_INSN_CASE(error)
+            VM_INSN_CASE(move)
+            VM_INSN_CASE(move_to_eax)
+            VM_INSN_CASE(cmp)
+            VM_INSN_CASE(jl)
+            VM_INSN_CASE(nop)
+            VM_INSN_CASE(nop_n) {
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(inc) {
+                uint32_t value = fp.getArgValueUInt32(ip->index);
+                fp.putArgValueUInt32(ip->index, value + 1);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(dec) {
+                uint32_t value = fp.getArgValueUInt32(ip->index);
+                fp.putArgValueUInt32(ip->index, value - 1);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(add) {
+                uint32_t value1 = fp.getArgValueUInt32(ip->index);
+                uint32_t value2 = fp.getArgValueUInt32(ip->index2);
+                fp.putArgValueUInt32(ip->index, value1 + value2);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(add_imm) {
+                uint32_t value = fp.getArgValueUInt32(ip->index);
+                fp.putArgValueUInt32(ip->index, value + ip->imm.u32);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(add_eax) {
+                regs.eax.u32 += fp.getArgValueUInt32(ip->index);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(add_eax_imm) {
+                regs.eax.u32 += ip->imm.u32;
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(sub) {
+                uint32_t value1 = fp.getArgValueUInt32(ip->index);
+                uint32_t value2 = fp.getArgValueUInt32(ip->index2);
+                fp.putArgValueUInt32(ip->index, value1 - value2);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(sub_imm) {
+                uint32_t value = fp.getArgValueUInt32(ip->index);
+                fp.putArgValueUInt32(ip->index, value - ip->imm.u32);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(sub_eax) {
+                regs.eax.u32 -= fp.getArgValueUInt32(ip->index);
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            VM_INSN_CASE(sub_eax_imm) {
+                regs.eax.u32 -= ip->imm.u32;
+                ip++;
+                VM_INSN_NEXT();
+            }
+
+            // Generated by SuperInsnGenerator, begin.
+            VM_SUPER_INSN_CASE(add_sp_push_dec_call) {
+                // add_sp_4, push, dec, call_near
+                sp.next(sizeof(uint32_t));
+                sp.writeUInt32(fp.getArgValueUInt32((ip + 1)->index));
+                fp.putArgValueUInt32((ip + 2)->index, fp.getArgValueUInt32((ip + 2)->index) - 1);
+                push_callstack<Growable>(sp, fp, (void *)(ip + 4));
+                ip = (ip + 3)->target;
+                VM_INSN_NEXT();
+            }
+
+            VM_SUPER_INSN_CASE(cmp_imm_jl) {
+                // cmp_imm_u32, jl_near
+                flags.u32.low = (uint32_t)this_type::getCondition(fp.getArgValueUInt32(ip->index),
+                                                                  ip->imm.u32, ip->cond);
+                if (likely(flags.u32.low != (uint32_t)true))
+                    ip += 2;
+                else
+                    ip = (ip + 1)->target;
+                VM_INSN_NEXT();
+            }
+
+            VM_SUPER_INSN_CASE(copy_eax_dec_call) {
+                // copy_from_eax, dec, call_near
+                fp.putArgValueUInt32(ip->index, regs.eax.u32);
+                fp.putArgValueUInt32((ip + 1)->index, fp.getArgValueUInt32((ip + 1)->index) - 1);
+                push_callstack<Growable>(sp, fp, (void *)(ip + 3));
+                ip = (ip + 2)->target;
+                VM_INSN_NEXT();
+            }
+
+            VM_SUPER_INSN_CASE(add_eax_ret_n) {
+                // add_eax, ret_n
+                regs.eax.u32 += fp.getArgValueUInt32(ip->index);
+                ip = (const vmInstruction *)pop_callstack(sp, fp, (uint16_t)(ip + 1)->index);
+                if (likely(ip != nullptr))
+                    VM_INSN_NEXT();
+                else
+                    goto Execute_Finished;
+            }
+            // Generated by SuperInsnGenerator, end.
+
+#if USE_TYPED_HANDLERS
+            // The typed compares, see TypedInsnPlanner.
+            VM_FOR_EACH_COND(VM_TYPED_CMP_CASE,     cmp_i32,     int32_t)
+            VM_FOR_EACH_COND(VM_TYPED_CMP_CASE,     cmp_u32,     uint32_t)
+            VM_FOR_EACH_COND(VM_TYPED_CMP_IMM_CASE, cmp_imm_i32, int32_t)
+            VM_FOR_EACH_COND(VM_TYPED_CMP_IMM_CASE, cmp_imm_u32, uint32_t)
+#endif // USE_TYPED_HANDLERS
+
+            VM_INSN_CASE(exit) {
+                goto Execute_Finished;
+            }
+
+            VM_INSN_DEFAULT() {
+                Console::trace("%08X:  Error: Unknown opcode: %u",
+                               ip->offset, (uint32_t)ip->opcode);
+                ip++;
+                VM_INSN_NEXT();
+            }
+#if !USE_COMPUTED_GOTO
+            } // switch (ip->opcode)
+#endif
+
+Execute_Finished:
+            retVal.setDataType(return_type::Basic);
+            retVal.setValue(regs.eax.u32);
+        }
+        return ec;
+    }
+
+#undef VM_INSN_PROFILE
+#undef VM_INSN_CASE
+#undef VM_SUPER_INSN_CASE
+#undef VM_TYPED_HANDLER
+#undef VM_TYPED_CMP_CASE
+#undef VM_TYPED_CMP_IMM_CASE
+#undef VM_INSN_DEFAULT
+#undef VM_INSN_NEXT
+
+    //
+    // The growable stack runs the Growable loop, and its records are
+    // translated for that loop.
+    //
+    int execute_predecoded(return_type & retVal, const void ** handlerTable = nullptr) {
+        if (stack_.isGrowable())
+            return execute_predecoded_impl<false, true>(retVal, handlerTable, nullptr);
+        else
+            return execute_predecoded_impl<false, false>(retVal, handlerTable, nullptr);
+    }
+
+    //
+    // The instrumented version of execute_predecoded(), the records must be
+    // translated with predecode(true).
+    //
+    int execute_profiled(return_type & retVal, vmOpcodeProfile * profile,
+                         const void ** handlerTable = nullptr) {
+        return execute_predecoded_impl<true>(retVal, handlerTable, profile);
+    }
+
+    void getHandlerTable(const void ** handlerTable, bool profiling) {
+        return_type dummy;
+        if (profiling)
+            execute_profiled(dummy, nullptr, handlerTable);
+        else
+            execute_predecoded(dummy, handlerTable);
+    }
+
+    //
+    // Translate the byte code image to the pre-decoded records.
+    //
+    int predecode(bool profiling = false) {
+        const void * handlerTable[kMaxHandlers];
+        getHandlerTable(handlerTable, profiling);
+
+        // The traces refer to the records, drop them.
+        traceMonitor_.clear();
+
+        size_t imageSize = (size_t)(image_.getLimit() - image_.getStart());
+        size_t entryOffset = (size_t)(image_.getPtr() - image_.getStart());
+        int ec = PreDecoder::translate(decoded_, image_.getStart(), imageSize,
+                                       entryOffset, handlerTable);
+        if (ec != Error::Ok) {
+            return ec;
+        }
+        decodedGrowable_ = stack_.isGrowable();
+        // The compares run the typed handlers of their conditions.
+        TypedInsnPlanner::plan(decoded_, handlerTable);
+        return Error::Ok;
+    }
+
+    //
+    // Verify the byte code image, a verified image can run without the
+    // bounds checks, see execute_verified().
+    //
+    int verify() {
+        size_t imageSize = (size_t)(image_.getLimit() - image_.getStart());
+        size_t entryOffset = (size_t)(image_.getPtr() - image_.getStart());
+        vmDecodedImage decoded;
+        int ec = PreDecoder::translate(decoded, image_.getStart(), imageSize,
+                                       entryOffset, nullptr);
+        if (ec != Error::Ok) {
+            verifyInfo_.clear();
+            return ec;
+        }
+        ec = Verifier::verify<Layout>(decoded, verifyInfo_);
+        updateGrowMark();
+        return ec;
+    }
+
+    const vmVerifyInfo & getVerifyInfo() const {
+        return verifyInfo_;
+    }
+
+    //
+    // Substitute the super instructions in the pre-decoded records,
+    // return the count of the fused sequences.
+    //
+    size_t fuse(bool profiling = false) {
+        const void * handlerTable[kMaxHandlers];
+        getHandlerTable(handlerTable, profiling);
+        return SuperInsnRewriter::rewrite(decoded_, handlerTable);
+    }
+
+#if USE_COMPUTED_GOTO
+#define VM_REG_CASE(op)         Reg_##op:
+#define VM_REG_DEFAULT()        Reg_unknown:
+#define VM_REG_NEXT() \
+    do { if (Counting) (*dispatchCount)++; goto *(ip->handler); } while (0)
+#else
+#define VM_REG_CASE(op)         case RegOpCode::op:
+#define VM_REG_DEFAULT()        default:
+#define VM_REG_NEXT()           goto Reg_Dispatch
+#endif
+
+#define VM_REG(index)           (*((uint32_t *)fp + (index)))
+
+    //
+    // Execute the register machine records, the register r(n) is the 32-bit
+    // slot fp[n], see RegTranslator.h. The frame header is the same as the
+    // stack machine: [saved fp][return record], followed by the registers.
+    //
+    // If handlerTable is not null, only fill the handler addresses and return.
+    // If Counting is true, the dispatches are counted to dispatchCount.
+    //
+    template <bool Counting>
+    int execute_register_impl(return_type & retVal, const void ** handlerTable,
+                              uint64_t * dispatchCount) {
+        int ec = 0;
+        if (handlerTable != nullptr) {
+#if USE_COMPUTED_GOTO
+            // GCC 12 takes the labels for the local variables, but their
+            // addresses never dangle.
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 12)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdangling-pointer"
+#endif
+            for (size_t i = 0; i < RegOpCode::last; ++i) {
+                handlerTable[i] = &&Reg_unknown;
+            }
+
+            handlerTable[RegOpCode::nop]        = &&Reg_nop;
+            handlerTable[RegOpCode::mov]        = &&Reg_mov;
+            handlerTable[RegOpCode::movi]       = &&Reg_movi;
+            handlerTable[RegOpCode::add]        = &&Reg_add;
+            handlerTable[RegOpCode::addi]       = &&Reg_addi;
+            handlerTable[RegOpCode::sub]        = &&Reg_sub;
+            handlerTable[RegOpCode::subi]       = &&Reg_subi;
+            handlerTable[RegOpCode::blt_i32]    = &&Reg_blt_i32;
+            handlerTable[RegOpCode::blt_u32]    = &&Reg_blt_u32;
+            handlerTable[RegOpCode::blti_i32]   = &&Reg_blti_i32;
+            handlerTable[RegOpCode::blti_u32]   = &&Reg_blti_u32;
+            handlerTable[RegOpCode::jmp]        = &&Reg_jmp;
+            handlerTable[RegOpCode::call]       = &&Reg_call;
+            handlerTable[RegOpCode::call_rv]    = &&Reg_call_rv;
+            handlerTable[RegOpCode::ret]        = &&Reg_ret;
+            handlerTable[RegOpCode::reti]       = &&Reg_reti;
+            handlerTable[RegOpCode::exit]       = &&Reg_exit;
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 12)
+#pragma GCC diagnostic pop
+#endif
+#else
+            // The switch dispatch don't use the handler address.
+            for (size_t i = 0; i < RegOpCode::last; ++i) {
+                handlerTable[i] = nullptr;
+            }
+#endif
+            return ec;
+        }
+
+        if (isInited() && regImage_.isInited()) {
+            register const vmRegInsn * ip;
+            register unsigned char * fp;
+            uint32_t value;
+
+            // The frames grow forward from the bottom of the stack.
+            unsigned char * fp_limit = stack_.last() - regImage_.getMaxFrameSize();
+
+            // Init environment, r0 of the bottom frame is the initial eax.
+            ip = regImage_.entry();
+            fp = stack_.first();
+            VM_REG(0) = 0;
+
+#if USE_COMPUTED_GOTO
+            // Enter the first handler
+            VM_REG_NEXT();
+#else
+Reg_Dispatch:
+            if (Counting) (*dispatchCount)++;
+            switch (ip->opcode) {
+#endif
+            VM_REG_CASE(mov) {
+                VM_REG(ip->dst) = VM_REG(ip->src1);
+                ip++;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(movi) {
+                VM_REG(ip->dst) = ip->imm.u32;
+                ip++;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(add) {
+                VM_REG(ip->dst) = VM_REG(ip->src1) + VM_REG(ip->src2);
+                ip++;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(addi) {
+                VM_REG(ip->dst) = VM_REG(ip->src1) + ip->imm.u32;
+                ip++;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(sub) {
+                VM_REG(ip->dst) = VM_REG(ip->src1) - VM_REG(ip->src2);
+                ip++;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(subi) {
+                VM_REG(ip->dst) = VM_REG(ip->src1) - ip->imm.u32;
+                ip++;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(blt_i32) {
+                if ((int32_t)VM_REG(ip->src1) < (int32_t)VM_REG(ip->src2))
+                    ip = ip->target;
+                else
+                    ip++;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(blt_u32) {
+                if (VM_REG(ip->src1) < VM_REG(ip->src2))
+                    ip = ip->target;
+                else
+                    ip++;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(blti_i32) {
+                if ((int32_t)VM_REG(ip->src1) < ip->imm.i32)
+                    ip = ip->target;
+                else
+                    ip++;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(blti_u32) {
+                if (VM_REG(ip->src1) < ip->imm.u32)
+                    ip = ip->target;
+                else
+                    ip++;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(jmp) {
+                ip = ip->target;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(call) {
+                unsigned char * callee = fp + ip->frame;
+                if (unlikely(callee >= fp_limit)) {
+                    ec = Error::RegVM_Stack_Overflow;
+                    goto Register_Finished;
+                }
+                *((unsigned char **)callee - 2) = fp;
+                *((const vmRegInsn **)callee - 1) = ip + 1;
+                fp = callee;
+                ip = ip->target;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(call_rv) {
+                unsigned char * callee = fp + ip->frame;
+                if (unlikely(callee >= fp_limit)) {
+                    ec = Error::RegVM_Stack_Overflow;
+                    goto Register_Finished;
+                }
+                *((unsigned char **)callee - 2) = fp;
+                *((const vmRegInsn **)callee - 1) = ip + 1;
+                *(uint32_t *)callee = VM_REG(0);
+                fp = callee;
+                ip = ip->target;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(ret) {
+                value = VM_REG(ip->src1);
+                ip = *((const vmRegInsn **)fp - 1);
+                fp = *((unsigned char **)fp - 2);
+                // The call record is just before the return record.
+                VM_REG((ip - 1)->dst) = value;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(reti) {
+                value = ip->imm.u32;
+                ip = *((const vmRegInsn **)fp - 1);
+                fp = *((unsigned char **)fp - 2);
+                VM_REG((ip - 1)->dst) = value;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(nop) {
+                ip++;
+                VM_REG_NEXT();
+            }
+
+            VM_REG_CASE(exit) {
+                retVal.setDataType(return_type::Basic);
+                retVal.setValue(VM_REG(ip->src1));
+                goto Register_Finished;
+            }
+
+            VM_REG_DEFAULT() {
+                Console::trace("%08X:  Error: Unknown register opcode: %u",
+                               ip->offset, (uint32_t)ip->opcode);
+                ip++;
+                VM_REG_NEXT();
+            }
+#if !USE_COMPUTED_GOTO
+            } // switch (ip->opcode)
+#endif
+
+Register_Finished:
+            // The ret of the image's main function doesn't pop its local slot,
+            // the stack machine reads it as a part of the return address, so
+            // give back the bottom of the stack zeroed as it was.
+            memset((void *)stack_.first(), 0,
+                   regImage_.entry()->frame + regImage_.getMaxFrameSize());
+        }
+        return ec;
+    }
+
+#undef VM_REG_CASE
+#undef VM_REG_DEFAULT
+#undef VM_REG_NEXT
+#undef VM_REG
+
+    int execute_register(return_type & retVal, const void ** handlerTable = nullptr) {
+        return execute_register_impl<false>(retVal, handlerTable, nullptr);
+    }
+
+    //
+    // The counting version of execute_register(), the records must be
+    // translated with reg_translate(true).
+    //
+    int execute_register_counted(return_type & retVal, uint64_t * dispatchCount,
+                                 const void ** handlerTable = nullptr) {
+        return execute_register_impl<true>(retVal, handlerTable, dispatchCount);
+    }
+
+    //
+    // Translate the byte code image to the register machine records.
+    //
+    int reg_translate(bool counting = false) {
+        if (!kIsNativeLayout) {
+            return Error::RegVM_Unsupported_Layout;
+        }
+        int ec = predecode();
+        if (ec != Error::Ok) {
+            return ec;
+        }
+
+        const void * handlerTable[RegOpCode::last];
+        return_type dummy;
+        if (counting)
+            execute_register_counted(dummy, nullptr, handlerTable);
+        else
+            execute_register(dummy, handlerTable);
+        return RegTranslator::translate(regImage_, decoded_, handlerTable);
+    }
+
+    const vmRegImage & getRegImage() const {
+        return regImage_;
+    }
+
+    //
+    // Compile the pre-decoded records to the native code.
+    //
+    int jit_compile() {
+        if (!kIsNativeLayout) {
+            return Error::Jit_Unsupported_Layout;
+        }
+        int ec = predecode();
+        if (ec != Error::Ok) {
+            return ec;
+        }
+        return JitCompiler::compile(decoded_, jitCode_);
+    }
+
+    //
+    // Run the compiled code, the calls stop at the limit that keeps the max
+    // frame of the image free, then return Error::Jit_Stack_Overflow.
+    //
+    int execute_jit(return_type & retVal) {
+        int ec = 0;
+        if (isInited() && jitCode_.isInited()) {
+            vmJitFunc func = jitCode_.entry();
+            size_type reserve = verifyInfo_.maxFrameSize + sizeof(void *) * 2;
+            const unsigned char * limit = stack_.last() - reserve;
+            uint32_t overflow = 0;
+            uint32_t eax = func((void *)stack_.current(), (const void *)limit, &overflow);
+            if (overflow != 0)
+                return Error::Jit_Stack_Overflow;
+            retVal.setDataType(return_type::Basic);
+            retVal.setValue(eax);
+        }
+        return ec;
+    }
+
+    //
+    // Execute the pre-decoded records with the tracing JIT, see TraceJit.h.
+    //
+    // The interpreter is the switch dispatch, the anchors are checked only
+    // after the backward jumps, the calls and the trace exits. While a trace
+    // is recording, every executed record is recorded.
+    //
+    int execute_traced(return_type & retVal) {
+        int ec = 0;
+        if (isInited() && decoded_.isInited()) {
+            register const vmInstruction * ip;
+            register vmStackPtr sp;
+            register vmFramePtr fp;
+            register Register   regs;
+            const vmInstruction * insn;
+            uint64_t interpreted = 0;
+
+            if (!traceMonitor_.isInited())
+                traceMonitor_.reset(decoded_);
+
+            // Init environment
+            ip = decoded_.entry();
+            sp.set(stack_.current());
+            fp.set(stack_.current());
+            regs.uval = 0;
+
+            // Push call program entry.
+            push_callstack(sp, fp, nullptr);
+
+            bool isAnchor = true;
+            while (ip != nullptr) {
+#if USE_JIT_X86_64
+                // The traces are compiled for the native layout only.
+                if (kIsNativeLayout && isAnchor) {
+                    isAnchor = false;
+                    vmTraceFunc trace = traceMonitor_.enter(ip);
+                    if (trace != nullptr) {
+                        vmTraceState state;
+                        state.sp = sp.ptr();
+                        state.fp = fp.ptr();
+                        state.eax = regs.eax.u32;
+                        state.flags = flags.u32.low;
+                        ip = trace(&state);
+                        sp.set(state.sp);
+                        fp.set(state.fp);
+                        regs.eax.u32 = state.eax;
+                        flags.u32.low = state.flags;
+                        traceMonitor_.getStats().entries++;
+                        isAnchor = true;
+                        continue;
+                    }
+                }
+#endif
+                insn = ip;
+                interpreted++;
+
+                switch (ip->opcode) {
+                case OpCode::push:
+                    sp.writeUInt32(fp.getArgValueUInt32(ip->index));
+                    ip++;
+                    break;
+
+                case OpCode::push_i32:
+                    sp.writeInt32(ip->imm.i32);
+                    ip++;
+                    break;
+
+                case OpCode::push_i64:
+                    sp.writeInt64(ip->imm.i64);
+                    ip++;
+                    break;
+
+                case OpCode::push_i32_0:
+                    sp.writeInt32(0);
+                    ip++;
+                    break;
+
+                case OpCode::push_i64_0:
+                    sp.writeInt64(0);
+                    ip++;
+                    break;
+
+                case OpCode::pop:
+                case OpCode::pop_i32:
+                    sp.backUInt32();
+                    ip++;
+                    break;
+
+                case OpCode::pop_i64:
+                    sp.backUInt64();
+                    ip++;
+                    break;
+
+                case OpCode::add_sp:
+                    sp.next(ip->index);
+                    ip++;
+                    break;
+
+                case OpCode::add_sp_4:
+                    sp.next(sizeof(uint32_t));
+                    ip++;
+                    break;
+
+                case OpCode::load_eax:
+                    regs.eax.u32 = ip->imm.u32;
+                    ip++;
+                    break;
+
+                case OpCode::store:
+                    fp.putArgValueUInt32(ip->index, ip->imm.u32);
+                    ip++;
+                    break;
+
+                case OpCode::copy_from_eax:
+                    fp.putArgValueUInt32(ip->index, regs.eax.u32);
+                    ip++;
+                    break;
+
+                case OpCode::cmp_i32:
+                    flags.u32.low = (uint32_t)this_type::getCondition(fp.getArgValueInt32(ip->index),
+                                                                      fp.getArgValueInt32(ip->index2),
+                                                                      ip->cond);
+                    ip++;
+                    break;
+
+                case OpCode::cmp_u32:
+                    flags.u32.low = (uint32_t)this_type::getCondition(fp.getArgValueUInt32(ip->index),
+                                                                      fp.getArgValueUInt32(ip->index2),
+                                                                      ip->cond);
+                    ip++;
+                    break;
+
+                case OpCode::cmp_imm_i32:
+                    flags.u32.low = (uint32_t)this_type::getCondition(fp.getArgValueInt32(ip->index),
+                                                                      ip->imm.i32, ip->cond);
+                    ip++;
+                    break;
+
+                case OpCode::cmp_imm_u32:
+                    flags.u32.low = (uint32_t)this_type::getCondition(fp.getArgValueUInt32(ip->index),
+                                                                      ip->imm.u32, ip->cond);
+                    ip++;
+                    break;
+
+                case OpCode::jl_near:
+                case OpCode::jl_short:
+                case OpCode::jl_long:
+                    if (likely(flags.u32.low != (uint32_t)true)) {
+                        ip++;
+                    }
+                    else {
+                        ip = ip->target;
+                        isAnchor = (ip <= insn);
+                    }
+                    break;
+
+                case OpCode::jmp:
+                case OpCode::jmp_near:
+                case OpCode::jmp_short:
+                case OpCode::jmp_long:
+                    ip = ip->target;
+                    isAnchor = (ip <= insn);
+                    break;
+
+                case OpCode::call:
+                case OpCode::call_near:
+                case OpCode::call_short:
+                case OpCode::call_long:
+                    push_callstack(sp, fp, (void *)(ip + 1));
+                    ip = ip->target;
+                    isAnchor = true;
+                    break;
+
+                case OpCode::ret:
+                    ip = (const vmInstruction *)pop_callstack(sp, fp);
+                    break;
+
+                case OpCode::ret_n_sm:
+                case OpCode::ret_n:
+                    ip = (const vmInstruction *)pop_callstack(sp, fp, (uint16_t)ip->index);
+                    break;
+
+                case OpCode::ret_eax:
+                    regs.eax.u32 = ip->imm.u32;
+                    ip = (const vmInstruction *)pop_callstack(sp, fp);
+                    break;
+
+                case OpCode::ret_eax_n:
+                    regs.eax.u32 = ip->imm.u32;
+                    ip = (const vmInstruction *)pop_callstack(sp, fp, (uint16_t)ip->index);
+                    break;
+
+                case OpCode::error:
+                case OpCode::move:
+                case OpCode::move_to_eax:
+                case OpCode::cmp:
+                case OpCode::jl:
+                case OpCode::nop:
+                case OpCode::nop_n:
+                    ip++;
+                    break;
+
+                case OpCode::inc:
+                    fp.putArgValueUInt32(ip->index, fp.getArgValueUInt32(ip->index) + 1);
+                    ip++;
+                    break;
+
+                case OpCode::dec:
+                    fp.putArgValueUInt32(ip->index, fp.getArgValueUInt32(ip->index) - 1);
+                    ip++;
+                    break;
+
+                case OpCode::add:
+                    fp.putArgValueUInt32(ip->index, fp.getArgValueUInt32(ip->index) +
+                                                    fp.getArgValueUInt32(ip->index2));
+                    ip++;
+                    break;
+
+                case OpCode::add_imm:
+                    fp.putArgValueUInt32(ip->index, fp.getArgValueUInt32(ip->index) + ip->imm.u32);
+                    ip++;
+                    break;
+
+                case OpCode::add_eax:
+                    regs.eax.u32 += fp.getArgValueUInt32(ip->index);
+                    ip++;
+                    break;
+
+                case OpCode::add_eax_imm:
+                    regs.eax.u32 += ip->imm.u32;
+                    ip++;
+                    break;
+
+                case OpCode::sub:
+                    fp.putArgValueUInt32(ip->index, fp.getArgValueUInt32(ip->index) -
+                                                    fp.getArgValueUInt32(ip->index2));
+                    ip++;
+                    break;
+
+                case OpCode::sub_imm:
+                    fp.putArgValueUInt32(ip->index, fp.getArgValueUInt32(ip->index) - ip->imm.u32);
+                    ip++;
+                    break;
+
+                case OpCode::sub_eax:
+                    regs.eax.u32 -= fp.getArgValueUInt32(ip->index);
+                    ip++;
+                    break;
+
+                case OpCode::sub_eax_imm:
+                    regs.eax.u32 -= ip->imm.u32;
+                    ip++;
+                    break;
+
+                case OpCode::exit:
+                    ip = nullptr;
+                    break;
+
+                default:
+                    Console::trace("%08X:  Error: Unknown opcode: %u",
+                                   ip->offset, (uint32_t)ip->opcode);
+                    ip++;
+                    break;
+                }
+
+                if (traceMonitor_.isRecording())
+                    traceMonitor_.record(insn, ip);
+            }
+
+            traceMonitor_.getStats().interpreted += interpreted;
+            retVal.setDataType(return_type::Basic);
+            retVal.setValue(regs.eax.u32);
+        }
+        return ec;
+    }
+
+    const vmTraceStats & getTraceStats() const {
+        return traceMonitor_.getStats();
+    }
+
+    enum {
+        ret_first,
+        ret_00,
+        ret_01,
+        ret_02,
+        ret_last
+    };
+
+    //
+    // The ret dispatches through the return table indexed by the retType,
+    // or a switch if the computed goto is not supported.
+    //
+#if USE_COMPUTED_GOTO
+#define VM_INLINE_RETURN(retType) \
+    goto *kReturnSites[retType]
+#else
+#define VM_INLINE_RETURN(retType) \
+    switch (retType) { \
+        case ret_01: goto fibonacci_ret_01; \
+        case ret_02: goto fibonacci_ret_02; \
+        default:     goto fibonacci_ret_00; \
+    }
+#endif
+
+    int execute_inline(return_type & retVal) {
+        int ec = 0;
+        if (isInited()) {
+            register vmImagePtr ip;
+            register vmStackPtr sp;
+            register vmFramePtr fp;
+            register vmStackPtr cp;
+            register Register   regs;
+#if USE_COMPUTED_GOTO
+            static const void * const kReturnSites[ret_last] = {
+                &&fibonacci_ret_00,     // ret_first, the exit never returns
+                &&fibonacci_ret_00,
+                &&fibonacci_ret_01,
+                &&fibonacci_ret_02
+            };
+#endif
+
+            // Init environment
+            ip.set(image_.getPtr());
+            sp.set(stack_.current());
+            fp.set(stack_.current());
+            cp.set(callstack_.current());
+            regs.uval = 0;
+
+            // Push call program entry.
+            inline_push_callstack(sp, fp, cp, nullptr, ret_first);
+
+            // Main loop
+            bool done;
+            do {
+                op_add_sp_4(ip, sp);
+                op_push_i32(ip, sp);
+                op_inline_call_short(ip, sp, fp, cp, ret_00);
+                goto fibonacci_n;
+fibonacci_ret_00:
+                {
+                    op_pop_i32(ip, sp);
+                    int retType = op_inline_ret(ip, sp, fp, cp, done);
+                    if (likely(done)) {
+                        retVal.setDataType(return_type::Basic);
+                        retVal.setValue(regs.eax.u32);
+                        break;
+                    }
+                    else {
+                        Console::trace("Error: Unknown error.");
+                    }
+                    goto Execute_Finished;
+                }
+fibonacci_n:
+                op_cmp_imm_i32(ip, sp, fp);
+                bool is_large = op_jl_near(ip);
+                if (likely(!is_large)) {
+                    op_add_sp_4(ip, sp);
+                    op_push(ip, sp, fp);
+                    op_dec(ip, fp);
+                    op_inline_call_near(ip, sp, fp, cp, ret_01);
+                    goto fibonacci_n;
+fibonacci_ret_01:
+                    op_copy_from_eax(ip, sp, fp, regs);
+                    op_dec(ip, fp);
+                    op_inline_call_near(ip, sp, fp, cp, ret_02);
+                    goto fibonacci_n;
+fibonacci_ret_02:
+                    op_add_eax(ip, fp, regs);
+                    int retType = op_inline_ret_n(ip, sp, fp, cp, done);
+                    VM_INLINE_RETURN(retType);
+                }
+                else {
+                    int retType = op_inline_ret_eax(ip, sp, fp, cp, regs, done);
+                    VM_INLINE_RETURN(retType);
+                }
+            } while (1);
+        }
+
+Execute_Finished:
+        return ec;
+    }
+
+#undef VM_INLINE_RETURN
+
+    //
+    // Run the loop, a hit on the guard regions of the stacks returns
+    // Error::StackGuard_Overflow, and the context must be reset then. The
+    // run drops the suspended run, resume() takes it before.
+    //
+    template <typename Execute>
+    int run_guarded(Execute execute) {
+        safepoint_.setSuspended(false);
+        if (stack_.isGrowable() && !verifyInfo_.verified) {
+            return Error::Stack_Grow_Unverified;
+        }
+        // The verified loops read the arguments of the entry unchecked.
+        if (verifyInfo_.verified && getArgSize() < verifyInfo_.entryArgSize) {
+            return Error::Verify_Stack_Underflow;
+        }
+#if USE_VM_STACK_GUARD
+        vmStackGuard::Scope scope;
+        scope.add(stack_);
+        scope.add(callstack_);
+        if (sigsetjmp(scope.jumpBuffer(), 0) != 0) {
+            return Error::StackGuard_Overflow;
+        }
+#endif
+        return execute();
+    }
+
+    int run(return_type & retVal) {
+        if (stack_.isGrowable()) {
+            return Error::Stack_Not_Growable;
+        }
+        ip_.set(image_.getPtr());
+        sp_.set(stack_.current());
+        fp_.set(stack_.current());
+        return run_guarded([&]() { return execute(retVal); });
+    }
+
+    //
+    // Run the plain loop with the safepoints, the context that's stopped at
+    // one returns its Error::Safepoint_* code, it's resumed by resume(), or
+    // saved to a snapshot and resumed in another context.
+    //
+    int run_pausable(return_type & retVal) {
+        if (stack_.isGrowable()) {
+            return Error::Stack_Not_Growable;
+        }
+        ip_.set(image_.getPtr());
+        sp_.set(stack_.current());
+        fp_.set(stack_.current());
+        return run_guarded([&]() { return execute_impl<true>(retVal, false); });
+    }
+
+    //
+    // Continue the context that's stopped at a safepoint.
+    //
+    int resume(return_type & retVal) {
+        if (!safepoint_.isSuspended()) {
+            return Error::Safepoint_Not_Suspended;
+        }
+        return run_guarded([&]() { return execute_impl<true>(retVal, true); });
+    }
+
+    int run_inline(return_type & retVal) {
+        if (stack_.isGrowable()) {
+            return Error::Stack_Not_Growable;
+        }
+        ip_.set(image_.getPtr());
+        sp_.set(stack_.current());
+        fp_.set(stack_.current());
+        return run_guarded([&]() { return execute_inline(retVal); });
+    }
+
+    int run_threaded(return_type & retVal) {
+        if (stack_.isGrowable()) {
+            return Error::Stack_Not_Growable;
+        }
+        ip_.set(image_.getPtr());
+        sp_.set(stack_.current());
+        fp_.set(stack_.current());
+        return run_guarded([&]() { return execute_threaded(retVal); });
+    }
+
+    int run_verified(return_type & retVal) {
+        if (stack_.isGrowable()) {
+            return Error::Stack_Not_Growable;
+        }
+        ip_.set(image_.getPtr());
+        sp_.set(stack_.current());
+        fp_.set(stack_.current());
+        return run_guarded([&]() { return execute_verified(retVal); });
+    }
+
+    int run_predecoded(return_type & retVal) {
+        // The records must be translated after the stack is created.
+        if (decodedGrowable_ != stack_.isGrowable()) {
+            return Error::Stack_Not_Growable;
+        }
+        ip_.set(image_.getPtr());
+        sp_.set(stack_.current());
+        fp_.set(stack_.current());
+        return run_guarded([&]() { return execute_predecoded(retVal); });
+    }
+
+    int run_profiled(return_type & retVal, vmOpcodeProfile & profile) {
+        if (stack_.isGrowable()) {
+            return Error::Stack_Not_Growable;
+        }
+        ip_.set(image_.getPtr());
+        sp_.set(stack_.current());
+        fp_.set(stack_.current());
+        return run_guarded([&]() { return execute_profiled(retVal, &profile); });
+    }
+
+    int run_jit(return_type & retVal) {
+        if (stack_.isGrowable()) {
+            return Error::Stack_Not_Growable;
+        }
+        ip_.set(image_.getPtr());
+        sp_.set(stack_.current());
+        fp_.set(stack_.current());
+        return run_guarded([&]() { return execute_jit(retVal); });
+    }
+
+    int run_traced(return_type & retVal) {
+        if (stack_.isGrowable()) {
+            return Error::Stack_Not_Growable;
+        }
+        ip_.set(image_.getPtr());
+        sp_.set(stack_.current());
+        fp_.set(stack_.current());
+        return run_guarded([&]() { return execute_traced(retVal); });
+    }
+
+    int run_register(return_type & retVal) {
+        if (stack_.isGrowable()) {
+            return Error::Stack_Not_Growable;
+        }
+        return run_guarded([&]() { return execute_register(retVal); });
+    }
+
+    int run_register_counted(return_type & retVal, uint64_t & dispatchCount) {
+        dispatchCount = 0;
+        if (stack_.isGrowable()) {
+            return Error::Stack_Not_Growable;
+        }
+        return run_guarded([&]() { return execute_register_counted(retVal, &dispatchCount); });
+    }
+};
+
+template <typename BasicType = uintptr_t, typename Layout = vmDefaultLayout>
+class ExecutionEngine {
+public:
+    typedef BasicType                               basic_type;
+    typedef Layout                                  layout_type;
+    typedef size_t                                  size_type;
+    typedef ExecutionContext<basic_type, Layout>    context_type;
+    typedef vmReturn<basic_type>                    return_type;
+    typedef ExecutionEngine<basic_type, Layout>     this_type;
+
+private:
+    //
+    // The kinds of the translation of the records, see prepare().
+    //
+    enum DecodedKind {
+        kDecodedNone,
+        kDecodedPlain,
+        kDecodedFused,
+        kDecodedProfiled,
+        kDecodedProfiledFused,
+        kDecodedRegister,
+        kDecodedRegisterCounted
+    };
+
+    vmBinaryFile binary_;
+    context_type context_;
+
+    // The records of the context are translated for the kind and the input.
+    int          decodedKind_;
+    basic_type   decodedInput_;
+    // The register records are translated for the kind and the input.
+    int          regKind_;
+    basic_type   regInput_;
+    // The native code is compiled for the input.
+    bool         jitCompiled_;
+    basic_type   jitInput_;
+
+    //
+    // Patch the input into the image and translate the records for the
+    // kind of the run. The records are cached, they're translated again
+    // only when the input or the kind changes.
+    //
+    int prepare(int kind, basic_type input) {
+        if (decodedKind_ == kind && decodedInput_ == input)
+            return Error::Ok;
+        decodedKind_ = kDecodedNone;
+        binary_.setInput(input);
+
+        int ec;
+        switch (kind) {
+        case kDecodedFused:
+            ec = context_.predecode();
+            if (ec == Error::Ok)
+                context_.fuse();
+            break;
+        case kDecodedProfiled:
+            ec = context_.predecode(true);
+            break;
+        case kDecodedProfiledFused:
+            ec = context_.predecode(true);
+            if (ec == Error::Ok)
+                context_.fuse(true);
+            break;
+        default:
+            ec = context_.predecode();
+            break;
+        }
+        if (ec != Error::Ok)
+            return ec;
+        decodedKind_ = kind;
+        decodedInput_ = input;
+        return Error::Ok;
+    }
+
+    //
+    // Translate the register records for the input, the plain records are
+    // translated on the way.
+    //
+    int prepare_register(int kind, basic_type input) {
+        if (regKind_ == kind && regInput_ == input)
+            return Error::Ok;
+        regKind_ = kDecodedNone;
+        decodedKind_ = kDecodedNone;
+        binary_.setInput(input);
+
+        int ec = context_.reg_translate(kind == kDecodedRegisterCounted);
+        if (ec != Error::Ok)
+            return ec;
+        regKind_ = kind;
+        regInput_ = input;
+        decodedKind_ = kDecodedPlain;
+        decodedInput_ = input;
+        return Error::Ok;
+    }
+
+    //
+    // Compile the native code for the input, the plain records are
+    // translated on the way.
+    //
+    int prepare_jit(basic_type input) {
+        if (jitCompiled_ && jitInput_ == input)
+            return Error::Ok;
+        jitCompiled_ = false;
+        decodedKind_ = kDecodedNone;
+        binary_.setInput(input);
+
+        int ec = context_.jit_compile();
+        if (ec != Error::Ok)
+            return ec;
+        jitCompiled_ = true;
+        jitInput_ = input;
+        decodedKind_ = kDecodedPlain;
+        decodedInput_ = input;
+        return Error::Ok;
+    }
+
+public:
+    ExecutionEngine() : decodedKind_(kDecodedNone), decodedInput_(0),
+                        regKind_(kDecodedNone), regInput_(0),
+                        jitCompiled_(false), jitInput_(0) {}
+    virtual ~ExecutionEngine() {
+        destroy();
+    }
+
+    bool isInited() const { return (context_.getId() != 0); }
+
+    //
+    // The image mode is USE_FIBONACCI_IMAGE or USE_FIBONACCI_IMAGE_FAST, the
+    // image is encoded for the stack layout of the engine.
+    //
+    int create(int imageMode = USE_FIBONACCI_IMAGE) {
+        int ec = binary_.template loadBuiltin<Layout>(imageMode);
+        if (ec <= 0) {
+            return Error::BinaryFile_Read_Failed;
+        }
+
+        context_.setImageInfo(binary_.getImagePtr(), binary_.getImageSize(),
+                              binary_.getImageEntry());
+
+        bool success = createContext();
+        if (!success) {
+            return Error::MainProcess_Create_Failed;
+        }
+
+        ec = context_.predecode();
+        if (ec != Error::Ok) {
+            return ec;
+        }
+        // The records are translated again for the input of the first run.
+        decodedKind_ = kDecodedNone;
+        regKind_ = kDecodedNone;
+        jitCompiled_ = false;
+
+        // The image that fails the verification still runs in the checked loops.
+        context_.verify();
+
+        return (int)success;
+    }
+
+    void destroy() {
+        destroyContext();
+    }
+
+    bool createContext() {
+        if (!context_.isInited()) {
+            context_.create();
+        }
+
+        return context_.isInited();
+    }
+
+    void destroyContext() {
+        if (context_.isInited()) {
+            context_.destroy();
+        }
+    }
+
+    int run(return_type & ret) {
+        binary_.setInput(ret.getValue());
+        int ec = context_.run(ret);
+        return ec;
+    }
+
+    int run_inline(return_type & ret) {
+        binary_.setInput(ret.getValue());
+        int ec = context_.run_inline(ret);
+        return ec;
+    }
+
+    int run_threaded(return_type & ret) {
+        binary_.setInput(ret.getValue());
+        int ec = context_.run_threaded(ret);
+        return ec;
+    }
+
+    //
+    // Run the verified image without the bounds checks, the input is only an
+    // immediate, it needn't verify the image again.
+    //
+    int run_verified(return_type & ret) {
+        binary_.setInput(ret.getValue());
+        int ec = context_.run_verified(ret);
+        return ec;
+    }
+
+    const vmVerifyInfo & getVerifyInfo() const {
+        return context_.getVerifyInfo();
+    }
+
+    int run_predecoded(return_type & ret) {
+        int ec = prepare(kDecodedPlain, ret.getValue());
+        if (ec != Error::Ok) {
+            return ec;
+        }
+        ec = context_.run_predecoded(ret);
+        return ec;
+    }
+
+    int run_superinsn(return_type & ret) {
+        int ec = prepare(kDecodedFused, ret.getValue());
+        if (ec != Error::Ok) {
+            return ec;
+        }
+        ec = context_.run_predecoded(ret);
+        return ec;
+    }
+
+    //
+    // Run the instrumented interpreter, with or without the super
+    // instructions, and record the opcode n-grams to the profile.
+    //
+    int run_profiled(return_type & ret, vmOpcodeProfile & profile, bool fused = false) {
+        int ec = prepare(fused ? kDecodedProfiledFused : kDecodedProfiled, ret.getValue());
+        if (ec != Error::Ok) {
+            return ec;
+        }
+        ec = context_.run_profiled(ret, profile);
+        return ec;
+    }
+
+    int run_jit(return_type & ret) {
+        // The input is patched into the image, so compile it again when the
+        // input changes.
+        int ec = prepare_jit(ret.getValue());
+        if (ec != Error::Ok) {
+            return ec;
+        }
+        ec = context_.run_jit(ret);
+        return ec;
+    }
+
+    //
+    // Run the pre-decoded records with the tracing JIT, the traces are
+    // compiled while running, and dropped when the input changes.
+    //
+    int run_traced(return_type & ret) {
+        int ec = prepare(kDecodedPlain, ret.getValue());
+        if (ec != Error::Ok) {
+            return ec;
+        }
+        ec = context_.run_traced(ret);
+        return ec;
+    }
+
+    const vmTraceStats & getTraceStats() const {
+        return context_.getTraceStats();
+    }
+
+    int run_register(return_type & ret) {
+        int ec = prepare_register(kDecodedRegister, ret.getValue());
+        if (ec != Error::Ok) {
+            return ec;
+        }
+        ec = context_.run_register(ret);
+        return ec;
+    }
+
+    //
+    // Run the register machine and count the dispatches.
+    //
+    int run_register_counted(return_type & ret, uint64_t & dispatchCount) {
+        int ec = prepare_register(kDecodedRegisterCounted, ret.getValue());
+        if (ec != Error::Ok) {
+            return ec;
+        }
+        ec = context_.run_register_counted(ret, dispatchCount);
+        return ec;
+    }
+
+    const vmRegImage & getRegImage() const {
+        return context_.getRegImage();
+    }
+};
+
+template <typename BasicType = uintptr_t, typename Layout = vmDefaultLayout>
+class Interpreter {
+public:
+    typedef BasicType                           basic_type;
+    typedef Layout                              layout_type;
+    typedef ExecutionEngine<basic_type, Layout> engine_type;
+    typedef vmReturn<basic_type>                return_type;
+    typedef Interpreter<basic_type, Layout>     this_type;
+
+private:
+    engine_type engine_;
+
+public:
+    Interpreter() {}
+    ~Interpreter() {}
+
+    int create(int imageMode = USE_FIBONACCI_IMAGE) {
+        int ec = engine_.create(imageMode);
+        return ec;
+    }
+
+    int run(return_type & ret) {
+        int ec = engine_.run(ret);
+        return ec;
+    }
+
+    int run_inline(return_type & ret) {
+        int ec = engine_.run_inline(ret);
+        return ec;
+    }
+
+    int run_threaded(return_type & ret) {
+        int ec = engine_.run_threaded(ret);
+        return ec;
+    }
+
+    int run_verified(return_type & ret) {
+        int ec = engine_.run_verified(ret);
+        return ec;
+    }
+
+    const vmVerifyInfo & getVerifyInfo() const {
+        return engine_.getVerifyInfo();
+    }
+
+    int run_predecoded(return_type & ret) {
+        int ec = engine_.run_predecoded(ret);
+        return ec;
+    }
+
+    int run_superinsn(return_type & ret) {
+        int ec = engine_.run_superinsn(ret);
+        return ec;
+    }
+
+    int run_profiled(return_type & ret, vmOpcodeProfile & profile, bool fused = false) {
+        int ec = engine_.run_profiled(ret, profile, fused);
+        return ec;
+    }
+
+    int run_jit(return_type & ret) {
+        int ec = engine_.run_jit(ret);
+        return ec;
+    }
+
+    int run_traced(return_type & ret) {
+        int ec = engine_.run_traced(ret);
+        return ec;
+    }
+
+    const vmTraceStats & getTraceStats() const {
+        return engine_.getTraceStats();
+    }
+
+    int run_register(return_type & ret) {
+        int ec = engine_.run_register(ret);
+        return ec;
+    }
+
+    int run_register_counted(return_type & ret, uint64_t & dispatchCount) {
+        int ec = engine_.run_register_counted(ret, dispatchCount);
+        return ec;
+    }
+
+    const vmRegImage & getRegImage() const {
+        return engine_.getRegImage();
+    }
+};
+
+} // namespace v3
+} // namespace jlang
 
 #endif // JLANG_VM_INTERPRETER_V3_H
@@ -6,24 +6,10 @@
 #pragma once
 #endif
 
-//////////////////////////////////////////////////////////////
-
-#undef FRAME_STACK_SIZEOF
-#undef USE_FORWARD_STACK_PTR
-
-/* If is forward stack pointer ? */
-#define USE_FORWARD_STACK_PTR   1
-
-#define FRAME_STACK_SIZEOF      ((sizeof(void *) * 1) / sizeof(uint32_t))
-
-//////////////////////////////////////////////////////////////
-
-#include "jlang/vm/ArgsDefine.h"
-
-#define JLANG_VM_ARGS_DEFINE_H
-
 #include "jlang/vm/Interpreter.h"
 #include "jlang/vm/Interpreter_v3.h"
+#include "jlang/vm/StackLayout.h"
+#include "jlang/vm/StackGuard.h"
 #include "jlang/lang/Error.h"
 #include "jlang/system/Console.h"
 
@@ -42,6 +28,12 @@ using namespace std;
 namespace jlang {
 namespace v4 {
 
+//
+// The stack layout of v4, the stack grows forward and the frame header is
+// the compact one, the return IP and the 32-bit distance to the caller's fp.
+//
+typedef v3::vmStackLayout<true, true> vmLayout;
+
 //
 // 00000000:    store var0, 0x00000014 (int32)
 // 00000006:    fast_call 0x00000010, 8 (short offset 0x0005, local_size = 8)
@@ -68,7 +60,7 @@ namespace v4 {
 
 static const unsigned char fibonacciBinary32[] = {
     // 00000000:    store var0, 0x00000014 (int32)
-    OpCode::store, __var0, 0x14, 0x00, 0x00, 0x00,
+    OpCode::store, vmLayout::kVar0, 0x14, 0x00, 0x00, 0x00,
     // 00000006:    call (0x00000010, 8) (short offset 0x0005, local_size = 8)
     OpCode::fast_call_short, 0x05, 0x00, 0x08, 0x00,
     // 0000000B:    ret_n 8
@@ -78,26 +70,26 @@ static const unsigned char fibonacciBinary32[] = {
     OpCode::nop,  OpCode::nop,
 
     // 00000010:    cmp_imm_u32 arg1, 0x00000003
-    OpCode::cmp_imm_u32, __arg1, 0x03, 0x00, 0x00, 0x00,
+    OpCode::cmp_imm_u32, vmLayout::kArg1, 0x03, 0x00, 0x00, 0x00,
     // 00000016:    jl_near 0x00000030 (near offset 0x18)
     OpCode::jl_near, 0x18,
 
     // 00000018:    move var0, arg1
-    OpCode::move, __var0, __arg1,
+    OpCode::move, vmLayout::kVar0, vmLayout::kArg1,
     // 0000001B:    dec var0
-    OpCode::dec,  __var0,
+    OpCode::dec,  vmLayout::kVar0,
     // 0000001D:    fast_call (0x00000010, 8) (short offset 0xFFEE, local_size = 8)
     OpCode::fast_call_short, 0xEE, 0xFF, 0x08, 0x00,
 
     // 00000022:    copy_from var1, eax
-    OpCode::copy_from_eax, __var1,
+    OpCode::copy_from_eax, vmLayout::kVar1,
     // 00000024:    dec var0
-    OpCode::dec,  __var0,
+    OpCode::dec,  vmLayout::kVar0,
     // 00000026:    fast_call (0x00000010, 8) (short offset 0xFFE5, local_size = 8)
     OpCode::fast_call_short, 0xE5, 0xFF, 0x08, 0x00,
 
     // 0000002B:    add eax, var1
-    OpCode::add_eax, __var1,
+    OpCode::add_eax, vmLayout::kVar1,
     // 0000002D:    ret_n 8
     OpCode::ret_n,  0x08, 0x00,
 
@@ -114,13 +106,8 @@ static const unsigned char fibonacciBinary32[] = {
 
 typedef v3::ForwardPtr  vmImagePtr;
 
-#if USE_FORWARD_STACK_PTR
-typedef v3::ForwardPtr  vmStackPtr;
-typedef v3::ForwardPtr  vmFramePtr;
-#else
-typedef v3::BackwardPtr vmStackPtr;
-typedef v3::BackwardPtr vmFramePtr;
-#endif
+typedef v3::vmStackPtrTraits<vmLayout>::stack_ptr vmStackPtr;
+typedef v3::vmStackPtrTraits<vmLayout>::frame_ptr vmFramePtr;
 
 struct vmContextRegs {
     vmImagePtr  ip_;
@@ -257,15 +244,11 @@ public:
     typedef ExecutionContext<basic_type>    this_type;
 
     static const size_type kDefaultStackSize = 8 * 1048576U;
+    static const size_type kMaxHandlers = 256;
 
 private:
-#if USE_FORWARD_STACK_PTR
-    vmStack<basic_type, false>  stack_;
-    vmStack<basic_type, false>  callstack_;
-#else
-    vmStack<basic_type, true> stack_;
-    vmStack<basic_type, true> callstack_;
-#endif
+    vmStack<basic_type, !vmLayout::kIsForward>  stack_;
+    vmStack<basic_type, !vmLayout::kIsForward>  callstack_;
     vmImageInfo<basic_type> image_;
     vmHeap<basic_type>      heap_;
     engine_type *           engine_;
@@ -325,73 +308,72 @@ public:
     }
 
     int32_t getArgIndex(int8_t index) {
-#if USE_FORWARD_STACK_PTR
-        return (index + (FRAME_STACK_SIZEOF + 1));
-#else
-        return (index - FRAME_STACK_SIZEOF);
-#endif
+        if (vmLayout::kIsForward)
+            return (index + (vmLayout::kFrameHeaderSlots + 1));
+        else
+            return (index - vmLayout::kFrameHeaderSlots);
     }
 
-    JM_FORCEINLINE void push_callstack(vmFramePtr & fp, void * returnIP, intptr_t localSize) {
-        void * framePoint = fp.get<void *>();
+    //
+    // Push the compact frame header, the distance from the caller's fp to
+    // the new fp and the return IP, the new frame follows the caller's locals.
+    //
+    JM_FORCEINLINE void push_frame_header(vmFramePtr & fp, void * returnIP, intptr_t localSize) {
         fp.next64(localSize);
-        fp.push_Pointer(framePoint);
+        fp.push_UInt32((uint32_t)(localSize + vmLayout::kFrameHeaderSize));
         fp.push_Pointer(returnIP);
         assert(!fp_isOverflow(fp));
     }
 
-    JM_FORCEINLINE void * pop_callstack(vmFramePtr & fp) {
+    JM_FORCEINLINE void * pop_frame_header(vmFramePtr & fp) {
         void * returnIP = fp.pop_Pointer();
-        void * framePoint = fp.pop_Pointer();
-        fp.set(framePoint);
+        uint32_t distance = fp.pop_UInt32();
+        fp.back((int)distance - vmLayout::kFrameHeaderSize);
         return returnIP;
     }
 
+    JM_FORCEINLINE void push_callstack(vmFramePtr & fp, void * returnIP, intptr_t localSize) {
+        push_frame_header(fp, returnIP, localSize);
+    }
+
+    JM_FORCEINLINE void * pop_callstack(vmFramePtr & fp) {
+        return pop_frame_header(fp);
+    }
+
     JM_FORCEINLINE void push_callstack_fast(vmFramePtr & fp, void * returnIP, int32_t localSize) {
-        fp.next(localSize);
-        fp.push_Pointer(returnIP);
-        assert(!fp_isOverflow(fp));
+        push_frame_header(fp, returnIP, localSize);
     }
 
+    // The fast return knows the size of the locals, the distance is skipped.
     JM_FORCEINLINE void * pop_callstack_fast(vmFramePtr & fp, int32_t localSize) {
         void * returnIP = fp.pop_Pointer();
-        fp.back(localSize);
+        fp.back(localSize + (int32_t)sizeof(uint32_t));
         assert((localSize & 0x03) == 0);
         return returnIP;
     }
 
     JM_FORCEINLINE void inline_push_callstack(vmFramePtr & fp, vmStackPtr & cp,
                                               void * returnIP, intptr_t localSize, int retType) {
-        void * framePoint = fp.get<void *>();
-        fp.next64(localSize);
-        fp.push_Pointer(framePoint);
-        fp.push_Pointer(returnIP);
+        push_frame_header(fp, returnIP, localSize);
         cp.push_Int32(retType);
-        assert(!fp_isOverflow(fp));
     }
 
     JM_FORCEINLINE void * inline_pop_callstack(vmFramePtr & fp, vmStackPtr & cp,
                                                int & retType) {
-        void * returnIP = fp.pop_Pointer();
-        void * framePoint = fp.pop_Pointer();
-        fp.set(framePoint);
+        void * returnIP = pop_frame_header(fp);
         retType = cp.pop_Int32();
         return returnIP;
     }
 
     JM_FORCEINLINE void inline_push_callstack_fast(vmFramePtr & fp, vmStackPtr & cp,
                                                    void * returnIP, int32_t localSize, int retType) {
-        fp.next(localSize);
-        fp.push_Pointer(returnIP);
+        push_frame_header(fp, returnIP, localSize);
         cp.push_Int32(retType);
-        assert(!fp_isOverflow(fp));
     }
 
     JM_FORCEINLINE void * inline_pop_callstack_fast(vmFramePtr & fp, vmStackPtr & cp,
                                                     int32_t localSize, int & retType) {
-        void * returnIP = fp.pop_Pointer();
-        fp.back(localSize);
-        assert((localSize & 0x03) == 0);
+        void * returnIP = pop_callstack_fast(fp, localSize);
         retType = cp.pop_Int32();
         return returnIP;
     }
@@ -469,177 +451,195 @@ public:
     //
     // error inst.
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_error(vmImagePtr & ip) {
-        Console::trace("%08X:  error", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  error", getIpOffset(ip));
         ip.next();
     }
 
     //
     // push arg0 (int32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_push(vmImagePtr & ip, vmStackPtr & sp, vmFramePtr & fp) {
         int8_t index = ip.getValue<0, int8_t>();
         int32_t value = fp.getArgValueUInt32(index);
         sp.writeInt32(value);
 
-        Console::trace("%08X:  push args[%d]  (0x%08X, int32)",
-                      getIpOffset(ip), getArgIndex(index), value);
+        if (Traced) Console::trace("%08X:  push args[%d]  (0x%08X, int32)",
+                                  getIpOffset(ip), getArgIndex(index), value);
         ip.next(1 + sizeof(int8_t));
     }
 
     //
     // push 0x00000008 (int32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_push_i32(vmImagePtr & ip, vmStackPtr & sp) {
         int32_t value = ip.getValue<0, int32_t>();
         sp.writeInt32(value);
-        Console::trace("%08X:  push_i32 0x%08X (int32)", getIpOffset(ip), value);
+        if (Traced) Console::trace("%08X:  push_i32 0x%08X (int32)", getIpOffset(ip), value);
         ip.next(1 + sizeof(int32_t));
     }
 
     //
     // push 0x00000000 00000008 (int64)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_push_i64(vmImagePtr & ip, vmStackPtr & sp) {
         int64_t value = ip.getValue<0, int64_t>();
         sp.writeInt64(value);
-        Console::trace("%08X:  push_i64 0x%016X (int64)", getIpOffset(ip), value);
+        if (Traced) Console::trace("%08X:  push_i64 0x%016X (int64)", getIpOffset(ip), value);
         ip.next(1 + sizeof(int64_t));
     }
 
     //
     // push_0 (int32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_push_i32_0(vmImagePtr & ip, vmStackPtr & sp) {
         int32_t value = 0;
         sp.writeInt32(value);
-        Console::trace("%08X:  push_i32_0 (int32)", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  push_i32_0 (int32)", getIpOffset(ip));
         ip.next();
     }
 
     //
     // push_0 (int64)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_push_i64_0(vmImagePtr & ip, vmStackPtr & sp) {
         int64_t value = 0;
         sp.writeInt64(value);
-        Console::trace("%08X:  push_i64_0 (int64)", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  push_i64_0 (int64)", getIpOffset(ip));
         ip.next();
     }
 
     //
     // pop uint32
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_pop(vmImagePtr & ip, vmStackPtr & sp) {
         sp.backUInt32();
         uint32_t value = sp.getUInt32();
-        Console::trace("%08X:  pop  (0x%08X)", getIpOffset(ip), value);
+        if (Traced) Console::trace("%08X:  pop  (0x%08X)", getIpOffset(ip), value);
         ip.next();
     }
 
     //
     // pop int32
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_pop_i32(vmImagePtr & ip, vmStackPtr & sp) {
         sp.backInt32();
         int32_t value = sp.getInt32();
-        Console::trace("%08X:  pop_i32  (0x%08X)", getIpOffset(ip), value);
+        if (Traced) Console::trace("%08X:  pop_i32  (0x%08X)", getIpOffset(ip), value);
         ip.next();
     }
 
     //
     // pop int64
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_pop_i64(vmImagePtr & ip, vmStackPtr & sp) {
         sp.backInt64();
         int64_t value = sp.getInt64();
-        Console::trace("%08X:  pop_i64  (0x%016X)", getIpOffset(ip), value);
+        if (Traced) Console::trace("%08X:  pop_i64  (0x%016X)", getIpOffset(ip), value);
         ip.next();
     }
 
     //
     // add_sp 16
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add_sp(vmImagePtr & ip, vmStackPtr & sp) {
         uint8_t localSize = ip.getValue<0, uint8_t>();
         sp.next(localSize);
 
-        Console::trace("%08X:  add_sp %u", getIpOffset(ip), (uint32_t)localSize);
+        if (Traced) Console::trace("%08X:  add_sp %u", getIpOffset(ip), (uint32_t)localSize);
         ip.next(1 + sizeof(uint8_t));
     }
 
     //
     // add_sp_4
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add_sp_4(vmImagePtr & ip, vmStackPtr & sp) {
         sp.next(sizeof(uint32_t));
-        Console::trace("%08X:  add_sp_4", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  add_sp_4", getIpOffset(ip));
         ip.next();
     }
 
     //
     // load eax, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_load_eax(vmImagePtr & ip, vmFramePtr & fp, Register & regs) {
         uint32_t value = ip.getValue<0, uint32_t>();
         regs.eax.u32 = value;
-        Console::trace("%08X:  load eax, 0x%08X", getIpOffset(ip), value);
+        if (Traced) Console::trace("%08X:  load eax, 0x%08X", getIpOffset(ip), value);
         ip.next(1 + sizeof(uint32_t));
     }
 
     //
     // store arg0, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_store(vmImagePtr & ip, vmFramePtr & fp) {
         int8_t index = ip.getValue<0, int8_t>();
         uint32_t value = ip.getValue<0, uint32_t, uint32_t, 2>();
         fp.putArgValueUInt32(index, value);
-        Console::trace("%08X:  store args[%d], 0x%08X",
-                      getIpOffset(ip), getArgIndex(index), value);
+        if (Traced) Console::trace("%08X:  store args[%d], 0x%08X",
+                                  getIpOffset(ip), getArgIndex(index), value);
         ip.next(1 + sizeof(int8_t) + sizeof(uint32_t));
     }
 
     //
     // move arg0, arg1
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_move(vmImagePtr & ip, vmFramePtr & fp) {
         int8_t index1 = ip.getValue<0, int8_t>();
         int8_t index2 = ip.getValue<0, int8_t, int8_t, 2>();
         uint32_t value = fp.getArgValueUInt32(index2);
         fp.putArgValueUInt32(index1, value);
-        Console::trace("%08X:  move args[%d], args[%d] - 0x%08X",
-                      getIpOffset(ip), getArgIndex(index1), getArgIndex(index2), value);
+        if (Traced) Console::trace("%08X:  move args[%d], args[%d] - 0x%08X",
+                                  getIpOffset(ip), getArgIndex(index1), getArgIndex(index2), value);
         ip.next(1 + sizeof(int8_t) + sizeof(int8_t));
     }
 
     //
     // move eax, arg1
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_move_to_eax(vmImagePtr & ip, vmFramePtr & fp) {
-        Console::trace("%08X:  move eax, args[%d]", getIpOffset(ip), 0);
+        if (Traced) Console::trace("%08X:  move eax, args[%d]", getIpOffset(ip), 0);
         ip.next();
     }
 
     //
     // copy arg0, eax
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_copy_from_eax(vmImagePtr & ip, vmFramePtr & fp, Register & regs) {
         int8_t index = ip.getValue<0, int8_t>();
         uint32_t value = regs.eax.u32;
         fp.putArgValueUInt32(index, value);
-        Console::trace("%08X:  copy args[%d], eax = (0x%08X)",
-                      getIpOffset(ip), getArgIndex(index), value);
+        if (Traced) Console::trace("%08X:  copy args[%d], eax = (0x%08X)",
+                                  getIpOffset(ip), getArgIndex(index), value);
         ip.next(1 + sizeof(int8_t));
     }
 
+    template <bool Traced = true>
     JM_FORCEINLINE void op_cmp(vmImagePtr & ip, vmFramePtr & fp) {
-        Console::trace("%08X:  cmp", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  cmp", getIpOffset(ip));
         ip.next();
     }
 
     //
     // cmp arg0, arg1 (int32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_cmp_i32(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index1 = ip.getValue<0, int8_t>();
@@ -648,23 +648,26 @@ public:
         int32_t value2 = fp.getArgValueInt32(index2);
         ip.next(1 + sizeof(int8_t) * 2);
 
-        Console::trace("%08X:  cmp  args[%d], args[%d] - (%d, %d) (int32)",
-                      offset, getArgIndex(index1), getArgIndex(index2),
-                      value1, value2);
+        if (Traced) Console::trace("%08X:  cmp  args[%d], args[%d] - (%d, %d) (int32)",
+                                  offset, getArgIndex(index1), getArgIndex(index2),
+                                  value1, value2);
 
         unsigned char jmpType = ip.getUInt8();
         bool condition = this_type::getCondition(value1, value2, jmpType);
         flags.u32.low = (uint32_t)condition;
-        if (likely(!condition))
-            Console::trace("%08X:  cmp  condition [false]", offset);
-        else
-            Console::trace("%08X:  cmp  condition [true]", offset);
+        if (Traced) {
+            if (likely(!condition))
+                Console::trace("%08X:  cmp  condition [false]", offset);
+            else
+                Console::trace("%08X:  cmp  condition [true]", offset);
+        }
         return condition;
     }
 
     //
     // cmp arg0, arg1 (uint32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_cmp_u32(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index1 = ip.getValue<0, int8_t>();
@@ -673,23 +676,26 @@ public:
         uint32_t value2 = fp.getArgValueUInt32(index2);
         ip.next(1 + sizeof(int8_t) * 2);
 
-        Console::trace("%08X:  cmp  args[%d], args[%d] - (%u, %u) (uint32)",
-                      offset, getArgIndex(index1), getArgIndex(index2),
-                      value1, value2);
+        if (Traced) Console::trace("%08X:  cmp  args[%d], args[%d] - (%u, %u) (uint32)",
+                                  offset, getArgIndex(index1), getArgIndex(index2),
+                                  value1, value2);
 
         unsigned char jmpType = ip.getUInt8();
         bool condition = this_type::getCondition(value1, value2, jmpType);
         flags.u32.low = (uint32_t)condition;
-        if (likely(!condition))
-            Console::trace("%08X:  cmp  condition [false]", offset);
-        else
-            Console::trace("%08X:  cmp  condition [true]", offset);
+        if (Traced) {
+            if (likely(!condition))
+                Console::trace("%08X:  cmp  condition [false]", offset);
+            else
+                Console::trace("%08X:  cmp  condition [true]", offset);
+        }
         return condition;
     }
 
     //
     // cmp arg0, 0x00000008 (int32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_cmp_imm_i32(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -697,22 +703,25 @@ public:
         int32_t value2 = ip.getValue<0, int32_t, int32_t, 2>();
         ip.next(1 + sizeof(int8_t) + sizeof(int32_t));
 
-        Console::trace("%08X:  cmp  args[%d], 0x%08X (int32)",
-                      offset, getArgIndex(index), value2);
+        if (Traced) Console::trace("%08X:  cmp  args[%d], 0x%08X (int32)",
+                                  offset, getArgIndex(index), value2);
 
         unsigned char jmpType = ip.getUInt8();
         bool condition = this_type::getCondition(value1, value2, jmpType);
         flags.u32.low = (uint32_t)condition;
-        if (likely(!condition))
-            Console::trace("%08X:  cmp  condition [false]", offset);
-        else
-            Console::trace("%08X:  cmp  condition [true]", offset);
+        if (Traced) {
+            if (likely(!condition))
+                Console::trace("%08X:  cmp  condition [false]", offset);
+            else
+                Console::trace("%08X:  cmp  condition [true]", offset);
+        }
         return condition;
     }
 
     //
     // cmp arg0, 0x00000008 (uint32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_cmp_imm_u32(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -720,39 +729,43 @@ public:
         uint32_t value2 = ip.getValue<0, uint32_t, uint32_t, 2>();
         ip.next(1 + sizeof(int8_t) + sizeof(uint32_t));
 
-        Console::trace("%08X:  cmp  args[%d], 0x%08X (uint32)",
-                      offset, getArgIndex(index), value2);
+        if (Traced) Console::trace("%08X:  cmp  args[%d], 0x%08X (uint32)",
+                                  offset, getArgIndex(index), value2);
 
         unsigned char jmpType = ip.getUInt8();
         bool condition = this_type::getCondition(value1, value2, jmpType);
         flags.u32.low = (uint32_t)condition;
-        if (likely(!condition))
-            Console::trace("%08X:  cmp  condition [false]", offset);
-        else
-            Console::trace("%08X:  cmp  condition [true]", offset);
+        if (Traced) {
+            if (likely(!condition))
+                Console::trace("%08X:  cmp  condition [false]", offset);
+            else
+                Console::trace("%08X:  cmp  condition [true]", offset);
+        }
         return condition;
     }
 
+    template <bool Traced = true>
     JM_FORCEINLINE void op_jl(vmImagePtr & ip) {
-        Console::trace("%08X:  jl", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  jl", getIpOffset(ip));
         ip.next();
     }
 
     //
     // jl_near 0x06
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_jl_near(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int8_t jmpOffset = ip.getValue<0, int8_t>();
         if (likely(flags.u32.low != (uint32_t)true)) {
             ip.next(1 + sizeof(int8_t));
             uint32_t jmpEntry = getIpOffset(ip) + jmpOffset;
-            Console::trace("%08X:  jl   0x%08X (near)", offset, jmpEntry);
+            if (Traced) Console::trace("%08X:  jl   0x%08X (near)", offset, jmpEntry);
             return false;
         }
         else {
             ip.next(1L + sizeof(int8_t) + jmpOffset);
-            Console::trace("%08X:  jl   0x%08X (near)", offset, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  jl   0x%08X (near)", offset, getIpOffset(ip));
             return true;
         }
     }
@@ -760,18 +773,19 @@ public:
     //
     // jl_short 0x16, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_jl_short(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int16_t jmpOffset = ip.getValue<0, int16_t>();
         if (likely(flags.u32.low != (uint32_t)true)) {
             ip.next(1 + sizeof(int16_t));
             uint32_t jmpEntry = getIpOffset(ip) + jmpOffset;
-            Console::trace("%08X:  jl   0x%08X (short)", offset, jmpEntry);
+            if (Traced) Console::trace("%08X:  jl   0x%08X (short)", offset, jmpEntry);
             return false;
         }
         else {
             ip.next(1L + sizeof(int16_t) + jmpOffset);
-            Console::trace("%08X:  jl   0x%08X (short)", offset, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  jl   0x%08X (short)", offset, getIpOffset(ip));
             return true;
         }
     }
@@ -779,18 +793,19 @@ public:
     //
     // jl_long 0x29, 0x00, 0x00, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_jl_long(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int32_t jmpOffset = ip.getValue<0, int32_t>();
         if (likely(flags.u32.low != (uint32_t)true)) {
             ip.next(1 + sizeof(int32_t));
             uint32_t jmpEntry = getIpOffset(ip) + jmpOffset;
-            Console::trace("%08X:  jl   0x%08X (long)", offset, jmpEntry);
+            if (Traced) Console::trace("%08X:  jl   0x%08X (long)", offset, jmpEntry);
             return false;
         }
         else {
             ip.next(1L + sizeof(int8_t) + jmpOffset);
-            Console::trace("%08X:  jl   0x%08X (long)", offset, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  jl   0x%08X (long)", offset, getIpOffset(ip));
             return true;
         }
     }
@@ -798,46 +813,51 @@ public:
     //
     // jmp 0x00102030 (ptr32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_jmp(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         uint32_t jmpEntry = ip.getValue<0, uint32_t>();
         ip.set(image_.getStart() + jmpEntry);
-        Console::trace("%08X:  jmp  0x%08X (ptr32)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  jmp  0x%08X (ptr32)", offset, getIpOffset(ip));
     }
 
     //
     // jmp_near 0x08
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_jmp_near(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int8_t jmpOffset = ip.getValue<0, int8_t>();
         ip.next(1L + sizeof(int8_t) + jmpOffset);
-        Console::trace("%08X:  jmp  0x%08X (near)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  jmp  0x%08X (near)", offset, getIpOffset(ip));
     }
 
     //
     // jmp_short 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_jmp_short(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int16_t jmpOffset = ip.getValue<0, int16_t>();
         ip.next(1L + sizeof(int16_t) + jmpOffset);
-        Console::trace("%08X:  jmp  0x%08X (short)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  jmp  0x%08X (short)", offset, getIpOffset(ip));
     }
 
     //
     // jmp_long 0x18, 0x00, 0x00, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_jmp_long(vmImagePtr & ip) {
         uint32_t offset = getIpOffset(ip);
         int32_t jmpOffset = ip.getValue<0, int32_t>();
         ip.next(1L + sizeof(int32_t) + jmpOffset);
-        Console::trace("%08X:  jmp  0x%08X (long)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  jmp  0x%08X (long)", offset, getIpOffset(ip));
     }
 
     //
     // call 0x00102030 (ptr32)
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_call(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         uint32_t callEntry = ip.getValue<0, uint32_t>();
@@ -851,13 +871,14 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X, %u (ptr32)",
-                      offset, (uint32_t)localSize, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X, %u (ptr32)",
+                                  offset, (uint32_t)localSize, getIpOffset(ip));
     }
 
     //
     // call_short 0x08, 0x00, 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_call_short(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int16_t callOffset = ip.getValue<0, int16_t>();
@@ -871,13 +892,14 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X, %u (short)",
-                      offset, (uint32_t)localSize, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X, %u (short)",
+                                  offset, (uint32_t)localSize, getIpOffset(ip));
     }
 
     //
     // call_long 0x18, 0x00, 0x00, 0x00, 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_call_long(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int32_t callOffset = ip.getValue<0, int32_t>();
@@ -891,13 +913,14 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X, %u (long)",
-                      offset, (uint32_t)localSize, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X, %u (long)",
+                                  offset, (uint32_t)localSize, getIpOffset(ip));
     }
 
     //
     // fast_call_short 0x05, 0x00, 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_fast_call_short(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int16_t callOffset = ip.getValue<0, int16_t>();
@@ -911,24 +934,25 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  fast_call 0x%08X, %u (short)",
-                      offset, (uint32_t)localSize, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  fast_call 0x%08X, %u (short)",
+                                  offset, (uint32_t)localSize, getIpOffset(ip));
     }
 
     //
     // ret
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_ret(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         void * returnIP = pop_callstack(fp);
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret  0x%08X", offset, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  ret  0x%08X", offset, getIpOffset(ip));
             return false;
         }
         else {
-            Console::trace("%08X:  ret  (done)", offset);
+            if (Traced) Console::trace("%08X:  ret  (done)", offset);
             return true;
         }
     }
@@ -936,6 +960,7 @@ public:
     //
     // ret_n_sm 0x08
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_ret_n_sm(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         uint8_t localSize = ip.getValue<0, uint8_t>();
@@ -943,11 +968,11 @@ public:
         ip.set(returnIP);
 
         if (returnIP == nullptr) {
-            Console::trace("%08X:  ret_n_sm [%u] (done)", offset, (uint32_t)localSize);
+            if (Traced) Console::trace("%08X:  ret_n_sm [%u] (done)", offset, (uint32_t)localSize);
         }
         else {
-            Console::trace("%08X:  ret_n_sm [%u] 0x%08X",
-                          offset, (uint32_t)localSize, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  ret_n_sm [%u] 0x%08X",
+                                      offset, (uint32_t)localSize, getIpOffset(ip));
         }
 
         return (returnIP == nullptr);
@@ -956,6 +981,7 @@ public:
     //
     // ret_n 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_ret_n(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         uint16_t localSize = ip.getValue<0, uint16_t>();
@@ -963,11 +989,11 @@ public:
         ip.set(returnIP);
 
         if (returnIP == nullptr) {
-            Console::trace("%08X:  ret_n [%u] (done)", offset, (uint32_t)localSize);
+            if (Traced) Console::trace("%08X:  ret_n [%u] (done)", offset, (uint32_t)localSize);
         }
         else {
-            Console::trace("%08X:  ret_n [%u] 0x%08X",
-                          offset, (uint32_t)localSize, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  ret_n [%u] 0x%08X",
+                                      offset, (uint32_t)localSize, getIpOffset(ip));
         }
 
         return (returnIP == nullptr);
@@ -976,6 +1002,7 @@ public:
     //
     // ret_eax 0x00000001
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_ret_eax(vmImagePtr & ip, vmFramePtr & fp, Register & regs) {
         uint32_t offset = getIpOffset(ip);
         uint32_t value = ip.getValue<0, uint32_t>();
@@ -985,12 +1012,12 @@ public:
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret_eax 0x%08X (eax = 0x%08X)",
-                          offset, getIpOffset(ip), value);
+            if (Traced) Console::trace("%08X:  ret_eax 0x%08X (eax = 0x%08X)",
+                                      offset, getIpOffset(ip), value);
             return false;
         }
         else {
-            Console::trace("%08X:  ret_eax (done) (eax = 0x%08X)", offset, value);
+            if (Traced) Console::trace("%08X:  ret_eax (done) (eax = 0x%08X)", offset, value);
             return true;
         }
     }
@@ -998,6 +1025,7 @@ public:
     //
     // ret_eax_n 0x08, 0x00, 0x00000001
     //
+    template <bool Traced = true>
     JM_FORCEINLINE bool op_ret_eax_n(vmImagePtr & ip, vmFramePtr & fp, Register & regs) {
         uint32_t offset = getIpOffset(ip);
         uint16_t localSize = ip.getValue<0, uint16_t>();
@@ -1008,13 +1036,13 @@ public:
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret_eax_n [%u] 0x%08X (eax = 0x%08X)",
-                          offset, (uint32_t)localSize, getIpOffset(ip), value);
+            if (Traced) Console::trace("%08X:  ret_eax_n [%u] 0x%08X (eax = 0x%08X)",
+                                      offset, (uint32_t)localSize, getIpOffset(ip), value);
             return false;
         }
         else {
-            Console::trace("%08X:  ret_eax_n [%u] (eax = 0x%08X) (done)",
-                          offset, (uint32_t)localSize, value);
+            if (Traced) Console::trace("%08X:  ret_eax_n [%u] (eax = 0x%08X) (done)",
+                                      offset, (uint32_t)localSize, value);
             return true;
         }
     }
@@ -1022,6 +1050,7 @@ public:
     //
     // inline_call_near 0x08
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_inline_call_near(vmImagePtr & ip, vmFramePtr & fp,
                                             vmStackPtr & cp, int retType) {
         uint32_t offset = getIpOffset(ip);
@@ -1035,12 +1064,13 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X (near)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X (near)", offset, getIpOffset(ip));
     }
 
     //
     // inline_call_short 0x05, 0x00, 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_inline_call_short(vmImagePtr & ip, vmFramePtr & fp,
                                              vmStackPtr & cp, int retType) {
         uint32_t offset = getIpOffset(ip);
@@ -1055,13 +1085,14 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  fast_call 0x%08X, %u (short)",
-                      offset, (uint32_t)localSize, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  fast_call 0x%08X, %u (short)",
+                                  offset, (uint32_t)localSize, getIpOffset(ip));
     }
 
     //
     // inline_fast_call_short 0x05, 0x00, 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_inline_fast_call_short(vmImagePtr & ip, vmFramePtr & fp,
                                                   vmStackPtr & cp, int retType) {
         uint32_t offset = getIpOffset(ip);
@@ -1076,13 +1107,14 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  fast_call 0x%08X, %u (short)",
-                      offset, (uint32_t)localSize, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  fast_call 0x%08X, %u (short)",
+                                  offset, (uint32_t)localSize, getIpOffset(ip));
     }
 
     //
     // inline_call_long 0x18, 0x00, 0x00, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_inline_call_long(vmImagePtr & ip, vmFramePtr & fp,
                                             vmStackPtr & cp, int retType) {
         uint32_t offset = getIpOffset(ip);
@@ -1096,12 +1128,13 @@ public:
         assert(CHECK_ADDR_ALIGNMENT(newIP));
         ip.set(newIP);
 
-        Console::trace("%08X:  call 0x%08X (long)", offset, getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  call 0x%08X (long)", offset, getIpOffset(ip));
     }
 
     //
     // ret
     //
+    template <bool Traced = true>
     JM_FORCEINLINE int op_inline_ret(vmImagePtr & ip, vmFramePtr & fp,
                                      vmStackPtr & cp, bool & done) {
         uint32_t offset = getIpOffset(ip);
@@ -1111,11 +1144,11 @@ public:
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret  0x%08X", offset, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  ret  0x%08X", offset, getIpOffset(ip));
             done = false;
         }
         else {
-            Console::trace("%08X:  ret  (done)", offset);
+            if (Traced) Console::trace("%08X:  ret  (done)", offset);
             done = true;
         }
 
@@ -1125,6 +1158,7 @@ public:
     //
     // ret_n 0x08, 0x00
     //
+    template <bool Traced = true>
     JM_FORCEINLINE int op_inline_ret_n(vmImagePtr & ip, vmFramePtr & fp,
                                        vmStackPtr & cp, bool & done) {
         uint32_t offset = getIpOffset(ip);
@@ -1135,12 +1169,12 @@ public:
         ip.set(returnIP);
 
         if (returnIP != nullptr) {
-            Console::trace("%08X:  ret_n [%u] 0x%08X",
-                          offset, (uint32_t)localSize, getIpOffset(ip));
+            if (Traced) Console::trace("%08X:  ret_n [%u] 0x%08X",
+                                      offset, (uint32_t)localSize, getIpOffset(ip));
             done = false;
         }
         else {
-            Console::trace("%08X:  ret_n [%u] (done)", offset, (uint32_t)localSize);
+            if (Traced) Console::trace("%08X:  ret_n [%u] (done)", offset, (uint32_t)localSize);
             done = true;
         }
 
@@ -1150,6 +1184,7 @@ public:
     //
     // ret_eax_n 0x08, 0x00000001
     //
+    template <bool Traced = true>
     JM_FORCEINLINE int op_inline_ret_eax_n(vmImagePtr & ip, vmFramePtr & fp, vmStackPtr & cp,
                                            Register & regs, bool & done) {
         uint32_t offset = getIpOffset(ip);
@@ -1162,12 +1197,12 @@ public:
         ip.set(returnIP);
 
         if (returnIP == nullptr) {
-            Console::trace("%08X:  ret_eax_n %u (done) (eax = 0x%08X)",
-                          offset, (uint32_t)localSize, value);
+            if (Traced) Console::trace("%08X:  ret_eax_n %u (done) (eax = 0x%08X)",
+                                      offset, (uint32_t)localSize, value);
         }
         else {
-            Console::trace("%08X:  ret_eax_n %u, 0x%08X (eax = 0x%08X)",
-                          offset, getIpOffset(ip), (uint32_t)localSize, value);
+            if (Traced) Console::trace("%08X:  ret_eax_n %u, 0x%08X (eax = 0x%08X)",
+                                      offset, getIpOffset(ip), (uint32_t)localSize, value);
         }
 
         done = (returnIP == nullptr);
@@ -1177,23 +1212,26 @@ public:
     //
     // nop
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_nop(vmImagePtr & ip) {
-        Console::trace("%08X:  nop", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  nop", getIpOffset(ip));
         ip.next();
     }
 
     //
     // nop_n 0x08
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_nop_n(vmImagePtr & ip) {
         uint8_t skip_n = ip.getValue<0, uint8_t>();
-        Console::trace("%08X:  nop_n %u", getIpOffset(ip), (uint32_t)skip_n);
+        if (Traced) Console::trace("%08X:  nop_n %u", getIpOffset(ip), (uint32_t)skip_n);
         ip.next(1 + sizeof(uint8_t) + skip_n);
     }
 
     //
     // inc arg0
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_inc(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1201,14 +1239,15 @@ public:
         value++;
         fp.putArgValueUInt32(index, value);
 
-        Console::trace("%08X:  inc  arg[%d]  (0x%08X)",
-                      offset, getArgIndex(index), value);
+        if (Traced) Console::trace("%08X:  inc  arg[%d]  (0x%08X)",
+                                  offset, getArgIndex(index), value);
         ip.next(1 + sizeof(int8_t));
     }
 
     //
     // dec arg0
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_dec(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1216,14 +1255,15 @@ public:
         value--;
         fp.putArgValueUInt32(index, value);
 
-        Console::trace("%08X:  dec  args[%d]  (0x%08X)",
-                      offset, getArgIndex(index), value);
+        if (Traced) Console::trace("%08X:  dec  args[%d]  (0x%08X)",
+                                  offset, getArgIndex(index), value);
         ip.next(1 + sizeof(int8_t));
     }
 
     //
     // add arg0, arg1
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index1 = ip.getValue<0, int8_t>();
@@ -1234,15 +1274,16 @@ public:
         uint32_t newValue = value1 + value2;
         fp.putArgValueUInt32(index1, newValue);
 
-        Console::trace("%08X:  add  args[%d], args[%d] = (0x%08X)",
-                      offset, getArgIndex(index1), getArgIndex(index2),
-                      newValue);
+        if (Traced) Console::trace("%08X:  add  args[%d], args[%d] = (0x%08X)",
+                                  offset, getArgIndex(index1), getArgIndex(index2),
+                                  newValue);
         ip.next(1 + sizeof(int8_t) * 2);
     }
 
     //
     // add arg0, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add_imm(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1252,14 +1293,15 @@ public:
         uint32_t newValue = value1 + value2;
         fp.putArgValueUInt32(index, newValue);
 
-        Console::trace("%08X:  add  args[%d], 0x%08X = (0x%08X)",
-                      offset, getArgIndex(index), value2, newValue);
+        if (Traced) Console::trace("%08X:  add  args[%d], 0x%08X = (0x%08X)",
+                                  offset, getArgIndex(index), value2, newValue);
         ip.next(1 + sizeof(int8_t) + sizeof(uint32_t));
     }
 
     //
     // add eax, arg0
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add_eax(vmImagePtr & ip, vmFramePtr & fp, Register & regs) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1268,14 +1310,15 @@ public:
         uint32_t newValue = regs.eax.u32 + value;
         regs.eax.u32 = newValue;
 
-        Console::trace("%08X:  add  eax, args[%d] = (0x%08X)",
-                      offset, getArgIndex(index), newValue);
+        if (Traced) Console::trace("%08X:  add  eax, args[%d] = (0x%08X)",
+                                  offset, getArgIndex(index), newValue);
         ip.next(1 + sizeof(int8_t));
     }
 
     //
     // add eax, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_add_eax_imm(vmImagePtr & ip, Register & regs) {
         uint32_t offset = getIpOffset(ip);
         uint32_t value = ip.getValue<0, uint32_t, uint32_t>();
@@ -1283,14 +1326,15 @@ public:
         uint32_t newValue = regs.eax.u32 + value;
         regs.eax.u32 = newValue;
 
-        Console::trace("%08X:  add  eax, 0x%08X = (0x%08X)",
-                      offset, value, newValue);
+        if (Traced) Console::trace("%08X:  add  eax, 0x%08X = (0x%08X)",
+                                  offset, value, newValue);
         ip.next(1 + sizeof(uint32_t));
     }
 
     //
     // sub arg0, arg1
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_sub(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index1 = ip.getValue<0, int8_t>();
@@ -1300,15 +1344,16 @@ public:
         uint32_t newValue = value1 - value2;
         fp.putArgValueUInt32(index1, newValue);
 
-        Console::trace("%08X:  sub  args[%d], args[%d] = (0x%08X)",
-                      offset, getArgIndex(index1), getArgIndex(index2),
-                      newValue);
+        if (Traced) Console::trace("%08X:  sub  args[%d], args[%d] = (0x%08X)",
+                                  offset, getArgIndex(index1), getArgIndex(index2),
+                                  newValue);
         ip.next(1 + sizeof(int8_t) * 2);
     }
 
     //
     // sub arg0, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_sub_imm(vmImagePtr & ip, vmFramePtr & fp) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1318,14 +1363,15 @@ public:
         uint32_t newValue = value1 - value2;
         fp.putArgValueUInt32(index, newValue);
 
-        Console::trace("%08X:  sub  args[%d], 0x%08X = (0x%08X)",
-                      offset, getArgIndex(index), value2, newValue);
+        if (Traced) Console::trace("%08X:  sub  args[%d], 0x%08X = (0x%08X)",
+                                  offset, getArgIndex(index), value2, newValue);
         ip.next(1 + sizeof(int8_t) + sizeof(uint32_t));
     }
 
     //
     // sub eax, arg0
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_sub_eax(vmImagePtr & ip, vmFramePtr & fp, Register & regs) {
         uint32_t offset = getIpOffset(ip);
         int8_t index = ip.getValue<0, int8_t>();
@@ -1333,14 +1379,15 @@ public:
         uint32_t newValue = regs.eax.u32 - value;
         regs.eax.u32 = newValue;
 
-        Console::trace("%08X:  sub  eax, args[%d] = (0x%08X)",
-                      offset, getArgIndex(index), newValue);
+        if (Traced) Console::trace("%08X:  sub  eax, args[%d] = (0x%08X)",
+                                  offset, getArgIndex(index), newValue);
         ip.next(1 + sizeof(int8_t));
     }
 
     //
     // add eax, 0x00000006
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_sub_eax_imm(vmImagePtr & ip, Register & regs) {
         uint32_t offset = getIpOffset(ip);
         uint32_t value = ip.getValue<0, uint32_t>();
@@ -1348,24 +1395,26 @@ public:
         uint32_t newValue = regs.eax.u32 - value;
         regs.eax.u32 = newValue;
 
-        Console::trace("%08X:  sub  eax, 0x%08X = (0x%08X)",
-                      offset, value, newValue);
+        if (Traced) Console::trace("%08X:  sub  eax, 0x%08X = (0x%08X)",
+                                  offset, value, newValue);
         ip.next(1 + sizeof(uint32_t));
     }
 
     //
     // Exit the program
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_exit(vmImagePtr & ip, return_type & retValue) {
-        Console::trace("%08X:  end", getIpOffset(ip));
+        if (Traced) Console::trace("%08X:  end", getIpOffset(ip));
         ip.next();
     }
 
     //
     // Unknown opcode.
     //
+    template <bool Traced = true>
     JM_FORCEINLINE void op_unknown(vmImagePtr & ip, unsigned char opcode) {
-        Console::trace("%08X:  Error: Unknown opcode: %u", getIpOffset(ip), (uint32_t)opcode);
+        if (Traced) Console::trace("%08X:  Error: Unknown opcode: %u", getIpOffset(ip), (uint32_t)opcode);
         ip.next();
     }
 
@@ -1592,6 +1641,304 @@ Execute_Finished:
         return ec;
     }
 
+#if USE_COMPUTED_GOTO
+
+#define VM_DISPATCH_NEXT()                              \
+    do {                                                \
+        if (likely(ip.ptr() < ipLimit))                 \
+            goto *dispatchTable[ip.getUInt8()];         \
+        else                                            \
+            goto Execute_Finished;                      \
+    } while (0)
+
+#define VM_DISPATCH_RET(isDone)                         \
+    do {                                                \
+        if (likely(!(isDone)))                          \
+            VM_DISPATCH_NEXT();                         \
+        else                                            \
+            goto Execute_Finished;                      \
+    } while (0)
+
+    //
+    // Execute the vm bytecode, direct-threaded dispatch (computed goto).
+    //
+    // The handlers don't trace. If handlerTable is not null, only fill the
+    // handler addresses and return, see fillThreadedTable().
+    //
+    int execute_threaded(return_type & retVal, const void ** handlerTable = nullptr) {
+        int ec = 0;
+        if (handlerTable != nullptr) {
+            // GCC 12 takes the labels for the local variables, but their
+            // addresses never dangle.
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 12)
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wdangling-pointer"
+#endif
+            for (size_t i = 0; i < kMaxHandlers; ++i) {
+                handlerTable[i] = &&Op_unknown;
+            }
+
+            handlerTable[OpCode::error]           = &&Op_error;
+            handlerTable[OpCode::load_eax]        = &&Op_load_eax;
+            handlerTable[OpCode::store]           = &&Op_store;
+            handlerTable[OpCode::move]            = &&Op_move;
+            handlerTable[OpCode::move_to_eax]     = &&Op_move_to_eax;
+            handlerTable[OpCode::copy_from_eax]   = &&Op_copy_from_eax;
+            handlerTable[OpCode::cmp]             = &&Op_cmp;
+            handlerTable[OpCode::cmp_i32]         = &&Op_cmp_i32;
+            handlerTable[OpCode::cmp_u32]         = &&Op_cmp_u32;
+            handlerTable[OpCode::cmp_imm_i32]     = &&Op_cmp_imm_i32;
+            handlerTable[OpCode::cmp_imm_u32]     = &&Op_cmp_imm_u32;
+            handlerTable[OpCode::jl]              = &&Op_jl;
+            handlerTable[OpCode::jl_near]         = &&Op_jl_near;
+            handlerTable[OpCode::jl_short]        = &&Op_jl_short;
+            handlerTable[OpCode::jl_long]         = &&Op_jl_long;
+            handlerTable[OpCode::jmp]             = &&Op_jmp;
+            handlerTable[OpCode::jmp_near]        = &&Op_jmp_near;
+            handlerTable[OpCode::jmp_short]       = &&Op_jmp_short;
+            handlerTable[OpCode::jmp_long]        = &&Op_jmp_long;
+            handlerTable[OpCode::call]            = &&Op_call;
+            handlerTable[OpCode::call_short]      = &&Op_call_short;
+            handlerTable[OpCode::call_long]       = &&Op_call_long;
+            handlerTable[OpCode::fast_call_short] = &&Op_fast_call_short;
+            handlerTable[OpCode::ret]             = &&Op_ret;
+            handlerTable[OpCode::ret_n_sm]        = &&Op_ret_n_sm;
+            handlerTable[OpCode::ret_n]           = &&Op_ret_n;
+            handlerTable[OpCode::ret_eax]         = &&Op_ret_eax;
+            handlerTable[OpCode::ret_eax_n]       = &&Op_ret_eax_n;
+            handlerTable[OpCode::nop]             = &&Op_nop;
+            handlerTable[OpCode::nop_n]           = &&Op_nop_n;
+            handlerTable[OpCode::inc]             = &&Op_inc;
+            handlerTable[OpCode::dec]             = &&Op_dec;
+            handlerTable[OpCode::add]             = &&Op_add;
+            handlerTable[OpCode::add_imm]         = &&Op_add_imm;
+            handlerTable[OpCode::add_eax]         = &&Op_add_eax;
+            handlerTable[OpCode::add_eax_imm]     = &&Op_add_eax_imm;
+            handlerTable[OpCode::sub]             = &&Op_sub;
+            handlerTable[OpCode::sub_imm]         = &&Op_sub_imm;
+            handlerTable[OpCode::sub_eax]         = &&Op_sub_eax;
+            handlerTable[OpCode::sub_eax_imm]     = &&Op_sub_eax_imm;
+            handlerTable[OpCode::exit]            = &&Op_exit;
+#if defined(__GNUC__) && !defined(__clang__) && (__GNUC__ >= 12)
+#pragma GCC diagnostic pop
+#endif
+            return ec;
+        }
+
+        if (isInited()) {
+            register vmImagePtr ip;
+            register vmFramePtr fp;
+            register Register   regs;
+
+            // The handler addresses are the same for all the interpreters,
+            // the table is filled once by the first run.
+            static const void * dispatchTable[kMaxHandlers];
+            static const bool dispatchTableFilled = fillThreadedTable(dispatchTable);
+            (void)dispatchTableFilled;
+
+            unsigned char * ipLimit = image_.getLimit();
+
+            // Init environment
+            ip.set(image_.getPtr());
+            fp.set(stack_.current());
+            regs.uval = 0;
+
+            // Push call program entry.
+            push_callstack(fp, nullptr, 0);
+
+            // Enter the first handler
+            VM_DISPATCH_NEXT();
+
+Op_error:
+            op_error<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_load_eax:
+            op_load_eax<false>(ip, fp, regs);
+            VM_DISPATCH_NEXT();
+
+Op_store:
+            op_store<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_move:
+            op_move<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_move_to_eax:
+            op_move_to_eax<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_copy_from_eax:
+            op_copy_from_eax<false>(ip, fp, regs);
+            VM_DISPATCH_NEXT();
+
+Op_cmp:
+            op_cmp<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_cmp_i32:
+            op_cmp_i32<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_cmp_u32:
+            op_cmp_u32<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_cmp_imm_i32:
+            op_cmp_imm_i32<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_cmp_imm_u32:
+            op_cmp_imm_u32<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_jl:
+            op_jl<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jl_near:
+            op_jl_near<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jl_short:
+            op_jl_short<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jl_long:
+            op_jl_long<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jmp:
+            op_jmp<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jmp_near:
+            op_jmp_near<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jmp_short:
+            op_jmp_short<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_jmp_long:
+            op_jmp_long<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_call:
+            op_call<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_call_short:
+            op_call_short<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_call_long:
+            op_call_long<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_fast_call_short:
+            op_fast_call_short<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_ret:
+            VM_DISPATCH_RET(op_ret<false>(ip, fp));
+
+Op_ret_n_sm:
+            VM_DISPATCH_RET(op_ret_n_sm<false>(ip, fp));
+
+Op_ret_n:
+            VM_DISPATCH_RET(op_ret_n<false>(ip, fp));
+
+Op_ret_eax:
+            VM_DISPATCH_RET(op_ret_eax<false>(ip, fp, regs));
+
+Op_ret_eax_n:
+            VM_DISPATCH_RET(op_ret_eax_n<false>(ip, fp, regs));
+
+Op_nop:
+            op_nop<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_nop_n:
+            op_nop_n<false>(ip);
+            VM_DISPATCH_NEXT();
+
+Op_inc:
+            op_inc<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_dec:
+            op_dec<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_add:
+            op_add<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_add_imm:
+            op_add_imm<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_add_eax:
+            op_add_eax<false>(ip, fp, regs);
+            VM_DISPATCH_NEXT();
+
+Op_add_eax_imm:
+            op_add_eax_imm<false>(ip, regs);
+            VM_DISPATCH_NEXT();
+
+Op_sub:
+            op_sub<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_sub_imm:
+            op_sub_imm<false>(ip, fp);
+            VM_DISPATCH_NEXT();
+
+Op_sub_eax:
+            op_sub_eax<false>(ip, fp, regs);
+            VM_DISPATCH_NEXT();
+
+Op_sub_eax_imm:
+            op_sub_eax_imm<false>(ip, regs);
+            VM_DISPATCH_NEXT();
+
+Op_exit:
+            op_exit<false>(ip, retVal);
+            goto Execute_Finished;
+
+Op_unknown:
+            op_unknown<false>(ip, ip.getUInt8());
+            VM_DISPATCH_NEXT();
+
+Execute_Finished:
+            retVal.setDataType(return_type::Basic);
+            retVal.setValue(regs.eax.u32);
+        }
+        return ec;
+    }
+
+#undef VM_DISPATCH_NEXT
+#undef VM_DISPATCH_RET
+
+    bool fillThreadedTable(const void ** handlerTable) {
+        return_type dummy;
+        execute_threaded(dummy, handlerTable);
+        return true;
+    }
+
+#else // !USE_COMPUTED_GOTO
+
+    //
+    // Computed goto is not supported, fallback to the switch dispatch.
+    //
+    int execute_threaded(return_type & retVal) {
+        return execute(retVal);
+    }
+
+#endif // USE_COMPUTED_GOTO
+
     enum {
         ret_first,
         ret_00,
@@ -1679,16 +2026,39 @@ Execute_Finished:
         return ec;
     }
 
+    //
+    // Run the loop, a hit on the guard regions of the stacks returns
+    // Error::StackGuard_Overflow.
+    //
+    template <typename Execute>
+    int run_guarded(Execute execute) {
+#if USE_VM_STACK_GUARD
+        vmStackGuard::Scope scope;
+        scope.add(stack_);
+        scope.add(callstack_);
+        if (sigsetjmp(scope.jumpBuffer(), 0) != 0) {
+            return Error::StackGuard_Overflow;
+        }
+#endif
+        return execute();
+    }
+
     int run(return_type & retVal) {
         ip_.set(image_.getPtr());
         fp_.set(stack_.current());
-        return execute(retVal);
+        return run_guarded([&]() { return execute(retVal); });
     }
 
     int run_inline(return_type & retVal) {
         ip_.set(image_.getPtr());
         fp_.set(stack_.current());
-        return execute_inline(retVal);
+        return run_guarded([&]() { return execute_inline(retVal); });
+    }
+
+    int run_threaded(return_type & retVal) {
+        ip_.set(image_.getPtr());
+        fp_.set(stack_.current());
+        return run_guarded([&]() { return execute_threaded(retVal); });
     }
 };
 
@@ -1759,6 +2129,12 @@ public:
         int ec = context_.run_inline(ret);
         return ec;
     }
+
+    int run_threaded(return_type & ret) {
+        binary_.setInput(ret.getValue());
+        int ec = context_.run_threaded(ret);
+        return ec;
+    }
 };
 
 template <typename BasicType = uintptr_t>
@@ -1790,39 +2166,14 @@ public:
         int ec = engine_.run_inline(ret);
         return ec;
     }
+
+    int run_threaded(return_type & ret) {
+        int ec = engine_.run_threaded(ret);
+        return ec;
+    }
 };
 
 } // namespace v4
 } // namespace jlang
 
-#undef JLANG_VM_ARGS_DEFINE_H
-
-#undef __arg0 
-#undef __arg1 
-#undef __arg2 
-#undef __arg3 
-#undef __arg4 
-#undef __arg5 
-#undef __arg6 
-#undef __arg7 
-#undef __arg8 
-#undef __arg9 
-
-#undef __var0 
-#undef __var1 
-#undef __var2 
-#undef __var3 
-#undef __var4 
-#undef __var5 
-#undef __var6 
-#undef __var7 
-#undef __var8 
-#undef __var9 
-#undef __var10
-#undef __var11
-#undef __var12
-#undef __var13
-#undef __var14
-#undef __var15
-
 #endif // JLANG_VM_INTERPRETER_V4_H
@@ -0,0 +1,735 @@
+
+#ifndef JLANG_VM_INTERPRETER_V5_H
+#define JLANG_VM_INTERPRETER_V5_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/vm/Interpreter.h"
+#include "jlang/vm/Interpreter_v3.h"
+#include "jlang/vm/PreDecoder.h"
+#include "jlang/vm/StackGuard.h"
+#include "jlang/lang/Error.h"
+#include "jlang/system/Console.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+//////////////////////////////////////////////////////////////
+
+/* Is support the guaranteed tail call attribute ? */
+#ifndef JM_MUSTTAIL
+#if defined(__has_attribute)
+#if __has_attribute(musttail)
+#define JM_MUSTTAIL             __attribute__((musttail))
+#endif
+#endif
+#endif // JM_MUSTTAIL
+
+//
+// The handlers chain to the next handler with a tail call, it must be
+// compiled to a jump, otherwise the native stack will grow on every opcode.
+// Only musttail guarantees it, the sibling call optimization may be skipped
+// by the optimizer, so the other compilers use the trampoline loop.
+//
+#ifndef USE_TAIL_CALL_DISPATCH
+#if defined(JM_MUSTTAIL)
+#define USE_TAIL_CALL_DISPATCH  1
+#else
+#define USE_TAIL_CALL_DISPATCH  0
+#endif
+#endif // USE_TAIL_CALL_DISPATCH
+
+#if USE_TAIL_CALL_DISPATCH && !defined(JM_MUSTTAIL)
+#error "USE_TAIL_CALL_DISPATCH requires the musttail attribute."
+#endif
+
+#ifndef JM_MUSTTAIL
+#define JM_MUSTTAIL
+#endif
+
+//
+// The trampoline loop passes the VM state through memory on every opcode,
+// it's slower than the v3 threaded loop, so the v5 interpreter is built by
+// default only when the tail calls are guaranteed. Define it to 1 to build
+// the trampoline loop anyway.
+//
+#ifndef USE_INTERPRETER_V5
+#define USE_INTERPRETER_V5      USE_TAIL_CALL_DISPATCH
+#endif // USE_INTERPRETER_V5
+
+//////////////////////////////////////////////////////////////
+
+#if USE_INTERPRETER_V5
+
+using namespace std;
+
+namespace jlang {
+namespace v5 {
+
+using v3::vmInstruction;
+using v3::vmDecodedImage;
+using v3::PreDecoder;
+
+struct vmContextRegs {
+    const vmInstruction *   ip_;
+    unsigned char *         sp_;
+    unsigned char *         fp_;
+    Register                regs_;
+    Integer                 flags;
+
+    vmContextRegs() : ip_(nullptr), sp_(nullptr), fp_(nullptr) {
+        regs_.uval = 0;
+        flags.uval = 0;
+    }
+    ~vmContextRegs() {}
+
+    void clear() {
+        ip_ = nullptr;
+        sp_ = nullptr;
+        fp_ = nullptr;
+        regs_.uval = 0;
+        flags.uval = 0;
+    }
+};
+
+template <typename BasicType>
+class ExecutionEngine;
+
+template <typename BasicType = uintptr_t>
+class ExecutionContext : public IExecutionContext<BasicType>,
+                         public vmContextRegs {
+public:
+    typedef BasicType                       basic_type;
+    typedef IExecutionContext<basic_type>   base_type;
+    typedef size_t                          size_type;
+    typedef ExecutionEngine<basic_type>     engine_type;
+    typedef vmReturn<basic_type>            return_type;
+    typedef vmContextRegs                   ctx_reg_type;
+    typedef ExecutionContext<basic_type>    this_type;
+
+    //
+    // The handler of each opcode, the VM state (ip, sp, fp, regs) is passed
+    // in the argument registers, return false when the execution is done.
+    //
+    typedef bool (*handler_type)(const vmInstruction * ip, unsigned char * sp,
+                                 unsigned char * fp, Register regs, this_type * ctx);
+
+    static const size_type kDefaultStackSize = 8 * 1048576U;
+    static const size_type kMaxHandlers = 256;
+
+private:
+    vmStack<basic_type, false>      stack_;
+    v3::vmImageInfo<basic_type>     image_;
+    vmHeap<basic_type>              heap_;
+    vmDecodedImage                  decoded_;
+    engine_type *                   engine_;
+
+public:
+    ExecutionContext(engine_type * engine = nullptr) : engine_(engine) {}
+    virtual ~ExecutionContext() {
+        destroy();
+    }
+
+    vmThreadId getId() { return 1; }
+    void setId(vmThreadId id) {
+    }
+
+    bool isInited() const {
+        return (image_.isInited() && stack_.isInited());
+    }
+
+    engine_type * getEngine() { return engine_; }
+    void setEngine(engine_type * engine) {
+        engine_ = engine;
+    }
+
+    void setImageInfo(void * imageStart, size_t imageSize,
+                      void * imageEntry) {
+        image_.setting(imageStart, imageSize, imageEntry);
+    }
+
+    void create(size_type stackSize = kDefaultStackSize) {
+        stack_.create(stackSize);
+    }
+
+    void destroy() {
+        stack_.destroy();
+        decoded_.deallocate();
+        image_.clear();
+    }
+
+    bool sp_isOverflow(const unsigned char * sp) const {
+        return (sp >= stack_.last());
+    }
+
+    // The frame layout is same as the v3 forward stack: [fp, returnIP].
+    JM_FORCEINLINE static void push_callstack(unsigned char *& sp, unsigned char *& fp,
+                                              const void * returnIP) {
+        *(unsigned char **)sp = fp;
+        sp += sizeof(void *);
+        *(const void **)sp = returnIP;
+        sp += sizeof(void *);
+        fp = sp;
+    }
+
+    JM_FORCEINLINE static const void * pop_callstack(unsigned char *& sp, unsigned char *& fp) {
+        sp -= sizeof(void *);
+        const void * returnIP = *(const void **)sp;
+        sp -= sizeof(void *);
+        fp = *(unsigned char **)sp;
+        return returnIP;
+    }
+
+    JM_FORCEINLINE static const void * pop_callstack(unsigned char *& sp, unsigned char *& fp,
+                                                     uint16_t localSize) {
+        sp -= localSize;
+        assert((localSize & 0x03) == 0);
+        return pop_callstack(sp, fp);
+    }
+
+    JM_FORCEINLINE static uint32_t getArgValueUInt32(const unsigned char * fp, int32_t index) {
+        return *(((const uint32_t *)fp) + index);
+    }
+
+    JM_FORCEINLINE static int32_t getArgValueInt32(const unsigned char * fp, int32_t index) {
+        return *(((const int32_t *)fp) + index);
+    }
+
+    JM_FORCEINLINE static void putArgValueUInt32(unsigned char * fp, int32_t index, uint32_t value) {
+        *(((uint32_t *)fp) + index) = value;
+    }
+
+    template <typename U>
+    JM_FORCEINLINE static void push(unsigned char *& sp, U value) {
+        *(U *)sp = value;
+        sp += sizeof(U);
+    }
+
+#define VM_HANDLER(op)                                                  \
+    static bool insn_##op(const vmInstruction * ip, unsigned char * sp,   \
+                          unsigned char * fp, Register regs, this_type * ctx)
+
+#if USE_TAIL_CALL_DISPATCH
+#define VM_NEXT()                                                       \
+    JM_MUSTTAIL return ((handler_type)ip->handler)(ip, sp, fp, regs, ctx)
+#else
+#define VM_NEXT()                                                       \
+    do {                                                                \
+        ctx->ip_ = ip;                                                  \
+        ctx->sp_ = sp;                                                  \
+        ctx->fp_ = fp;                                                  \
+        ctx->regs_ = regs;                                              \
+        return true;                                                    \
+    } while (0)
+#endif // USE_TAIL_CALL_DISPATCH
+
+#define VM_EXIT()                                                       \
+    do {                                                                \
+        ctx->regs_ = regs;                                              \
+        return false;                                                   \
+    } while (0)
+
+    VM_HANDLER(push) {
+        push<uint32_t>(sp, getArgValueUInt32(fp, ip->index));
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(push_i32) {
+        push<int32_t>(sp, ip->imm.i32);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(push_i64) {
+        push<int64_t>(sp, ip->imm.i64);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(push_i32_0) {
+        push<int32_t>(sp, 0);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(push_i64_0) {
+        push<int64_t>(sp, 0);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(pop_i32) {
+        sp -= sizeof(uint32_t);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(pop_i64) {
+        sp -= sizeof(uint64_t);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(add_sp) {
+        sp += ip->index;
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(add_sp_4) {
+        sp += sizeof(uint32_t);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(load_eax) {
+        regs.eax.u32 = ip->imm.u32;
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(store) {
+        putArgValueUInt32(fp, ip->index, ip->imm.u32);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(copy_from_eax) {
+        putArgValueUInt32(fp, ip->index, regs.eax.u32);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(cmp_i32) {
+        int32_t value1 = getArgValueInt32(fp, ip->index);
+        int32_t value2 = getArgValueInt32(fp, ip->index2);
+        ctx->flags.u32.low = (uint32_t)v3::ExecutionContext<basic_type>::getCondition(
+                                                value1, value2, ip->cond);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(cmp_u32) {
+        uint32_t value1 = getArgValueUInt32(fp, ip->index);
+        uint32_t value2 = getArgValueUInt32(fp, ip->index2);
+        ctx->flags.u32.low = (uint32_t)v3::ExecutionContext<basic_type>::getCondition(
+                                                value1, value2, ip->cond);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(cmp_imm_i32) {
+        int32_t value1 = getArgValueInt32(fp, ip->index);
+        int32_t value2 = ip->imm.i32;
+        ctx->flags.u32.low = (uint32_t)v3::ExecutionContext<basic_type>::getCondition(
+                                                value1, value2, ip->cond);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(cmp_imm_u32) {
+        uint32_t value1 = getArgValueUInt32(fp, ip->index);
+        uint32_t value2 = ip->imm.u32;
+        ctx->flags.u32.low = (uint32_t)v3::ExecutionContext<basic_type>::getCondition(
+                                                value1, value2, ip->cond);
+        ip++;
+        VM_NEXT();
+    }
+
+    // jl, jl_near, jl_short, jl_long
+    VM_HANDLER(jl) {
+        if (likely(ctx->flags.u32.low != (uint32_t)true))
+            ip++;
+        else
+            ip = ip->target;
+        VM_NEXT();
+    }
+
+    // jmp, jmp_near, jmp_short, jmp_long
+    VM_HANDLER(jmp) {
+        ip = ip->target;
+        VM_NEXT();
+    }
+
+    // call, call_near, call_short, call_long
+    VM_HANDLER(call) {
+        push_callstack(sp, fp, (const void *)(ip + 1));
+        assert(!ctx->sp_isOverflow(sp));
+        ip = ip->target;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(ret) {
+        ip = (const vmInstruction *)pop_callstack(sp, fp);
+        if (likely(ip != nullptr))
+            VM_NEXT();
+        else
+            VM_EXIT();
+    }
+
+    // ret_n_sm, ret_n
+    VM_HANDLER(ret_n) {
+        ip = (const vmInstruction *)pop_callstack(sp, fp, (uint16_t)ip->index);
+        if (likely(ip != nullptr))
+            VM_NEXT();
+        else
+            VM_EXIT();
+    }
+
+    VM_HANDLER(ret_eax) {
+        regs.eax.u32 = ip->imm.u32;
+        ip = (const vmInstruction *)pop_callstack(sp, fp);
+        if (likely(ip != nullptr))
+            VM_NEXT();
+        else
+            VM_EXIT();
+    }
+
+    VM_HANDLER(ret_eax_n) {
+        regs.eax.u32 = ip->imm.u32;
+        ip = (const vmInstruction *)pop_callstack(sp, fp, (uint16_t)ip->index);
+        if (likely(ip != nullptr))
+            VM_NEXT();
+        else
+            VM_EXIT();
+    }
+
+    VM_HANDLER(nop) {
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(inc) {
+        uint32_t value = getArgValueUInt32(fp, ip->index);
+        putArgValueUInt32(fp, ip->index, value + 1);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(dec) {
+        uint32_t value = getArgValueUInt32(fp, ip->index);
+        putArgValueUInt32(fp, ip->index, value - 1);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(add) {
+        uint32_t value1 = getArgValueUInt32(fp, ip->index);
+        uint32_t value2 = getArgValueUInt32(fp, ip->index2);
+        putArgValueUInt32(fp, ip->index, value1 + value2);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(add_imm) {
+        uint32_t value = getArgValueUInt32(fp, ip->index);
+        putArgValueUInt32(fp, ip->index, value + ip->imm.u32);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(add_eax) {
+        regs.eax.u32 += getArgValueUInt32(fp, ip->index);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(add_eax_imm) {
+        regs.eax.u32 += ip->imm.u32;
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(sub) {
+        uint32_t value1 = getArgValueUInt32(fp, ip->index);
+        uint32_t value2 = getArgValueUInt32(fp, ip->index2);
+        putArgValueUInt32(fp, ip->index, value1 - value2);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(sub_imm) {
+        uint32_t value = getArgValueUInt32(fp, ip->index);
+        putArgValueUInt32(fp, ip->index, value - ip->imm.u32);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(sub_eax) {
+        regs.eax.u32 -= getArgValueUInt32(fp, ip->index);
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(sub_eax_imm) {
+        regs.eax.u32 -= ip->imm.u32;
+        ip++;
+        VM_NEXT();
+    }
+
+    VM_HANDLER(exit) {
+        VM_EXIT();
+    }
+
+    VM_HANDLER(unknown) {
+        Console::trace("%08X:  Error: Unknown opcode: %u",
+                       ip->offset, (uint32_t)ip->opcode);
+        ip++;
+        VM_NEXT();
+    }
+
+#undef VM_HANDLER
+#undef VM_NEXT
+#undef VM_EXIT
+
+    static void getHandlerTable(const void ** handlerTable) {
+        for (size_t i = 0; i < kMaxHandlers; ++i) {
+            handlerTable[i] = (const void *)&insn_unknown;
+        }
+
+        handlerTable[OpCode::push]          = (const void *)&insn_push;
+        handlerTable[OpCode::push_i32]      = (const void *)&insn_push_i32;
+        handlerTable[OpCode::push_i64]      = (const void *)&insn_push_i64;
+        handlerTable[OpCode::push_i32_0]    = (const void *)&insn_push_i32_0;
+        handlerTable[OpCode::push_i64_0]    = (const void *)&insn_push_i64_0;
+        handlerTable[OpCode::pop]           = (const void *)&insn_pop_i32;
+        handlerTable[OpCode::pop_i32]       = (const void *)&insn_pop_i32;
+        handlerTable[OpCode::pop_i64]       = (const void *)&insn_pop_i64;
+        handlerTable[OpCode::add_sp]        = (const void *)&insn_add_sp;
+        handlerTable[OpCode::add_sp_4]      = (const void *)&insn_add_sp_4;
+        handlerTable[OpCode::load_eax]      = (const void *)&insn_load_eax;
+        handlerTable[OpCode::store]         = (const void *)&insn_store;
+        handlerTable[OpCode::copy_from_eax] = (const void *)&insn_copy_from_eax;
+        handlerTable[OpCode::cmp_i32]       = (const void *)&insn_cmp_i32;
+        handlerTable[OpCode::cmp_u32]       = (const void *)&insn_cmp_u32;
+        handlerTable[OpCode::cmp_imm_i32]   = (const void *)&insn_cmp_imm_i32;
+        handlerTable[OpCode::cmp_imm_u32]   = (const void *)&insn_cmp_imm_u32;
+        handlerTable[OpCode::jl_near]       = (const void *)&insn_jl;
+        handlerTable[OpCode::jl_short]      = (const void *)&insn_jl;
+        handlerTable[OpCode::jl_long]       = (const void *)&insn_jl;
+        handlerTable[OpCode::jmp]           = (const void *)&insn_jmp;
+        handlerTable[OpCode::jmp_near]      = (const void *)&insn_jmp;
+        handlerTable[OpCode::jmp_short]     = (const void *)&insn_jmp;
+        handlerTable[OpCode::jmp_long]      = (const void *)&insn_jmp;
+        handlerTable[OpCode::call]          = (const void *)&insn_call;
+        handlerTable[OpCode::call_near]     = (const void *)&insn_call;
+        handlerTable[OpCode::call_short]    = (const void *)&insn_call;
+        handlerTable[OpCode::call_long]     = (const void *)&insn_call;
+        handlerTable[OpCode::ret]           = (const void *)&insn_ret;
+        handlerTable[OpCode::ret_n_sm]      = (const void *)&insn_ret_n;
+        handlerTable[OpCode::ret_n]         = (const void *)&insn_ret_n;
+        handlerTable[OpCode::ret_eax]       = (const void *)&insn_ret_eax;
+        handlerTable[OpCode::ret_eax_n]     = (const void *)&insn_ret_eax_n;
+        handlerTable[OpCode::error]         = (const void *)&insn_nop;
+        handlerTable[OpCode::move]          = (const void *)&insn_nop;
+        handlerTable[OpCode::move_to_eax]   = (const void *)&insn_nop;
+        handlerTable[OpCode::cmp]           = (const void *)&insn_nop;
+        handlerTable[OpCode::jl]            = (const void *)&insn_nop;
+        handlerTable[OpCode::nop]           = (const void *)&insn_nop;
+        handlerTable[OpCode::nop_n]         = (const void *)&insn_nop;
+        handlerTable[OpCode::inc]           = (const void *)&insn_inc;
+        handlerTable[OpCode::dec]           = (const void *)&insn_dec;
+        handlerTable[OpCode::add]           = (const void *)&insn_add;
+        handlerTable[OpCode::add_imm]       = (const void *)&insn_add_imm;
+        handlerTable[OpCode::add_eax]       = (const void *)&insn_add_eax;
+        handlerTable[OpCode::add_eax_imm]   = (const void *)&insn_add_eax_imm;
+        handlerTable[OpCode::sub]           = (const void *)&insn_sub;
+        handlerTable[OpCode::sub_imm]       = (const void *)&insn_sub_imm;
+        handlerTable[OpCode::sub_eax]       = (const void *)&insn_sub_eax;
+        handlerTable[OpCode::sub_eax_imm]   = (const void *)&insn_sub_eax_imm;
+        handlerTable[OpCode::exit]          = (const void *)&insn_exit;
+    }
+
+    //
+    // Translate the byte code image to the pre-decoded records,
+    // the handler of each record is the address of insn_* function.
+    //
+    int predecode() {
+        const void * handlerTable[kMaxHandlers];
+        getHandlerTable(handlerTable);
+
+        size_t imageSize = (size_t)(image_.getLimit() - image_.getStart());
+        size_t entryOffset = (size_t)(image_.getPtr() - image_.getStart());
+        return PreDecoder::translate(decoded_, image_.getStart(), imageSize,
+                                     entryOffset, handlerTable);
+    }
+
+    int execute(return_type & retVal) {
+        int ec = 0;
+        if (isInited() && decoded_.isInited()) {
+            const vmInstruction * ip = decoded_.entry();
+            unsigned char * sp = stack_.current();
+            unsigned char * fp = stack_.current();
+            Register regs;
+            regs.uval = 0;
+            flags.uval = 0;
+
+            // Push call program entry.
+            push_callstack(sp, fp, nullptr);
+
+#if USE_TAIL_CALL_DISPATCH
+            // Enter the first handler, it returns when the program is done.
+            ((handler_type)ip->handler)(ip, sp, fp, regs, this);
+#else
+            // The trampoline loop, each handler saves the VM state and returns.
+            ip_ = ip;
+            sp_ = sp;
+            fp_ = fp;
+            regs_ = regs;
+            while (((handler_type)ip_->handler)(ip_, sp_, fp_, regs_, this)) {
+                // Nothing to do
+            }
+#endif // USE_TAIL_CALL_DISPATCH
+
+            retVal.setDataType(return_type::Basic);
+            retVal.setValue(regs_.eax.u32);
+        }
+        return ec;
+    }
+
+    //
+    // A hit on the guard regions of the stack returns
+    // Error::StackGuard_Overflow.
+    //
+    int run(return_type & retVal) {
+        ip_ = nullptr;
+        sp_ = stack_.current();
+        fp_ = stack_.current();
+#if USE_VM_STACK_GUARD
+        vmStackGuard::Scope scope;
+        scope.add(stack_);
+        if (sigsetjmp(scope.jumpBuffer(), 0) != 0) {
+            return Error::StackGuard_Overflow;
+        }
+#endif
+        return execute(retVal);
+    }
+};
+
+template <typename BasicType = uintptr_t>
+class ExecutionEngine {
+public:
+    typedef BasicType                       basic_type;
+    typedef size_t                          size_type;
+    typedef ExecutionContext<basic_type>    context_type;
+    typedef vmReturn<basic_type>            return_type;
+    typedef ExecutionEngine<basic_type>     this_type;
+
+private:
+    v3::vmBinaryFile binary_;
+    context_type     context_;
+
+    // The records are translated for the input, they're cached until it changes.
+    bool             decoded_;
+    basic_type       decodedInput_;
+
+public:
+    ExecutionEngine() : decoded_(false), decodedInput_(0) {}
+    virtual ~ExecutionEngine() {
+        destroy();
+    }
+
+    bool isInited() const { return (context_.getId() != 0); }
+
+    int create() {
+        int ec = binary_.loadFromFile("test.bin");
+        if (ec <= 0) {
+            return Error::BinaryFile_Read_Failed;
+        }
+
+        context_.setImageInfo(binary_.getImagePtr(), binary_.getImageSize(),
+                              binary_.getImageEntry());
+
+        bool success = createContext();
+        if (!success) {
+            return Error::MainProcess_Create_Failed;
+        }
+
+        ec = context_.predecode();
+        if (ec != Error::Ok) {
+            return ec;
+        }
+        decoded_ = false;
+
+        return (int)success;
+    }
+
+    void destroy() {
+        destroyContext();
+    }
+
+    bool createContext() {
+        if (!context_.isInited()) {
+            context_.create();
+        }
+
+        return context_.isInited();
+    }
+
+    void destroyContext() {
+        if (context_.isInited()) {
+            context_.destroy();
+        }
+    }
+
+    int run(return_type & ret) {
+        // The input is patched into the image, so translate it again when
+        // the input changes.
+        if (!decoded_ || decodedInput_ != ret.getValue()) {
+            decoded_ = false;
+            binary_.setInput(ret.getValue());
+            int ec = context_.predecode();
+            if (ec != Error::Ok) {
+                return ec;
+            }
+            decoded_ = true;
+            decodedInput_ = ret.getValue();
+        }
+        int ec = context_.run(ret);
+        return ec;
+    }
+};
+
+template <typename BasicType = uintptr_t>
+class Interpreter {
+public:
+    typedef BasicType                   basic_type;
+    typedef ExecutionEngine<basic_type> engine_type;
+    typedef vmReturn<basic_type>        return_type;
+    typedef Interpreter<basic_type>     this_type;
+
+private:
+    engine_type engine_;
+
+public:
+    Interpreter() {}
+    ~Interpreter() {}
+
+    //
+    // The dispatch mode that's compiled in, "tailcall" or "trampoline".
+    //
+    static const char * getDispatchMode() {
+        return (USE_TAIL_CALL_DISPATCH ? "tailcall" : "trampoline");
+    }
+
+    int create() {
+        int ec = engine_.create();
+        return ec;
+    }
+
+    int run(return_type & ret) {
+        int ec = engine_.run(ret);
+        return ec;
+    }
+};
+
+} // namespace v5
+} // namespace jlang
+
+#endif // USE_INTERPRETER_V5
+
+#endif // JLANG_VM_INTERPRETER_V5_H
@@ -0,0 +1,769 @@
+#ifndef JLANG_VM_JITCOMPILER_H
+#define JLANG_VM_JITCOMPILER_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/vm/Interpreter.h"
+#include "jlang/vm/PreDecoder.h"
+#include "jlang/lang/Error.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <sys/mman.h>
+#endif // _WIN32
+
+//////////////////////////////////////////////////////////////
+
+/* Is the host x86-64 ? The stack layout is checked by the callers, see kIsNativeLayout. */
+#ifndef USE_JIT_X86_64
+#if defined(WIN64) || defined(_WIN64) || defined(_M_X64) || defined(_M_AMD64) \
+ || defined(__amd64__) || defined(__x86_64__)
+#define USE_JIT_X86_64          1
+#else
+#define USE_JIT_X86_64          0
+#endif
+#endif // USE_JIT_X86_64
+
+//////////////////////////////////////////////////////////////
+
+namespace jlang {
+namespace v3 {
+
+//
+// The native entry of the compiled image, it takes the current address
+// of the VM stack and returns the VM eax. A call beyond the limit stops
+// the run, and sets the overflow to 1.
+//
+typedef uint32_t (*vmJitFunc)(void * stack, const void * limit, uint32_t * overflow);
+
+//
+// The executable memory of the compiled code, it's writable only while
+// the code is copied in, and then it's turned to read + execute.
+//
+class vmJitCode {
+private:
+    void *  code_;
+    size_t  size_;
+    size_t  allocSize_;
+
+public:
+    vmJitCode() : code_(nullptr), size_(0), allocSize_(0) {}
+    ~vmJitCode() {
+        this->deallocate();
+    }
+
+    bool isInited() const { return (code_ != nullptr); }
+
+    void * data() const { return code_; }
+    size_t size() const { return size_; }
+
+    vmJitFunc entry() const { return (vmJitFunc)code_; }
+
+    int assign(const uint8_t * code, size_t codeSize) {
+        this->deallocate();
+
+        size_t allocSize = (codeSize + 4095) & ~(size_t)4095;
+#if defined(_WIN32)
+        void * memory = ::VirtualAlloc(NULL, allocSize, MEM_COMMIT | MEM_RESERVE, PAGE_READWRITE);
+        if (memory == NULL)
+            return Error::Jit_Alloc_Failed;
+        memcpy(memory, (const void *)code, codeSize);
+        DWORD oldProtect;
+        if (!::VirtualProtect(memory, allocSize, PAGE_EXECUTE_READ, &oldProtect)) {
+            ::VirtualFree(memory, 0, MEM_RELEASE);
+            return Error::Jit_Alloc_Failed;
+        }
+        ::FlushInstructionCache(::GetCurrentProcess(), memory, allocSize);
+#else
+        void * memory = ::mmap(NULL, allocSize, PROT_READ | PROT_WRITE,
+                               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (memory == MAP_FAILED)
+            return Error::Jit_Alloc_Failed;
+        memcpy(memory, (const void *)code, codeSize);
+        if (::mprotect(memory, allocSize, PROT_READ | PROT_EXEC) != 0) {
+            ::munmap(memory, allocSize);
+            return Error::Jit_Alloc_Failed;
+        }
+#endif // _WIN32
+        code_ = memory;
+        size_ = codeSize;
+        allocSize_ = allocSize;
+        return Error::Ok;
+    }
+
+    void deallocate() {
+        if (code_) {
+#if defined(_WIN32)
+            ::VirtualFree(code_, 0, MEM_RELEASE);
+#else
+            ::munmap(code_, allocSize_);
+#endif
+            code_ = nullptr;
+        }
+        size_ = 0;
+        allocSize_ = 0;
+    }
+};
+
+//
+// A minimal x86-64 machine code emitter, only the forms used by the
+// JitCompiler are supported.
+//
+class X64Emitter {
+public:
+    enum Reg {
+        rax, rcx, rdx, rbx, rsp, rbp, rsi, rdi,
+        r8, r9, r10, r11, r12, r13, r14, r15
+    };
+
+    enum Cond {
+        cc_o, cc_no, cc_b, cc_ae, cc_e, cc_ne, cc_be, cc_a,
+        cc_s, cc_ns, cc_p, cc_np, cc_l, cc_ge, cc_le, cc_g
+    };
+
+private:
+    std::vector<uint8_t> code_;
+
+    static bool isInt8(int32_t value) {
+        return (value >= -128 && value <= 127);
+    }
+
+    void rex(bool w, int reg, int base, bool force = false) {
+        uint8_t prefix = (uint8_t)(0x40 | (w ? 0x08 : 0) | ((reg >> 3) << 2) | (base >> 3));
+        if (prefix != 0x40 || force)
+            emit8(prefix);
+    }
+
+    void modrmReg(int reg, int rm) {
+        emit8((uint8_t)(0xC0 | ((reg & 7) << 3) | (rm & 7)));
+    }
+
+    // Always use a displacement, so rbp/r13 as the base needn't a special case.
+    void modrmMem(int reg, int base, int32_t disp) {
+        int mod = isInt8(disp) ? 1 : 2;
+        emit8((uint8_t)((mod << 6) | ((reg & 7) << 3) | (base & 7)));
+        // rsp/r12 as the base need a SIB byte.
+        if ((base & 7) == rsp)
+            emit8(0x24);
+        if (mod == 1)
+            emit8((uint8_t)(int8_t)disp);
+        else
+            emit32((uint32_t)disp);
+    }
+
+public:
+    X64Emitter() {}
+    ~X64Emitter() {}
+
+    const uint8_t * data() const { return code_.data(); }
+    size_t size() const { return code_.size(); }
+
+    void emit8(uint8_t value) {
+        code_.push_back(value);
+    }
+
+    void emit32(uint32_t value) {
+        for (int i = 0; i < 4; ++i) {
+            code_.push_back((uint8_t)(value >> (i * 8)));
+        }
+    }
+
+    void emit64(uint64_t value) {
+        for (int i = 0; i < 8; ++i) {
+            code_.push_back((uint8_t)(value >> (i * 8)));
+        }
+    }
+
+    void patchRel32(size_t at, size_t target) {
+        int32_t rel = (int32_t)((int64_t)target - (int64_t)(at + 4));
+        memcpy(&code_[at], &rel, sizeof(int32_t));
+    }
+
+    // op r, [base + disp]  or  op [base + disp], r
+    void opMem(uint8_t opcode, bool w, int reg, int base, int32_t disp) {
+        rex(w, reg, base);
+        emit8(opcode);
+        modrmMem(reg, base, disp);
+    }
+
+    // op [base + disp], imm  (0x81 /ext id, 0x83 /ext ib, 0xC7 /0 id)
+    void opMemImm(uint8_t ext, bool w, int base, int32_t disp, int32_t imm, bool isMove = false) {
+        rex(w, 0, base);
+        if (isMove) {
+            emit8(0xC7);
+            modrmMem(ext, base, disp);
+            emit32((uint32_t)imm);
+        }
+        else if (isInt8(imm)) {
+            emit8(0x83);
+            modrmMem(ext, base, disp);
+            emit8((uint8_t)(int8_t)imm);
+        }
+        else {
+            emit8(0x81);
+            modrmMem(ext, base, disp);
+            emit32((uint32_t)imm);
+        }
+    }
+
+    // op r, imm  (0x81 /ext id, 0x83 /ext ib)
+    void opRegImm(uint8_t ext, bool w, int reg, int32_t imm) {
+        rex(w, 0, reg);
+        if (isInt8(imm)) {
+            emit8(0x83);
+            modrmReg(ext, reg);
+            emit8((uint8_t)(int8_t)imm);
+        }
+        else {
+            emit8(0x81);
+            modrmReg(ext, reg);
+            emit32((uint32_t)imm);
+        }
+    }
+
+    void mov_r32_imm(int reg, uint32_t imm) {
+        rex(false, 0, reg);
+        emit8((uint8_t)(0xB8 + (reg & 7)));
+        emit32(imm);
+    }
+
+    void mov_r64_imm(int reg, uint64_t imm) {
+        rex(true, 0, reg);
+        emit8((uint8_t)(0xB8 + (reg & 7)));
+        emit64(imm);
+    }
+
+    void mov_r32_r32(int dest, int src) {
+        rex(false, src, dest);
+        emit8(0x89);
+        modrmReg(src, dest);
+    }
+
+    void mov_r64_r64(int dest, int src) {
+        rex(true, src, dest);
+        emit8(0x89);
+        modrmReg(src, dest);
+    }
+
+    void mov_r32_mem(int reg, int base, int32_t disp)  { opMem(0x8B, false, reg, base, disp); }
+    void mov_mem_r32(int base, int32_t disp, int reg)  { opMem(0x89, false, reg, base, disp); }
+    void mov_r64_mem(int reg, int base, int32_t disp)  { opMem(0x8B, true,  reg, base, disp); }
+    void mov_mem_r64(int base, int32_t disp, int reg)  { opMem(0x89, true,  reg, base, disp); }
+
+    void mov_mem32_imm(int base, int32_t disp, int32_t imm) { opMemImm(0, false, base, disp, imm, true); }
+    void mov_mem64_imm(int base, int32_t disp, int32_t imm) { opMemImm(0, true,  base, disp, imm, true); }
+
+    void add_mem32_imm(int base, int32_t disp, int32_t imm) { opMemImm(0, false, base, disp, imm); }
+    void sub_mem32_imm(int base, int32_t disp, int32_t imm) { opMemImm(5, false, base, disp, imm); }
+    void cmp_mem32_imm(int base, int32_t disp, int32_t imm) { opMemImm(7, false, base, disp, imm); }
+
+    void add_mem_r32(int base, int32_t disp, int reg)  { opMem(0x01, false, reg, base, disp); }
+    void sub_mem_r32(int base, int32_t disp, int reg)  { opMem(0x29, false, reg, base, disp); }
+    void add_r32_mem(int reg, int base, int32_t disp)  { opMem(0x03, false, reg, base, disp); }
+    void sub_r32_mem(int reg, int base, int32_t disp)  { opMem(0x2B, false, reg, base, disp); }
+    void cmp_r32_mem(int reg, int base, int32_t disp)  { opMem(0x3B, false, reg, base, disp); }
+
+    void add_r32_imm(int reg, int32_t imm) { opRegImm(0, false, reg, imm); }
+    void sub_r32_imm(int reg, int32_t imm) { opRegImm(5, false, reg, imm); }
+    void add_r64_imm(int reg, int32_t imm) { opRegImm(0, true,  reg, imm); }
+    void sub_r64_imm(int reg, int32_t imm) { opRegImm(5, true,  reg, imm); }
+
+    void setcc(int cond, int reg8) {
+        rex(false, 0, reg8, (reg8 >= rsp));
+        emit8(0x0F);
+        emit8((uint8_t)(0x90 | cond));
+        modrmReg(0, reg8);
+    }
+
+    void cmp_r64_r64(int reg1, int reg2) {
+        rex(true, reg2, reg1);
+        emit8(0x39);
+        modrmReg(reg2, reg1);
+    }
+
+    void test_r64_r64(int reg) {
+        rex(true, reg, reg);
+        emit8(0x85);
+        modrmReg(reg, reg);
+    }
+
+    void jmp_r64(int reg) {
+        rex(false, 0, reg);
+        emit8(0xFF);
+        modrmReg(4, reg);
+    }
+
+    void test_r8_r8(int reg8) {
+        rex(false, reg8, reg8, (reg8 >= rsp));
+        emit8(0x84);
+        modrmReg(reg8, reg8);
+    }
+
+    void push(int reg) {
+        rex(false, 0, reg);
+        emit8((uint8_t)(0x50 + (reg & 7)));
+    }
+
+    void pop(int reg) {
+        rex(false, 0, reg);
+        emit8((uint8_t)(0x58 + (reg & 7)));
+    }
+
+    // Return the offset of rel32 to patch.
+    size_t jcc(int cond) {
+        emit8(0x0F);
+        emit8((uint8_t)(0x80 | cond));
+        emit32(0);
+        return (size() - 4);
+    }
+
+    size_t jmp() {
+        emit8(0xE9);
+        emit32(0);
+        return (size() - 4);
+    }
+
+    size_t call() {
+        emit8(0xE8);
+        emit32(0);
+        return (size() - 4);
+    }
+
+    void ret() {
+        emit8(0xC3);
+    }
+};
+
+//
+// The baseline (template) JIT, translate the pre-decoded records to x86-64
+// machine code, one fixed code template per opcode.
+//
+// Host register mapping:
+//
+//   r12 = VM sp, r13 = VM fp, ebx = VM eax, r14b = VM flags,
+//   r15 = the limit of VM sp at the calls, rbp = the host rsp at entry
+//   (used by exit), rax = scratch.
+//
+// VM call/ret are mapped to native call/ret, the VM frame (saved fp and the
+// return address slot) is still pushed to the VM stack, so the frame layout
+// is same as the interpreter, but the return address slot isn't written,
+// the native return address is on the host stack.
+//
+// Every call checks VM sp against the limit first, so the depth of the
+// host stack is bounded by the VM stack: a VM frame takes 16 bytes at
+// least, and a native call takes 8 bytes.
+//
+class JitCompiler {
+private:
+    typedef X64Emitter Asm;
+
+    enum {
+        kSP     = Asm::r12,
+        kFP     = Asm::r13,
+        kEAX    = Asm::rbx,
+        kFlags  = Asm::r14,
+        kLimit  = Asm::r15,
+        kTemp   = Asm::rax
+    };
+
+    // The fixup targets of the exit and the overflow stub.
+    static const size_t kExitTarget = (size_t)-1;
+    static const size_t kOverflowTarget = (size_t)-2;
+
+    struct Fixup {
+        size_t at;
+        size_t target;      // Index of the target record
+    };
+
+    static const int32_t kFrameSize = (int32_t)(sizeof(void *) * 2);
+
+    static int32_t getSlotDisp(int32_t index) {
+        return (index * (int32_t)sizeof(uint32_t));
+    }
+
+    static bool isCondJump(uint8_t opcode) {
+        return (opcode == OpCode::jl_near || opcode == OpCode::jl_short ||
+                opcode == OpCode::jl_long);
+    }
+
+public:
+    //
+    // Get the condition code of the cmp, return 1 if the condition is
+    // always true, 0 if always false, -1 if unsupported, else 2.
+    //
+    static int getCondCode(uint8_t cond, bool isSigned, int & cc) {
+        switch (cond) {
+        case OpCode::je:
+            cc = Asm::cc_e;
+            return 2;
+        case OpCode::jne:
+            cc = Asm::cc_ne;
+            return 2;
+        case OpCode::jl:
+        case OpCode::jl_near:
+        case OpCode::jl_short:
+        case OpCode::jl_long:
+            cc = isSigned ? Asm::cc_l : Asm::cc_b;
+            return 2;
+        case OpCode::jle:
+            cc = isSigned ? Asm::cc_le : Asm::cc_be;
+            return 2;
+        case OpCode::jg:
+            cc = isSigned ? Asm::cc_g : Asm::cc_a;
+            return 2;
+        case OpCode::jge:
+            cc = isSigned ? Asm::cc_ge : Asm::cc_ae;
+            return 2;
+        case OpCode::jmp:
+        case OpCode::jmp_near:
+        case OpCode::jmp_short:
+        case OpCode::jmp_long:
+            return 1;
+        case OpCode::jz:
+        case OpCode::jnz:
+        case OpCode::js:
+        case OpCode::jns:
+            return -1;
+        default:
+            return 0;
+        }
+    }
+
+private:
+    //
+    // Push the VM frame and call the target, the call beyond the limit
+    // jumps to the overflow stub.
+    //
+    static void emitCall(Asm & a, std::vector<Fixup> & fixups, size_t target) {
+        a.cmp_r64_r64(kSP, kLimit);
+        Fixup overflow = { a.jcc(Asm::cc_ae), kOverflowTarget };
+        fixups.push_back(overflow);
+        // push_callstack(): save fp, skip the return address slot.
+        a.mov_mem_r64(kSP, 0, kFP);
+        a.add_r64_imm(kSP, kFrameSize);
+        a.mov_r64_r64(kFP, kSP);
+        Fixup fixup = { a.call(), target };
+        fixups.push_back(fixup);
+    }
+
+    static void emitReturn(Asm & a, int32_t localSize) {
+        // pop_callstack(): back the locals, the return address and the fp.
+        a.sub_r64_imm(kSP, localSize + kFrameSize);
+        a.mov_r64_mem(kFP, kSP, 0);
+        a.ret();
+    }
+
+public:
+    JitCompiler() {}
+    ~JitCompiler() {}
+
+    static int compile(const vmDecodedImage & decoded, vmJitCode & jitCode) {
+#if USE_JIT_X86_64
+        if (!decoded.isInited())
+            return Error::Error_NullPtr;
+
+        const vmInstruction * insns = decoded.data();
+        // Include the tail sentinel record.
+        size_t insnCount = decoded.size() + 1;
+
+        std::vector<bool> isTarget(insnCount, false);
+        for (size_t i = 0; i < insnCount; ++i) {
+            if (insns[i].target != nullptr)
+                isTarget[(size_t)(insns[i].target - insns)] = true;
+        }
+
+        Asm a;
+        std::vector<size_t> offsets(insnCount, 0);
+        std::vector<Fixup> fixups;
+
+        // Prologue, the overflow pointer is kept at [rbp - 8].
+        a.push(Asm::rbp);
+        a.push(Asm::rbx);
+        a.push(Asm::r12);
+        a.push(Asm::r13);
+        a.push(Asm::r14);
+        a.push(Asm::r15);
+        a.mov_r64_r64(Asm::rbp, Asm::rsp);
+#if defined(_WIN32)
+        a.mov_r64_r64(kSP, Asm::rcx);
+        a.mov_r64_r64(kLimit, Asm::rdx);
+        a.push(Asm::r8);
+#else
+        a.mov_r64_r64(kSP, Asm::rdi);
+        a.mov_r64_r64(kLimit, Asm::rsi);
+        a.push(Asm::rdx);
+#endif
+        a.mov_r64_r64(kFP, kSP);
+        a.mov_r32_imm(kEAX, 0);
+        a.mov_r32_imm(kFlags, 0);
+
+        // Push call program entry, the returned address slot is nullptr.
+        a.mov_mem64_imm(kSP, sizeof(void *), 0);
+        emitCall(a, fixups, (size_t)(decoded.entry() - insns));
+
+        // Epilogue, the exit opcode also jump to here.
+        size_t exitOffset = a.size();
+        a.mov_r64_r64(Asm::rsp, Asm::rbp);
+        a.mov_r32_r32(Asm::rax, kEAX);
+        a.pop(Asm::r15);
+        a.pop(Asm::r14);
+        a.pop(Asm::r13);
+        a.pop(Asm::r12);
+        a.pop(Asm::rbx);
+        a.pop(Asm::rbp);
+        a.ret();
+
+        // The overflow stub, set the overflow and exit, the host stack is
+        // unwound by the epilogue.
+        size_t overflowOffset = a.size();
+        a.mov_r64_mem(kTemp, Asm::rbp, -(int32_t)sizeof(void *));
+        a.mov_mem32_imm(kTemp, 0, 1);
+        Fixup exitFixup = { a.jmp(), kExitTarget };
+        fixups.push_back(exitFixup);
+
+        int lastCC = -1;
+        for (size_t i = 0; i < insnCount; ++i) {
+            const vmInstruction & insn = insns[i];
+            offsets[i] = a.size();
+
+            // The native flags of the previous cmp can be used directly,
+            // only if this jump can't be reached from elsewhere.
+            int cmpCC = lastCC;
+            lastCC = -1;
+            if (isTarget[i])
+                cmpCC = -1;
+
+            switch (insn.opcode) {
+            case OpCode::push:
+                a.mov_r32_mem(kTemp, kFP, getSlotDisp(insn.index));
+                a.mov_mem_r32(kSP, 0, kTemp);
+                a.add_r64_imm(kSP, sizeof(uint32_t));
+                break;
+
+            case OpCode::push_i32:
+                a.mov_mem32_imm(kSP, 0, insn.imm.i32);
+                a.add_r64_imm(kSP, sizeof(uint32_t));
+                break;
+
+            case OpCode::push_i64:
+                a.mov_r64_imm(kTemp, insn.imm.u64);
+                a.mov_mem_r64(kSP, 0, kTemp);
+                a.add_r64_imm(kSP, sizeof(uint64_t));
+                break;
+
+            case OpCode::push_i32_0:
+                a.mov_mem32_imm(kSP, 0, 0);
+                a.add_r64_imm(kSP, sizeof(uint32_t));
+                break;
+
+            case OpCode::push_i64_0:
+                a.mov_mem64_imm(kSP, 0, 0);
+                a.add_r64_imm(kSP, sizeof(uint64_t));
+                break;
+
+            case OpCode::pop:
+            case OpCode::pop_i32:
+                a.sub_r64_imm(kSP, sizeof(uint32_t));
+                break;
+
+            case OpCode::pop_i64:
+                a.sub_r64_imm(kSP, sizeof(uint64_t));
+                break;
+
+            case OpCode::add_sp:
+                a.add_r64_imm(kSP, insn.index);
+                break;
+
+            case OpCode::add_sp_4:
+                a.add_r64_imm(kSP, sizeof(uint32_t));
+                break;
+
+            case OpCode::load_eax:
+                a.mov_r32_imm(kEAX, insn.imm.u32);
+                break;
+
+            case OpCode::store:
+                a.mov_mem32_imm(kFP, getSlotDisp(insn.index), insn.imm.i32);
+                break;
+
+            case OpCode::copy_from_eax:
+                a.mov_mem_r32(kFP, getSlotDisp(insn.index), kEAX);
+                break;
+
+            case OpCode::cmp_i32:
+            case OpCode::cmp_u32:
+            case OpCode::cmp_imm_i32:
+            case OpCode::cmp_imm_u32: {
+                bool isSigned = (insn.opcode == OpCode::cmp_i32 ||
+                                 insn.opcode == OpCode::cmp_imm_i32);
+                int cc = 0;
+                int kind = getCondCode(insn.cond, isSigned, cc);
+                if (kind < 0)
+                    return Error::Jit_Unsupported_OpCode;
+                if (kind == 2) {
+                    if (insn.opcode == OpCode::cmp_i32 || insn.opcode == OpCode::cmp_u32) {
+                        a.mov_r32_mem(kTemp, kFP, getSlotDisp(insn.index));
+                        a.cmp_r32_mem(kTemp, kFP, getSlotDisp(insn.index2));
+                    }
+                    else {
+                        a.cmp_mem32_imm(kFP, getSlotDisp(insn.index), insn.imm.i32);
+                    }
+                    a.setcc(cc, kFlags);
+                    if ((i + 1) < insnCount && insns[i + 1].opcode == insn.cond &&
+                        isCondJump(insn.cond))
+                        lastCC = cc;
+                }
+                else {
+                    a.mov_r32_imm(kFlags, (uint32_t)kind);
+                }
+                break;
+            }
+
+            case OpCode::jl_near:
+            case OpCode::jl_short:
+            case OpCode::jl_long: {
+                size_t at;
+                if (cmpCC >= 0) {
+                    at = a.jcc(cmpCC);
+                }
+                else {
+                    a.test_r8_r8(kFlags);
+                    at = a.jcc(Asm::cc_ne);
+                }
+                Fixup fixup = { at, (size_t)(insn.target - insns) };
+                fixups.push_back(fixup);
+                break;
+            }
+
+            case OpCode::jmp:
+            case OpCode::jmp_near:
+            case OpCode::jmp_short:
+            case OpCode::jmp_long: {
+                Fixup fixup = { a.jmp(), (size_t)(insn.target - insns) };
+                fixups.push_back(fixup);
+                break;
+            }
+
+            case OpCode::call:
+            case OpCode::call_near:
+            case OpCode::call_short:
+            case OpCode::call_long:
+                emitCall(a, fixups, (size_t)(insn.target - insns));
+                break;
+
+            case OpCode::ret:
+                emitReturn(a, 0);
+                break;
+
+            case OpCode::ret_n_sm:
+            case OpCode::ret_n:
+                emitReturn(a, insn.index);
+                break;
+
+            case OpCode::ret_eax:
+                a.mov_r32_imm(kEAX, insn.imm.u32);
+                emitReturn(a, 0);
+                break;
+
+            case OpCode::ret_eax_n:
+                a.mov_r32_imm(kEAX, insn.imm.u32);
+                emitReturn(a, insn.index);
+                break;
+
+            case OpCode::error:
+            case OpCode::move:
+            case OpCode::move_to_eax:
+            case OpCode::cmp:
+            case OpCode::jl:
+            case OpCode::nop:
+            case OpCode::nop_n:
+                // Same as the interpreter, do nothing.
+                break;
+
+            case OpCode::inc:
+                a.add_mem32_imm(kFP, getSlotDisp(insn.index), 1);
+                break;
+
+            case OpCode::dec:
+                a.sub_mem32_imm(kFP, getSlotDisp(insn.index), 1);
+                break;
+
+            case OpCode::add:
+                a.mov_r32_mem(kTemp, kFP, getSlotDisp(insn.index2));
+                a.add_mem_r32(kFP, getSlotDisp(insn.index), kTemp);
+                break;
+
+            case OpCode::add_imm:
+                a.add_mem32_imm(kFP, getSlotDisp(insn.index), insn.imm.i32);
+                break;
+
+            case OpCode::add_eax:
+                a.add_r32_mem(kEAX, kFP, getSlotDisp(insn.index));
+                break;
+
+            case OpCode::add_eax_imm:
+                a.add_r32_imm(kEAX, insn.imm.i32);
+                break;
+
+            case OpCode::sub:
+                a.mov_r32_mem(kTemp, kFP, getSlotDisp(insn.index2));
+                a.sub_mem_r32(kFP, getSlotDisp(insn.index), kTemp);
+                break;
+
+            case OpCode::sub_imm:
+                a.sub_mem32_imm(kFP, getSlotDisp(insn.index), insn.imm.i32);
+                break;
+
+            case OpCode::sub_eax:
+                a.sub_r32_mem(kEAX, kFP, getSlotDisp(insn.index));
+                break;
+
+            case OpCode::sub_eax_imm:
+                a.sub_r32_imm(kEAX, insn.imm.i32);
+                break;
+
+            case OpCode::exit: {
+                Fixup fixup = { a.jmp(), kExitTarget };
+                fixups.push_back(fixup);
+                break;
+            }
+
+            default:
+                return Error::Jit_Unsupported_OpCode;
+            }
+        }
+
+        for (size_t i = 0; i < fixups.size(); ++i) {
+            const Fixup & fixup = fixups[i];
+            if (fixup.target == kExitTarget)
+                a.patchRel32(fixup.at, exitOffset);
+            else if (fixup.target == kOverflowTarget)
+                a.patchRel32(fixup.at, overflowOffset);
+            else
+                a.patchRel32(fixup.at, offsets[fixup.target]);
+        }
+
+        return jitCode.assign(a.data(), a.size());
+#else
+        return Error::Jit_Unsupported_Platform;
+#endif // USE_JIT_X86_64
+    }
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_JITCOMPILER_H
@@ -0,0 +1,180 @@
+#ifndef JLANG_VM_LAZYFLAGS_H
+#define JLANG_VM_LAZYFLAGS_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+#include "jlang/vm/Interpreter.h"
+#include "jlang/vm/TypedOps.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <type_traits>
+
+namespace jlang {
+
+//
+// The kind of the operands saved in the flags.
+//
+// Result is the result of an arithmetic instruction (inc, dec, add, sub),
+// the flags read it as "cmp result, 0", except jnz tests the result only.
+//
+struct vmFlagsKind {
+    enum Type {
+        None,
+        Int32,
+        UInt32,
+        Int64,
+        UInt64,
+        Result,
+        Last
+    };
+};
+
+template <typename T>
+struct vmFlagsKindOf;
+
+template <>
+struct vmFlagsKindOf<int32_t> {
+    static const uint32_t value = vmFlagsKind::Int32;
+};
+
+template <>
+struct vmFlagsKindOf<uint32_t> {
+    static const uint32_t value = vmFlagsKind::UInt32;
+};
+
+template <>
+struct vmFlagsKindOf<int64_t> {
+    static const uint32_t value = vmFlagsKind::Int64;
+};
+
+template <>
+struct vmFlagsKindOf<uint64_t> {
+    static const uint32_t value = vmFlagsKind::UInt64;
+};
+
+//
+// The lazy condition flags, like the EFLAGS of x86, but no flag bit is
+// computed when they are set.
+//
+// A cmp only saves its operands and their kind, the condition jump that
+// reads the flags evaluates the one predicate it needs, so the cmp needn't
+// be followed by the jump, and any number of jumps can test one cmp. An
+// arithmetic instruction saves its result, so "dec reg; jnz loop" needs
+// no cmp.
+//
+class vmLazyFlags {
+private:
+    uint64_t    value1_;
+    uint64_t    value2_;
+    uint32_t    kind_;
+
+    //
+    // The predicates of jz .. jge are same as the typed compares, js and
+    // jns test the sign of (v1 - v2) in the width of T. The subtraction
+    // wraps around, it's done in the unsigned type.
+    //
+    template <typename T>
+    JM_FORCEINLINE bool testAs(uint8_t condJmp) const {
+        typedef typename std::make_signed<T>::type S;
+        typedef typename std::make_unsigned<T>::type U;
+        T v1 = (T)value1_;
+        T v2 = (T)value2_;
+        switch (condJmp) {
+        case OpCode::jz:
+            return vmCond<vmCondType::jz>::test<T>(v1, v2);
+        case OpCode::jnz:
+            return vmCond<vmCondType::jnz>::test<T>(v1, v2);
+        case OpCode::je:
+            return vmCond<vmCondType::je>::test<T>(v1, v2);
+        case OpCode::jne:
+            return vmCond<vmCondType::jne>::test<T>(v1, v2);
+        case OpCode::jl:
+        case OpCode::jl_near:
+        case OpCode::jl_short:
+        case OpCode::jl_long:
+            return vmCond<vmCondType::jl>::test<T>(v1, v2);
+        case OpCode::jle:
+        case OpCode::jle_short:
+            return vmCond<vmCondType::jle>::test<T>(v1, v2);
+        case OpCode::jg:
+            return vmCond<vmCondType::jg>::test<T>(v1, v2);
+        case OpCode::jge:
+            return vmCond<vmCondType::jge>::test<T>(v1, v2);
+        case OpCode::js:
+            return ((S)(U)((U)v1 - (U)v2) < 0);
+        case OpCode::jns:
+            return ((S)(U)((U)v1 - (U)v2) >= 0);
+        default:
+            return false;
+        }
+    }
+
+public:
+    vmLazyFlags() : value1_(0), value2_(0), kind_(vmFlagsKind::None) {}
+    ~vmLazyFlags() {}
+
+    void clear() {
+        value1_ = 0;
+        value2_ = 0;
+        kind_ = vmFlagsKind::None;
+    }
+
+    uint32_t getKind() const { return kind_; }
+    uint64_t getValue1() const { return value1_; }
+    uint64_t getValue2() const { return value2_; }
+
+    //
+    // cmp v1, v2, T is int32_t, uint32_t, int64_t or uint64_t. The 8-bit
+    // and 16-bit operands are promoted to 32-bit by the caller.
+    //
+    template <typename T>
+    JM_FORCEINLINE void setCompare(T v1, T v2) {
+        value1_ = (uint64_t)v1;
+        value2_ = (uint64_t)v2;
+        kind_ = vmFlagsKindOf<T>::value;
+    }
+
+    //
+    // The result of inc, dec, add or sub, it's sign-extended from the
+    // width of T.
+    //
+    template <typename T>
+    JM_FORCEINLINE void setResult(T result) {
+        typedef typename std::make_signed<T>::type S;
+        value1_ = (uint64_t)(int64_t)(S)result;
+        value2_ = 0;
+        kind_ = vmFlagsKind::Result;
+    }
+
+    //
+    // Evaluate the condition of the jump opcode, the flags that are never
+    // set are false for every condition.
+    //
+    JM_FORCEINLINE bool test(uint8_t condJmp) const {
+        switch (kind_) {
+        case vmFlagsKind::Int32:
+            return testAs<int32_t>(condJmp);
+        case vmFlagsKind::UInt32:
+            return testAs<uint32_t>(condJmp);
+        case vmFlagsKind::Int64:
+            return testAs<int64_t>(condJmp);
+        case vmFlagsKind::UInt64:
+            return testAs<uint64_t>(condJmp);
+        case vmFlagsKind::Result:
+            if (condJmp == OpCode::jnz)
+                return (value1_ != 0);
+            return testAs<int64_t>(condJmp);
+        default:
+            return false;
+        }
+    }
+};
+
+} // namespace jlang
+
+#endif // JLANG_VM_LAZYFLAGS_H
@@ -0,0 +1,224 @@
+#ifndef JLANG_VM_MEMOPS_H
+#define JLANG_VM_MEMOPS_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+#include "jlang/vm/VectorOps.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+
+//////////////////////////////////////////////////////////////
+
+/* Use the SIMD kernels for the bulk memory opcodes ? Otherwise the C runtime is used. */
+#ifndef USE_MEM_SIMD
+#if JLANG_VM_SIMD_AVX2 || JLANG_VM_SIMD_SSE2
+#define USE_MEM_SIMD            1
+#else
+#define USE_MEM_SIMD            0
+#endif
+#endif // USE_MEM_SIMD
+
+//////////////////////////////////////////////////////////////
+
+namespace jlang {
+
+namespace detail {
+
+#if USE_MEM_SIMD
+
+static JM_FORCEINLINE uint32_t memCountTrailingZeros(uint32_t mask) {
+    assert(mask != 0);
+#if defined(_MSC_VER)
+    unsigned long index;
+    _BitScanForward(&index, mask);
+    return (uint32_t)index;
+#else
+    return (uint32_t)__builtin_ctz(mask);
+#endif
+}
+
+//
+// The byte vector of the bulk memory kernels, it's the widest vector that
+// has the byte compare, AVX2 or SSE2. eqMask() has one bit per byte.
+//
+#if JLANG_VM_SIMD_AVX2
+struct vmMemVec {
+    typedef __m256i type;
+    static const size_t kBytes = 32;
+    static const uint32_t kAllEqual = 0xFFFFFFFFU;
+
+    static JM_FORCEINLINE type load(const uint8_t * p) { return _mm256_loadu_si256((const __m256i *)p); }
+    static JM_FORCEINLINE type loadAligned(const uint8_t * p) { return _mm256_load_si256((const __m256i *)p); }
+    static JM_FORCEINLINE void store(uint8_t * p, type v) { _mm256_storeu_si256((__m256i *)p, v); }
+    static JM_FORCEINLINE void storeAligned(uint8_t * p, type v) { _mm256_store_si256((__m256i *)p, v); }
+    static JM_FORCEINLINE type splat(uint8_t value) { return _mm256_set1_epi8((char)value); }
+    static JM_FORCEINLINE uint32_t eqMask(type a, type b) {
+        return (uint32_t)_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, b));
+    }
+};
+#else
+struct vmMemVec {
+    typedef __m128i type;
+    static const size_t kBytes = 16;
+    static const uint32_t kAllEqual = 0x0000FFFFU;
+
+    static JM_FORCEINLINE type load(const uint8_t * p) { return _mm_loadu_si128((const __m128i *)p); }
+    static JM_FORCEINLINE type loadAligned(const uint8_t * p) { return _mm_load_si128((const __m128i *)p); }
+    static JM_FORCEINLINE void store(uint8_t * p, type v) { _mm_storeu_si128((__m128i *)p, v); }
+    static JM_FORCEINLINE void storeAligned(uint8_t * p, type v) { _mm_store_si128((__m128i *)p, v); }
+    static JM_FORCEINLINE type splat(uint8_t value) { return _mm_set1_epi8((char)value); }
+    static JM_FORCEINLINE uint32_t eqMask(type a, type b) {
+        return (uint32_t)_mm_movemask_epi8(_mm_cmpeq_epi8(a, b));
+    }
+};
+#endif // JLANG_VM_SIMD_AVX2
+
+//
+// The bytes from p to the next vector boundary, it's in [1, kBytes].
+//
+static JM_FORCEINLINE size_t memHeadBytes(const void * p) {
+    return (vmMemVec::kBytes - ((uintptr_t)p & (vmMemVec::kBytes - 1)));
+}
+
+#endif // USE_MEM_SIMD
+
+} // namespace detail
+
+//
+// The kernels of the bulk memory opcodes, mem_copy, mem_set, mem_cmp and
+// mem_chr. The ranges are verified by the caller, once per instruction.
+//
+// The ranges that are shorter than one vector go to the C runtime. The
+// longer ranges run one unaligned vector at the head, the aligned vectors
+// of the body (aligned to the destination, or the first operand), and one
+// unaligned vector that ends at the tail, the head and the tail vectors
+// may overlap the body, so there is no scalar loop.
+//
+class vmMemOps {
+public:
+    //
+    // Copy len bytes, the ranges may overlap, like memmove().
+    //
+    static void copy(void * dest, const void * src, size_t len) {
+#if USE_MEM_SIMD
+        typedef detail::vmMemVec V;
+        uint8_t * d = (uint8_t *)dest;
+        const uint8_t * s = (const uint8_t *)src;
+        if (len < V::kBytes || (d < s + len && s < d + len)) {
+            ::memmove(dest, src, len);
+            return;
+        }
+        V::type tail = V::load(s + len - V::kBytes);
+        V::store(d, V::load(s));
+        size_t i = detail::memHeadBytes(d);
+        for (; i + V::kBytes <= len; i += V::kBytes) {
+            V::storeAligned(d + i, V::load(s + i));
+        }
+        V::store(d + len - V::kBytes, tail);
+#else
+        ::memmove(dest, src, len);
+#endif
+    }
+
+    //
+    // Set len bytes to value.
+    //
+    static void set(void * dest, uint8_t value, size_t len) {
+#if USE_MEM_SIMD
+        typedef detail::vmMemVec V;
+        uint8_t * d = (uint8_t *)dest;
+        if (len < V::kBytes) {
+            ::memset(dest, value, len);
+            return;
+        }
+        V::type v = V::splat(value);
+        V::store(d, v);
+        size_t i = detail::memHeadBytes(d);
+        for (; i + V::kBytes <= len; i += V::kBytes) {
+            V::storeAligned(d + i, v);
+        }
+        V::store(d + len - V::kBytes, v);
+#else
+        ::memset(dest, value, len);
+#endif
+    }
+
+    //
+    // Compare len bytes as unsigned bytes, return -1, 0 or 1.
+    //
+    static int32_t compare(const void * ptr1, const void * ptr2, size_t len) {
+#if USE_MEM_SIMD
+        typedef detail::vmMemVec V;
+        const uint8_t * a = (const uint8_t *)ptr1;
+        const uint8_t * b = (const uint8_t *)ptr2;
+        if (len >= V::kBytes) {
+            size_t i = 0;
+            uint32_t mask = V::eqMask(V::load(a), V::load(b));
+            if (mask == V::kAllEqual) {
+                i = detail::memHeadBytes(a);
+                for (; i + V::kBytes <= len; i += V::kBytes) {
+                    mask = V::eqMask(V::loadAligned(a + i), V::load(b + i));
+                    if (mask != V::kAllEqual)
+                        break;
+                }
+                if (mask == V::kAllEqual) {
+                    i = len - V::kBytes;
+                    mask = V::eqMask(V::load(a + i), V::load(b + i));
+                    if (mask == V::kAllEqual)
+                        return 0;
+                }
+            }
+            size_t k = i + detail::memCountTrailingZeros(~mask);
+            return (a[k] < b[k]) ? -1 : 1;
+        }
+#endif
+        int result = ::memcmp(ptr1, ptr2, len);
+        return (result < 0) ? -1 : ((result > 0) ? 1 : 0);
+    }
+
+    //
+    // Find the first byte that equals to value, return its offset, or len
+    // if it's not found.
+    //
+    static size_t find(const void * ptr, uint8_t value, size_t len) {
+#if USE_MEM_SIMD
+        typedef detail::vmMemVec V;
+        const uint8_t * p = (const uint8_t *)ptr;
+        if (len >= V::kBytes) {
+            V::type v = V::splat(value);
+            uint32_t mask = V::eqMask(V::load(p), v);
+            if (mask != 0)
+                return detail::memCountTrailingZeros(mask);
+            size_t i = detail::memHeadBytes(p);
+            for (; i + V::kBytes <= len; i += V::kBytes) {
+                mask = V::eqMask(V::loadAligned(p + i), v);
+                if (mask != 0)
+                    return (i + detail::memCountTrailingZeros(mask));
+            }
+            i = len - V::kBytes;
+            mask = V::eqMask(V::load(p + i), v);
+            if (mask != 0)
+                return (i + detail::memCountTrailingZeros(mask));
+            return len;
+        }
+#endif
+        const void * found = ::memchr(ptr, value, len);
+        if (found == nullptr)
+            return len;
+        return (size_t)((const uint8_t *)found - (const uint8_t *)ptr);
+    }
+};
+
+} // namespace jlang
+
+#endif // JLANG_VM_MEMOPS_H
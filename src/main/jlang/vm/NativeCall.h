@@ -0,0 +1,218 @@
+#ifndef JLANG_VM_NATIVECALL_H
+#define JLANG_VM_NATIVECALL_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+#include "jlang/vm/Interpreter.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <string>
+#include <vector>
+#include <type_traits>
+
+namespace jlang {
+
+//
+// The host function of call_native, it's cast back to its own signature by
+// the thunk that's generated when it's registered.
+//
+typedef void (*vmNativeFunc)();
+
+//
+// Call the host function with the arguments in the register slots, return
+// the result as the value of a register.
+//
+typedef uintptr_t (*vmNativeThunk)(vmNativeFunc func, const Register * args);
+
+namespace detail {
+
+template <size_t... I>
+struct vmIndexSeq {};
+
+template <size_t N, size_t... I>
+struct vmMakeIndexSeq : vmMakeIndexSeq<N - 1, N - 1, I...> {};
+
+template <size_t... I>
+struct vmMakeIndexSeq<0, I...> {
+    typedef vmIndexSeq<I...> type;
+};
+
+//
+// Read an argument of type T from a register slot, in place. The integers,
+// the enums and the pointers are the value of the register, the floating
+// points are the low bits of the register.
+//
+template <typename T>
+static JM_FORCEINLINE
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, T>::type
+nativeArg(const Register & reg) {
+    return (T)reg.uval;
+}
+
+template <typename T>
+static JM_FORCEINLINE
+typename std::enable_if<std::is_pointer<T>::value, T>::type
+nativeArg(const Register & reg) {
+    return reinterpret_cast<T>((uintptr_t)reg.uval);
+}
+
+template <typename T>
+static JM_FORCEINLINE
+typename std::enable_if<std::is_floating_point<T>::value, T>::type
+nativeArg(const Register & reg) {
+    static_assert(sizeof(T) <= sizeof(reg.uval), "The floating point is wider than the register.");
+    T value;
+    memcpy(&value, &reg.uval, sizeof(T));
+    return value;
+}
+
+//
+// Write the result of type T to the value of a register.
+//
+template <typename T>
+static JM_FORCEINLINE
+typename std::enable_if<std::is_integral<T>::value || std::is_enum<T>::value, uintptr_t>::type
+nativeResult(T value) {
+    return (uintptr_t)value;
+}
+
+template <typename T>
+static JM_FORCEINLINE
+typename std::enable_if<std::is_pointer<T>::value, uintptr_t>::type
+nativeResult(T value) {
+    return reinterpret_cast<uintptr_t>(value);
+}
+
+template <typename T>
+static JM_FORCEINLINE
+typename std::enable_if<std::is_floating_point<T>::value, uintptr_t>::type
+nativeResult(T value) {
+    static_assert(sizeof(T) <= sizeof(uintptr_t), "The floating point is wider than the register.");
+    uintptr_t bits = 0;
+    memcpy(&bits, &value, sizeof(T));
+    return bits;
+}
+
+template <typename R, typename... Args>
+struct vmNativeCaller {
+    typedef R (*func_type)(Args...);
+
+    template <size_t... I>
+    static JM_FORCEINLINE uintptr_t invoke(func_type func, const Register * args,
+                                           vmIndexSeq<I...>) {
+        (void)args;
+        return nativeResult<R>(func(nativeArg<Args>(args[I])...));
+    }
+
+    static uintptr_t call(vmNativeFunc func, const Register * args) {
+        return invoke(reinterpret_cast<func_type>(func), args,
+                      typename vmMakeIndexSeq<sizeof...(Args)>::type());
+    }
+};
+
+template <typename... Args>
+struct vmNativeCaller<void, Args...> {
+    typedef void (*func_type)(Args...);
+
+    template <size_t... I>
+    static JM_FORCEINLINE uintptr_t invoke(func_type func, const Register * args,
+                                           vmIndexSeq<I...>) {
+        (void)args;
+        func(nativeArg<Args>(args[I])...);
+        return 0;
+    }
+
+    static uintptr_t call(vmNativeFunc func, const Register * args) {
+        return invoke(reinterpret_cast<func_type>(func), args,
+                      typename vmMakeIndexSeq<sizeof...(Args)>::type());
+    }
+};
+
+} // namespace detail
+
+struct vmNativeEntry {
+    std::string     name;
+    vmNativeFunc    func;
+    vmNativeThunk   thunk;
+    uint32_t        argc;
+};
+
+//
+// The table of the host functions that call_native can call, it's filled
+// by the host before the image runs, and only read by the threads.
+//
+// The signature of the function is known when it's registered, so the
+// thunk passes the register slots r0 .. r5 straight to the host calling
+// convention, and the result goes to rax, nothing is boxed or copied to a
+// vmReturn.
+//
+class vmNativeTable {
+public:
+    static const uint32_t kMaxArgs = 6;
+    static const uint32_t kFirstArgReg = vmRegId::r0;
+    static const uint32_t kNotFound = 0xFFFFFFFFU;
+
+private:
+    std::vector<vmNativeEntry> entries_;
+
+public:
+    vmNativeTable() {}
+    ~vmNativeTable() {}
+
+    size_t size() const { return entries_.size(); }
+
+    void clear() {
+        entries_.clear();
+    }
+
+    //
+    // Register the host function, return its index of call_native. The
+    // arguments and the result must be the integers, the enums, the
+    // pointers or the floating points.
+    //
+    template <typename R, typename... Args>
+    uint32_t add(const char * name, R (*func)(Args...)) {
+        static_assert(sizeof...(Args) <= kMaxArgs, "Too many arguments of the native function.");
+        assert(name != nullptr);
+        assert(func != nullptr);
+        if (entries_.size() >= 0xFFFFU)
+            return kNotFound;
+        vmNativeEntry entry;
+        entry.name = name;
+        entry.func = reinterpret_cast<vmNativeFunc>(func);
+        entry.thunk = &detail::vmNativeCaller<R, Args...>::call;
+        entry.argc = (uint32_t)sizeof...(Args);
+        entries_.push_back(entry);
+        return (uint32_t)(entries_.size() - 1);
+    }
+
+    uint32_t find(const char * name) const {
+        for (size_t i = 0; i < entries_.size(); ++i) {
+            if (entries_[i].name == name)
+                return (uint32_t)i;
+        }
+        return kNotFound;
+    }
+
+    const vmNativeEntry * get(uint32_t index) const {
+        return (index < entries_.size()) ? &entries_[index] : nullptr;
+    }
+
+    //
+    // args points to the register slot of r0.
+    //
+    static JM_FORCEINLINE uintptr_t call(const vmNativeEntry & entry, const Register * args) {
+        return entry.thunk(entry.func, args);
+    }
+};
+
+} // namespace jlang
+
+#endif // JLANG_VM_NATIVECALL_H
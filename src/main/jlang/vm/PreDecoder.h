@@ -0,0 +1,418 @@
+
+#ifndef JLANG_VM_PREDECODER_H
+#define JLANG_VM_PREDECODER_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/vm/Interpreter.h"
+#include "jlang/lang/Error.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+namespace jlang {
+namespace v3 {
+
+//
+// The pre-decoded instruction record.
+//
+// All of the operands are widened and aligned, and the branch/call targets
+// are resolved to the absolute address of the target record, so a handler
+// never touches the raw byte image at runtime.
+//
+struct vmInstruction {
+    const void *            handler;    // Handler address (label or function)
+    const vmInstruction *   target;     // Resolved branch/call target record
+    union {
+        int32_t  i32;
+        uint32_t u32;
+        int64_t  i64;
+        uint64_t u64;
+    } imm;                              // Immediate value
+    int32_t     index;                  // Frame slot index or local size
+    int32_t     index2;                 // Second frame slot index
+    uint32_t    offset;                 // Offset of the instruction in the image
+    uint8_t     opcode;                 // OpCode::Type
+    uint8_t     cond;                   // The condition jump opcode used by cmp
+    uint16_t    length;                 // Length of the instruction in the image
+};
+
+class vmDecodedImage {
+private:
+    vmInstruction * insns_;
+    size_t          size_;
+    vmInstruction * entry_;
+    int32_t *       offsetMap_;
+    size_t          imageSize_;
+
+public:
+    vmDecodedImage() : insns_(nullptr), size_(0), entry_(nullptr),
+                       offsetMap_(nullptr), imageSize_(0) {}
+    ~vmDecodedImage() {
+        this->deallocate();
+    }
+
+    bool isInited() const { return (insns_ != nullptr); }
+
+    vmInstruction * data() const { return insns_; }
+    vmInstruction * entry() const { return entry_; }
+
+    // The count of records, not including the tail sentinel.
+    size_t size() const { return size_; }
+    size_t getImageSize() const { return imageSize_; }
+
+    void setEntry(vmInstruction * entry) {
+        entry_ = entry;
+    }
+
+    int32_t getIndex(size_t offset) const {
+        if (offsetMap_ != nullptr && offset <= imageSize_)
+            return offsetMap_[offset];
+        else
+            return -1;
+    }
+
+    // Get the record of the instruction begin at the offset of image.
+    vmInstruction * getInsn(size_t offset) const {
+        int32_t index = getIndex(offset);
+        if (index >= 0)
+            return (insns_ + index);
+        else
+            return nullptr;
+    }
+
+    void allocate(size_t insnCount, size_t imageSize) {
+        this->deallocate();
+
+        // Include the tail sentinel record.
+        size_t allocSize = sizeof(vmInstruction) * (insnCount + 1);
+#if defined(_WIN32)
+        insns_ = (vmInstruction *)_aligned_malloc(allocSize, 64);
+#else
+        int ret = posix_memalign((void **)&insns_, 64, allocSize);
+        if (ret != 0)
+            insns_ = nullptr;
+#endif // _WIN32
+        if (insns_ != nullptr) {
+            memset((void *)insns_, 0, allocSize);
+        }
+
+        offsetMap_ = (int32_t *)malloc(sizeof(int32_t) * (imageSize + 1));
+        if (offsetMap_ != nullptr) {
+            for (size_t i = 0; i <= imageSize; ++i) {
+                offsetMap_[i] = -1;
+            }
+        }
+
+        size_ = insnCount;
+        imageSize_ = imageSize;
+        entry_ = insns_;
+    }
+
+    void deallocate() {
+        if (insns_) {
+#if defined(_WIN32)
+            _aligned_free(insns_);
+#else
+            free(insns_);
+#endif
+            insns_ = nullptr;
+        }
+        if (offsetMap_) {
+            free(offsetMap_);
+            offsetMap_ = nullptr;
+        }
+        size_ = 0;
+        entry_ = nullptr;
+        imageSize_ = 0;
+    }
+
+    friend class PreDecoder;
+};
+
+class PreDecoder {
+private:
+    template <typename U>
+    static U readValue(const unsigned char * ip, size_t offset) {
+        U value;
+        memcpy((void *)&value, (const void *)(ip + offset), sizeof(U));
+        return value;
+    }
+
+public:
+    PreDecoder() {}
+    ~PreDecoder() {}
+
+    //
+    // Get the byte length of the instruction at ip, return 0 if the
+    // instruction is truncated by the end of image.
+    //
+    static uint32_t getInsnLength(const unsigned char * ip, const unsigned char * limit) {
+        if (ip >= limit)
+            return 0;
+
+        uint32_t length;
+        uint8_t opcode = *ip;
+        switch (opcode) {
+        case OpCode::push:
+        case OpCode::add_sp:
+        case OpCode::copy_from_eax:
+        case OpCode::jl_near:
+        case OpCode::jmp_near:
+        case OpCode::call_near:
+        case OpCode::ret_n_sm:
+        case OpCode::inc:
+        case OpCode::dec:
+        case OpCode::add_eax:
+        case OpCode::sub_eax:
+            length = 1 + sizeof(int8_t);
+            break;
+
+        case OpCode::cmp_i32:
+        case OpCode::cmp_u32:
+        case OpCode::add:
+        case OpCode::sub:
+            length = 1 + sizeof(int8_t) * 2;
+            break;
+
+        case OpCode::jl_short:
+        case OpCode::jmp_short:
+        case OpCode::call_short:
+        case OpCode::ret_n:
+            length = 1 + sizeof(int16_t);
+            break;
+
+        case OpCode::push_i32:
+        case OpCode::load_eax:
+        case OpCode::jl_long:
+        case OpCode::jmp:
+        case OpCode::jmp_long:
+        case OpCode::call:
+        case OpCode::call_long:
+        case OpCode::ret_eax:
+        case OpCode::add_eax_imm:
+        case OpCode::sub_eax_imm:
+            length = 1 + sizeof(int32_t);
+            break;
+
+        case OpCode::store:
+        case OpCode::cmp_imm_i32:
+        case OpCode::cmp_imm_u32:
+        case OpCode::add_imm:
+        case OpCode::sub_imm:
+            length = 1 + sizeof(int8_t) + sizeof(int32_t);
+            break;
+
+        case OpCode::ret_eax_n:
+            length = 1 + sizeof(uint16_t) + sizeof(uint32_t);
+            break;
+
+        case OpCode::push_i64:
+            length = 1 + sizeof(int64_t);
+            break;
+
+        case OpCode::nop_n:
+            if ((ip + 1) < limit)
+                length = 1 + sizeof(uint8_t) + (uint32_t)ip[1];
+            else
+                return 0;
+            break;
+
+        default:
+            length = 1;
+            break;
+        }
+
+        if ((ip + length) <= limit)
+            return length;
+        else
+            return 0;
+    }
+
+    //
+    // Get the branch/call target offset of the instruction, return false
+    // if the instruction has no any target. The target may be out of the
+    // image, even negative, the caller must check it.
+    //
+    static bool getTargetOffset(const unsigned char * image, uint32_t offset, uint32_t length,
+                                int64_t & target) {
+        const unsigned char * ip = image + offset;
+        int64_t next = (int64_t)offset + length;
+        switch (*ip) {
+        case OpCode::jl_near:
+        case OpCode::jmp_near:
+        case OpCode::call_near:
+            target = next + readValue<int8_t>(ip, 1);
+            return true;
+
+        case OpCode::jl_short:
+        case OpCode::jmp_short:
+        case OpCode::call_short:
+            target = next + readValue<int16_t>(ip, 1);
+            return true;
+
+        case OpCode::jl_long:
+        case OpCode::jmp_long:
+        case OpCode::call_long:
+            target = next + readValue<int32_t>(ip, 1);
+            return true;
+
+        case OpCode::jmp:
+        case OpCode::call:
+            target = (int64_t)readValue<uint32_t>(ip, 1);
+            return true;
+
+        default:
+            return false;
+        }
+    }
+
+    //
+    // Translate the byte code image to the pre-decoded record array.
+    //
+    static int translate(vmDecodedImage & decoded,
+                         const unsigned char * image, size_t imageSize,
+                         size_t entryOffset, const void * const * handlers) {
+        const unsigned char * limit = image + imageSize;
+
+        // Pass 1: Count the instructions.
+        size_t insnCount = 0;
+        size_t offset = 0;
+        while (offset < imageSize) {
+            uint32_t length = getInsnLength(image + offset, limit);
+            if (length == 0)
+                return Error::PreDecode_Truncated_Instruction;
+            offset += length;
+            insnCount++;
+        }
+
+        decoded.allocate(insnCount, imageSize);
+        if (!decoded.isInited() || decoded.offsetMap_ == nullptr)
+            return Error::Error_NullPtr;
+
+        // Pass 2: Build the offset map, it's used to resolve the targets.
+        int32_t index = 0;
+        offset = 0;
+        while (offset < imageSize) {
+            uint32_t length = getInsnLength(image + offset, limit);
+            decoded.offsetMap_[offset] = index;
+            offset += length;
+            index++;
+        }
+        decoded.offsetMap_[imageSize] = index;
+
+        // Pass 3: Decode the operands and resolve the targets.
+        vmInstruction * insn = decoded.data();
+        offset = 0;
+        while (offset < imageSize) {
+            const unsigned char * ip = image + offset;
+            uint32_t length = getInsnLength(ip, limit);
+            uint8_t opcode = *ip;
+
+            insn->opcode = opcode;
+            insn->offset = (uint32_t)offset;
+            insn->length = (uint16_t)length;
+            insn->handler = (handlers != nullptr) ? handlers[opcode] : nullptr;
+
+            switch (opcode) {
+            case OpCode::push:
+            case OpCode::copy_from_eax:
+            case OpCode::inc:
+            case OpCode::dec:
+            case OpCode::add_eax:
+            case OpCode::sub_eax:
+                insn->index = readValue<int8_t>(ip, 1);
+                break;
+
+            case OpCode::push_i32:
+            case OpCode::load_eax:
+            case OpCode::ret_eax:
+            case OpCode::add_eax_imm:
+            case OpCode::sub_eax_imm:
+                insn->imm.u64 = readValue<uint32_t>(ip, 1);
+                break;
+
+            case OpCode::push_i64:
+                insn->imm.i64 = readValue<int64_t>(ip, 1);
+                break;
+
+            case OpCode::add_sp:
+            case OpCode::ret_n_sm:
+                insn->index = readValue<uint8_t>(ip, 1);
+                break;
+
+            case OpCode::ret_n:
+                insn->index = readValue<uint16_t>(ip, 1);
+                break;
+
+            case OpCode::ret_eax_n:
+                insn->index = readValue<uint16_t>(ip, 1);
+                insn->imm.u64 = readValue<uint32_t>(ip, 3);
+                break;
+
+            case OpCode::store:
+            case OpCode::add_imm:
+            case OpCode::sub_imm:
+            case OpCode::cmp_imm_i32:
+            case OpCode::cmp_imm_u32:
+                insn->index = readValue<int8_t>(ip, 1);
+                insn->imm.u64 = readValue<uint32_t>(ip, 2);
+                break;
+
+            case OpCode::cmp_i32:
+            case OpCode::cmp_u32:
+            case OpCode::add:
+            case OpCode::sub:
+                insn->index = readValue<int8_t>(ip, 1);
+                insn->index2 = readValue<int8_t>(ip, 2);
+                break;
+
+            default:
+                break;
+            }
+
+            // The cmp instructions read the condition from the next opcode.
+            if (opcode >= OpCode::cmp && opcode <= OpCode::cmp_imm_u64) {
+                if ((offset + length) < imageSize)
+                    insn->cond = *(ip + length);
+            }
+
+            int64_t targetOffset;
+            if (getTargetOffset(image, (uint32_t)offset, length, targetOffset)) {
+                // A target must be an instruction in the image.
+                vmInstruction * target = nullptr;
+                if (targetOffset >= 0 && targetOffset < (int64_t)imageSize)
+                    target = decoded.getInsn((size_t)targetOffset);
+                if (target == nullptr)
+                    return Error::PreDecode_Invalid_Target;
+                insn->target = target;
+            }
+
+            offset += length;
+            insn++;
+        }
+
+        // The tail sentinel, running off the end of image is same as exit.
+        insn->opcode = OpCode::exit;
+        insn->offset = (uint32_t)imageSize;
+        insn->length = 0;
+        insn->handler = (handlers != nullptr) ? handlers[OpCode::exit] : nullptr;
+
+        vmInstruction * entry = decoded.getInsn(entryOffset);
+        if (entry == nullptr)
+            return Error::PreDecode_Invalid_Target;
+        decoded.setEntry(entry);
+
+        return Error::Ok;
+    }
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_PREDECODER_H
@@ -0,0 +1,287 @@
+#ifndef JLANG_VM_QUICKENER_H
+#define JLANG_VM_QUICKENER_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/vm/Interpreter.h"
+#include "jlang/vm/TypedOps.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+namespace jlang {
+namespace v1 {
+
+//
+// The private opcodes of the quickened image, they follow OpCode::last and
+// never appear in a loaded image.
+//
+// The "_r32" forms are the register forms of the generic instructions that
+// only use the 32-bit registers, the "jcc_" forms are the condition jumps
+// fused behind a quickened cmp, they branch on the result of the cmp.
+//
+// The "cmp_" forms are the typed compares, the operand type and the
+// condition are both in the opcode, "cmp_<type>_<cond>".
+//
+#define V1_QUICK_CMP_OPCODE(kind, type, cond)   kind##_##cond,
+
+struct QuickOpCode {
+    enum Type {
+        first = OpCode::last,
+
+        push_r32 = first,
+        pop_r32,
+        load_r32,
+        move_r32,
+        inc_r32,
+        dec_r32,
+        add_r32,
+        sub_r32,
+
+        // The order must be same as vmJumpType::Near, Short and Long.
+        jcc_near,
+        jcc_short,
+        jcc_long,
+
+        // The order of the conditions must be same as vmCondType.
+        VM_FOR_EACH_COND(V1_QUICK_CMP_OPCODE, cmp_i32,     int32_t)
+        VM_FOR_EACH_COND(V1_QUICK_CMP_OPCODE, cmp_u32,     uint32_t)
+        VM_FOR_EACH_COND(V1_QUICK_CMP_OPCODE, cmp_imm_i32, int32_t)
+        VM_FOR_EACH_COND(V1_QUICK_CMP_OPCODE, cmp_imm_u32, uint32_t)
+        VM_FOR_EACH_COND(V1_QUICK_CMP_OPCODE, cmp_i64,     int64_t)
+        VM_FOR_EACH_COND(V1_QUICK_CMP_OPCODE, cmp_u64,     uint64_t)
+        VM_FOR_EACH_COND(V1_QUICK_CMP_OPCODE, cmp_imm_i64, int64_t)
+        VM_FOR_EACH_COND(V1_QUICK_CMP_OPCODE, cmp_imm_u64, uint64_t)
+
+        last
+    };
+};
+
+#undef V1_QUICK_CMP_OPCODE
+
+//
+// Rewrite a generic instruction of the v1 image to its specialized form
+// in place, the first time it runs.
+//
+// The specialized form always has the same length and operand layout as
+// the generic form, only the opcode byte (and for cmp, the combo type
+// byte and the condition jump byte) are rewritten, so the jump and call
+// offsets of the image are still valid. The operand types and registers
+// are verified here, the specialized handlers needn't switch on them.
+//
+// The forms that have no specialized variant (Ptr32/Ptr64 jumps and calls,
+// the 8/16-bit and 64-bit register forms) are kept generic.
+//
+// The quickened cmp:
+//
+//   [cmp_*_cond][condJmp][dataType][reg][imm or reg] [jcc_*][jumpType][offset]
+//
+// The opcode becomes the typed compare of the condition, the condition
+// jump code moves to the combo type byte, the condition jump byte becomes
+// jcc_near, jcc_short or jcc_long. The quickened cmp still saves its
+// operands in the lazy flags, the condition jumps that don't follow it are
+// kept generic and evaluate the flags.
+//
+class Quickener {
+private:
+    static bool isReg32(uint8_t reg) {
+        return (vmReg::isValidRegister((reg_t)reg) &&
+                vmReg::getType((reg_t)reg) == vmRegType::r32);
+    }
+
+    static bool isRegOfType(uint8_t reg, uint8_t dataType) {
+        if (!vmReg::isValidRegister((reg_t)reg))
+            return false;
+        uint32_t regType = vmReg::getType((reg_t)reg);
+        switch (dataType) {
+        case vmDataType::Int32:
+        case vmDataType::UInt32:
+            return (regType == vmRegType::r32);
+#if defined(WIN64) || defined(_WIN64) || defined(_M_X64) || defined(_M_AMD64) \
+ || defined(__amd64__) || defined(__x86_64__) || defined(__aarch64__)
+        case vmDataType::Int64:
+        case vmDataType::UInt64:
+            return (regType == vmRegType::r64);
+#endif
+        default:
+            return false;
+        }
+    }
+
+    static bool quickenPush(unsigned char * ip) {
+        switch (ip[1]) {
+        case vmDataType::Reg:
+            if (!isReg32(ip[2]))
+                return false;
+            ip[0] = QuickOpCode::push_r32;
+            return true;
+        case vmDataType::Data:
+        case vmDataType::Int32:
+        case vmDataType::UInt32:
+            ip[0] = OpCode::push_i32;
+            return true;
+        case vmDataType::Int64:
+        case vmDataType::UInt64:
+            ip[0] = OpCode::push_i64;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool quickenPop(unsigned char * ip) {
+        switch (ip[1]) {
+        case vmDataType::Reg:
+            if (!isReg32(ip[2]))
+                return false;
+            ip[0] = QuickOpCode::pop_r32;
+            return true;
+        case vmDataType::Int32:
+        case vmDataType::UInt32:
+            ip[0] = OpCode::pop_i32;
+            return true;
+        case vmDataType::Int64:
+        case vmDataType::UInt64:
+            ip[0] = OpCode::pop_i64;
+            return true;
+        default:
+            return false;
+        }
+    }
+
+    static bool quickenCmp(unsigned char * ip) {
+        uint8_t cmpType = ip[1];
+        uint8_t dataType = ip[2];
+        if (!isRegOfType(ip[3], dataType))
+            return false;
+
+        bool is64Bit = (dataType == vmDataType::Int64 || dataType == vmDataType::UInt64);
+        bool isSigned = (dataType == vmDataType::Int32 || dataType == vmDataType::Int64);
+        size_t operandSize;
+        uint8_t quickOpcode;
+        if (cmpType == vmComboType::Reg_Reg) {
+            if (!isRegOfType(ip[4], dataType))
+                return false;
+            operandSize = 1;
+            if (is64Bit)
+                quickOpcode = isSigned ? QuickOpCode::cmp_i64_jz : QuickOpCode::cmp_u64_jz;
+            else
+                quickOpcode = isSigned ? QuickOpCode::cmp_i32_jz : QuickOpCode::cmp_u32_jz;
+        }
+        else if (cmpType == vmComboType::Reg_Imm) {
+            operandSize = is64Bit ? sizeof(uint64_t) : sizeof(uint32_t);
+            if (is64Bit)
+                quickOpcode = isSigned ? QuickOpCode::cmp_imm_i64_jz : QuickOpCode::cmp_imm_u64_jz;
+            else
+                quickOpcode = isSigned ? QuickOpCode::cmp_imm_i32_jz : QuickOpCode::cmp_imm_u32_jz;
+        }
+        else {
+            return false;
+        }
+
+        // The condition jump must follow the cmp with a relative offset.
+        unsigned char * jcc = ip + 4 + operandSize;
+        uint8_t condJmp = jcc[0];
+        uint8_t jumpType = jcc[1];
+        if (condJmp < OpCode::cond_jmp_first || condJmp > OpCode::cond_jmp_last)
+            return false;
+        if (jumpType != vmJumpType::Near && jumpType != vmJumpType::Short &&
+            jumpType != vmJumpType::Long)
+            return false;
+        uint8_t condType = getCondType(condJmp);
+        if (condType == vmCondType::last)
+            return false;
+
+        jcc[0] = (unsigned char)(QuickOpCode::jcc_near + jumpType);
+        ip[1] = condJmp;
+        ip[0] = (unsigned char)(quickOpcode + condType);
+        return true;
+    }
+
+public:
+    Quickener() {}
+    ~Quickener() {}
+
+    //
+    // Quicken the instruction at ip, return true if it's rewritten, the
+    // caller must dispatch the instruction again.
+    //
+    static bool quicken(unsigned char * ip) {
+        assert(ip != nullptr);
+        switch (ip[0]) {
+        case OpCode::push:
+            return quickenPush(ip);
+
+        case OpCode::pop:
+            return quickenPop(ip);
+
+        case OpCode::load:
+            // load reg, imm32
+            if (!isReg32(ip[1]))
+                return false;
+            ip[0] = QuickOpCode::load_r32;
+            return true;
+
+        case OpCode::move:
+            if (!isReg32(ip[1]) || !isReg32(ip[2]))
+                return false;
+            ip[0] = QuickOpCode::move_r32;
+            return true;
+
+        case OpCode::inc:
+        case OpCode::dec:
+            if (!isReg32(ip[1]))
+                return false;
+            ip[0] = (ip[0] == OpCode::inc) ? QuickOpCode::inc_r32 : QuickOpCode::dec_r32;
+            return true;
+
+        case OpCode::add:
+        case OpCode::sub:
+            if (ip[1] != vmComboType::Reg_Reg || !isReg32(ip[2]) || !isReg32(ip[3]))
+                return false;
+            ip[0] = (ip[0] == OpCode::add) ? QuickOpCode::add_r32 : QuickOpCode::sub_r32;
+            return true;
+
+        case OpCode::cmp:
+            return quickenCmp(ip);
+
+        case OpCode::jmp:
+            switch (ip[1]) {
+            case vmJumpType::Near:
+                ip[0] = OpCode::jmp_near;
+                return true;
+            case vmJumpType::Short:
+                ip[0] = OpCode::jmp_short;
+                return true;
+            case vmJumpType::Long:
+                ip[0] = OpCode::jmp_long;
+                return true;
+            default:
+                return false;
+            }
+
+        case OpCode::call:
+            switch (ip[1]) {
+            case vmCallType::Short:
+                ip[0] = OpCode::call_short;
+                return true;
+            case vmCallType::Long:
+                ip[0] = OpCode::call_long;
+                return true;
+            default:
+                return false;
+            }
+
+        default:
+            return false;
+        }
+    }
+};
+
+} // namespace v1
+} // namespace jlang
+
+#endif // JLANG_VM_QUICKENER_H
@@ -0,0 +1,721 @@
+#ifndef JLANG_VM_REGTRANSLATOR_H
+#define JLANG_VM_REGTRANSLATOR_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/vm/Interpreter.h"
+#include "jlang/vm/PreDecoder.h"
+#include "jlang/lang/Error.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <vector>
+#include <algorithm>
+
+namespace jlang {
+namespace v3 {
+
+//
+// The register machine instruction set.
+//
+// A register is a 32-bit slot of the frame, addressed by its index relative
+// to fp, so the registers of a function are a window of the VM stack:
+//
+//   r0             The return value register (eax of the stack machine).
+//   r1 ~ rN        The stack slots 0 ~ N-1 of the stack machine.
+//   r-5, r-6 ...   The arguments, they are the registers of the caller.
+//
+// The callee's frame is placed right after the caller's registers, the
+// arguments are never copied. A ret writes the value to the destination
+// register of the call, the stack pointer is gone at all.
+//
+struct RegOpCode {
+    enum Type {
+        nop,
+        mov,            // mov      rd, rs
+        movi,           // movi     rd, imm
+        add,            // add      rd, rs1, rs2
+        addi,           // addi     rd, rs, imm
+        sub,            // sub      rd, rs1, rs2
+        subi,           // subi     rd, rs, imm
+        blt_i32,        // blt      rs1, rs2, target (int32)
+        blt_u32,        // blt      rs1, rs2, target (uint32)
+        blti_i32,       // blti     rs, imm, target (int32)
+        blti_u32,       // blti     rs, imm, target (uint32)
+        jmp,            // jmp      target
+        call,           // call     target, frame -> rd
+        call_rv,        // call     target, frame -> rd, and pass r0 to the callee
+        ret,            // ret      rs
+        reti,           // reti     imm
+        exit,           // exit     rs
+        last
+    };
+};
+
+//
+// The register machine instruction record, same as vmInstruction, the
+// operands are widened and the targets are resolved at load time.
+//
+struct vmRegInsn {
+    const void *        handler;    // Handler address (label)
+    const vmRegInsn *   target;     // Resolved branch/call target record
+    union {
+        int32_t  i32;
+        uint32_t u32;
+    } imm;                          // Immediate value
+    int32_t     frame;              // Byte offset of the callee's fp (call)
+    int16_t     dst;                // Destination register
+    int16_t     src1;               // Source register 1
+    int16_t     src2;               // Source register 2
+    uint8_t     opcode;             // RegOpCode::Type
+    uint8_t     reserved;
+    uint32_t    offset;             // Offset of the source instruction in the image
+};
+
+class vmRegImage {
+private:
+    std::vector<vmRegInsn>  insns_;
+    size_t                  maxFrameSize_;
+    size_t                  funcCount_;
+    size_t                  sourceCount_;
+
+public:
+    vmRegImage() : maxFrameSize_(0), funcCount_(0), sourceCount_(0) {}
+    ~vmRegImage() {}
+
+    bool isInited() const { return !insns_.empty(); }
+
+    const vmRegInsn * data() const { return insns_.data(); }
+    const vmRegInsn * entry() const { return insns_.data(); }
+    size_t size() const { return insns_.size(); }
+
+    // The max bytes of a frame, include the registers and the frame header.
+    size_t getMaxFrameSize() const { return maxFrameSize_; }
+    size_t getFuncCount() const { return funcCount_; }
+    // The count of the source records that been translated.
+    size_t getSourceCount() const { return sourceCount_; }
+
+    void clear() {
+        insns_.clear();
+        maxFrameSize_ = 0;
+        funcCount_ = 0;
+        sourceCount_ = 0;
+    }
+
+    friend class RegTranslator;
+};
+
+//
+// Translate the pre-decoded stack machine records to the register machine.
+//
+// The depth of the stack is static at every instruction of a function, so
+// a push is a mov to the register of the slot, and the sp adjustments are
+// dropped. Besides, a few stack idioms are folded to the three-address form:
+//
+//   push rs; dec/inc/add_imm/sub_imm (pushed)  ->  subi/addi rd, rs, imm
+//   cmp ...; jl target                         ->  blt/blti ..., target
+//   call target; copy_from_eax index           ->  call target -> r(index)
+//
+// The last one is done only if r0 is overwritten before read.
+//
+class RegTranslator {
+private:
+    static const int32_t kFrameHeaderSize = (int32_t)(sizeof(void *) * 2);
+
+    struct Function {
+        size_t                  entry;          // Index of the entry record
+        std::vector<int32_t>    depth;          // Stack depth of records, -1 is unreachable
+        int32_t                 maxDepth;
+        bool                    needsRv;        // Read r0 before it's written
+        size_t                  start;          // Index of the first register record
+    };
+
+    struct Fixup {
+        size_t  insn;       // Index of the register record
+        size_t  func;       // Index of the function
+        size_t  target;     // Index of the target record or function entry
+        bool    isCall;
+    };
+
+    const vmInstruction *   insns_;
+    size_t                  insnCount_;
+    std::vector<Function>   funcs_;
+    std::vector<vmRegInsn>  out_;
+    std::vector<Fixup>      fixups_;
+
+    static bool isCall(uint8_t opcode) {
+        return (opcode == OpCode::call || opcode == OpCode::call_near ||
+                opcode == OpCode::call_short || opcode == OpCode::call_long);
+    }
+
+    static bool isJump(uint8_t opcode) {
+        return (opcode == OpCode::jmp || opcode == OpCode::jmp_near ||
+                opcode == OpCode::jmp_short || opcode == OpCode::jmp_long);
+    }
+
+    static bool isCondJump(uint8_t opcode) {
+        return (opcode == OpCode::jl_near || opcode == OpCode::jl_short ||
+                opcode == OpCode::jl_long);
+    }
+
+    static bool isReturn(uint8_t opcode) {
+        return (opcode >= OpCode::ret && opcode <= OpCode::ret_eax_n);
+    }
+
+    static bool isFallThrough(uint8_t opcode) {
+        return !(isJump(opcode) || isReturn(opcode) || opcode == OpCode::exit);
+    }
+
+    // The register of the stack machine's frame slot.
+    static int16_t reg(int32_t index) {
+        return (int16_t)((index >= 0) ? (index + 1) : index);
+    }
+
+    // The stack depth change of the instruction, in 32-bit slots.
+    static bool getDepthDelta(const vmInstruction & insn, int32_t & delta) {
+        switch (insn.opcode) {
+        case OpCode::push:
+        case OpCode::push_i32:
+        case OpCode::push_i32_0:
+        case OpCode::add_sp_4:
+            delta = 1;
+            return true;
+        case OpCode::push_i64:
+        case OpCode::push_i64_0:
+            delta = 2;
+            return true;
+        case OpCode::pop:
+        case OpCode::pop_i32:
+            delta = -1;
+            return true;
+        case OpCode::pop_i64:
+            delta = -2;
+            return true;
+        case OpCode::add_sp:
+            delta = insn.index / (int32_t)sizeof(uint32_t);
+            return ((insn.index % (int32_t)sizeof(uint32_t)) == 0);
+        default:
+            delta = 0;
+            return true;
+        }
+    }
+
+    size_t indexOf(const vmInstruction * insn) const {
+        return (size_t)(insn - insns_);
+    }
+
+    size_t findFunction(size_t entry) const {
+        for (size_t n = 0; n < funcs_.size(); ++n) {
+            if (funcs_[n].entry == entry)
+                return n;
+        }
+        return funcs_.size();
+    }
+
+    //
+    // Walk the records of the function, and compute the stack depth of them,
+    // the call targets are appended to the function list.
+    //
+    int analyze(size_t func) {
+        std::vector<int32_t> depth(insnCount_, -1);
+        int32_t maxDepth = 0;
+
+        std::vector<std::pair<size_t, int32_t> > worklist;
+        worklist.push_back(std::make_pair(funcs_[func].entry, 0));
+        while (!worklist.empty()) {
+            size_t index = worklist.back().first;
+            int32_t current = worklist.back().second;
+            worklist.pop_back();
+            if (index >= insnCount_)
+                return Error::RegVM_Stack_Mismatch;
+            if (depth[index] >= 0) {
+                if (depth[index] != current)
+                    return Error::RegVM_Stack_Mismatch;
+                continue;
+            }
+            depth[index] = current;
+
+            const vmInstruction & insn = insns_[index];
+            int32_t delta;
+            if (!getDepthDelta(insn, delta))
+                return Error::RegVM_Unsupported_OpCode;
+            int32_t next = current + delta;
+            if (next < 0)
+                return Error::RegVM_Stack_Mismatch;
+            maxDepth = std::max(maxDepth, next);
+
+            if (insn.target != nullptr) {
+                size_t target = indexOf(insn.target);
+                if (isCall(insn.opcode)) {
+                    if (findFunction(target) >= funcs_.size()) {
+                        Function callee;
+                        callee.entry = target;
+                        callee.maxDepth = 0;
+                        callee.needsRv = false;
+                        callee.start = 0;
+                        funcs_.push_back(callee);
+                    }
+                }
+                else {
+                    worklist.push_back(std::make_pair(target, next));
+                }
+            }
+            if (isFallThrough(insn.opcode))
+                worklist.push_back(std::make_pair(index + 1, next));
+        }
+
+        funcs_[func].depth.swap(depth);
+        funcs_[func].maxDepth = maxDepth;
+        return Error::Ok;
+    }
+
+    // Does the instruction read eax (r0) ?
+    bool readsRv(const vmInstruction & insn) const {
+        switch (insn.opcode) {
+        case OpCode::copy_from_eax:
+        case OpCode::add_eax:
+        case OpCode::add_eax_imm:
+        case OpCode::sub_eax:
+        case OpCode::sub_eax_imm:
+        case OpCode::ret:
+        case OpCode::ret_n_sm:
+        case OpCode::ret_n:
+        case OpCode::exit:
+            return true;
+        default:
+            if (isCall(insn.opcode)) {
+                size_t callee = findFunction(indexOf(insn.target));
+                return (callee < funcs_.size() && funcs_[callee].needsRv);
+            }
+            return false;
+        }
+    }
+
+    // Does the instruction overwrite eax (r0) without read it ?
+    static bool writesRv(const vmInstruction & insn) {
+        return (insn.opcode == OpCode::load_eax || isCall(insn.opcode) ||
+                insn.opcode == OpCode::ret_eax || insn.opcode == OpCode::ret_eax_n);
+    }
+
+    //
+    // Is r0 of the function read on a path before it's written ? It's a
+    // must-defined dataflow, the merge is AND.
+    //
+    bool computeNeedsRv(size_t func) const {
+        const Function & f = funcs_[func];
+        // 0: undefined, 1: defined, -1: not visited.
+        std::vector<int8_t> state(insnCount_, -1);
+        std::vector<size_t> worklist;
+        state[f.entry] = 0;
+        worklist.push_back(f.entry);
+        while (!worklist.empty()) {
+            size_t index = worklist.back();
+            worklist.pop_back();
+            const vmInstruction & insn = insns_[index];
+            bool defined = (state[index] == 1);
+            if (!defined && readsRv(insn))
+                return true;
+            if (writesRv(insn) || readsRv(insn))
+                defined = true;
+
+            size_t succ[2];
+            size_t succCount = 0;
+            if (insn.target != nullptr && !isCall(insn.opcode))
+                succ[succCount++] = indexOf(insn.target);
+            if (isFallThrough(insn.opcode))
+                succ[succCount++] = index + 1;
+            for (size_t k = 0; k < succCount; ++k) {
+                size_t s = succ[k];
+                int8_t merged = (int8_t)defined;
+                if (state[s] >= 0)
+                    merged = (int8_t)(state[s] & merged);
+                if (state[s] != merged) {
+                    state[s] = merged;
+                    worklist.push_back(s);
+                }
+            }
+        }
+        return false;
+    }
+
+    //
+    // Is r0 dead after the record at index ? Only scan the straight-line
+    // records, a branch target or the end of block is taken as live.
+    //
+    bool isRvDeadAfter(const std::vector<size_t> & order, size_t n,
+                       const std::vector<bool> & isTarget) const {
+        for (size_t k = n + 1; k < order.size(); ++k) {
+            if (order[k] != order[k - 1] + 1 || isTarget[order[k]])
+                return false;
+            const vmInstruction & insn = insns_[order[k]];
+            if (readsRv(insn))
+                return false;
+            if (writesRv(insn))
+                return true;
+            if (!isFallThrough(insn.opcode) || isCondJump(insn.opcode))
+                return false;
+        }
+        return false;
+    }
+
+    vmRegInsn & emit(uint8_t opcode, const vmInstruction & insn) {
+        vmRegInsn rinsn;
+        memset((void *)&rinsn, 0, sizeof(rinsn));
+        rinsn.opcode = opcode;
+        rinsn.offset = insn.offset;
+        out_.push_back(rinsn);
+        return out_.back();
+    }
+
+    void emitBranch(uint8_t opcode, const vmInstruction & insn, size_t func, size_t target,
+                    bool isCall = false) {
+        emit(opcode, insn);
+        Fixup fixup;
+        fixup.insn = out_.size() - 1;
+        fixup.func = func;
+        fixup.target = target;
+        fixup.isCall = isCall;
+        fixups_.push_back(fixup);
+    }
+
+    void emitCall(const vmInstruction & insn, size_t func, int32_t depth, int16_t dst) {
+        size_t callee = findFunction(indexOf(insn.target));
+        uint8_t opcode = funcs_[callee].needsRv ? RegOpCode::call_rv : RegOpCode::call;
+        emitBranch(opcode, insn, func, callee, true);
+        out_.back().frame = (depth + 1) * (int32_t)sizeof(uint32_t) + kFrameHeaderSize;
+        out_.back().dst = dst;
+    }
+
+    //
+    // Emit the register records of one function, in the order of the image.
+    //
+    int translateFunction(size_t func, std::vector<std::vector<size_t> > & insnMap,
+                          size_t & frameSize) {
+        Function & f = funcs_[func];
+        f.start = out_.size();
+        const std::vector<int32_t> & depth = f.depth;
+
+        std::vector<size_t> order;
+        for (size_t i = 0; i < insnCount_; ++i) {
+            if (depth[i] >= 0)
+                order.push_back(i);
+        }
+
+        std::vector<bool> isTarget(insnCount_, false);
+        isTarget[f.entry] = true;
+        for (size_t n = 0; n < order.size(); ++n) {
+            const vmInstruction & insn = insns_[order[n]];
+            if (insn.target != nullptr && !isCall(insn.opcode))
+                isTarget[indexOf(insn.target)] = true;
+        }
+
+        // The entry must be the first record of the function.
+        if (order.empty() || order[0] != f.entry)
+            emitBranch(RegOpCode::jmp, insns_[f.entry], func, f.entry);
+
+        std::vector<size_t> & map = insnMap[func];
+        map.assign(insnCount_, (size_t)-1);
+
+        for (size_t n = 0; n < order.size(); ++n) {
+            size_t index = order[n];
+            const vmInstruction & insn = insns_[index];
+            int32_t d = depth[index];
+            map[index] = out_.size();
+
+            // The next record can be fused with this one ?
+            const vmInstruction * next = nullptr;
+            if ((n + 1) < order.size() && order[n + 1] == index + 1 && !isTarget[index + 1])
+                next = &insns_[index + 1];
+            bool fused = false;
+
+            switch (insn.opcode) {
+            case OpCode::push:
+                if (next != nullptr && next->index == d &&
+                    (next->opcode == OpCode::inc || next->opcode == OpCode::dec ||
+                     next->opcode == OpCode::add_imm || next->opcode == OpCode::sub_imm)) {
+                    bool isAdd = (next->opcode == OpCode::inc || next->opcode == OpCode::add_imm);
+                    vmRegInsn & rinsn = emit(isAdd ? RegOpCode::addi : RegOpCode::subi, insn);
+                    rinsn.dst = reg(d);
+                    rinsn.src1 = reg(insn.index);
+                    rinsn.imm.u32 = (next->opcode == OpCode::inc || next->opcode == OpCode::dec)
+                                    ? 1 : next->imm.u32;
+                    fused = true;
+                }
+                else {
+                    vmRegInsn & rinsn = emit(RegOpCode::mov, insn);
+                    rinsn.dst = reg(d);
+                    rinsn.src1 = reg(insn.index);
+                }
+                break;
+            case OpCode::push_i32:
+            case OpCode::push_i32_0: {
+                vmRegInsn & rinsn = emit(RegOpCode::movi, insn);
+                rinsn.dst = reg(d);
+                rinsn.imm.u32 = (insn.opcode == OpCode::push_i32) ? insn.imm.u32 : 0;
+                break;
+            }
+            case OpCode::push_i64:
+            case OpCode::push_i64_0: {
+                uint64_t value = (insn.opcode == OpCode::push_i64) ? insn.imm.u64 : 0;
+                vmRegInsn & low = emit(RegOpCode::movi, insn);
+                low.dst = reg(d);
+                low.imm.u32 = (uint32_t)value;
+                vmRegInsn & high = emit(RegOpCode::movi, insn);
+                high.dst = reg(d + 1);
+                high.imm.u32 = (uint32_t)(value >> 32);
+                break;
+            }
+            case OpCode::load_eax: {
+                vmRegInsn & rinsn = emit(RegOpCode::movi, insn);
+                rinsn.dst = 0;
+                rinsn.imm.u32 = insn.imm.u32;
+                break;
+            }
+            case OpCode::store: {
+                vmRegInsn & rinsn = emit(RegOpCode::movi, insn);
+                rinsn.dst = reg(insn.index);
+                rinsn.imm.u32 = insn.imm.u32;
+                break;
+            }
+            case OpCode::copy_from_eax: {
+                vmRegInsn & rinsn = emit(RegOpCode::mov, insn);
+                rinsn.dst = reg(insn.index);
+                rinsn.src1 = 0;
+                break;
+            }
+            case OpCode::inc:
+            case OpCode::dec:
+            case OpCode::add_imm:
+            case OpCode::sub_imm: {
+                bool isAdd = (insn.opcode == OpCode::inc || insn.opcode == OpCode::add_imm);
+                vmRegInsn & rinsn = emit(isAdd ? RegOpCode::addi : RegOpCode::subi, insn);
+                rinsn.dst = rinsn.src1 = reg(insn.index);
+                rinsn.imm.u32 = (insn.opcode == OpCode::inc || insn.opcode == OpCode::dec)
+                                ? 1 : insn.imm.u32;
+                break;
+            }
+            case OpCode::add:
+            case OpCode::sub: {
+                vmRegInsn & rinsn = emit((insn.opcode == OpCode::add) ? RegOpCode::add
+                                                                      : RegOpCode::sub, insn);
+                rinsn.dst = rinsn.src1 = reg(insn.index);
+                rinsn.src2 = reg(insn.index2);
+                break;
+            }
+            case OpCode::add_eax:
+            case OpCode::sub_eax: {
+                vmRegInsn & rinsn = emit((insn.opcode == OpCode::add_eax) ? RegOpCode::add
+                                                                          : RegOpCode::sub, insn);
+                rinsn.dst = rinsn.src1 = 0;
+                rinsn.src2 = reg(insn.index);
+                break;
+            }
+            case OpCode::add_eax_imm:
+            case OpCode::sub_eax_imm: {
+                vmRegInsn & rinsn = emit((insn.opcode == OpCode::add_eax_imm) ? RegOpCode::addi
+                                                                              : RegOpCode::subi, insn);
+                rinsn.dst = rinsn.src1 = 0;
+                rinsn.imm.u32 = insn.imm.u32;
+                break;
+            }
+            case OpCode::cmp_i32:
+            case OpCode::cmp_u32:
+            case OpCode::cmp_imm_i32:
+            case OpCode::cmp_imm_u32:
+                // The flags are only read by the jl of the next record.
+                if (next != nullptr && isCondJump(next->opcode) && isCondJump(insn.cond)) {
+                    uint8_t opcode;
+                    if (insn.opcode == OpCode::cmp_i32)
+                        opcode = RegOpCode::blt_i32;
+                    else if (insn.opcode == OpCode::cmp_u32)
+                        opcode = RegOpCode::blt_u32;
+                    else if (insn.opcode == OpCode::cmp_imm_i32)
+                        opcode = RegOpCode::blti_i32;
+                    else
+                        opcode = RegOpCode::blti_u32;
+                    emitBranch(opcode, insn, func, indexOf(next->target));
+                    vmRegInsn & rinsn = out_.back();
+                    rinsn.src1 = reg(insn.index);
+                    rinsn.src2 = reg(insn.index2);
+                    rinsn.imm.u32 = insn.imm.u32;
+                    fused = true;
+                }
+                break;
+            case OpCode::jl_near:
+            case OpCode::jl_short:
+            case OpCode::jl_long:
+                // The flags come from a cmp of another block.
+                return Error::RegVM_Unsupported_OpCode;
+            case OpCode::jmp:
+            case OpCode::jmp_near:
+            case OpCode::jmp_short:
+            case OpCode::jmp_long:
+                emitBranch(RegOpCode::jmp, insn, func, indexOf(insn.target));
+                break;
+            case OpCode::call:
+            case OpCode::call_near:
+            case OpCode::call_short:
+            case OpCode::call_long:
+                if (next != nullptr && next->opcode == OpCode::copy_from_eax &&
+                    isRvDeadAfter(order, n + 1, isTarget)) {
+                    emitCall(insn, func, d, reg(next->index));
+                    fused = true;
+                }
+                else {
+                    emitCall(insn, func, d, 0);
+                }
+                break;
+            case OpCode::ret:
+            case OpCode::ret_n_sm:
+            case OpCode::ret_n: {
+                vmRegInsn & rinsn = emit(RegOpCode::ret, insn);
+                rinsn.src1 = 0;
+                break;
+            }
+            case OpCode::ret_eax:
+            case OpCode::ret_eax_n: {
+                vmRegInsn & rinsn = emit(RegOpCode::reti, insn);
+                rinsn.imm.u32 = insn.imm.u32;
+                break;
+            }
+            case OpCode::exit: {
+                vmRegInsn & rinsn = emit(RegOpCode::exit, insn);
+                rinsn.src1 = 0;
+                break;
+            }
+            case OpCode::pop:
+            case OpCode::pop_i32:
+            case OpCode::pop_i64:
+            case OpCode::add_sp:
+            case OpCode::add_sp_4:
+            case OpCode::error:
+            case OpCode::move:
+            case OpCode::move_to_eax:
+            case OpCode::cmp:
+            case OpCode::jl:
+            case OpCode::nop:
+            case OpCode::nop_n:
+                break;
+            default:
+                return Error::RegVM_Unsupported_OpCode;
+            }
+
+            size_t last = index;
+            if (fused) {
+                map[index + 1] = map[index];
+                last = index + 1;
+                n++;
+            }
+
+            if (isFallThrough(insns_[last].opcode) &&
+                ((n + 1) >= order.size() || order[n + 1] != last + 1)) {
+                emitBranch(RegOpCode::jmp, insns_[last], func, last + 1);
+            }
+        }
+
+        frameSize = (size_t)((f.maxDepth + 1) * (int32_t)sizeof(uint32_t) + kFrameHeaderSize);
+        return Error::Ok;
+    }
+
+    int translate(const vmDecodedImage & decoded, vmRegImage & image,
+                  const void * const * handlers) {
+        size_t entry = indexOf(decoded.entry());
+
+        Function main;
+        main.entry = entry;
+        main.maxDepth = 0;
+        main.needsRv = false;
+        main.start = 0;
+        funcs_.push_back(main);
+
+        for (size_t n = 0; n < funcs_.size(); ++n) {
+            int ec = analyze(n);
+            if (ec != Error::Ok)
+                return ec;
+        }
+
+        // A callee may read the caller's r0, iterate until it's stable.
+        bool changed;
+        do {
+            changed = false;
+            for (size_t n = 0; n < funcs_.size(); ++n) {
+                if (!funcs_[n].needsRv && computeNeedsRv(n)) {
+                    funcs_[n].needsRv = true;
+                    changed = true;
+                }
+            }
+        } while (changed);
+
+        // The program entry: call main -> r0, exit r0, the r0 of the bottom
+        // frame is the initial eax (zero).
+        const vmInstruction & first = insns_[entry];
+        emitBranch(funcs_[0].needsRv ? RegOpCode::call_rv : RegOpCode::call,
+                   first, 0, 0, true);
+        out_.back().frame = (int32_t)sizeof(uint32_t) + kFrameHeaderSize;
+        out_.back().dst = 0;
+        emit(RegOpCode::exit, first).src1 = 0;
+
+        size_t maxFrameSize = (size_t)out_[0].frame;
+        std::vector<std::vector<size_t> > insnMap(funcs_.size());
+        for (size_t n = 0; n < funcs_.size(); ++n) {
+            size_t frameSize = 0;
+            int ec = translateFunction(n, insnMap, frameSize);
+            if (ec != Error::Ok)
+                return ec;
+            maxFrameSize = std::max(maxFrameSize, frameSize);
+        }
+
+        // Resolve the targets, the records won't move any more.
+        for (size_t k = 0; k < fixups_.size(); ++k) {
+            const Fixup & fixup = fixups_[k];
+            size_t target;
+            if (fixup.isCall)
+                target = funcs_[fixup.target].start;
+            else
+                target = insnMap[fixup.func][fixup.target];
+            if (target >= out_.size())
+                return Error::RegVM_Stack_Mismatch;
+            out_[fixup.insn].target = &out_[0] + target;
+        }
+
+        for (size_t k = 0; k < out_.size(); ++k) {
+            out_[k].handler = (handlers != nullptr) ? handlers[out_[k].opcode] : nullptr;
+        }
+
+        image.insns_.swap(out_);
+        image.maxFrameSize_ = maxFrameSize;
+        image.funcCount_ = funcs_.size();
+        image.sourceCount_ = insnCount_;
+        return Error::Ok;
+    }
+
+    RegTranslator(const vmDecodedImage & decoded)
+        : insns_(decoded.data()), insnCount_(decoded.size() + 1) {}
+
+public:
+    ~RegTranslator() {}
+
+    //
+    // Translate the pre-decoded records to the register records, the
+    // handlers is indexed by RegOpCode::Type, it can be null.
+    //
+    static int translate(vmRegImage & image, const vmDecodedImage & decoded,
+                         const void * const * handlers) {
+        image.clear();
+        if (!decoded.isInited())
+            return Error::Error_NullPtr;
+
+        RegTranslator translator(decoded);
+        return translator.translate(decoded, image, handlers);
+    }
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_REGTRANSLATOR_H
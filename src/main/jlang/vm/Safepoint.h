@@ -0,0 +1,187 @@
+#ifndef JLANG_VM_SAFEPOINT_H
+#define JLANG_VM_SAFEPOINT_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include <atomic>
+
+//////////////////////////////////////////////////////////////
+
+/* Compile the safepoints of the fuel metering and the interrupts ? */
+#ifndef USE_VM_SAFEPOINTS
+#define USE_VM_SAFEPOINTS       1
+#endif
+
+//////////////////////////////////////////////////////////////
+
+namespace jlang {
+
+//
+// The request that a host thread sends to a running context.
+//
+struct vmInterrupt {
+    enum Type {
+        None,
+        Pause,
+        Abort,
+        OutOfFuel,
+        Yield,
+        Last
+    };
+};
+
+//
+// The safepoints of a context are the backward branches and the calls,
+// every loop iteration and every call passes one of them, the straight
+// code between them is charged as one block.
+//
+// The hot path is one decrement and one branch: the safepoint charges the
+// cost of the block to a countdown, only when the countdown goes below
+// zero, poll() charges the spent interval to the fuel and reads the
+// interrupt flag. The interval is kPollInterval units at most, so an
+// interrupt is seen within microseconds, without an atomic load on every
+// safepoint.
+//
+// A backward branch costs the bytes of code it jumps back over, a call
+// costs kCallCost. The fuel is the count of the units, it's unlimited
+// unless setFuel() is called. The time slice of the scheduler is counted
+// in the same units, the context yields when its slice is spent.
+//
+class vmSafepoint {
+public:
+    static const int32_t kPollInterval = 4096;
+    static const int32_t kCallCost = 16;
+
+private:
+    int32_t                 countdown_;
+    int32_t                 interval_;
+    int64_t                 fuel_;
+    int64_t                 slice_;
+    int64_t                 sliceLeft_;
+    bool                    metered_;
+    bool                    suspended_;
+    std::atomic<uint32_t>   interrupt_;
+
+    void rearm() {
+        if (metered_ && fuel_ < (int64_t)kPollInterval)
+            interval_ = (int32_t)fuel_;
+        else
+            interval_ = kPollInterval;
+        countdown_ = interval_;
+    }
+
+public:
+    vmSafepoint()
+        : countdown_(kPollInterval), interval_(kPollInterval), fuel_(0),
+          slice_(0), sliceLeft_(0), metered_(false), suspended_(false),
+          interrupt_(vmInterrupt::None) {}
+    ~vmSafepoint() {}
+
+    //
+    // Charge the cost of a block, return true if poll() must be called.
+    //
+    JM_FORCEINLINE bool charge(int32_t cost) {
+        countdown_ -= cost;
+        return (countdown_ < 0);
+    }
+
+    //
+    // Charge the spent interval to the fuel and take the interrupt request,
+    // return the vmInterrupt that stops the context, or vmInterrupt::None.
+    //
+    uint32_t poll() {
+        int32_t spent = interval_ - countdown_;
+        if (metered_) {
+            fuel_ -= spent;
+            if (fuel_ < 0) {
+                fuel_ = 0;
+                rearm();
+                return vmInterrupt::OutOfFuel;
+            }
+        }
+        rearm();
+        uint32_t request = interrupt_.exchange(vmInterrupt::None, std::memory_order_acquire);
+        if (slice_ > 0) {
+            sliceLeft_ -= spent;
+            if (sliceLeft_ <= 0) {
+                sliceLeft_ = slice_;
+                if (request == vmInterrupt::None)
+                    request = vmInterrupt::Yield;
+            }
+        }
+        return request;
+    }
+
+    //
+    // The fuel metering, only the owner thread of the context calls them,
+    // when the context isn't running.
+    //
+    bool isMetered() const { return metered_; }
+
+    int64_t getFuel() const {
+        if (!metered_)
+            return -1;
+        int64_t fuel = fuel_ - (int64_t)(interval_ - countdown_);
+        return (fuel > 0) ? fuel : 0;
+    }
+
+    void setFuel(int64_t fuel) {
+        fuel_ = (fuel > 0) ? fuel : 0;
+        metered_ = true;
+        rearm();
+    }
+
+    void addFuel(int64_t fuel) {
+        setFuel(getFuel() + fuel);
+    }
+
+    void disableFuel() {
+        metered_ = false;
+        fuel_ = 0;
+        rearm();
+    }
+
+    //
+    // The time slice, 0 is no slice.
+    //
+    int64_t getSlice() const { return slice_; }
+    void setSlice(int64_t slice) {
+        slice_ = (slice > 0) ? slice : 0;
+        sliceLeft_ = slice_;
+    }
+
+    //
+    // The context is stopped at a safepoint by Pause, OutOfFuel or Yield,
+    // or by the yield opcode, and can be resumed.
+    //
+    bool isSuspended() const { return suspended_; }
+    void setSuspended(bool suspended) {
+        suspended_ = suspended;
+    }
+
+    //
+    // The interrupt requests, any host thread can call them.
+    //
+    void requestPause() {
+        interrupt_.store(vmInterrupt::Pause, std::memory_order_release);
+    }
+
+    void requestAbort() {
+        interrupt_.store(vmInterrupt::Abort, std::memory_order_release);
+    }
+
+    void clearInterrupt() {
+        interrupt_.store(vmInterrupt::None, std::memory_order_release);
+    }
+};
+
+} // namespace jlang
+
+#endif // JLANG_VM_SAFEPOINT_H
@@ -0,0 +1,481 @@
+#ifndef JLANG_VM_SCHEDULER_H
+#define JLANG_VM_SCHEDULER_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+#include "jlang/vm/Interpreter_v1.h"
+#include "jlang/vm/Safepoint.h"
+#include "jlang/vm/WorkDeque.h"
+#include "jlang/lang/Error.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <unordered_set>
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+
+namespace jlang {
+namespace v1 {
+
+//
+// The M:N scheduler, it runs many green threads (vmThread) on a fixed
+// pool of OS worker threads.
+//
+// A green thread runs until it finishes, or stops at a safepoint: the
+// yield opcode and the spent time slice put it back to the run queue, a
+// pause (suspend()) or the spent fuel suspend it until resume(). It's
+// never bound to a worker, it may resume on any worker.
+//
+// Every worker has a Chase-Lev deque, the threads that are spawned or
+// woken by a worker are pushed to its own deque, the other workers steal
+// from it when they have no work. The threads that are spawned by the
+// other OS threads and the threads that yield go to the global FIFO queue,
+// so a yield lets the other threads run first.
+//
+// The worker that finds no work parks on a condition variable, it's woken
+// when a thread is queued. A native function that blocks the worker calls
+// enterBlocking(), the local queue of the worker is handed to the global
+// queue, and a spare worker is started in its place, so the count of the
+// workers that run the threads stays same. The spare worker exits when a
+// blocked worker comes back by leaveBlocking().
+//
+template <typename BasicType = uintptr_t>
+class vmScheduler {
+public:
+    typedef BasicType                   basic_type;
+    typedef vmThread<basic_type>        thread_type;
+    typedef vmScheduler<basic_type>     this_type;
+
+    // The time slice of a thread, in the units of vmSafepoint.
+    static const int64_t kDefaultSlice = 256 * 1024;
+
+    // The max count of the spare workers that stand in for the blocked
+    // workers, the other blocked workers aren't replaced.
+    static const size_t kMaxSpareWorkers = 64;
+
+private:
+    struct Worker {
+        this_type *                 owner;
+        size_t                      index;
+        uint32_t                    seed;
+        bool                        spare;
+        bool                        retired;
+        vmWorkDeque<thread_type *>  deque;
+        std::thread                 thread;
+
+        Worker(this_type * owner, size_t index, bool spare = false)
+            : owner(owner), index(index), seed((uint32_t)index * 2654435761U + 1),
+              spare(spare), retired(false) {}
+    };
+
+    std::vector<Worker *>       workers_;
+    // The spare workers, guarded by lock_, the workers never steal from them.
+    std::vector<Worker *>       spares_;
+    size_t                      spareCount_;
+    std::mutex                  lock_;
+    std::condition_variable     wakeup_;
+    std::condition_variable     finished_;
+    std::deque<thread_type *>   injector_;
+    size_t                      signals_;
+    // The threads that are spawned and not finished yet.
+    std::unordered_set<thread_type *> live_;
+    std::atomic<uint32_t>       parked_;
+    std::atomic<uint32_t>       blocking_;
+    std::atomic<bool>           stopping_;
+    int64_t                     slice_;
+
+    static Worker *& currentWorker() {
+        static thread_local Worker * worker = nullptr;
+        return worker;
+    }
+
+    Worker * getLocalWorker() const {
+        Worker * worker = currentWorker();
+        return (worker != nullptr && worker->owner == this) ? worker : nullptr;
+    }
+
+    //
+    // Wake a parked worker, if any. The fence pairs with the fence in
+    // park(), either the worker sees the queued thread, or it's counted
+    // in parked_ here.
+    //
+    void notifyOne() {
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (parked_.load(std::memory_order_relaxed) > 0) {
+            std::lock_guard<std::mutex> guard(lock_);
+            signals_++;
+            wakeup_.notify_one();
+        }
+    }
+
+    void pushGlobal(thread_type * thread) {
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            injector_.push_back(thread);
+        }
+        notifyOne();
+    }
+
+    void enqueue(thread_type * thread) {
+        Worker * worker = getLocalWorker();
+        if (worker != nullptr && !worker->spare) {
+            worker->deque.push(thread);
+            notifyOne();
+        }
+        else {
+            pushGlobal(thread);
+        }
+    }
+
+    bool hasQueuedWork() {
+        for (size_t i = 0; i < workers_.size(); ++i) {
+            if (!workers_[i]->deque.empty())
+                return true;
+        }
+        std::lock_guard<std::mutex> guard(lock_);
+        return !injector_.empty();
+    }
+
+    thread_type * findWork(Worker * worker) {
+        thread_type * thread = worker->deque.pop();
+        if (thread != nullptr)
+            return thread;
+
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            if (!injector_.empty()) {
+                thread = injector_.front();
+                injector_.pop_front();
+                return thread;
+            }
+        }
+
+        // Steal from a random victim, a steal fails when it loses a race,
+        // so try twice.
+        size_t count = workers_.size();
+        worker->seed = worker->seed * 1103515245U + 12345U;
+        size_t start = (size_t)(worker->seed >> 8);
+        for (size_t i = 0; i < count * 2; ++i) {
+            Worker * victim = workers_[(start + i) % count];
+            if (victim == worker)
+                continue;
+            thread = victim->deque.steal();
+            if (thread != nullptr)
+                return thread;
+        }
+        return nullptr;
+    }
+
+    void park(Worker * worker) {
+        parked_.fetch_add(1, std::memory_order_seq_cst);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        if (!hasQueuedWork()) {
+            std::unique_lock<std::mutex> guard(lock_);
+            wakeup_.wait(guard, [this, worker] {
+                return (signals_ > 0 || !injector_.empty() ||
+                        stopping_.load(std::memory_order_relaxed) ||
+                        (worker->spare && isSpareNeedless()));
+            });
+            if (signals_ > 0)
+                signals_--;
+        }
+        parked_.fetch_sub(1, std::memory_order_relaxed);
+    }
+
+    void finish(thread_type * thread, int ec) {
+        thread->setExitCode(ec);
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            // The owner may destroy the thread once it's finished.
+            thread->setStatus(vmThreadStatus::Finished);
+            live_.erase(thread);
+        }
+        finished_.notify_all();
+    }
+
+    void runSlice(thread_type * thread) {
+        thread->setStatus(vmThreadStatus::Running);
+        int ec;
+        if (thread->getSafepoint().isSuspended())
+            ec = thread->resumeRun(thread->getReturn());
+        else if (thread->isQuickened())
+            ec = thread->run_quickened(thread->getReturn());
+        else
+            ec = thread->run(thread->getReturn());
+
+        switch (ec) {
+        case Error::Safepoint_Yielded:
+            thread->setStatus(vmThreadStatus::Ready);
+            pushGlobal(thread);
+            break;
+
+        case Error::Safepoint_Paused:
+        case Error::Safepoint_Out_Of_Fuel:
+            if (thread->changeStatus(vmThreadStatus::Running, vmThreadStatus::Suspended))
+                break;
+            // It's resumed while it's running.
+            thread->setStatus(vmThreadStatus::Ready);
+            enqueue(thread);
+            break;
+
+        default:
+            finish(thread, ec);
+            break;
+        }
+    }
+
+    // More spare workers run than the workers that are blocked.
+    bool isSpareNeedless() const {
+        return (spareCount_ > (size_t)blocking_.load(std::memory_order_relaxed));
+    }
+
+    //
+    // Start a spare worker for a blocked worker, or restart a retired one.
+    //
+    void addSpare() {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (stopping_.load(std::memory_order_relaxed) || workers_.empty())
+            return;
+        if (spareCount_ >= (size_t)blocking_.load(std::memory_order_relaxed) ||
+            spareCount_ >= kMaxSpareWorkers)
+            return;
+        Worker * spare = nullptr;
+        for (size_t i = 0; i < spares_.size(); ++i) {
+            if (spares_[i]->retired) {
+                spare = spares_[i];
+                // It exits without the lock once it's retired.
+                if (spare->thread.joinable())
+                    spare->thread.join();
+                spare->retired = false;
+                break;
+            }
+        }
+        if (spare == nullptr) {
+            spare = new Worker(this, workers_.size() + spares_.size(), true);
+            spares_.push_back(spare);
+        }
+        spareCount_++;
+        spare->thread = std::thread(&this_type::workerMain, this, spare);
+    }
+
+    //
+    // Retire the spare worker when the blocked worker is back. The signal
+    // that it took in park() is passed on if a thread is still queued.
+    //
+    bool retireSpare(Worker * worker) {
+        std::lock_guard<std::mutex> guard(lock_);
+        if (!isSpareNeedless())
+            return false;
+        spareCount_--;
+        worker->retired = true;
+        if (!injector_.empty() && parked_.load(std::memory_order_relaxed) > 0) {
+            signals_++;
+            wakeup_.notify_one();
+        }
+        return true;
+    }
+
+    void workerMain(Worker * worker) {
+        currentWorker() = worker;
+        while (!stopping_.load(std::memory_order_acquire)) {
+            if (worker->spare && retireSpare(worker))
+                break;
+            thread_type * thread = findWork(worker);
+            if (thread != nullptr)
+                runSlice(thread);
+            else
+                park(worker);
+        }
+        currentWorker() = nullptr;
+    }
+
+public:
+    vmScheduler()
+        : spareCount_(0), signals_(0), parked_(0), blocking_(0),
+          stopping_(false), slice_(kDefaultSlice) {}
+    ~vmScheduler() {
+        stop();
+    }
+
+    bool isStarted() const { return !workers_.empty(); }
+
+    size_t getWorkerCount() const { return workers_.size(); }
+    uint32_t getBlockingCount() const { return blocking_.load(std::memory_order_relaxed); }
+
+    // The time slice of the threads that are spawned later, 0 is no slice.
+    int64_t getSlice() const { return slice_; }
+    void setSlice(int64_t slice) {
+        slice_ = slice;
+    }
+
+    //
+    // Start the workers, the count is the count of the CPUs by default.
+    //
+    bool start(size_t workerCount = 0) {
+        if (isStarted())
+            return false;
+        if (workerCount == 0)
+            workerCount = std::thread::hardware_concurrency();
+        if (workerCount == 0)
+            workerCount = 1;
+
+        stopping_.store(false, std::memory_order_relaxed);
+        for (size_t i = 0; i < workerCount; ++i) {
+            workers_.push_back(new Worker(this, i));
+        }
+        for (size_t i = 0; i < workerCount; ++i) {
+            Worker * worker = workers_[i];
+            worker->thread = std::thread(&this_type::workerMain, this, worker);
+        }
+        return true;
+    }
+
+    //
+    // Stop the workers after their running slices. The threads that aren't
+    // finished yet, the queued and the suspended ones, are finished with
+    // Error::Safepoint_Aborted, so join() and waitAll() return, and they
+    // can be spawned again from the entry.
+    //
+    void stop() {
+        if (isStarted()) {
+            {
+                std::lock_guard<std::mutex> guard(lock_);
+                stopping_.store(true, std::memory_order_release);
+                wakeup_.notify_all();
+            }
+            // No spare is added once it's stopping.
+            for (size_t i = 0; i < workers_.size(); ++i) {
+                if (workers_[i]->thread.joinable())
+                    workers_[i]->thread.join();
+                delete workers_[i];
+            }
+            for (size_t i = 0; i < spares_.size(); ++i) {
+                if (spares_[i]->thread.joinable())
+                    spares_[i]->thread.join();
+                delete spares_[i];
+            }
+            workers_.clear();
+            spares_.clear();
+            spareCount_ = 0;
+        }
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            typename std::unordered_set<thread_type *>::iterator iter;
+            for (iter = live_.begin(); iter != live_.end(); ++iter) {
+                thread_type * thread = *iter;
+                thread->discardSuspended();
+                thread->getSafepoint().clearInterrupt();
+                thread->setExitCode(Error::Safepoint_Aborted);
+                thread->setStatus(vmThreadStatus::Finished);
+            }
+            live_.clear();
+            injector_.clear();
+            signals_ = 0;
+        }
+        finished_.notify_all();
+    }
+
+    //
+    // Queue the thread to run from its entry, the thread must be created,
+    // and its image must be set. Return false if it's already queued.
+    //
+    bool spawn(thread_type * thread) {
+        assert(thread != nullptr);
+        assert(thread->isInited());
+        if (!thread->changeStatus(vmThreadStatus::Created, vmThreadStatus::Ready) &&
+            !thread->changeStatus(vmThreadStatus::Finished, vmThreadStatus::Ready))
+            return false;
+        thread->setScheduler(this);
+        thread->getSafepoint().setSlice(slice_);
+        {
+            std::lock_guard<std::mutex> guard(lock_);
+            live_.insert(thread);
+        }
+        enqueue(thread);
+        return true;
+    }
+
+    //
+    // Queue the suspended thread again. Return false if it isn't suspended
+    // or running.
+    //
+    bool wake(thread_type * thread) {
+        assert(thread != nullptr);
+        for (;;) {
+            uint32_t status = thread->getStatus();
+            if (status == vmThreadStatus::Suspended) {
+                if (thread->changeStatus(status, vmThreadStatus::Ready)) {
+                    enqueue(thread);
+                    return true;
+                }
+            }
+            else if (status == vmThreadStatus::Running) {
+                if (thread->changeStatus(status, vmThreadStatus::Resumed))
+                    return true;
+            }
+            else {
+                return false;
+            }
+        }
+    }
+
+    //
+    // Wait until the thread is finished.
+    //
+    void join(thread_type * thread) {
+        std::unique_lock<std::mutex> guard(lock_);
+        finished_.wait(guard, [thread] { return thread->isFinished(); });
+    }
+
+    //
+    // Wait until all the spawned threads are finished.
+    //
+    void waitAll() {
+        std::unique_lock<std::mutex> guard(lock_);
+        finished_.wait(guard, [this] { return live_.empty(); });
+    }
+
+    //
+    // A native function calls them around the host call that may block
+    // the worker, they do nothing on the other OS threads.
+    //
+    static void enterBlocking() {
+        Worker * worker = currentWorker();
+        if (worker == nullptr)
+            return;
+        this_type * owner = worker->owner;
+        owner->blocking_.fetch_add(1, std::memory_order_relaxed);
+        // Hand the local queue to the awake workers.
+        thread_type * thread;
+        while ((thread = worker->deque.pop()) != nullptr) {
+            owner->pushGlobal(thread);
+        }
+        owner->addSpare();
+    }
+
+    static void leaveBlocking() {
+        Worker * worker = currentWorker();
+        if (worker == nullptr)
+            return;
+        this_type * owner = worker->owner;
+        std::lock_guard<std::mutex> guard(owner->lock_);
+        owner->blocking_.fetch_sub(1, std::memory_order_relaxed);
+        // Wake the parked spare that isn't needed now.
+        if (owner->isSpareNeedless())
+            owner->wakeup_.notify_all();
+    }
+};
+
+} // namespace v1
+} // namespace jlang
+
+#endif // JLANG_VM_SCHEDULER_H
@@ -0,0 +1,332 @@
+#ifndef JLANG_VM_SNAPSHOT_H
+#define JLANG_VM_SNAPSHOT_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+#include "jlang/lang/Error.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <vector>
+
+#if defined(_WIN32)
+#ifndef WIN32_LEAN_AND_MEAN
+#define WIN32_LEAN_AND_MEAN
+#endif
+#include <windows.h>
+#else
+#include <unistd.h>
+#include <fcntl.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#endif // _WIN32
+
+namespace jlang {
+namespace v3 {
+
+//
+// The header of a snapshot blob, all the offsets are in bytes.
+//
+// A snapshot caches the arg frame and the heap that a run starts from, or
+// the context that's paused at a safepoint, with its registers and its
+// frames. The stack offsets are counted from the bottom of the stack, so
+// they're same for the forward and the backward stacks. The sections are
+// aligned to pageSize in the blob, so the stack section of a blob file can
+// be mapped onto the stack of a context.
+//
+// The frame headers of a paused context are saved as offsets: the return
+// IP to the offset in the image, or kNullSlot for the entry frame, and the
+// saved fp to the offset in the stack. The other values of the stack are
+// saved as they are.
+//
+struct vmSnapshotHeader {
+    static const uint32_t kMagic = 0x534D564AU;     // "JVMS"
+    static const uint32_t kVersion = 2;
+    static const uint64_t kNullOffset = ~(uint64_t)0;
+    static const uintptr_t kNullSlot = ~(uintptr_t)0;
+
+    // The layout flags.
+    static const uint32_t kIsForward = 0x01;
+    static const uint32_t kIsCompactFrame = 0x02;
+
+    uint32_t    magic;
+    uint32_t    version;
+    uint32_t    layout;
+    uint32_t    basicSize;
+    uint32_t    pageSize;
+    uint32_t    reserved;
+
+    // The identity of the image.
+    uint64_t    imageSize;
+    uint64_t    imageHash;
+    uint64_t    entryOffset;
+
+    // The used bytes from the bottom of the stack, the arg frame, or all
+    // the frames up to sp of a paused context. They're at the bottom end
+    // of the section: the start for the forward stack, the end for the
+    // backward stack.
+    uint64_t    stackUsed;
+    uint64_t    stackOffset;
+    uint64_t    stackSection;
+
+    // The top of the arg frame, the runs after the paused one start from it.
+    uint64_t    argsUsed;
+
+    // The registers of the paused context, see vmContextRegs. ipOffset is
+    // kNullOffset if the context isn't paused, the next run starts from
+    // the entry then. spOffset is stackUsed.
+    uint64_t    ipOffset;
+    uint64_t    spOffset;
+    uint64_t    fpOffset;
+    uint64_t    eax;
+    uint64_t    flags;
+
+    // The heap bytes after heapUsed are zero, they aren't saved.
+    uint64_t    heapCapacity;
+    uint64_t    heapUsed;
+    uint64_t    heapOffset;
+
+    uint64_t    totalSize;
+};
+
+//
+// The cached arg frame and heap, or the paused run of a context, see
+// ExecutionContext::saveSnapshot() and ExecutionContext::restoreSnapshot().
+//
+// The blob is in memory, or it's a file that's mapped read-only. The file
+// keeps its descriptor open, the contexts map its stack section
+// copy-on-write, so restoring a large stack only maps the pages, and the
+// contexts share them until they write to them. The file must not change
+// while it's loaded.
+//
+class vmSnapshot {
+private:
+    std::vector<unsigned char>  buffer_;
+    const unsigned char *       data_;
+    size_t                      size_;
+    void *                      mapped_;
+    size_t                      mappedSize_;
+    int                         fd_;
+
+    static size_t alignUp(size_t size, size_t align) {
+        return ((size + align - 1) / align * align);
+    }
+
+public:
+    vmSnapshot() : data_(nullptr), size_(0), mapped_(nullptr), mappedSize_(0), fd_(-1) {}
+    ~vmSnapshot() {
+        clear();
+    }
+
+    bool isInited() const { return (data_ != nullptr); }
+
+    const unsigned char * data() const { return data_; }
+    size_t size() const { return size_; }
+
+    //
+    // The descriptor of the blob file, or -1 if the blob is in memory.
+    //
+    int getFile() const { return fd_; }
+
+    const vmSnapshotHeader & header() const {
+        assert(isInited());
+        return *(const vmSnapshotHeader *)data_;
+    }
+
+    const unsigned char * getStackSection() const {
+        return (data_ + header().stackOffset);
+    }
+
+    const unsigned char * getHeapSection() const {
+        return (data_ + header().heapOffset);
+    }
+
+    //
+    // The FNV-1a hash of the image, it identifies the image of a snapshot.
+    //
+    static uint64_t hashImage(const void * image, size_t size) {
+        const unsigned char * bytes = (const unsigned char *)image;
+        uint64_t hash = 14695981039346656037ULL;
+        for (size_t i = 0; i < size; ++i) {
+            hash ^= bytes[i];
+            hash *= 1099511628211ULL;
+        }
+        return hash;
+    }
+
+    static size_t getPageSize() {
+#if defined(_WIN32)
+        SYSTEM_INFO info;
+        ::GetSystemInfo(&info);
+        return (size_t)info.dwAllocationGranularity;
+#else
+        return (size_t)::sysconf(_SC_PAGESIZE);
+#endif
+    }
+
+    //
+    // Allocate the blob of the header, the stack section of stackUsed bytes
+    // and the heap section of heapUsed bytes, and fill in the offsets of the
+    // header. The sections are zero-filled.
+    //
+    vmSnapshotHeader * allocate(size_t stackUsed, size_t heapUsed) {
+        clear();
+        size_t pageSize = getPageSize();
+        size_t stackOffset = alignUp(sizeof(vmSnapshotHeader), pageSize);
+        size_t stackSection = alignUp(stackUsed, pageSize);
+        size_t heapOffset = stackOffset + stackSection;
+        size_t totalSize = heapOffset + heapUsed;
+
+        buffer_.assign(totalSize, 0);
+        data_ = buffer_.data();
+        size_ = totalSize;
+
+        vmSnapshotHeader * header = (vmSnapshotHeader *)buffer_.data();
+        header->magic = vmSnapshotHeader::kMagic;
+        header->version = vmSnapshotHeader::kVersion;
+        header->pageSize = (uint32_t)pageSize;
+        header->stackUsed = stackUsed;
+        header->stackOffset = stackOffset;
+        header->stackSection = stackSection;
+        header->argsUsed = stackUsed;
+        header->ipOffset = vmSnapshotHeader::kNullOffset;
+        header->spOffset = stackUsed;
+        header->fpOffset = vmSnapshotHeader::kNullOffset;
+        header->heapUsed = heapUsed;
+        header->heapOffset = heapOffset;
+        header->totalSize = totalSize;
+        return header;
+    }
+
+    //
+    // Is the blob a snapshot of this version, and are its sections in it ?
+    //
+    bool isValid() const {
+        if (!isInited() || size_ < sizeof(vmSnapshotHeader))
+            return false;
+        const vmSnapshotHeader & h = header();
+        if (h.magic != vmSnapshotHeader::kMagic || h.version != vmSnapshotHeader::kVersion)
+            return false;
+        if (h.pageSize == 0 || h.totalSize != (uint64_t)size_)
+            return false;
+        if (h.stackUsed > h.stackSection || h.stackOffset % h.pageSize != 0 ||
+            h.stackOffset > h.totalSize || h.stackSection > h.totalSize - h.stackOffset)
+            return false;
+        if (h.heapUsed > h.heapCapacity || h.heapOffset > h.totalSize ||
+            h.heapUsed > h.totalSize - h.heapOffset)
+            return false;
+        if (h.argsUsed > h.stackUsed)
+            return false;
+        if (h.ipOffset != vmSnapshotHeader::kNullOffset &&
+            (h.ipOffset >= h.imageSize || h.spOffset != h.stackUsed || h.fpOffset > h.stackUsed))
+            return false;
+        return true;
+    }
+
+    //
+    // Copy the blob from memory.
+    //
+    int assign(const void * data, size_t size) {
+        clear();
+        const unsigned char * bytes = (const unsigned char *)data;
+        buffer_.assign(bytes, bytes + size);
+        data_ = buffer_.data();
+        size_ = size;
+        return (isValid() ? Error::Ok : Error::Snapshot_Invalid);
+    }
+
+    int saveToFile(const char * filename) const {
+        if (!isInited())
+            return Error::Snapshot_Invalid;
+        FILE * file = ::fopen(filename, "wb");
+        if (file == nullptr)
+            return Error::Snapshot_File_Failed;
+        size_t written = ::fwrite((const void *)data_, 1, size_, file);
+        int closed = ::fclose(file);
+        if (written != size_ || closed != 0)
+            return Error::Snapshot_File_Failed;
+        return Error::Ok;
+    }
+
+    //
+    // Map the blob file read-only, the file is read into memory when it
+    // can't be mapped.
+    //
+    int loadFromFile(const char * filename) {
+        clear();
+#if defined(_WIN32)
+        FILE * file = ::fopen(filename, "rb");
+        if (file == nullptr)
+            return Error::Snapshot_File_Failed;
+        std::vector<unsigned char> buffer;
+        unsigned char chunk[4096];
+        size_t count;
+        while ((count = ::fread(chunk, 1, sizeof(chunk), file)) > 0) {
+            buffer.insert(buffer.end(), chunk, chunk + count);
+        }
+        ::fclose(file);
+        buffer_.swap(buffer);
+        data_ = buffer_.empty() ? nullptr : buffer_.data();
+        size_ = buffer_.size();
+#else
+        int fd = ::open(filename, O_RDONLY);
+        if (fd < 0)
+            return Error::Snapshot_File_Failed;
+        struct stat st;
+        if (::fstat(fd, &st) != 0 || st.st_size <= 0) {
+            ::close(fd);
+            return Error::Snapshot_File_Failed;
+        }
+        size_t size = (size_t)st.st_size;
+        void * memory = ::mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+        if (memory == MAP_FAILED) {
+            ::close(fd);
+            return Error::Snapshot_File_Failed;
+        }
+        mapped_ = memory;
+        mappedSize_ = size;
+        fd_ = fd;
+        data_ = (const unsigned char *)memory;
+        size_ = size;
+#endif // _WIN32
+        if (!isValid()) {
+            clear();
+            return Error::Snapshot_Invalid;
+        }
+        return Error::Ok;
+    }
+
+    void clear() {
+#if !defined(_WIN32)
+        if (mapped_) {
+            ::munmap(mapped_, mappedSize_);
+            mapped_ = nullptr;
+            mappedSize_ = 0;
+        }
+        if (fd_ >= 0) {
+            ::close(fd_);
+            fd_ = -1;
+        }
+#endif
+        std::vector<unsigned char>().swap(buffer_);
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+private:
+    // The contexts may map the file, it's never copied.
+    vmSnapshot(const vmSnapshot &);
+    vmSnapshot & operator = (const vmSnapshot &);
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_SNAPSHOT_H
@@ -0,0 +1,152 @@
+#ifndef JLANG_VM_STACKGUARD_H
+#define JLANG_VM_STACKGUARD_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+#include "jlang/vm/Interpreter.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#if USE_VM_STACK_GUARD
+#include <signal.h>
+#include <setjmp.h>
+#endif
+
+namespace jlang {
+
+#if USE_VM_STACK_GUARD
+
+//
+// Turn a hit on the guard regions of the VM stacks into a VM stack
+// overflow, instead of a crash.
+//
+// A run opens a Scope with the reserved ranges of its stacks and calls
+// sigsetjmp() on it, the SIGSEGV (or SIGBUS) handler jumps back to it when
+// the fault address is in one of the ranges of the current thread's scope.
+// The other faults go to the previous handler.
+//
+// The interpreter loops don't check every push then, a verified image
+// only needs its max frame size to be less than the guard region.
+//
+class vmStackGuard {
+public:
+    static const size_t kMaxRanges = 4;
+
+    class Scope {
+    private:
+        friend class vmStackGuard;
+
+        Scope *     prev_;
+        size_t      count_;
+        uintptr_t   first_[kMaxRanges];
+        uintptr_t   last_[kMaxRanges];
+        sigjmp_buf  jumpBuffer_;
+
+    public:
+        Scope() : count_(0) {
+            static const bool installed = vmStackGuard::install();
+            (void)installed;
+            prev_ = current();
+            current() = this;
+        }
+        ~Scope() {
+            current() = prev_;
+        }
+
+        sigjmp_buf & jumpBuffer() { return jumpBuffer_; }
+
+        template <typename Stack>
+        void add(const Stack & stack) {
+            if (stack.isGuarded()) {
+                assert(count_ < kMaxRanges);
+                first_[count_] = (uintptr_t)stack.reservedFirst();
+                last_[count_] = (uintptr_t)stack.reservedLast();
+                count_++;
+            }
+        }
+
+        bool contains(uintptr_t address) const {
+            for (size_t i = 0; i < count_; ++i) {
+                if (address >= first_[i] && address < last_[i])
+                    return true;
+            }
+            return false;
+        }
+    };
+
+private:
+    static Scope *& current() {
+        static thread_local Scope * scope = nullptr;
+        return scope;
+    }
+
+    static struct sigaction & previous(int sig) {
+        static struct sigaction segvAction;
+        static struct sigaction busAction;
+        return (sig == SIGBUS) ? busAction : segvAction;
+    }
+
+    static void onSignal(int sig, siginfo_t * info, void * ucontext) {
+        Scope * scope = current();
+        if (scope != nullptr && scope->contains((uintptr_t)info->si_addr)) {
+            siglongjmp(scope->jumpBuffer_, 1);
+        }
+
+        // Not ours, chain to the previous handler.
+        struct sigaction & action = previous(sig);
+        if (action.sa_flags & SA_SIGINFO) {
+            action.sa_sigaction(sig, info, ucontext);
+        }
+        else if (action.sa_handler != SIG_DFL && action.sa_handler != SIG_IGN) {
+            action.sa_handler(sig);
+        }
+        else {
+            // Fault again with the default action.
+            ::sigaction(sig, &action, nullptr);
+        }
+    }
+
+public:
+    //
+    // Stop the run of the current thread as if its guard region is hit,
+    // it's called when the code finds the overflow, not the fault.
+    //
+    static void raiseOverflow() {
+        Scope * scope = current();
+        if (scope != nullptr) {
+            siglongjmp(scope->jumpBuffer_, 1);
+        }
+        ::abort();
+    }
+
+    //
+    // Install the handler of SIGSEGV and SIGBUS, the scope does it once.
+    // The handler doesn't block the signal, so it can jump out with
+    // siglongjmp() without restoring the signal mask. It runs on the stack
+    // of the thread, the faults it takes are on the VM stacks, never on
+    // the native stack.
+    //
+    static bool install() {
+        struct sigaction action;
+        memset(&action, 0, sizeof(action));
+        action.sa_sigaction = &vmStackGuard::onSignal;
+        action.sa_flags = SA_SIGINFO | SA_NODEFER;
+        sigemptyset(&action.sa_mask);
+        bool success = (::sigaction(SIGSEGV, &action, &previous(SIGSEGV)) == 0);
+        success = (::sigaction(SIGBUS, &action, &previous(SIGBUS)) == 0) && success;
+        return success;
+    }
+};
+
+#endif // USE_VM_STACK_GUARD
+
+} // namespace jlang
+
+#endif // JLANG_VM_STACKGUARD_H
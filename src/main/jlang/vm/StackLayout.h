@@ -0,0 +1,85 @@
+#ifndef JLANG_VM_STACKLAYOUT_H
+#define JLANG_VM_STACKLAYOUT_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include <stdint.h>
+#include <stddef.h>
+
+//////////////////////////////////////////////////////////////
+
+/* If is forward stack pointer ? */
+#ifndef USE_FORWARD_STACK_PTR
+#define USE_FORWARD_STACK_PTR   1
+#endif
+
+//////////////////////////////////////////////////////////////
+
+namespace jlang {
+namespace v3 {
+
+//
+// The stack layout policy of the v3 execution context.
+//
+// IsForward:       The stack grows to the high address, the locals are the
+//                  slots 0, 1, 2 ... above fp, the arguments are below the
+//                  frame header. Otherwise the stack grows to the low
+//                  address, the locals are the slots -1, -2, -3 ..., the
+//                  arguments are above the frame header.
+//
+// IsCompactFrame:  The frame header saves the caller's fp as a 32-bit
+//                  distance instead of a pointer, it's 3 slots instead of
+//                  4 slots on the 64-bit targets.
+//
+// The frame slot operands of an image are encoded for a layout, the image
+// must be built with the kArgN and kVarN of the layout that runs it.
+//
+template <bool IsForward, bool IsCompactFrame>
+struct vmStackLayout {
+    static const bool kIsForward = IsForward;
+    static const bool kIsCompactFrame = IsCompactFrame;
+
+    // The bytes of the frame header between the locals and the arguments.
+    static const int32_t kFrameHeaderSize = IsCompactFrame ?
+        (int32_t)(sizeof(void *) + sizeof(uint32_t)) : (int32_t)(sizeof(void *) * 2);
+    static const int32_t kFrameHeaderSlots = kFrameHeaderSize / (int32_t)sizeof(uint32_t);
+
+    // The frame slot operands of the first arguments and locals.
+    static const uint8_t kArg0 = IsForward ? (uint8_t)(0 - kFrameHeaderSlots - 1)
+                                           : (uint8_t)(0 + kFrameHeaderSlots + 0);
+    static const uint8_t kArg1 = IsForward ? (uint8_t)(0 - kFrameHeaderSlots - 2)
+                                           : (uint8_t)(0 + kFrameHeaderSlots + 1);
+    static const uint8_t kVar0 = IsForward ? (uint8_t)(0) : (uint8_t)(0 - 1);
+    static const uint8_t kVar1 = IsForward ? (uint8_t)(1) : (uint8_t)(0 - 2);
+
+    // The frame slot operand of the argument n.
+    static uint8_t getArg(int n) {
+        return IsForward ? (uint8_t)(0 - kFrameHeaderSlots - 1 - n)
+                         : (uint8_t)(0 + kFrameHeaderSlots + n);
+    }
+
+    // The frame slot operand of the local n.
+    static uint8_t getVar(int n) {
+        return IsForward ? (uint8_t)(n) : (uint8_t)(0 - 1 - n);
+    }
+
+    static const char * name() {
+        if (IsForward)
+            return (IsCompactFrame ? "forward, compact frame" : "forward, full frame");
+        else
+            return (IsCompactFrame ? "backward, compact frame" : "backward, full frame");
+    }
+};
+
+//
+// The default layout of the v3 interpreter. The native tiers (JIT, trace JIT,
+// register VM and AOT) only run the images of this layout.
+//
+typedef vmStackLayout<(USE_FORWARD_STACK_PTR != 0), false> vmDefaultLayout;
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_STACKLAYOUT_H
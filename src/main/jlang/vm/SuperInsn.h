@@ -0,0 +1,595 @@
+#ifndef JLANG_VM_SUPERINSN_H
+#define JLANG_VM_SUPERINSN_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/vm/Interpreter.h"
+#include "jlang/vm/PreDecoder.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+#include <assert.h>
+
+#include <string>
+#include <vector>
+#include <unordered_map>
+#include <algorithm>
+
+namespace jlang {
+namespace v3 {
+
+static const size_t kMaxSuperInsnLength = 4;
+
+//
+// The super instructions (fused opcode sequences), their opcodes follow
+// OpCode::last, so they share the 256 entries handler table of the base
+// opcodes.
+//
+// The entries between the "Generated" markers are the output of
+// SuperInsnGenerator::generate() over the profile of fibonacci.jasm
+// (top-K = 4), don't edit them by hand, run the profile again instead.
+//
+struct SuperOpCode {
+    enum Type {
+        first = OpCode::last,
+
+        // Generated by SuperInsnGenerator, begin.
+        add_sp_push_dec_call = first,
+        cmp_imm_jl,
+        copy_eax_dec_call,
+        add_eax_ret_n,
+        // Generated by SuperInsnGenerator, end.
+
+        last
+    };
+};
+
+struct vmSuperInsnDef {
+    uint8_t         opcode;                     // SuperOpCode::Type
+    uint8_t         length;                     // Count of the fused opcodes
+    uint8_t         ops[kMaxSuperInsnLength];   // The fused opcodes
+    const char *    name;
+};
+
+static const vmSuperInsnDef kSuperInsnDefs[] = {
+    // Generated by SuperInsnGenerator, begin.
+    { SuperOpCode::add_sp_push_dec_call, 4,
+      { OpCode::add_sp_4, OpCode::push, OpCode::dec, OpCode::call_near }, "add_sp_push_dec_call" },
+    { SuperOpCode::cmp_imm_jl, 2,
+      { OpCode::cmp_imm_u32, OpCode::jl_near, 0, 0 }, "cmp_imm_jl" },
+    { SuperOpCode::copy_eax_dec_call, 3,
+      { OpCode::copy_from_eax, OpCode::dec, OpCode::call_near, 0 }, "copy_eax_dec_call" },
+    { SuperOpCode::add_eax_ret_n, 2,
+      { OpCode::add_eax, OpCode::ret_n, 0, 0 }, "add_eax_ret_n" },
+    // Generated by SuperInsnGenerator, end.
+    { SuperOpCode::last, 0, { 0, 0, 0, 0 }, nullptr }
+};
+
+static const size_t kSuperInsnDefCount =
+    sizeof(kSuperInsnDefs) / sizeof(kSuperInsnDefs[0]) - 1;
+
+//
+// The source template of a pre-decoded handler body, it's used to compose
+// the fused handlers. In the code, '@' is the expression of the record of
+// this instruction, and '$' is the count of the fused records.
+//
+struct vmInsnTemplate {
+    uint8_t         opcode;
+    bool            isBranch;       // Transfer the control, must be the last one
+    const char *    name;
+    const char *    shortName;      // Used to build the super instruction name
+    const char *    code;
+};
+
+class SuperInsnTemplates {
+public:
+    static const vmInsnTemplate * get(uint8_t opcode) {
+        static const TemplateMap s_templateMap;
+        return s_templateMap.templates[opcode];
+    }
+
+    static bool isFusable(uint8_t opcode) {
+        return (get(opcode) != nullptr);
+    }
+
+    static bool isBranch(uint8_t opcode) {
+        const vmInsnTemplate * insnTpl = get(opcode);
+        return (insnTpl != nullptr) ? insnTpl->isBranch : true;
+    }
+
+private:
+    struct TemplateMap {
+        const vmInsnTemplate * templates[256];
+
+        TemplateMap() {
+            for (size_t i = 0; i < 256; ++i) {
+                templates[i] = nullptr;
+            }
+
+            const vmInsnTemplate * insnTpl = getTemplates();
+            while (insnTpl->name != nullptr) {
+                templates[insnTpl->opcode] = insnTpl;
+                insnTpl++;
+            }
+        }
+    };
+
+    static const vmInsnTemplate * getTemplates() {
+        static const vmInsnTemplate s_templates[] = {
+            { OpCode::push,          false, "push",          "push",
+              "sp.writeUInt32(fp.getArgValueUInt32(@->index));" },
+            { OpCode::push_i32,      false, "push_i32",      "push_i32",
+              "sp.writeInt32(@->imm.i32);" },
+            { OpCode::push_i64,      false, "push_i64",      "push_i64",
+              "sp.writeInt64(@->imm.i64);" },
+            { OpCode::push_i32_0,    false, "push_i32_0",    "push_0",
+              "sp.writeInt32(0);" },
+            { OpCode::push_i64_0,    false, "push_i64_0",    "push_0_i64",
+              "sp.writeInt64(0);" },
+            { OpCode::pop,           false, "pop",           "pop",
+              "sp.backUInt32();" },
+            { OpCode::pop_i32,       false, "pop_i32",       "pop",
+              "sp.backUInt32();" },
+            { OpCode::pop_i64,       false, "pop_i64",       "pop_i64",
+              "sp.backUInt64();" },
+            { OpCode::add_sp,        false, "add_sp",        "add_sp",
+              "sp.next(@->index);" },
+            { OpCode::add_sp_4,      false, "add_sp_4",      "add_sp",
+              "sp.next(sizeof(uint32_t));" },
+            { OpCode::load_eax,      false, "load_eax",      "load_eax",
+              "regs.eax.u32 = @->imm.u32;" },
+            { OpCode::store,         false, "store",         "store",
+              "fp.putArgValueUInt32(@->index, @->imm.u32);" },
+            { OpCode::copy_from_eax, false, "copy_from_eax", "copy_eax",
+              "fp.putArgValueUInt32(@->index, regs.eax.u32);" },
+            { OpCode::cmp_i32,       false, "cmp_i32",       "cmp_i",
+              "flags.u32.low = (uint32_t)this_type::getCondition(fp.getArgValueInt32(@->index),\n"
+              "                                                  fp.getArgValueInt32(@->index2), @->cond);" },
+            { OpCode::cmp_u32,       false, "cmp_u32",       "cmp",
+              "flags.u32.low = (uint32_t)this_type::getCondition(fp.getArgValueUInt32(@->index),\n"
+              "                                                  fp.getArgValueUInt32(@->index2), @->cond);" },
+            { OpCode::cmp_imm_i32,   false, "cmp_imm_i32",   "cmp_imm_i",
+              "flags.u32.low = (uint32_t)this_type::getCondition(fp.getArgValueInt32(@->index),\n"
+              "                                                  @->imm.i32, @->cond);" },
+            { OpCode::cmp_imm_u32,   false, "cmp_imm_u32",   "cmp_imm",
+              "flags.u32.low = (uint32_t)this_type::getCondition(fp.getArgValueUInt32(@->index),\n"
+              "                                                  @->imm.u32, @->cond);" },
+            { OpCode::jl_near,       true,  "jl_near",       "jl",
+              "if (likely(flags.u32.low != (uint32_t)true))\n"
+              "    ip += $;\n"
+              "else\n"
+              "    ip = @->target;\n"
+              "VM_INSN_NEXT();" },
+            { OpCode::jl_short,      true,  "jl_short",      "jl",
+              "if (likely(flags.u32.low != (uint32_t)true))\n"
+              "    ip += $;\n"
+              "else\n"
+              "    ip = @->target;\n"
+              "VM_INSN_NEXT();" },
+            { OpCode::jl_long,       true,  "jl_long",       "jl",
+              "if (likely(flags.u32.low != (uint32_t)true))\n"
+              "    ip += $;\n"
+              "else\n"
+              "    ip = @->target;\n"
+              "VM_INSN_NEXT();" },
+            { OpCode::jmp,           true,  "jmp",           "jmp",
+              "ip = @->target;\n"
+              "VM_INSN_NEXT();" },
+            { OpCode::jmp_near,      true,  "jmp_near",      "jmp",
+              "ip = @->target;\n"
+              "VM_INSN_NEXT();" },
+            { OpCode::jmp_short,     true,  "jmp_short",     "jmp",
+              "ip = @->target;\n"
+              "VM_INSN_NEXT();" },
+            { OpCode::jmp_long,      true,  "jmp_long",      "jmp",
+              "ip = @->target;\n"
+              "VM_INSN_NEXT();" },
+            { OpCode::call,          true,  "call",          "call",
+              "push_callstack<Growable>(sp, fp, (void *)(ip + $));\n"
+              "ip = @->target;\n"
+              "VM_INSN_NEXT();" },
+            { OpCode::call_near,     true,  "call_near",     "call",
+              "push_callstack<Growable>(sp, fp, (void *)(ip + $));\n"
+              "ip = @->target;\n"
+              "VM_INSN_NEXT();" },
+            { OpCode::call_short,    true,  "call_short",    "call",
+              "push_callstack<Growable>(sp, fp, (void *)(ip + $));\n"
+              "ip = @->target;\n"
+              "VM_INSN_NEXT();" },
+            { OpCode::call_long,     true,  "call_long",     "call",
+              "push_callstack<Growable>(sp, fp, (void *)(ip + $));\n"
+              "ip = @->target;\n"
+              "VM_INSN_NEXT();" },
+            { OpCode::ret,           true,  "ret",           "ret",
+              "ip = (const vmInstruction *)pop_callstack(sp, fp);\n"
+              "if (likely(ip != nullptr))\n"
+              "    VM_INSN_NEXT();\n"
+              "else\n"
+              "    goto Execute_Finished;" },
+            { OpCode::ret_n_sm,      true,  "ret_n_sm",      "ret_n",
+              "ip = (const vmInstruction *)pop_callstack(sp, fp, (uint16_t)@->index);\n"
+              "if (likely(ip != nullptr))\n"
+              "    VM_INSN_NEXT();\n"
+              "else\n"
+              "    goto Execute_Finished;" },
+            { OpCode::ret_n,         true,  "ret_n",         "ret_n",
+              "ip = (const vmInstruction *)pop_callstack(sp, fp, (uint16_t)@->index);\n"
+              "if (likely(ip != nullptr))\n"
+              "    VM_INSN_NEXT();\n"
+              "else\n"
+              "    goto Execute_Finished;" },
+            { OpCode::ret_eax,       true,  "ret_eax",       "ret_eax",
+              "regs.eax.u32 = @->imm.u32;\n"
+              "ip = (const vmInstruction *)pop_callstack(sp, fp);\n"
+              "if (likely(ip != nullptr))\n"
+              "    VM_INSN_NEXT();\n"
+              "else\n"
+              "    goto Execute_Finished;" },
+            { OpCode::ret_eax_n,     true,  "ret_eax_n",     "ret_eax_n",
+              "regs.eax.u32 = @->imm.u32;\n"
+              "ip = (const vmInstruction *)pop_callstack(sp, fp, (uint16_t)@->index);\n"
+              "if (likely(ip != nullptr))\n"
+              "    VM_INSN_NEXT();\n"
+              "else\n"
+              "    goto Execute_Finished;" },
+            { OpCode::inc,           false, "inc",           "inc",
+              "fp.putArgValueUInt32(@->index, fp.getArgValueUInt32(@->index) + 1);" },
+            { OpCode::dec,           false, "dec",           "dec",
+              "fp.putArgValueUInt32(@->index, fp.getArgValueUInt32(@->index) - 1);" },
+            { OpCode::add,           false, "add",           "add",
+              "fp.putArgValueUInt32(@->index, fp.getArgValueUInt32(@->index) +\n"
+              "                               fp.getArgValueUInt32(@->index2));" },
+            { OpCode::add_imm,       false, "add_imm",       "add_imm",
+              "fp.putArgValueUInt32(@->index, fp.getArgValueUInt32(@->index) + @->imm.u32);" },
+            { OpCode::add_eax,       false, "add_eax",       "add_eax",
+              "regs.eax.u32 += fp.getArgValueUInt32(@->index);" },
+            { OpCode::add_eax_imm,   false, "add_eax_imm",   "add_eax_imm",
+              "regs.eax.u32 += @->imm.u32;" },
+            { OpCode::sub,           false, "sub",           "sub",
+              "fp.putArgValueUInt32(@->index, fp.getArgValueUInt32(@->index) -\n"
+              "                               fp.getArgValueUInt32(@->index2));" },
+            { OpCode::sub_imm,       false, "sub_imm",       "sub_imm",
+              "fp.putArgValueUInt32(@->index, fp.getArgValueUInt32(@->index) - @->imm.u32);" },
+            { OpCode::sub_eax,       false, "sub_eax",       "sub_eax",
+              "regs.eax.u32 -= fp.getArgValueUInt32(@->index);" },
+            { OpCode::sub_eax_imm,   false, "sub_eax_imm",   "sub_eax_imm",
+              "regs.eax.u32 -= @->imm.u32;" },
+            { OpCode::error, false, nullptr, nullptr, nullptr }
+        };
+        return &s_templates[0];
+    }
+};
+
+//
+// A fall-through opcode sequence picked from the profile.
+//
+struct vmSuperInsnCandidate {
+    uint8_t     length;
+    uint8_t     ops[kMaxSuperInsnLength];
+    uint64_t    count;          // Dynamic count of the sequence
+    uint64_t    saved;          // Dispatches saved if it's fused
+
+    bool contains(const vmSuperInsnCandidate & other) const {
+        if (other.length > length)
+            return false;
+        for (size_t i = 0; i + other.length <= length; ++i) {
+            if (memcmp(&ops[i], &other.ops[0], other.length) == 0)
+                return true;
+        }
+        return false;
+    }
+};
+
+//
+// The n-gram (n = 1 to kMaxSuperInsnLength) histogram of the dispatched
+// opcodes. A sequence is only counted when every record falls through to
+// the next one, and only the last one of it may transfer the control.
+//
+class vmOpcodeProfile {
+private:
+    std::unordered_map<uint64_t, uint64_t> ngrams_;
+    uint64_t                counts_[256];
+    uint64_t                dispatches_;
+    const vmInstruction *   last_;
+    uint8_t                 window_[kMaxSuperInsnLength];
+    size_t                  windowSize_;
+
+    static uint64_t makeKey(const uint8_t * ops, size_t length) {
+        uint64_t key = (uint64_t)length << 32;
+        for (size_t i = 0; i < length; ++i) {
+            key |= (uint64_t)ops[i] << (i * 8);
+        }
+        return key;
+    }
+
+public:
+    vmOpcodeProfile() {
+        reset();
+    }
+    ~vmOpcodeProfile() {}
+
+    void reset() {
+        ngrams_.clear();
+        for (size_t i = 0; i < 256; ++i) {
+            counts_[i] = 0;
+        }
+        dispatches_ = 0;
+        last_ = nullptr;
+        windowSize_ = 0;
+    }
+
+    uint64_t getDispatchCount() const { return dispatches_; }
+
+    uint64_t getOpCodeCount(uint8_t opcode) const {
+        return counts_[opcode];
+    }
+
+    uint64_t getCount(const uint8_t * ops, size_t length) const {
+        if (length == 1)
+            return counts_[ops[0]];
+        std::unordered_map<uint64_t, uint64_t>::const_iterator iter =
+            ngrams_.find(makeKey(ops, length));
+        return (iter != ngrams_.end()) ? iter->second : 0;
+    }
+
+    //
+    // Called before each dispatch of the instrumented interpreter.
+    //
+    void record(const vmInstruction * ip) {
+        uint8_t opcode = ip->opcode;
+        dispatches_++;
+        counts_[opcode]++;
+
+        if (!SuperInsnTemplates::isFusable(opcode)) {
+            // The super instructions, exit and the unsupported opcodes.
+            windowSize_ = 0;
+            last_ = ip;
+            return;
+        }
+
+        if (windowSize_ == 0 || ip != (last_ + 1) ||
+            SuperInsnTemplates::isBranch(window_[windowSize_ - 1])) {
+            windowSize_ = 0;
+        }
+        if (windowSize_ >= kMaxSuperInsnLength) {
+            memmove(&window_[0], &window_[1], kMaxSuperInsnLength - 1);
+            windowSize_--;
+        }
+        window_[windowSize_++] = opcode;
+        last_ = ip;
+
+        for (size_t length = 2; length <= windowSize_; ++length) {
+            ngrams_[makeKey(&window_[windowSize_ - length], length)]++;
+        }
+    }
+
+    //
+    // Pick the top-K sequences by the saved dispatches, the sequence that
+    // contains or is contained by a picked one is skipped.
+    //
+    size_t select(std::vector<vmSuperInsnCandidate> & selected, size_t topK) const {
+        std::vector<vmSuperInsnCandidate> candidates;
+        candidates.reserve(ngrams_.size());
+
+        std::unordered_map<uint64_t, uint64_t>::const_iterator iter;
+        for (iter = ngrams_.begin(); iter != ngrams_.end(); ++iter) {
+            vmSuperInsnCandidate candidate;
+            uint64_t key = iter->first;
+            candidate.length = (uint8_t)(key >> 32);
+            for (size_t i = 0; i < kMaxSuperInsnLength; ++i) {
+                candidate.ops[i] = (i < candidate.length) ? (uint8_t)(key >> (i * 8)) : 0;
+            }
+            candidate.count = iter->second;
+            candidate.saved = iter->second * (candidate.length - 1);
+            candidates.push_back(candidate);
+        }
+
+        std::sort(candidates.begin(), candidates.end(),
+            [](const vmSuperInsnCandidate & a, const vmSuperInsnCandidate & b) {
+                if (a.saved != b.saved)
+                    return (a.saved > b.saved);
+                else if (a.length != b.length)
+                    return (a.length > b.length);
+                else
+                    return (memcmp(a.ops, b.ops, kMaxSuperInsnLength) < 0);
+            });
+
+        selected.clear();
+        for (size_t i = 0; i < candidates.size() && selected.size() < topK; ++i) {
+            const vmSuperInsnCandidate & candidate = candidates[i];
+            bool overlapped = false;
+            for (size_t j = 0; j < selected.size(); ++j) {
+                if (selected[j].contains(candidate) || candidate.contains(selected[j])) {
+                    overlapped = true;
+                    break;
+                }
+            }
+            if (!overlapped)
+                selected.push_back(candidate);
+        }
+        return selected.size();
+    }
+};
+
+//
+// Emit the C++ source of the super instructions picked from a profile:
+// the SuperOpCode entries, the kSuperInsnDefs[] rows, the handler table
+// entries and the handler bodies of execute_predecoded().
+//
+class SuperInsnGenerator {
+private:
+    static std::string replaceAll(const std::string & code,
+                                  const std::string & record,
+                                  const std::string & length) {
+        std::string result;
+        for (size_t i = 0; i < code.size(); ++i) {
+            if (code[i] == '@')
+                result += record;
+            else if (code[i] == '$')
+                result += length;
+            else
+                result += code[i];
+        }
+        return result;
+    }
+
+    static void appendIndented(std::string & out, const std::string & code,
+                               const char * indent) {
+        size_t start = 0;
+        while (start <= code.size()) {
+            size_t end = code.find('\n', start);
+            if (end == std::string::npos)
+                end = code.size();
+            out += indent;
+            out.append(code, start, end - start);
+            out += "\n";
+            start = end + 1;
+        }
+    }
+
+public:
+    static std::string getName(const vmSuperInsnCandidate & candidate) {
+        std::string name;
+        for (size_t i = 0; i < candidate.length; ++i) {
+            const vmInsnTemplate * insnTpl = SuperInsnTemplates::get(candidate.ops[i]);
+            assert(insnTpl != nullptr);
+            if (i != 0)
+                name += "_";
+            name += insnTpl->shortName;
+        }
+        return name;
+    }
+
+    static std::string getOpCodeList(const vmSuperInsnCandidate & candidate,
+                                     const char * prefix = "") {
+        std::string list;
+        for (size_t i = 0; i < candidate.length; ++i) {
+            const vmInsnTemplate * insnTpl = SuperInsnTemplates::get(candidate.ops[i]);
+            assert(insnTpl != nullptr);
+            if (i != 0)
+                list += ", ";
+            list += prefix;
+            list += insnTpl->name;
+        }
+        return list;
+    }
+
+    static std::string generate(const std::vector<vmSuperInsnCandidate> & candidates) {
+        std::vector<std::string> names;
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            std::string name = getName(candidates[i]);
+            // The jl/jmp/call widths share the same short name.
+            std::string uniqueName = name;
+            int suffix = 2;
+            while (std::find(names.begin(), names.end(), uniqueName) != names.end()) {
+                uniqueName = name + "_" + std::to_string(suffix++);
+            }
+            names.push_back(uniqueName);
+        }
+
+        std::string out;
+        out += "// SuperOpCode::Type\n";
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            out += "        " + names[i];
+            if (i == 0)
+                out += " = first";
+            out += ",\n";
+        }
+
+        out += "\n// kSuperInsnDefs[]\n";
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            const vmSuperInsnCandidate & candidate = candidates[i];
+            out += "    { SuperOpCode::" + names[i] + ", " + std::to_string(candidate.length) + ",\n";
+            out += "      { " + getOpCodeList(candidate, "OpCode::");
+            for (size_t j = candidate.length; j < kMaxSuperInsnLength; ++j) {
+                out += ", 0";
+            }
+            out += " }, \"" + names[i] + "\" },\n";
+        }
+
+        out += "\n// execute_predecoded(): handlerTable\n";
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            out += "            handlerTable[SuperOpCode::" + names[i] + "] = &&Insn_" + names[i] + ";\n";
+        }
+
+        out += "\n// execute_predecoded(): handlers\n";
+        for (size_t i = 0; i < candidates.size(); ++i) {
+            const vmSuperInsnCandidate & candidate = candidates[i];
+            std::string length = std::to_string(candidate.length);
+            std::string body;
+
+            out += "            VM_SUPER_INSN_CASE(" + names[i] + ") {\n";
+            out += "                // " + getOpCodeList(candidate) + "\n";
+            for (size_t j = 0; j < candidate.length; ++j) {
+                const vmInsnTemplate * insnTpl = SuperInsnTemplates::get(candidate.ops[j]);
+                std::string record = (j == 0) ? "ip" : "(ip + " + std::to_string(j) + ")";
+                appendIndented(out, replaceAll(insnTpl->code, record, length),
+                               "                ");
+            }
+            if (!SuperInsnTemplates::isBranch(candidate.ops[candidate.length - 1])) {
+                out += "                ip += " + length + ";\n";
+                out += "                VM_INSN_NEXT();\n";
+            }
+            out += "            }\n\n";
+        }
+        return out;
+    }
+};
+
+//
+// Substitute the super instructions in the pre-decoded records.
+//
+// Only the first record of a matched sequence is rewritten, the fused
+// handler reads the operands of the following records and skips them.
+// The following records keep their own handlers, so a branch target or
+// a return site in the middle of a sequence still runs correctly.
+//
+class SuperInsnRewriter {
+public:
+    static size_t rewrite(vmDecodedImage & decoded, const void * const * handlers,
+                          const vmSuperInsnDef * defs = &kSuperInsnDefs[0],
+                          size_t defCount = kSuperInsnDefCount) {
+        vmInstruction * insns = decoded.data();
+        size_t insnCount = decoded.size();
+        size_t fused = 0;
+
+        size_t i = 0;
+        while (i < insnCount) {
+            const vmSuperInsnDef * matched = nullptr;
+            for (size_t n = 0; n < defCount; ++n) {
+                const vmSuperInsnDef & def = defs[n];
+                if ((i + def.length) > insnCount)
+                    continue;
+                if (matched != nullptr && def.length <= matched->length)
+                    continue;
+                size_t k;
+                for (k = 0; k < def.length; ++k) {
+                    if (insns[i + k].opcode != def.ops[k])
+                        break;
+                }
+                if (k == def.length)
+                    matched = &def;
+            }
+
+            if (matched != nullptr) {
+                insns[i].opcode = matched->opcode;
+                insns[i].handler = (handlers != nullptr) ? handlers[matched->opcode] : nullptr;
+                fused++;
+                i += matched->length;
+            }
+            else {
+                i++;
+            }
+        }
+        return fused;
+    }
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_SUPERINSN_H
@@ -0,0 +1,616 @@
+#ifndef JLANG_VM_TRACEJIT_H
+#define JLANG_VM_TRACEJIT_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/vm/Interpreter.h"
+#include "jlang/vm/PreDecoder.h"
+#include "jlang/vm/JitCompiler.h"
+#include "jlang/lang/Error.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <vector>
+
+namespace jlang {
+namespace v3 {
+
+//
+// The VM registers that passed in and out of a native trace.
+//
+struct vmTraceState {
+    void *      sp;
+    void *      fp;
+    uint32_t    eax;
+    uint32_t    flags;
+};
+
+//
+// The native entry of a compiled trace, it returns the record where the
+// interpreter resumes, or nullptr if the program was returned.
+//
+typedef const vmInstruction * (*vmTraceFunc)(vmTraceState * state);
+
+//
+// A recorded step of the trace: the executed record and the record that
+// executed after it, so the taken direction of the branches and the
+// return sites are known.
+//
+struct vmTraceRecord {
+    const vmInstruction * insn;
+    const vmInstruction * next;
+};
+
+struct vmTraceStats {
+    uint64_t    interpreted;    // Records executed by the interpreter
+    uint64_t    entries;        // Trace entries from the interpreter
+    uint32_t    compiled;
+    uint32_t    aborted;
+    uint32_t    blacklisted;
+    size_t      codeSize;
+
+    vmTraceStats() {
+        clear();
+    }
+
+    void clear() {
+        interpreted = 0;
+        entries = 0;
+        compiled = 0;
+        aborted = 0;
+        blacklisted = 0;
+        codeSize = 0;
+    }
+};
+
+//
+// Compile a recorded trace to x86-64 machine code.
+//
+// The register mapping is same as the JitCompiler, and rbp points to the
+// vmTraceState. The VM calls and returns of the trace are inlined, the
+// frame is still pushed to the VM stack with the return record, so the
+// interpreter can return through it after a side exit.
+//
+// Every conditional jump becomes a guard of the recorded direction, and
+// every return becomes a guard of the recorded return site, a failed guard
+// leaves the trace to the record to resume.
+//
+// The traces are linked at runtime: the handler field of the anchor record
+// is the body entry of its trace (the tracing interpreter doesn't use the
+// handlers), so a trace that leaves to an anchor jumps to the next trace
+// directly, and returns to the interpreter only if there's no trace.
+//
+class TraceCompiler {
+private:
+    typedef X64Emitter Asm;
+
+    enum {
+        kSP     = Asm::r12,
+        kFP     = Asm::r13,
+        kEAX    = Asm::rbx,
+        kFlags  = Asm::r14,
+        kState  = Asm::rbp,
+        kTemp   = Asm::rax,
+        kTemp2  = Asm::rcx
+    };
+
+    struct SideExit {
+        size_t                  at;
+        int32_t                 spDelta;
+        const vmInstruction *   resume;     // nullptr: the popped return record in rax
+    };
+
+    static const int32_t kFrameSize = (int32_t)(sizeof(void *) * 2);
+
+    static int32_t getSlotDisp(int32_t index) {
+        return (index * (int32_t)sizeof(uint32_t));
+    }
+
+    static bool isCondJump(uint8_t opcode) {
+        return (opcode == OpCode::jl_near || opcode == OpCode::jl_short ||
+                opcode == OpCode::jl_long);
+    }
+
+    static bool isJump(uint8_t opcode) {
+        return (opcode == OpCode::jmp || opcode == OpCode::jmp_near ||
+                opcode == OpCode::jmp_short || opcode == OpCode::jmp_long);
+    }
+
+    // The record does nothing, same as the interpreter.
+    static bool isNoEffect(uint8_t opcode) {
+        return (opcode == OpCode::error || opcode == OpCode::move ||
+                opcode == OpCode::move_to_eax || opcode == OpCode::cmp ||
+                opcode == OpCode::jl || opcode == OpCode::nop ||
+                opcode == OpCode::nop_n);
+    }
+
+    static void materialize(Asm & a, int32_t & spDelta) {
+        if (spDelta != 0) {
+            a.add_r64_imm(kSP, spDelta);
+            spDelta = 0;
+        }
+    }
+
+    static void addExit(std::vector<SideExit> & exits, size_t at, int32_t spDelta,
+                        const vmInstruction * resume) {
+        SideExit exit = { at, spDelta, resume };
+        exits.push_back(exit);
+    }
+
+public:
+    TraceCompiler() {}
+    ~TraceCompiler() {}
+
+    static bool isTraceable(uint8_t opcode) {
+        switch (opcode) {
+        case OpCode::exit:
+            return false;
+        default:
+            return (opcode < OpCode::last);
+        }
+    }
+
+    //
+    // Remove the records that need no code in the trace: the no effect
+    // records, the unconditional jumps (the trace is linear), and the
+    // conditional jumps to the next record.
+    //
+    static void optimize(std::vector<vmTraceRecord> & trace) {
+        size_t count = 0;
+        for (size_t i = 0; i < trace.size(); ++i) {
+            const vmInstruction * insn = trace[i].insn;
+            if (isNoEffect(insn->opcode) || isJump(insn->opcode))
+                continue;
+            if (isCondJump(insn->opcode) && insn->target == (insn + 1))
+                continue;
+            trace[count++] = trace[i];
+        }
+        trace.resize(count);
+    }
+
+    //
+    // Compile the optimized trace. If isLoop is true, the trace jumps back
+    // to its head at the end, else it leaves to the next record of the last
+    // step.
+    //
+    // The sp adjustments are sunk: the pushes and pops only change the
+    // compile time delta of sp, and sp is updated at the calls, returns,
+    // side exits and the end of the trace.
+    //
+    static int compile(const std::vector<vmTraceRecord> & trace, const vmInstruction * exitTo,
+                       bool isLoop, vmJitCode & jitCode, size_t & bodyOffset) {
+#if USE_JIT_X86_64
+        Asm a;
+        std::vector<SideExit> exits;
+        std::vector<size_t> linkFixups;
+
+        // Prologue
+        a.push(Asm::rbp);
+        a.push(Asm::rbx);
+        a.push(Asm::r12);
+        a.push(Asm::r13);
+        a.push(Asm::r14);
+#if defined(_WIN32)
+        a.mov_r64_r64(kState, Asm::rcx);
+#else
+        a.mov_r64_r64(kState, Asm::rdi);
+#endif
+        a.mov_r64_mem(kSP, kState, (int32_t)offsetof(vmTraceState, sp));
+        a.mov_r64_mem(kFP, kState, (int32_t)offsetof(vmTraceState, fp));
+        a.mov_r32_mem(kEAX, kState, (int32_t)offsetof(vmTraceState, eax));
+        a.mov_r32_mem(kFlags, kState, (int32_t)offsetof(vmTraceState, flags));
+
+        size_t loopHead = a.size();
+        bodyOffset = loopHead;
+        int32_t spDelta = 0;
+        int lastCC = -1;
+
+        for (size_t i = 0; i < trace.size(); ++i) {
+            const vmInstruction & insn = *trace[i].insn;
+            const vmInstruction * next = trace[i].next;
+
+            // The native flags of the previous cmp are valid only for the
+            // guard right after it.
+            int cmpCC = lastCC;
+            lastCC = -1;
+
+            switch (insn.opcode) {
+            case OpCode::push:
+                a.mov_r32_mem(kTemp, kFP, getSlotDisp(insn.index));
+                a.mov_mem_r32(kSP, spDelta, kTemp);
+                spDelta += sizeof(uint32_t);
+                break;
+
+            case OpCode::push_i32:
+                a.mov_mem32_imm(kSP, spDelta, insn.imm.i32);
+                spDelta += sizeof(uint32_t);
+                break;
+
+            case OpCode::push_i64:
+                a.mov_r64_imm(kTemp, insn.imm.u64);
+                a.mov_mem_r64(kSP, spDelta, kTemp);
+                spDelta += sizeof(uint64_t);
+                break;
+
+            case OpCode::push_i32_0:
+                a.mov_mem32_imm(kSP, spDelta, 0);
+                spDelta += sizeof(uint32_t);
+                break;
+
+            case OpCode::push_i64_0:
+                a.mov_mem64_imm(kSP, spDelta, 0);
+                spDelta += sizeof(uint64_t);
+                break;
+
+            case OpCode::pop:
+            case OpCode::pop_i32:
+            case OpCode::pop_i64:
+                spDelta -= (insn.opcode == OpCode::pop_i64) ? sizeof(uint64_t)
+                                                           : sizeof(uint32_t);
+                break;
+
+            case OpCode::add_sp:
+                spDelta += insn.index;
+                break;
+
+            case OpCode::add_sp_4:
+                spDelta += sizeof(uint32_t);
+                break;
+
+            case OpCode::load_eax:
+                a.mov_r32_imm(kEAX, insn.imm.u32);
+                break;
+
+            case OpCode::store:
+                a.mov_mem32_imm(kFP, getSlotDisp(insn.index), insn.imm.i32);
+                break;
+
+            case OpCode::copy_from_eax:
+                a.mov_mem_r32(kFP, getSlotDisp(insn.index), kEAX);
+                break;
+
+            case OpCode::cmp_i32:
+            case OpCode::cmp_u32:
+            case OpCode::cmp_imm_i32:
+            case OpCode::cmp_imm_u32: {
+                bool isSigned = (insn.opcode == OpCode::cmp_i32 ||
+                                 insn.opcode == OpCode::cmp_imm_i32);
+                int cc = 0;
+                int kind = JitCompiler::getCondCode(insn.cond, isSigned, cc);
+                if (kind < 0)
+                    return Error::Jit_Unsupported_OpCode;
+                if (kind == 2) {
+                    if (insn.opcode == OpCode::cmp_i32 || insn.opcode == OpCode::cmp_u32) {
+                        a.mov_r32_mem(kTemp, kFP, getSlotDisp(insn.index));
+                        a.cmp_r32_mem(kTemp, kFP, getSlotDisp(insn.index2));
+                    }
+                    else {
+                        a.cmp_mem32_imm(kFP, getSlotDisp(insn.index), insn.imm.i32);
+                    }
+                    // Keep the VM flags exact for the side exits, setcc
+                    // doesn't change the native flags.
+                    a.setcc(cc, kFlags);
+                    lastCC = cc;
+                }
+                else {
+                    a.mov_r32_imm(kFlags, (uint32_t)kind);
+                }
+                break;
+            }
+
+            case OpCode::jl_near:
+            case OpCode::jl_short:
+            case OpCode::jl_long: {
+                // Guard the recorded direction, the x86 condition codes are
+                // paired, (cc ^ 1) is the negated condition.
+                bool taken = (next == insn.target);
+                int exitCC;
+                if (cmpCC >= 0) {
+                    exitCC = taken ? (cmpCC ^ 1) : cmpCC;
+                }
+                else {
+                    a.test_r8_r8(kFlags);
+                    exitCC = taken ? Asm::cc_e : Asm::cc_ne;
+                }
+                addExit(exits, a.jcc(exitCC), spDelta, taken ? (&insn + 1) : insn.target);
+                break;
+            }
+
+            case OpCode::call:
+            case OpCode::call_near:
+            case OpCode::call_short:
+            case OpCode::call_long:
+                // push_callstack(): save fp and the return record.
+                a.mov_mem_r64(kSP, spDelta, kFP);
+                a.mov_r64_imm(kTemp, (uint64_t)(uintptr_t)(&insn + 1));
+                a.mov_mem_r64(kSP, spDelta + (int32_t)sizeof(void *), kTemp);
+                spDelta += kFrameSize;
+                materialize(a, spDelta);
+                a.mov_r64_r64(kFP, kSP);
+                break;
+
+            case OpCode::ret:
+            case OpCode::ret_n_sm:
+            case OpCode::ret_n:
+            case OpCode::ret_eax:
+            case OpCode::ret_eax_n: {
+                if (insn.opcode == OpCode::ret_eax || insn.opcode == OpCode::ret_eax_n)
+                    a.mov_r32_imm(kEAX, insn.imm.u32);
+                int32_t localSize = (insn.opcode == OpCode::ret_n_sm ||
+                                     insn.opcode == OpCode::ret_n ||
+                                     insn.opcode == OpCode::ret_eax_n) ? insn.index : 0;
+                // pop_callstack(): back the locals, the return record and the fp.
+                spDelta -= localSize + kFrameSize;
+                materialize(a, spDelta);
+                a.mov_r64_mem(kTemp, kSP, (int32_t)sizeof(void *));
+                a.mov_r64_mem(kFP, kSP, 0);
+                // Guard the return site, else resume at the popped record.
+                a.mov_r64_imm(kTemp2, (uint64_t)(uintptr_t)next);
+                a.cmp_r64_r64(kTemp, kTemp2);
+                addExit(exits, a.jcc(Asm::cc_ne), 0, nullptr);
+                break;
+            }
+
+            case OpCode::inc:
+                a.add_mem32_imm(kFP, getSlotDisp(insn.index), 1);
+                break;
+
+            case OpCode::dec:
+                a.sub_mem32_imm(kFP, getSlotDisp(insn.index), 1);
+                break;
+
+            case OpCode::add:
+                a.mov_r32_mem(kTemp, kFP, getSlotDisp(insn.index2));
+                a.add_mem_r32(kFP, getSlotDisp(insn.index), kTemp);
+                break;
+
+            case OpCode::add_imm:
+                a.add_mem32_imm(kFP, getSlotDisp(insn.index), insn.imm.i32);
+                break;
+
+            case OpCode::add_eax:
+                a.add_r32_mem(kEAX, kFP, getSlotDisp(insn.index));
+                break;
+
+            case OpCode::add_eax_imm:
+                a.add_r32_imm(kEAX, insn.imm.i32);
+                break;
+
+            case OpCode::sub:
+                a.mov_r32_mem(kTemp, kFP, getSlotDisp(insn.index2));
+                a.sub_mem_r32(kFP, getSlotDisp(insn.index), kTemp);
+                break;
+
+            case OpCode::sub_imm:
+                a.sub_mem32_imm(kFP, getSlotDisp(insn.index), insn.imm.i32);
+                break;
+
+            case OpCode::sub_eax:
+                a.sub_r32_mem(kEAX, kFP, getSlotDisp(insn.index));
+                break;
+
+            case OpCode::sub_eax_imm:
+                a.sub_r32_imm(kEAX, insn.imm.i32);
+                break;
+
+            default:
+                return Error::Jit_Unsupported_OpCode;
+            }
+        }
+
+        // The end of trace.
+        materialize(a, spDelta);
+        if (isLoop) {
+            a.patchRel32(a.jmp(), loopHead);
+        }
+        else {
+            a.mov_r64_imm(kTemp, (uint64_t)(uintptr_t)exitTo);
+            linkFixups.push_back(a.jmp());
+        }
+
+        // The side exit stubs.
+        for (size_t i = 0; i < exits.size(); ++i) {
+            const SideExit & exit = exits[i];
+            a.patchRel32(exit.at, a.size());
+            int32_t exitDelta = exit.spDelta;
+            materialize(a, exitDelta);
+            if (exit.resume != nullptr)
+                a.mov_r64_imm(kTemp, (uint64_t)(uintptr_t)exit.resume);
+            linkFixups.push_back(a.jmp());
+        }
+
+        // Link to the trace of the resume record in rax, if any.
+        size_t link = a.size();
+        a.test_r64_r64(kTemp);
+        size_t noRecord = a.jcc(Asm::cc_e);
+        a.mov_r64_mem(kTemp2, kTemp, (int32_t)offsetof(vmInstruction, handler));
+        a.test_r64_r64(kTemp2);
+        size_t noTrace = a.jcc(Asm::cc_e);
+        a.jmp_r64(kTemp2);
+
+        // Epilogue, write back the VM registers, rax is the resume record.
+        size_t epilogue = a.size();
+        a.patchRel32(noRecord, epilogue);
+        a.patchRel32(noTrace, epilogue);
+        a.mov_mem_r64(kState, (int32_t)offsetof(vmTraceState, sp), kSP);
+        a.mov_mem_r64(kState, (int32_t)offsetof(vmTraceState, fp), kFP);
+        a.mov_mem_r32(kState, (int32_t)offsetof(vmTraceState, eax), kEAX);
+        a.mov_mem_r32(kState, (int32_t)offsetof(vmTraceState, flags), kFlags);
+        a.pop(Asm::r14);
+        a.pop(Asm::r13);
+        a.pop(Asm::r12);
+        a.pop(Asm::rbx);
+        a.pop(Asm::rbp);
+        a.ret();
+
+        for (size_t i = 0; i < linkFixups.size(); ++i) {
+            a.patchRel32(linkFixups[i], link);
+        }
+
+        return jitCode.assign(a.data(), a.size());
+#else
+        return Error::Jit_Unsupported_Platform;
+#endif // USE_JIT_X86_64
+    }
+};
+
+//
+// The trace monitor, counts the hotness of the anchors, records the hot
+// paths and keeps the compiled traces.
+//
+// The anchors are the targets of the backward jumps, the call targets and
+// the records where a trace left. When an anchor gets hot, the following
+// executed records are recorded until the path comes back to the anchor
+// (a loop, or a recursive call), reaches another trace, or is too long.
+// An anchor is blacklisted after it's aborted too many times.
+//
+class TraceMonitor {
+public:
+    enum {
+        kHotThreshold   = 50,
+        kMaxTraceLength = 256,
+        kMaxAborts      = 4,
+        kBlacklisted    = 0xFFFF
+    };
+
+private:
+    vmInstruction *                 insns_;
+    size_t                          insnCount_;
+    std::vector<uint16_t>           hotness_;
+    std::vector<uint8_t>            aborts_;
+    std::vector<vmJitCode *>        traces_;
+    std::vector<vmTraceRecord>      recording_;
+    const vmInstruction *           anchor_;
+    vmTraceStats                    stats_;
+
+    size_t getIndex(const vmInstruction * insn) const {
+        return (size_t)(insn - insns_);
+    }
+
+    void abort() {
+        size_t index = getIndex(anchor_);
+        stats_.aborted++;
+        if (++aborts_[index] >= kMaxAborts) {
+            hotness_[index] = kBlacklisted;
+            stats_.blacklisted++;
+        }
+        else {
+            hotness_[index] = 0;
+        }
+        recording_.clear();
+        anchor_ = nullptr;
+    }
+
+    void finish(const vmInstruction * exitTo, bool isLoop) {
+        TraceCompiler::optimize(recording_);
+
+        vmJitCode * jitCode = new vmJitCode();
+        size_t bodyOffset = 0;
+        int ec = TraceCompiler::compile(recording_, exitTo, isLoop, *jitCode, bodyOffset);
+        if (ec == Error::Ok) {
+            size_t index = getIndex(anchor_);
+            traces_[index] = jitCode;
+            insns_[index].handler = (const void *)((const uint8_t *)jitCode->data() + bodyOffset);
+            stats_.compiled++;
+            stats_.codeSize += jitCode->size();
+            recording_.clear();
+            anchor_ = nullptr;
+        }
+        else {
+            delete jitCode;
+            abort();
+        }
+    }
+
+public:
+    TraceMonitor() : insns_(nullptr), insnCount_(0), anchor_(nullptr) {}
+    ~TraceMonitor() {
+        clear();
+    }
+
+    bool isInited() const { return (insns_ != nullptr); }
+    bool isRecording() const { return (anchor_ != nullptr); }
+
+    const vmTraceStats & getStats() const { return stats_; }
+    vmTraceStats & getStats() { return stats_; }
+
+    //
+    // Attach to the pre-decoded records, the handlers of the records are
+    // cleared to link the traces.
+    //
+    void reset(vmDecodedImage & decoded) {
+        clear();
+        insns_ = decoded.data();
+        // Include the tail sentinel record.
+        insnCount_ = decoded.size() + 1;
+        for (size_t i = 0; i < insnCount_; ++i) {
+            insns_[i].handler = nullptr;
+        }
+        hotness_.assign(insnCount_, 0);
+        aborts_.assign(insnCount_, 0);
+        traces_.assign(insnCount_, nullptr);
+    }
+
+    void clear() {
+        for (size_t i = 0; i < traces_.size(); ++i) {
+            delete traces_[i];
+        }
+        traces_.clear();
+        hotness_.clear();
+        aborts_.clear();
+        recording_.clear();
+        anchor_ = nullptr;
+        insns_ = nullptr;
+        insnCount_ = 0;
+        stats_.clear();
+    }
+
+    //
+    // The interpreter reached an anchor, return the trace to run, or
+    // nullptr to continue interpreting, may start the recording.
+    //
+    vmTraceFunc enter(const vmInstruction * insn) {
+        size_t index = getIndex(insn);
+        assert(index < insnCount_);
+        if (traces_[index] != nullptr)
+            return (vmTraceFunc)traces_[index]->data();
+
+        if (!isRecording() && hotness_[index] != kBlacklisted) {
+            if (++hotness_[index] >= kHotThreshold) {
+                recording_.clear();
+                anchor_ = insn;
+            }
+        }
+        return nullptr;
+    }
+
+    //
+    // Record an executed record, next is the record executed after it,
+    // or nullptr if the program is finished.
+    //
+    void record(const vmInstruction * insn, const vmInstruction * next) {
+        if (!TraceCompiler::isTraceable(insn->opcode) || next == nullptr ||
+            getIndex(next) >= insnCount_ || recording_.size() >= kMaxTraceLength) {
+            abort();
+            return;
+        }
+
+        vmTraceRecord step = { insn, next };
+        recording_.push_back(step);
+
+        if (next == anchor_)
+            finish(next, true);
+        else if (traces_[getIndex(next)] != nullptr)
+            finish(next, false);
+    }
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_TRACEJIT_H
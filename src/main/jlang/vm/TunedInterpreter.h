@@ -0,0 +1,273 @@
+#ifndef JLANG_VM_TUNEDINTERPRETER_H
+#define JLANG_VM_TUNEDINTERPRETER_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/vm/Interpreter.h"
+#include "jlang/vm/Interpreter_v3.h"
+#include "jlang/vm/StackLayout.h"
+#include "jlang/support/StopWatch.h"
+#include "jlang/lang/Error.h"
+#include "jlang/system/Console.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdlib.h>
+#include <string.h>
+#include <assert.h>
+
+#include <string>
+#include <vector>
+#include <memory>
+
+namespace jlang {
+namespace v3 {
+
+//
+// A variant of the v3 interpreter, the stack layout and the image mode are
+// fixed when it's instantiated.
+//
+template <typename BasicType = uintptr_t>
+class IInterpreterVariant {
+public:
+    typedef vmReturn<BasicType> return_type;
+
+    virtual ~IInterpreterVariant() {}
+
+    virtual const char * getLayoutName() const = 0;
+    virtual int getImageMode() const = 0;
+
+    virtual int create() = 0;
+    virtual int run(return_type & ret) = 0;
+};
+
+template <typename BasicType, typename Layout>
+class InterpreterVariant : public IInterpreterVariant<BasicType> {
+public:
+    typedef BasicType                           basic_type;
+    typedef Layout                              layout_type;
+    typedef Interpreter<basic_type, Layout>     interpreter_type;
+    typedef vmReturn<basic_type>                return_type;
+
+private:
+    interpreter_type    interpreter_;
+    int                 imageMode_;
+
+public:
+    InterpreterVariant(int imageMode) : imageMode_(imageMode) {}
+    virtual ~InterpreterVariant() {}
+
+    const char * getLayoutName() const {
+        return Layout::name();
+    }
+
+    int getImageMode() const {
+        return imageMode_;
+    }
+
+    int create() {
+        return interpreter_.create(imageMode_);
+    }
+
+    //
+    // The verified image runs in the unchecked threaded loop, the others run
+    // in the checked threaded loop, or the switch loop if the computed goto
+    // is not supported. The threaded loops don't trace, so the calibration
+    // doesn't time the logger.
+    //
+    int run(return_type & ret) {
+        return interpreter_.run_verified(ret);
+    }
+};
+
+//
+// The v3 interpreter that instantiates every combination of the stack
+// layouts and the image modes, and selects the fastest one at runtime.
+//
+// The best layout differs between the CPUs, so create() runs a short
+// calibration with every variant and selects the fastest one. A variant can
+// be pinned with pin(), or with the environment variable JLANG_VM_VARIANT
+// (the index or the name of the variant), then the calibration is skipped.
+//
+template <typename BasicType = uintptr_t>
+class TunedInterpreter {
+public:
+    typedef BasicType                       basic_type;
+    typedef IInterpreterVariant<basic_type> variant_type;
+    typedef vmReturn<basic_type>            return_type;
+    typedef TunedInterpreter<basic_type>    this_type;
+
+    static const size_t kNotSelected = (size_t)-1;
+
+    // fibonacci(20) runs about 10,000 calls in a round.
+    static const uint32_t kCalibrateInput = 20;
+    static const int kCalibrateRounds = 5;
+
+private:
+    std::vector<std::unique_ptr<variant_type>>  variants_;
+    std::vector<std::string>                    names_;
+    std::vector<double>                         timings_;
+    size_t                                      selected_;
+    bool                                        pinned_;
+
+    template <typename Layout>
+    void addVariant(int imageMode) {
+        variants_.emplace_back(new InterpreterVariant<basic_type, Layout>(imageMode));
+        std::string name = Layout::name();
+        name += (imageMode == USE_FIBONACCI_IMAGE_FAST) ? ", fibonacci fast" : ", fibonacci";
+        names_.push_back(name);
+    }
+
+    void addVariants() {
+        static const int kImageModes[] = { USE_FIBONACCI_IMAGE, USE_FIBONACCI_IMAGE_FAST };
+        for (size_t i = 0; i < sizeof(kImageModes) / sizeof(kImageModes[0]); ++i) {
+            addVariant<vmStackLayout<true,  false> >(kImageModes[i]);
+            addVariant<vmStackLayout<true,  true > >(kImageModes[i]);
+            addVariant<vmStackLayout<false, false> >(kImageModes[i]);
+            addVariant<vmStackLayout<false, true > >(kImageModes[i]);
+        }
+        timings_.assign(variants_.size(), 0.0);
+    }
+
+    size_t findVariant(const char * name) const {
+        char * end = nullptr;
+        unsigned long index = strtoul(name, &end, 10);
+        if (end != name && *end == '\0')
+            return (index < variants_.size()) ? (size_t)index : kNotSelected;
+
+        for (size_t i = 0; i < names_.size(); ++i) {
+            if (names_[i] == name)
+                return i;
+        }
+        return kNotSelected;
+    }
+
+public:
+    TunedInterpreter() : selected_(kNotSelected), pinned_(false) {
+        addVariants();
+    }
+    ~TunedInterpreter() {}
+
+    size_t getVariantCount() const { return variants_.size(); }
+
+    const char * getVariantName(size_t index) const {
+        assert(index < names_.size());
+        return names_[index].c_str();
+    }
+
+    // The best time of the variant in the calibration, in milliseconds.
+    double getTiming(size_t index) const {
+        assert(index < timings_.size());
+        return timings_[index];
+    }
+
+    size_t getSelected() const { return selected_; }
+    bool isPinned() const { return pinned_; }
+
+    int create() {
+        for (size_t i = 0; i < variants_.size(); ++i) {
+            int ec = variants_[i]->create();
+            if (ec <= 0)
+                return ec;
+        }
+
+        if (!pinned_) {
+            const char * pinnedName = getenv("JLANG_VM_VARIANT");
+            if (pinnedName != nullptr && pin(pinnedName) != Error::Ok) {
+                Console::trace("Error: Unknown JLANG_VM_VARIANT = \"%s\".\n", pinnedName);
+            }
+        }
+        if (pinned_)
+            return (int)true;
+
+        int ec = calibrate();
+        return (ec == Error::Ok) ? (int)true : ec;
+    }
+
+    //
+    // Pin the variant, the calibration is skipped.
+    //
+    int pin(size_t index) {
+        if (index >= variants_.size())
+            return Error::Tuned_Variant_Out_Of_Range;
+        selected_ = index;
+        pinned_ = true;
+        return Error::Ok;
+    }
+
+    int pin(const char * name) {
+        return pin(findVariant(name));
+    }
+
+    void unpin() {
+        pinned_ = false;
+    }
+
+    //
+    // Run every variant with the same input, and select the fastest one.
+    // The variant that returns an error or a different result in any round
+    // is never selected.
+    //
+    int calibrate(uint32_t input = kCalibrateInput, int rounds = kCalibrateRounds) {
+        if (pinned_)
+            return Error::Ok;
+
+        StopWatch sw;
+        size_t best = kNotSelected;
+        basic_type expected = 0;
+        for (size_t i = 0; i < variants_.size(); ++i) {
+            return_type ret;
+            ret.setDataType(return_type::Basic);
+            ret.setValue(input);
+            // The first run is a warm up.
+            int ec = variants_[i]->run(ret);
+            if (ec != Error::Ok || (best != kNotSelected && ret.getValue() != expected)) {
+                timings_[i] = 0.0;
+                continue;
+            }
+            expected = ret.getValue();
+
+            double minTime = 0.0;
+            bool failed = false;
+            for (int round = 0; round < rounds; ++round) {
+                ret.setDataType(return_type::Basic);
+                ret.setValue(input);
+                sw.start();
+                ec = variants_[i]->run(ret);
+                sw.stop();
+                if (ec != Error::Ok || ret.getValue() != expected) {
+                    failed = true;
+                    break;
+                }
+                double elapsedTime = sw.getElapsedMillisec();
+                if (round == 0 || elapsedTime < minTime)
+                    minTime = elapsedTime;
+            }
+            if (failed) {
+                timings_[i] = 0.0;
+                continue;
+            }
+            timings_[i] = minTime;
+
+            if (best == kNotSelected || minTime < timings_[best])
+                best = i;
+        }
+
+        if (best == kNotSelected)
+            return Error::MainProcess_Create_Failed;
+        selected_ = best;
+        return Error::Ok;
+    }
+
+    int run(return_type & ret) {
+        assert(selected_ < variants_.size());
+        return variants_[selected_]->run(ret);
+    }
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_TUNEDINTERPRETER_H
@@ -0,0 +1,134 @@
+#ifndef JLANG_VM_TYPEDINSN_H
+#define JLANG_VM_TYPEDINSN_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/vm/Interpreter.h"
+#include "jlang/vm/TypedOps.h"
+#include "jlang/vm/PreDecoder.h"
+#include "jlang/vm/SuperInsn.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+//////////////////////////////////////////////////////////////
+
+/* Are the typed handlers supported ? The handlers need the computed goto. */
+#ifndef USE_TYPED_HANDLERS
+#if USE_COMPUTED_GOTO
+#define USE_TYPED_HANDLERS      1
+#else
+#define USE_TYPED_HANDLERS      0
+#endif
+#endif // USE_TYPED_HANDLERS
+
+//////////////////////////////////////////////////////////////
+
+namespace jlang {
+namespace v3 {
+
+//
+// The typed compare handlers of the pre-decoded records, they follow
+// SuperOpCode::last. The opcode "cmp_<kind>_<cond>" carries the width,
+// the signedness and the condition, the handler is op_cmp<T, Cond>.
+//
+#define V3_TYPED_CMP_OPCODE(kind, kindIndex, cond) \
+    kind##_##cond = first + (kindIndex) * vmCondType::last + vmCondType::cond,
+
+struct TypedOpCode {
+    enum Type {
+        first = SuperOpCode::last,
+
+        VM_FOR_EACH_COND(V3_TYPED_CMP_OPCODE, cmp_i32,        0)
+        VM_FOR_EACH_COND(V3_TYPED_CMP_OPCODE, cmp_u32,        1)
+        VM_FOR_EACH_COND(V3_TYPED_CMP_OPCODE, cmp_imm_i32,    2)
+        VM_FOR_EACH_COND(V3_TYPED_CMP_OPCODE, cmp_imm_u32,    3)
+
+        last = first + 4 * vmCondType::last
+    };
+};
+
+#undef V3_TYPED_CMP_OPCODE
+
+//
+// Replace the handlers of the compares by the typed handlers of their
+// condition, the condition is read from the next opcode when the image is
+// pre-decoded, so it's known before the first run.
+//
+class TypedInsnPlanner {
+private:
+    // The first typed opcode of the handler, or OpCode::last if none.
+    static uint8_t getTypedBase(const vmInstruction & insn, const void * const * handlers) {
+        switch (insn.opcode) {
+        case OpCode::cmp_i32:
+            if (insn.handler == handlers[OpCode::cmp_i32])
+                return TypedOpCode::cmp_i32_jz;
+            break;
+
+        case OpCode::cmp_u32:
+            if (insn.handler == handlers[OpCode::cmp_u32])
+                return TypedOpCode::cmp_u32_jz;
+            break;
+
+        case OpCode::cmp_imm_i32:
+            if (insn.handler == handlers[OpCode::cmp_imm_i32])
+                return TypedOpCode::cmp_imm_i32_jz;
+            break;
+
+        case OpCode::cmp_imm_u32:
+            if (insn.handler == handlers[OpCode::cmp_imm_u32])
+                return TypedOpCode::cmp_imm_u32_jz;
+            break;
+
+        default:
+            break;
+        }
+        return OpCode::last;
+    }
+
+public:
+    TypedInsnPlanner() {}
+    ~TypedInsnPlanner() {}
+
+    //
+    // Set the typed handlers of the pre-decoded records, the handlers is
+    // indexed by opcode, include TypedOpCode. It must run after the other
+    // planners that choose the handlers. Return the count of the records
+    // that run with the typed handlers.
+    //
+    static size_t plan(vmDecodedImage & decoded, const void * const * handlers) {
+#if USE_TYPED_HANDLERS
+        if (!decoded.isInited() || handlers == nullptr)
+            return 0;
+
+        vmInstruction * insns = decoded.data();
+        size_t insnCount = decoded.size();
+        size_t typed = 0;
+        for (size_t i = 0; i < insnCount; ++i) {
+            vmInstruction & insn = insns[i];
+            uint8_t base = getTypedBase(insn, handlers);
+            if (base == OpCode::last)
+                continue;
+            uint8_t condType = getCondType(insn.cond);
+            if (condType == vmCondType::last)
+                continue;
+            insn.handler = handlers[base + condType];
+            typed++;
+        }
+        return typed;
+#else
+        // Fallback to the base handlers.
+        (void)decoded;
+        (void)handlers;
+        return 0;
+#endif // USE_TYPED_HANDLERS
+    }
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_TYPEDINSN_H
@@ -0,0 +1,131 @@
+#ifndef JLANG_VM_TYPEDOPS_H
+#define JLANG_VM_TYPEDOPS_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+#include "jlang/vm/Interpreter.h"
+
+#include <stdint.h>
+#include <stddef.h>
+
+//////////////////////////////////////////////////////////////
+
+//
+// Expand M(kind, type, cond) for every condition of vmCondType, it's used
+// to generate the typed compare handlers and their handler table entries.
+//
+#define VM_FOR_EACH_COND(M, kind, type) \
+    M(kind, type, jz)   \
+    M(kind, type, jnz)  \
+    M(kind, type, je)   \
+    M(kind, type, jne)  \
+    M(kind, type, jl)   \
+    M(kind, type, jle)  \
+    M(kind, type, jg)   \
+    M(kind, type, jge)
+
+//////////////////////////////////////////////////////////////
+
+namespace jlang {
+
+//
+// The condition of a typed compare, CondType is vmCondType::Type. The
+// condition is a template argument, so the handlers never switch on it.
+//
+template <int CondType>
+struct vmCond;
+
+template <>
+struct vmCond<vmCondType::jz> {
+    template <typename T>
+    JM_FORCEINLINE static bool test(T v1, T v2) { return (v1 == 0 && v2 == 0); }
+};
+
+template <>
+struct vmCond<vmCondType::jnz> {
+    template <typename T>
+    JM_FORCEINLINE static bool test(T v1, T v2) { return (v1 != 0 && v2 != 0); }
+};
+
+template <>
+struct vmCond<vmCondType::je> {
+    template <typename T>
+    JM_FORCEINLINE static bool test(T v1, T v2) { return (v1 == v2); }
+};
+
+template <>
+struct vmCond<vmCondType::jne> {
+    template <typename T>
+    JM_FORCEINLINE static bool test(T v1, T v2) { return (v1 != v2); }
+};
+
+template <>
+struct vmCond<vmCondType::jl> {
+    template <typename T>
+    JM_FORCEINLINE static bool test(T v1, T v2) { return (v1 < v2); }
+};
+
+template <>
+struct vmCond<vmCondType::jle> {
+    template <typename T>
+    JM_FORCEINLINE static bool test(T v1, T v2) { return (v1 <= v2); }
+};
+
+template <>
+struct vmCond<vmCondType::jg> {
+    template <typename T>
+    JM_FORCEINLINE static bool test(T v1, T v2) { return (v1 > v2); }
+};
+
+template <>
+struct vmCond<vmCondType::jge> {
+    template <typename T>
+    JM_FORCEINLINE static bool test(T v1, T v2) { return (v1 >= v2); }
+};
+
+//
+// The typed compare, T carries the width and the signedness.
+//
+template <typename T, int CondType>
+JM_FORCEINLINE bool op_cmp(T v1, T v2) {
+    return vmCond<CondType>::template test<T>(v1, v2);
+}
+
+//
+// Get the vmCondType of the condition jump opcode, return vmCondType::last
+// if it's not a condition jump. It's only called when the image is loaded
+// or quickened, never on the hot path.
+//
+static inline uint8_t getCondType(uint8_t condJmp) {
+    switch (condJmp) {
+    case OpCode::jz:
+        return vmCondType::jz;
+    case OpCode::jnz:
+        return vmCondType::jnz;
+    case OpCode::je:
+        return vmCondType::je;
+    case OpCode::jne:
+        return vmCondType::jne;
+    case OpCode::jl:
+    case OpCode::jl_near:
+    case OpCode::jl_short:
+    case OpCode::jl_long:
+        return vmCondType::jl;
+    case OpCode::jle:
+    case OpCode::jle_short:
+        return vmCondType::jle;
+    case OpCode::jg:
+        return vmCondType::jg;
+    case OpCode::jge:
+        return vmCondType::jge;
+    default:
+        return vmCondType::last;
+    }
+}
+
+} // namespace jlang
+
+#endif // JLANG_VM_TYPEDOPS_H
@@ -0,0 +1,1030 @@
+#ifndef JLANG_VM_VECTOROPS_H
+#define JLANG_VM_VECTOROPS_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+#include "jlang/vm/Interpreter.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+#include <assert.h>
+
+#include <type_traits>
+
+//////////////////////////////////////////////////////////////
+
+/* Use the SIMD kernels for the vector opcodes ? Otherwise only the scalar kernels are used. */
+#ifndef USE_VECTOR_SIMD
+#define USE_VECTOR_SIMD         1
+#endif
+
+#if USE_VECTOR_SIMD
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64) \
+ || (defined(_M_IX86_FP) && (_M_IX86_FP >= 2))
+#define JLANG_VM_SIMD_SSE2      1
+#endif
+#if defined(__AVX2__)
+#define JLANG_VM_SIMD_AVX2      1
+#endif
+#if defined(__AVX512F__)
+#define JLANG_VM_SIMD_AVX512    1
+#endif
+#endif // USE_VECTOR_SIMD
+
+#ifndef JLANG_VM_SIMD_SSE2
+#define JLANG_VM_SIMD_SSE2      0
+#endif
+#ifndef JLANG_VM_SIMD_AVX2
+#define JLANG_VM_SIMD_AVX2      0
+#endif
+#ifndef JLANG_VM_SIMD_AVX512
+#define JLANG_VM_SIMD_AVX512    0
+#endif
+
+#if JLANG_VM_SIMD_SSE2
+#include <emmintrin.h>
+#endif
+#if JLANG_VM_SIMD_AVX2 || JLANG_VM_SIMD_AVX512
+#include <immintrin.h>
+#endif
+
+//////////////////////////////////////////////////////////////
+
+namespace jlang {
+
+//
+// The lane type of the vector opcodes.
+//
+struct vmLaneType {
+    enum Type {
+        Int32,
+        UInt32,
+        Int64,
+        UInt64,
+        Float32,
+        Float64,
+        Last
+    };
+
+    static size_t getSize(uint32_t laneType) {
+        return (laneType == Int32 || laneType == UInt32 || laneType == Float32) ? 4 : 8;
+    }
+};
+
+//
+// The lane-wise operation of valu, and the horizontal operation of vreduce.
+// And, Or and Xor are bitwise, they ignore the lane type.
+//
+struct vmVecOp {
+    enum Type {
+        Add,
+        Sub,
+        Mul,
+        Min,
+        Max,
+        And,
+        Or,
+        Xor,
+        Last
+    };
+};
+
+//
+// The lane-wise condition of vcmp, the lanes that meet the condition are set
+// to all ones, the others are set to zero. The float compares are ordered,
+// except Ne is true if any operand is NaN.
+//
+struct vmVecCmp {
+    enum Type {
+        Eq,
+        Ne,
+        Lt,
+        Le,
+        Gt,
+        Ge,
+        Last
+    };
+};
+
+//
+// A vector register, r128 (xmm), r256 (ymm) and r512 (zmm) of the same index
+// share the low bytes. An instruction only writes the bytes of its width,
+// the upper bytes are kept.
+//
+// The storage isn't aligned, the kernels always use the unaligned loads and
+// stores.
+//
+struct vmVector {
+    union {
+        uint8_t     u8[64];
+        int32_t     i32[16];
+        uint32_t    u32[16];
+        int64_t     i64[8];
+        uint64_t    u64[8];
+        float       f32[16];
+        double      f64[8];
+    };
+};
+
+class vmVectorRegs {
+private:
+    vmVector regs_[vmReg::kMaxRegs];
+
+public:
+    vmVectorRegs() { clear(); }
+    ~vmVectorRegs() {}
+
+    void clear() {
+        memset((void *)&regs_[0], 0, sizeof(regs_));
+    }
+
+    static bool isVectorReg(reg_t reg) {
+        uint32_t regType = vmReg::getType(reg);
+        return (regType >= vmRegType::r128 && regType <= vmRegType::r512);
+    }
+
+    // The bytes of the vector register, 16, 32 or 64.
+    static size_t getBytes(reg_t reg) {
+        assert(isVectorReg(reg));
+        return ((size_t)16 << (vmReg::getType(reg) - vmRegType::r128));
+    }
+
+    uint8_t * get(reg_t reg) {
+        return &regs_[vmReg::getIndex(reg)].u8[0];
+    }
+};
+
+namespace detail {
+
+template <typename T>
+JM_FORCEINLINE T getLane(const uint8_t * v, size_t i) {
+    T value;
+    memcpy(&value, v + i * sizeof(T), sizeof(T));
+    return value;
+}
+
+template <typename T>
+JM_FORCEINLINE void putLane(uint8_t * v, size_t i, T value) {
+    memcpy(v + i * sizeof(T), &value, sizeof(T));
+}
+
+//
+// The scalar kernels, they support every operation and every lane type.
+// The integer Add, Sub and Mul wrap around, they always run unsigned.
+//
+template <typename T, int Op>
+struct vmLaneOp;
+
+template <typename T>
+struct vmLaneOp<T, vmVecOp::Add> {
+    static JM_FORCEINLINE T apply(T a, T b) { return (T)(a + b); }
+};
+
+template <typename T>
+struct vmLaneOp<T, vmVecOp::Sub> {
+    static JM_FORCEINLINE T apply(T a, T b) { return (T)(a - b); }
+};
+
+template <typename T>
+struct vmLaneOp<T, vmVecOp::Mul> {
+    static JM_FORCEINLINE T apply(T a, T b) { return (T)(a * b); }
+};
+
+template <typename T>
+struct vmLaneOp<T, vmVecOp::Min> {
+    static JM_FORCEINLINE T apply(T a, T b) { return (a < b) ? a : b; }
+};
+
+template <typename T>
+struct vmLaneOp<T, vmVecOp::Max> {
+    static JM_FORCEINLINE T apply(T a, T b) { return (a > b) ? a : b; }
+};
+
+template <typename T>
+struct vmLaneOp<T, vmVecOp::And> {
+    static JM_FORCEINLINE T apply(T a, T b) { return (T)(a & b); }
+};
+
+template <typename T>
+struct vmLaneOp<T, vmVecOp::Or> {
+    static JM_FORCEINLINE T apply(T a, T b) { return (T)(a | b); }
+};
+
+template <typename T>
+struct vmLaneOp<T, vmVecOp::Xor> {
+    static JM_FORCEINLINE T apply(T a, T b) { return (T)(a ^ b); }
+};
+
+template <typename T, int Op>
+static void scalarAluLanes(uint8_t * d, const uint8_t * a, const uint8_t * b, size_t bytes) {
+    size_t lanes = bytes / sizeof(T);
+    for (size_t i = 0; i < lanes; ++i) {
+        putLane<T>(d, i, vmLaneOp<T, Op>::apply(getLane<T>(a, i), getLane<T>(b, i)));
+    }
+}
+
+template <typename T>
+static void scalarAlu(uint32_t op, uint8_t * d, const uint8_t * a, const uint8_t * b, size_t bytes) {
+    switch (op) {
+    case vmVecOp::Add: scalarAluLanes<T, vmVecOp::Add>(d, a, b, bytes); break;
+    case vmVecOp::Sub: scalarAluLanes<T, vmVecOp::Sub>(d, a, b, bytes); break;
+    case vmVecOp::Mul: scalarAluLanes<T, vmVecOp::Mul>(d, a, b, bytes); break;
+    case vmVecOp::Min: scalarAluLanes<T, vmVecOp::Min>(d, a, b, bytes); break;
+    case vmVecOp::Max: scalarAluLanes<T, vmVecOp::Max>(d, a, b, bytes); break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+static void scalarBitwise(uint32_t op, uint8_t * d, const uint8_t * a, const uint8_t * b, size_t bytes) {
+    switch (op) {
+    case vmVecOp::And: scalarAluLanes<uint64_t, vmVecOp::And>(d, a, b, bytes); break;
+    case vmVecOp::Or:  scalarAluLanes<uint64_t, vmVecOp::Or >(d, a, b, bytes); break;
+    case vmVecOp::Xor: scalarAluLanes<uint64_t, vmVecOp::Xor>(d, a, b, bytes); break;
+    default:
+        assert(false);
+        break;
+    }
+}
+
+template <typename T, typename U>
+static void scalarCmp(uint32_t cond, uint8_t * d, const uint8_t * a, const uint8_t * b, size_t bytes) {
+    size_t lanes = bytes / sizeof(T);
+    for (size_t i = 0; i < lanes; ++i) {
+        T v1 = getLane<T>(a, i);
+        T v2 = getLane<T>(b, i);
+        bool result;
+        switch (cond) {
+        case vmVecCmp::Eq: result = (v1 == v2); break;
+        case vmVecCmp::Ne: result = (v1 != v2); break;
+        case vmVecCmp::Lt: result = (v1 <  v2); break;
+        case vmVecCmp::Le: result = (v1 <= v2); break;
+        case vmVecCmp::Gt: result = (v1 >  v2); break;
+        case vmVecCmp::Ge: result = (v1 >= v2); break;
+        default:
+            assert(false);
+            result = false;
+            break;
+        }
+        putLane<U>(d, i, result ? (U)~(U)0 : (U)0);
+    }
+}
+
+template <typename U>
+static void scalarShuffle(uint8_t * d, const uint8_t * a, const uint8_t * idx, size_t bytes) {
+    uint8_t src[64];
+    memcpy(src, a, bytes);
+    size_t lanes = bytes / sizeof(U);
+    for (size_t i = 0; i < lanes; ++i) {
+        size_t index = (size_t)(getLane<U>(idx, i) % lanes);
+        putLane<U>(d, i, getLane<U>(src, index));
+    }
+}
+
+//
+// The SIMD kernels of one chunk, alu() and cmp() return false if the
+// operation of the lane type has no kernel, then nothing is written.
+//
+#if JLANG_VM_SIMD_SSE2
+
+struct vmSimdSSE2 {
+    static const size_t kBytes = 16;
+
+    static JM_FORCEINLINE __m128i cmpMask(__m128i mask, bool invert) {
+        return invert ? _mm_xor_si128(mask, _mm_set1_epi32(-1)) : mask;
+    }
+
+    static JM_FORCEINLINE bool alu(uint32_t op, uint32_t lane, uint8_t * d,
+                                   const uint8_t * a, const uint8_t * b) {
+        __m128i va = _mm_loadu_si128((const __m128i *)a);
+        __m128i vb = _mm_loadu_si128((const __m128i *)b);
+        __m128 fa = _mm_castsi128_ps(va), fb = _mm_castsi128_ps(vb);
+        __m128d da = _mm_castsi128_pd(va), db = _mm_castsi128_pd(vb);
+        __m128i r;
+        switch (op) {
+        case vmVecOp::And: r = _mm_and_si128(va, vb); break;
+        case vmVecOp::Or:  r = _mm_or_si128(va, vb);  break;
+        case vmVecOp::Xor: r = _mm_xor_si128(va, vb); break;
+        case vmVecOp::Add:
+            switch (lane) {
+            case vmLaneType::Int32:
+            case vmLaneType::UInt32:  r = _mm_add_epi32(va, vb); break;
+            case vmLaneType::Int64:
+            case vmLaneType::UInt64:  r = _mm_add_epi64(va, vb); break;
+            case vmLaneType::Float32: r = _mm_castps_si128(_mm_add_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm_castpd_si128(_mm_add_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Sub:
+            switch (lane) {
+            case vmLaneType::Int32:
+            case vmLaneType::UInt32:  r = _mm_sub_epi32(va, vb); break;
+            case vmLaneType::Int64:
+            case vmLaneType::UInt64:  r = _mm_sub_epi64(va, vb); break;
+            case vmLaneType::Float32: r = _mm_castps_si128(_mm_sub_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm_castpd_si128(_mm_sub_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Mul:
+            switch (lane) {
+            case vmLaneType::Float32: r = _mm_castps_si128(_mm_mul_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm_castpd_si128(_mm_mul_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Min:
+            switch (lane) {
+            case vmLaneType::Float32: r = _mm_castps_si128(_mm_min_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm_castpd_si128(_mm_min_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Max:
+            switch (lane) {
+            case vmLaneType::Float32: r = _mm_castps_si128(_mm_max_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm_castpd_si128(_mm_max_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        default:
+            return false;
+        }
+        _mm_storeu_si128((__m128i *)d, r);
+        return true;
+    }
+
+    static JM_FORCEINLINE bool cmp(uint32_t cond, uint32_t lane, uint8_t * d,
+                                   const uint8_t * a, const uint8_t * b) {
+        __m128i va = _mm_loadu_si128((const __m128i *)a);
+        __m128i vb = _mm_loadu_si128((const __m128i *)b);
+        __m128i r;
+        switch (lane) {
+        case vmLaneType::UInt32:
+            va = _mm_xor_si128(va, _mm_set1_epi32((int)0x80000000));
+            vb = _mm_xor_si128(vb, _mm_set1_epi32((int)0x80000000));
+            // Fall through
+        case vmLaneType::Int32:
+            switch (cond) {
+            case vmVecCmp::Eq: r = _mm_cmpeq_epi32(va, vb); break;
+            case vmVecCmp::Ne: r = cmpMask(_mm_cmpeq_epi32(va, vb), true); break;
+            case vmVecCmp::Lt: r = _mm_cmplt_epi32(va, vb); break;
+            case vmVecCmp::Le: r = cmpMask(_mm_cmpgt_epi32(va, vb), true); break;
+            case vmVecCmp::Gt: r = _mm_cmpgt_epi32(va, vb); break;
+            case vmVecCmp::Ge: r = cmpMask(_mm_cmplt_epi32(va, vb), true); break;
+            default: return false;
+            }
+            break;
+        case vmLaneType::Float32: {
+            __m128 fa = _mm_castsi128_ps(va), fb = _mm_castsi128_ps(vb);
+            __m128 fr;
+            switch (cond) {
+            case vmVecCmp::Eq: fr = _mm_cmpeq_ps(fa, fb);  break;
+            case vmVecCmp::Ne: fr = _mm_cmpneq_ps(fa, fb); break;
+            case vmVecCmp::Lt: fr = _mm_cmplt_ps(fa, fb);  break;
+            case vmVecCmp::Le: fr = _mm_cmple_ps(fa, fb);  break;
+            case vmVecCmp::Gt: fr = _mm_cmpgt_ps(fa, fb);  break;
+            case vmVecCmp::Ge: fr = _mm_cmpge_ps(fa, fb);  break;
+            default: return false;
+            }
+            r = _mm_castps_si128(fr);
+            break;
+        }
+        case vmLaneType::Float64: {
+            __m128d da = _mm_castsi128_pd(va), db = _mm_castsi128_pd(vb);
+            __m128d dr;
+            switch (cond) {
+            case vmVecCmp::Eq: dr = _mm_cmpeq_pd(da, db);  break;
+            case vmVecCmp::Ne: dr = _mm_cmpneq_pd(da, db); break;
+            case vmVecCmp::Lt: dr = _mm_cmplt_pd(da, db);  break;
+            case vmVecCmp::Le: dr = _mm_cmple_pd(da, db);  break;
+            case vmVecCmp::Gt: dr = _mm_cmpgt_pd(da, db);  break;
+            case vmVecCmp::Ge: dr = _mm_cmpge_pd(da, db);  break;
+            default: return false;
+            }
+            r = _mm_castpd_si128(dr);
+            break;
+        }
+        default:
+            return false;
+        }
+        _mm_storeu_si128((__m128i *)d, r);
+        return true;
+    }
+
+    static JM_FORCEINLINE void blend(uint8_t * d, const uint8_t * m,
+                                     const uint8_t * a, const uint8_t * b) {
+        __m128i vm = _mm_loadu_si128((const __m128i *)m);
+        __m128i va = _mm_loadu_si128((const __m128i *)a);
+        __m128i vb = _mm_loadu_si128((const __m128i *)b);
+        _mm_storeu_si128((__m128i *)d,
+                         _mm_or_si128(_mm_and_si128(vm, va), _mm_andnot_si128(vm, vb)));
+    }
+};
+
+#endif // JLANG_VM_SIMD_SSE2
+
+#if JLANG_VM_SIMD_AVX2
+
+struct vmSimdAVX2 {
+    static const size_t kBytes = 32;
+
+    static JM_FORCEINLINE __m256i cmpMask(__m256i mask, bool invert) {
+        return invert ? _mm256_xor_si256(mask, _mm256_set1_epi32(-1)) : mask;
+    }
+
+    static JM_FORCEINLINE bool alu(uint32_t op, uint32_t lane, uint8_t * d,
+                                   const uint8_t * a, const uint8_t * b) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)a);
+        __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+        __m256 fa = _mm256_castsi256_ps(va), fb = _mm256_castsi256_ps(vb);
+        __m256d da = _mm256_castsi256_pd(va), db = _mm256_castsi256_pd(vb);
+        __m256i r;
+        switch (op) {
+        case vmVecOp::And: r = _mm256_and_si256(va, vb); break;
+        case vmVecOp::Or:  r = _mm256_or_si256(va, vb);  break;
+        case vmVecOp::Xor: r = _mm256_xor_si256(va, vb); break;
+        case vmVecOp::Add:
+            switch (lane) {
+            case vmLaneType::Int32:
+            case vmLaneType::UInt32:  r = _mm256_add_epi32(va, vb); break;
+            case vmLaneType::Int64:
+            case vmLaneType::UInt64:  r = _mm256_add_epi64(va, vb); break;
+            case vmLaneType::Float32: r = _mm256_castps_si256(_mm256_add_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm256_castpd_si256(_mm256_add_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Sub:
+            switch (lane) {
+            case vmLaneType::Int32:
+            case vmLaneType::UInt32:  r = _mm256_sub_epi32(va, vb); break;
+            case vmLaneType::Int64:
+            case vmLaneType::UInt64:  r = _mm256_sub_epi64(va, vb); break;
+            case vmLaneType::Float32: r = _mm256_castps_si256(_mm256_sub_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm256_castpd_si256(_mm256_sub_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Mul:
+            switch (lane) {
+            case vmLaneType::Int32:
+            case vmLaneType::UInt32:  r = _mm256_mullo_epi32(va, vb); break;
+            case vmLaneType::Float32: r = _mm256_castps_si256(_mm256_mul_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm256_castpd_si256(_mm256_mul_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Min:
+            switch (lane) {
+            case vmLaneType::Int32:   r = _mm256_min_epi32(va, vb); break;
+            case vmLaneType::UInt32:  r = _mm256_min_epu32(va, vb); break;
+            case vmLaneType::Float32: r = _mm256_castps_si256(_mm256_min_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm256_castpd_si256(_mm256_min_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Max:
+            switch (lane) {
+            case vmLaneType::Int32:   r = _mm256_max_epi32(va, vb); break;
+            case vmLaneType::UInt32:  r = _mm256_max_epu32(va, vb); break;
+            case vmLaneType::Float32: r = _mm256_castps_si256(_mm256_max_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm256_castpd_si256(_mm256_max_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        default:
+            return false;
+        }
+        _mm256_storeu_si256((__m256i *)d, r);
+        return true;
+    }
+
+    static JM_FORCEINLINE bool cmp(uint32_t cond, uint32_t lane, uint8_t * d,
+                                   const uint8_t * a, const uint8_t * b) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)a);
+        __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+        __m256i r;
+        switch (lane) {
+        case vmLaneType::UInt32:
+            va = _mm256_xor_si256(va, _mm256_set1_epi32((int)0x80000000));
+            vb = _mm256_xor_si256(vb, _mm256_set1_epi32((int)0x80000000));
+            // Fall through
+        case vmLaneType::Int32:
+            switch (cond) {
+            case vmVecCmp::Eq: r = _mm256_cmpeq_epi32(va, vb); break;
+            case vmVecCmp::Ne: r = cmpMask(_mm256_cmpeq_epi32(va, vb), true); break;
+            case vmVecCmp::Lt: r = _mm256_cmpgt_epi32(vb, va); break;
+            case vmVecCmp::Le: r = cmpMask(_mm256_cmpgt_epi32(va, vb), true); break;
+            case vmVecCmp::Gt: r = _mm256_cmpgt_epi32(va, vb); break;
+            case vmVecCmp::Ge: r = cmpMask(_mm256_cmpgt_epi32(vb, va), true); break;
+            default: return false;
+            }
+            break;
+        case vmLaneType::UInt64:
+            va = _mm256_xor_si256(va, _mm256_set1_epi64x((long long)0x8000000000000000ULL));
+            vb = _mm256_xor_si256(vb, _mm256_set1_epi64x((long long)0x8000000000000000ULL));
+            // Fall through
+        case vmLaneType::Int64:
+            switch (cond) {
+            case vmVecCmp::Eq: r = _mm256_cmpeq_epi64(va, vb); break;
+            case vmVecCmp::Ne: r = cmpMask(_mm256_cmpeq_epi64(va, vb), true); break;
+            case vmVecCmp::Lt: r = _mm256_cmpgt_epi64(vb, va); break;
+            case vmVecCmp::Le: r = cmpMask(_mm256_cmpgt_epi64(va, vb), true); break;
+            case vmVecCmp::Gt: r = _mm256_cmpgt_epi64(va, vb); break;
+            case vmVecCmp::Ge: r = cmpMask(_mm256_cmpgt_epi64(vb, va), true); break;
+            default: return false;
+            }
+            break;
+        case vmLaneType::Float32: {
+            __m256 fa = _mm256_castsi256_ps(va), fb = _mm256_castsi256_ps(vb);
+            __m256 fr;
+            switch (cond) {
+            case vmVecCmp::Eq: fr = _mm256_cmp_ps(fa, fb, _CMP_EQ_OQ);  break;
+            case vmVecCmp::Ne: fr = _mm256_cmp_ps(fa, fb, _CMP_NEQ_UQ); break;
+            case vmVecCmp::Lt: fr = _mm256_cmp_ps(fa, fb, _CMP_LT_OQ);  break;
+            case vmVecCmp::Le: fr = _mm256_cmp_ps(fa, fb, _CMP_LE_OQ);  break;
+            case vmVecCmp::Gt: fr = _mm256_cmp_ps(fa, fb, _CMP_GT_OQ);  break;
+            case vmVecCmp::Ge: fr = _mm256_cmp_ps(fa, fb, _CMP_GE_OQ);  break;
+            default: return false;
+            }
+            r = _mm256_castps_si256(fr);
+            break;
+        }
+        case vmLaneType::Float64: {
+            __m256d da = _mm256_castsi256_pd(va), db = _mm256_castsi256_pd(vb);
+            __m256d dr;
+            switch (cond) {
+            case vmVecCmp::Eq: dr = _mm256_cmp_pd(da, db, _CMP_EQ_OQ);  break;
+            case vmVecCmp::Ne: dr = _mm256_cmp_pd(da, db, _CMP_NEQ_UQ); break;
+            case vmVecCmp::Lt: dr = _mm256_cmp_pd(da, db, _CMP_LT_OQ);  break;
+            case vmVecCmp::Le: dr = _mm256_cmp_pd(da, db, _CMP_LE_OQ);  break;
+            case vmVecCmp::Gt: dr = _mm256_cmp_pd(da, db, _CMP_GT_OQ);  break;
+            case vmVecCmp::Ge: dr = _mm256_cmp_pd(da, db, _CMP_GE_OQ);  break;
+            default: return false;
+            }
+            r = _mm256_castpd_si256(dr);
+            break;
+        }
+        default:
+            return false;
+        }
+        _mm256_storeu_si256((__m256i *)d, r);
+        return true;
+    }
+
+    static JM_FORCEINLINE void blend(uint8_t * d, const uint8_t * m,
+                                     const uint8_t * a, const uint8_t * b) {
+        __m256i vm = _mm256_loadu_si256((const __m256i *)m);
+        __m256i va = _mm256_loadu_si256((const __m256i *)a);
+        __m256i vb = _mm256_loadu_si256((const __m256i *)b);
+        _mm256_storeu_si256((__m256i *)d,
+                            _mm256_or_si256(_mm256_and_si256(vm, va), _mm256_andnot_si256(vm, vb)));
+    }
+
+    // The 32-bit lanes of a 256-bit register, the index is taken modulo 8.
+    static JM_FORCEINLINE void shuffle32(uint8_t * d, const uint8_t * a, const uint8_t * idx) {
+        __m256i va = _mm256_loadu_si256((const __m256i *)a);
+        __m256i vi = _mm256_loadu_si256((const __m256i *)idx);
+        _mm256_storeu_si256((__m256i *)d, _mm256_permutevar8x32_epi32(va, vi));
+    }
+};
+
+#endif // JLANG_VM_SIMD_AVX2
+
+#if JLANG_VM_SIMD_AVX512
+
+struct vmSimdAVX512 {
+    static const size_t kBytes = 64;
+
+    // The unmasked min, max and permute of gcc pass an undefined source
+    // vector that -Wmaybe-uninitialized reports. The zero-masked forms with
+    // every lane set take a zeroed source and compile to the same instructions.
+    static const __mmask16 kAll16 = 0xFFFF;
+    static const __mmask8  kAll8 = 0xFF;
+
+    static JM_FORCEINLINE __m512i mask32(__mmask16 k) {
+        return _mm512_maskz_mov_epi32(k, _mm512_set1_epi32(-1));
+    }
+
+    static JM_FORCEINLINE __m512i mask64(__mmask8 k) {
+        return _mm512_maskz_mov_epi64(k, _mm512_set1_epi32(-1));
+    }
+
+    // The predicate of the integer compare must be an immediate.
+    template <typename T>
+    static JM_FORCEINLINE __mmask16 cmpInt(uint32_t cond, __m512i va, __m512i vb) {
+#define VM_AVX512_CMP_INT(pred) \
+        (sizeof(T) == sizeof(uint32_t) ? \
+            (std::is_signed<T>::value ? _mm512_cmp_epi32_mask(va, vb, pred) \
+                                      : _mm512_cmp_epu32_mask(va, vb, pred)) : \
+            (__mmask16)(std::is_signed<T>::value ? _mm512_cmp_epi64_mask(va, vb, pred) \
+                                                 : _mm512_cmp_epu64_mask(va, vb, pred)))
+        switch (cond) {
+        case vmVecCmp::Eq: return VM_AVX512_CMP_INT(_MM_CMPINT_EQ);
+        case vmVecCmp::Ne: return VM_AVX512_CMP_INT(_MM_CMPINT_NE);
+        case vmVecCmp::Lt: return VM_AVX512_CMP_INT(_MM_CMPINT_LT);
+        case vmVecCmp::Le: return VM_AVX512_CMP_INT(_MM_CMPINT_LE);
+        case vmVecCmp::Gt: return VM_AVX512_CMP_INT(_MM_CMPINT_NLE);
+        default:           return VM_AVX512_CMP_INT(_MM_CMPINT_NLT);
+        }
+#undef VM_AVX512_CMP_INT
+    }
+
+    static JM_FORCEINLINE bool alu(uint32_t op, uint32_t lane, uint8_t * d,
+                                   const uint8_t * a, const uint8_t * b) {
+        __m512i va = _mm512_loadu_si512((const void *)a);
+        __m512i vb = _mm512_loadu_si512((const void *)b);
+        __m512 fa = _mm512_castsi512_ps(va), fb = _mm512_castsi512_ps(vb);
+        __m512d da = _mm512_castsi512_pd(va), db = _mm512_castsi512_pd(vb);
+        __m512i r;
+        switch (op) {
+        case vmVecOp::And: r = _mm512_and_si512(va, vb); break;
+        case vmVecOp::Or:  r = _mm512_or_si512(va, vb);  break;
+        case vmVecOp::Xor: r = _mm512_xor_si512(va, vb); break;
+        case vmVecOp::Add:
+            switch (lane) {
+            case vmLaneType::Int32:
+            case vmLaneType::UInt32:  r = _mm512_add_epi32(va, vb); break;
+            case vmLaneType::Int64:
+            case vmLaneType::UInt64:  r = _mm512_add_epi64(va, vb); break;
+            case vmLaneType::Float32: r = _mm512_castps_si512(_mm512_add_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm512_castpd_si512(_mm512_add_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Sub:
+            switch (lane) {
+            case vmLaneType::Int32:
+            case vmLaneType::UInt32:  r = _mm512_sub_epi32(va, vb); break;
+            case vmLaneType::Int64:
+            case vmLaneType::UInt64:  r = _mm512_sub_epi64(va, vb); break;
+            case vmLaneType::Float32: r = _mm512_castps_si512(_mm512_sub_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm512_castpd_si512(_mm512_sub_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Mul:
+            switch (lane) {
+            case vmLaneType::Int32:
+            case vmLaneType::UInt32:  r = _mm512_mullo_epi32(va, vb); break;
+            case vmLaneType::Float32: r = _mm512_castps_si512(_mm512_mul_ps(fa, fb)); break;
+            case vmLaneType::Float64: r = _mm512_castpd_si512(_mm512_mul_pd(da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Min:
+            switch (lane) {
+            case vmLaneType::Int32:   r = _mm512_maskz_min_epi32(kAll16, va, vb); break;
+            case vmLaneType::UInt32:  r = _mm512_maskz_min_epu32(kAll16, va, vb); break;
+            case vmLaneType::Int64:   r = _mm512_maskz_min_epi64(kAll8, va, vb); break;
+            case vmLaneType::UInt64:  r = _mm512_maskz_min_epu64(kAll8, va, vb); break;
+            case vmLaneType::Float32: r = _mm512_castps_si512(_mm512_maskz_min_ps(kAll16, fa, fb)); break;
+            case vmLaneType::Float64: r = _mm512_castpd_si512(_mm512_maskz_min_pd(kAll8, da, db)); break;
+            default: return false;
+            }
+            break;
+        case vmVecOp::Max:
+            switch (lane) {
+            case vmLaneType::Int32:   r = _mm512_maskz_max_epi32(kAll16, va, vb); break;
+            case vmLaneType::UInt32:  r = _mm512_maskz_max_epu32(kAll16, va, vb); break;
+            case vmLaneType::Int64:   r = _mm512_maskz_max_epi64(kAll8, va, vb); break;
+            case vmLaneType::UInt64:  r = _mm512_maskz_max_epu64(kAll8, va, vb); break;
+            case vmLaneType::Float32: r = _mm512_castps_si512(_mm512_maskz_max_ps(kAll16, fa, fb)); break;
+            case vmLaneType::Float64: r = _mm512_castpd_si512(_mm512_maskz_max_pd(kAll8, da, db)); break;
+            default: return false;
+            }
+            break;
+        default:
+            return false;
+        }
+        _mm512_storeu_si512((void *)d, r);
+        return true;
+    }
+
+    static JM_FORCEINLINE bool cmp(uint32_t cond, uint32_t lane, uint8_t * d,
+                                   const uint8_t * a, const uint8_t * b) {
+        __m512i va = _mm512_loadu_si512((const void *)a);
+        __m512i vb = _mm512_loadu_si512((const void *)b);
+        __m512i r;
+        switch (lane) {
+        case vmLaneType::Int32:
+            r = mask32(cmpInt<int32_t>(cond, va, vb));
+            break;
+        case vmLaneType::UInt32:
+            r = mask32(cmpInt<uint32_t>(cond, va, vb));
+            break;
+        case vmLaneType::Int64:
+            r = mask64((__mmask8)cmpInt<int64_t>(cond, va, vb));
+            break;
+        case vmLaneType::UInt64:
+            r = mask64((__mmask8)cmpInt<uint64_t>(cond, va, vb));
+            break;
+        case vmLaneType::Float32: {
+            __m512 fa = _mm512_castsi512_ps(va), fb = _mm512_castsi512_ps(vb);
+            __mmask16 k;
+            switch (cond) {
+            case vmVecCmp::Eq: k = _mm512_cmp_ps_mask(fa, fb, _CMP_EQ_OQ);  break;
+            case vmVecCmp::Ne: k = _mm512_cmp_ps_mask(fa, fb, _CMP_NEQ_UQ); break;
+            case vmVecCmp::Lt: k = _mm512_cmp_ps_mask(fa, fb, _CMP_LT_OQ);  break;
+            case vmVecCmp::Le: k = _mm512_cmp_ps_mask(fa, fb, _CMP_LE_OQ);  break;
+            case vmVecCmp::Gt: k = _mm512_cmp_ps_mask(fa, fb, _CMP_GT_OQ);  break;
+            default:           k = _mm512_cmp_ps_mask(fa, fb, _CMP_GE_OQ);  break;
+            }
+            r = mask32(k);
+            break;
+        }
+        case vmLaneType::Float64: {
+            __m512d da = _mm512_castsi512_pd(va), db = _mm512_castsi512_pd(vb);
+            __mmask8 k;
+            switch (cond) {
+            case vmVecCmp::Eq: k = _mm512_cmp_pd_mask(da, db, _CMP_EQ_OQ);  break;
+            case vmVecCmp::Ne: k = _mm512_cmp_pd_mask(da, db, _CMP_NEQ_UQ); break;
+            case vmVecCmp::Lt: k = _mm512_cmp_pd_mask(da, db, _CMP_LT_OQ);  break;
+            case vmVecCmp::Le: k = _mm512_cmp_pd_mask(da, db, _CMP_LE_OQ);  break;
+            case vmVecCmp::Gt: k = _mm512_cmp_pd_mask(da, db, _CMP_GT_OQ);  break;
+            default:           k = _mm512_cmp_pd_mask(da, db, _CMP_GE_OQ);  break;
+            }
+            r = mask64(k);
+            break;
+        }
+        default:
+            return false;
+        }
+        _mm512_storeu_si512((void *)d, r);
+        return true;
+    }
+
+    static JM_FORCEINLINE void blend(uint8_t * d, const uint8_t * m,
+                                     const uint8_t * a, const uint8_t * b) {
+        __m512i vm = _mm512_loadu_si512((const void *)m);
+        __m512i va = _mm512_loadu_si512((const void *)a);
+        __m512i vb = _mm512_loadu_si512((const void *)b);
+        // The bitwise select m ? a : b.
+        _mm512_storeu_si512((void *)d, _mm512_ternarylogic_epi64(vm, va, vb, 0xCA));
+    }
+
+    // The lanes of a 512-bit register, the index is taken modulo the lanes.
+    static JM_FORCEINLINE void shuffle32(uint8_t * d, const uint8_t * a, const uint8_t * idx) {
+        __m512i va = _mm512_loadu_si512((const void *)a);
+        __m512i vi = _mm512_loadu_si512((const void *)idx);
+        _mm512_storeu_si512((void *)d, _mm512_maskz_permutexvar_epi32(kAll16, vi, va));
+    }
+
+    static JM_FORCEINLINE void shuffle64(uint8_t * d, const uint8_t * a, const uint8_t * idx) {
+        __m512i va = _mm512_loadu_si512((const void *)a);
+        __m512i vi = _mm512_loadu_si512((const void *)idx);
+        _mm512_storeu_si512((void *)d, _mm512_maskz_permutexvar_epi64(kAll8, vi, va));
+    }
+};
+
+#endif // JLANG_VM_SIMD_AVX512
+
+//
+// Run the kernel of Simd on every chunk, return false if the bytes is not
+// a multiple of the chunk or the operation has no kernel.
+//
+template <typename Simd>
+JM_FORCEINLINE bool simdAlu(uint32_t op, uint32_t lane, uint8_t * d,
+                            const uint8_t * a, const uint8_t * b, size_t bytes) {
+    if (bytes < Simd::kBytes || (bytes % Simd::kBytes) != 0)
+        return false;
+    if (!Simd::alu(op, lane, d, a, b))
+        return false;
+    for (size_t offset = Simd::kBytes; offset < bytes; offset += Simd::kBytes) {
+        Simd::alu(op, lane, d + offset, a + offset, b + offset);
+    }
+    return true;
+}
+
+template <typename Simd>
+JM_FORCEINLINE bool simdCmp(uint32_t cond, uint32_t lane, uint8_t * d,
+                            const uint8_t * a, const uint8_t * b, size_t bytes) {
+    if (bytes < Simd::kBytes || (bytes % Simd::kBytes) != 0)
+        return false;
+    if (!Simd::cmp(cond, lane, d, a, b))
+        return false;
+    for (size_t offset = Simd::kBytes; offset < bytes; offset += Simd::kBytes) {
+        Simd::cmp(cond, lane, d + offset, a + offset, b + offset);
+    }
+    return true;
+}
+
+template <typename Simd>
+JM_FORCEINLINE bool simdBlend(uint8_t * d, const uint8_t * m,
+                              const uint8_t * a, const uint8_t * b, size_t bytes) {
+    if (bytes < Simd::kBytes || (bytes % Simd::kBytes) != 0)
+        return false;
+    for (size_t offset = 0; offset < bytes; offset += Simd::kBytes) {
+        Simd::blend(d + offset, m + offset, a + offset, b + offset);
+    }
+    return true;
+}
+
+} // namespace detail
+
+//
+// The kernels of the vector opcodes. The operands are the bytes of the
+// vector registers, bytes is 16, 32 or 64 (or less for the reduction).
+//
+// The widest SIMD kernel that the target supports runs on every chunk of
+// the register, a 512-bit register runs as 2 AVX2 or 4 SSE2 chunks if the
+// AVX-512 is not enabled. The operations that have no SIMD kernel for the
+// lane type run the scalar kernel.
+//
+struct vmVectorOps {
+    static void alu(uint32_t op, uint32_t lane, uint8_t * d,
+                    const uint8_t * a, const uint8_t * b, size_t bytes) {
+#if JLANG_VM_SIMD_AVX512
+        if (detail::simdAlu<detail::vmSimdAVX512>(op, lane, d, a, b, bytes))
+            return;
+#endif
+#if JLANG_VM_SIMD_AVX2
+        if (detail::simdAlu<detail::vmSimdAVX2>(op, lane, d, a, b, bytes))
+            return;
+#endif
+#if JLANG_VM_SIMD_SSE2
+        if (detail::simdAlu<detail::vmSimdSSE2>(op, lane, d, a, b, bytes))
+            return;
+#endif
+        if (op == vmVecOp::And || op == vmVecOp::Or || op == vmVecOp::Xor) {
+            detail::scalarBitwise(op, d, a, b, bytes);
+            return;
+        }
+        switch (lane) {
+        case vmLaneType::Int32:
+            if (op == vmVecOp::Min || op == vmVecOp::Max)
+                detail::scalarAlu<int32_t>(op, d, a, b, bytes);
+            else
+                detail::scalarAlu<uint32_t>(op, d, a, b, bytes);
+            break;
+        case vmLaneType::UInt32:
+            detail::scalarAlu<uint32_t>(op, d, a, b, bytes);
+            break;
+        case vmLaneType::Int64:
+            if (op == vmVecOp::Min || op == vmVecOp::Max)
+                detail::scalarAlu<int64_t>(op, d, a, b, bytes);
+            else
+                detail::scalarAlu<uint64_t>(op, d, a, b, bytes);
+            break;
+        case vmLaneType::UInt64:
+            detail::scalarAlu<uint64_t>(op, d, a, b, bytes);
+            break;
+        case vmLaneType::Float32:
+            detail::scalarAlu<float>(op, d, a, b, bytes);
+            break;
+        case vmLaneType::Float64:
+            detail::scalarAlu<double>(op, d, a, b, bytes);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    }
+
+    static void cmp(uint32_t cond, uint32_t lane, uint8_t * d,
+                    const uint8_t * a, const uint8_t * b, size_t bytes) {
+#if JLANG_VM_SIMD_AVX512
+        if (detail::simdCmp<detail::vmSimdAVX512>(cond, lane, d, a, b, bytes))
+            return;
+#endif
+#if JLANG_VM_SIMD_AVX2
+        if (detail::simdCmp<detail::vmSimdAVX2>(cond, lane, d, a, b, bytes))
+            return;
+#endif
+#if JLANG_VM_SIMD_SSE2
+        if (detail::simdCmp<detail::vmSimdSSE2>(cond, lane, d, a, b, bytes))
+            return;
+#endif
+        switch (lane) {
+        case vmLaneType::Int32:
+            detail::scalarCmp<int32_t, uint32_t>(cond, d, a, b, bytes);
+            break;
+        case vmLaneType::UInt32:
+            detail::scalarCmp<uint32_t, uint32_t>(cond, d, a, b, bytes);
+            break;
+        case vmLaneType::Int64:
+            detail::scalarCmp<int64_t, uint64_t>(cond, d, a, b, bytes);
+            break;
+        case vmLaneType::UInt64:
+            detail::scalarCmp<uint64_t, uint64_t>(cond, d, a, b, bytes);
+            break;
+        case vmLaneType::Float32:
+            detail::scalarCmp<float, uint32_t>(cond, d, a, b, bytes);
+            break;
+        case vmLaneType::Float64:
+            detail::scalarCmp<double, uint64_t>(cond, d, a, b, bytes);
+            break;
+        default:
+            assert(false);
+            break;
+        }
+    }
+
+    //
+    // d = (m & a) | (~m & b), it's bitwise, so the mask of vcmp selects the
+    // whole lanes.
+    //
+    static void blend(uint8_t * d, const uint8_t * m,
+                      const uint8_t * a, const uint8_t * b, size_t bytes) {
+#if JLANG_VM_SIMD_AVX512
+        if (detail::simdBlend<detail::vmSimdAVX512>(d, m, a, b, bytes))
+            return;
+#endif
+#if JLANG_VM_SIMD_AVX2
+        if (detail::simdBlend<detail::vmSimdAVX2>(d, m, a, b, bytes))
+            return;
+#endif
+#if JLANG_VM_SIMD_SSE2
+        if (detail::simdBlend<detail::vmSimdSSE2>(d, m, a, b, bytes))
+            return;
+#endif
+        size_t lanes = bytes / sizeof(uint64_t);
+        for (size_t i = 0; i < lanes; ++i) {
+            uint64_t mask = detail::getLane<uint64_t>(m, i);
+            uint64_t value = (mask & detail::getLane<uint64_t>(a, i)) |
+                             (~mask & detail::getLane<uint64_t>(b, i));
+            detail::putLane<uint64_t>(d, i, value);
+        }
+    }
+
+    //
+    // d[i] = a[idx[i] % lanes], the index lanes are unsigned of the lane size.
+    //
+    static void shuffle(uint32_t lane, uint8_t * d, const uint8_t * a,
+                        const uint8_t * idx, size_t bytes) {
+        if (vmLaneType::getSize(lane) == sizeof(uint32_t)) {
+#if JLANG_VM_SIMD_AVX512
+            if (bytes == detail::vmSimdAVX512::kBytes) {
+                detail::vmSimdAVX512::shuffle32(d, a, idx);
+                return;
+            }
+#endif
+#if JLANG_VM_SIMD_AVX2
+            if (bytes == detail::vmSimdAVX2::kBytes) {
+                detail::vmSimdAVX2::shuffle32(d, a, idx);
+                return;
+            }
+#endif
+            detail::scalarShuffle<uint32_t>(d, a, idx, bytes);
+        }
+        else {
+#if JLANG_VM_SIMD_AVX512
+            if (bytes == detail::vmSimdAVX512::kBytes) {
+                detail::vmSimdAVX512::shuffle64(d, a, idx);
+                return;
+            }
+#endif
+            detail::scalarShuffle<uint64_t>(d, a, idx, bytes);
+        }
+    }
+
+    //
+    // Reduce the lanes by the operation, return the bits of the result lane.
+    // The halves are folded by the lane-wise kernel, so the float sum runs in
+    // pairwise order, not in the lane order.
+    //
+    static uint64_t reduce(uint32_t op, uint32_t lane, const uint8_t * a, size_t bytes) {
+        uint8_t temp[64];
+        assert(bytes <= sizeof(temp));
+        memset(temp, 0, sizeof(temp));
+        memcpy(temp, a, bytes);
+        size_t laneSize = vmLaneType::getSize(lane);
+        while (bytes > laneSize) {
+            bytes /= 2;
+            alu(op, lane, temp, temp, temp + bytes, bytes);
+        }
+        if (laneSize == sizeof(uint32_t))
+            return (uint64_t)detail::getLane<uint32_t>(temp, 0);
+        else
+            return detail::getLane<uint64_t>(temp, 0);
+    }
+
+    //
+    // Broadcast the low bits of the scalar to every lane.
+    //
+    static void splat(uint32_t lane, uint8_t * d, uint64_t value, size_t bytes) {
+        if (vmLaneType::getSize(lane) == sizeof(uint32_t)) {
+            size_t lanes = bytes / sizeof(uint32_t);
+            for (size_t i = 0; i < lanes; ++i) {
+                detail::putLane<uint32_t>(d, i, (uint32_t)value);
+            }
+        }
+        else {
+            size_t lanes = bytes / sizeof(uint64_t);
+            for (size_t i = 0; i < lanes; ++i) {
+                detail::putLane<uint64_t>(d, i, value);
+            }
+        }
+    }
+};
+
+} // namespace jlang
+
+#endif // JLANG_VM_VECTOROPS_H
@@ -0,0 +1,408 @@
+#ifndef JLANG_VM_VERIFIER_H
+#define JLANG_VM_VERIFIER_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/vm/Interpreter.h"
+#include "jlang/vm/PreDecoder.h"
+#include "jlang/vm/StackLayout.h"
+#include "jlang/lang/Error.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include <vector>
+#include <algorithm>
+
+namespace jlang {
+namespace v3 {
+
+//
+// The facts that proven by the Verifier.
+//
+struct vmVerifyInfo {
+    bool        verified;
+    size_t      funcCount;
+    // The max bytes of the stack slots of a function.
+    size_t      maxStackSize;
+    // The max bytes of a frame, include the stack slots and the frame header.
+    size_t      maxFrameSize;
+    // The bytes of the arguments that the entry reads, the host pushes them
+    // before the run, see ExecutionContext::pushArg().
+    size_t      entryArgSize;
+
+    vmVerifyInfo() {
+        clear();
+    }
+
+    void clear() {
+        verified = false;
+        funcCount = 0;
+        maxStackSize = 0;
+        maxFrameSize = 0;
+        entryArgSize = 0;
+    }
+};
+
+//
+// Verify the pre-decoded records before they run, a verified image can run
+// without the per-instruction bounds checks. The PreDecoder has checked the
+// instructions aren't truncated and the targets are on the instruction
+// boundaries, the Verifier checks that:
+//
+//   - Every reachable opcode has a handler, and a cmp is always followed
+//     by a condition jump.
+//   - No path runs off the end of image, and the call targets are aligned.
+//   - The stack depth of a record is same on all paths of a function, and
+//     never below the frame, so the max depth of a function is bounded.
+//   - The returns pop exactly the stack slots of the function.
+//   - The frame slot operands address a pushed slot or an argument, and the
+//     callers always push the arguments that the callee reads. The entry
+//     may be a function too, its arguments are pushed by the host, and
+//     their size is in the info.
+//
+class Verifier {
+private:
+    struct Function {
+        size_t                  entry;          // Index of the entry record
+        std::vector<int32_t>    depth;          // Stack depth of records, -1 is unreachable
+        int32_t                 maxDepth;
+        int32_t                 argCount;       // The count of arguments that read or written
+    };
+
+    const vmInstruction *   insns_;
+    size_t                  insnCount_;
+    bool                    isForward_;
+    int32_t                 frameHeaderSize_;
+    std::vector<Function>   funcs_;
+
+    static bool isCall(uint8_t opcode) {
+        return (opcode == OpCode::call || opcode == OpCode::call_near ||
+                opcode == OpCode::call_short || opcode == OpCode::call_long);
+    }
+
+    static bool isJump(uint8_t opcode) {
+        return (opcode == OpCode::jmp || opcode == OpCode::jmp_near ||
+                opcode == OpCode::jmp_short || opcode == OpCode::jmp_long);
+    }
+
+    static bool isCondJump(uint8_t opcode) {
+        return (opcode == OpCode::jl_near || opcode == OpCode::jl_short ||
+                opcode == OpCode::jl_long);
+    }
+
+    static bool isReturn(uint8_t opcode) {
+        return (opcode >= OpCode::ret && opcode <= OpCode::ret_eax_n);
+    }
+
+    static bool isFallThrough(uint8_t opcode) {
+        return !(isJump(opcode) || isReturn(opcode) || opcode == OpCode::exit);
+    }
+
+    // The opcodes that have a handler in all of the engines.
+    static bool isSupported(uint8_t opcode) {
+        switch (opcode) {
+        case OpCode::push:
+        case OpCode::push_i32:
+        case OpCode::push_i64:
+        case OpCode::push_i32_0:
+        case OpCode::push_i64_0:
+        case OpCode::pop:
+        case OpCode::pop_i32:
+        case OpCode::pop_i64:
+        case OpCode::add_sp:
+        case OpCode::add_sp_4:
+        case OpCode::load_eax:
+        case OpCode::store:
+        case OpCode::copy_from_eax:
+        case OpCode::cmp_i32:
+        case OpCode::cmp_u32:
+        case OpCode::cmp_imm_i32:
+        case OpCode::cmp_imm_u32:
+        case OpCode::nop:
+        case OpCode::nop_n:
+        case OpCode::inc:
+        case OpCode::dec:
+        case OpCode::add:
+        case OpCode::add_imm:
+        case OpCode::add_eax:
+        case OpCode::add_eax_imm:
+        case OpCode::sub:
+        case OpCode::sub_imm:
+        case OpCode::sub_eax:
+        case OpCode::sub_eax_imm:
+        case OpCode::exit:
+            return true;
+        default:
+            return (isCall(opcode) || isJump(opcode) || isCondJump(opcode) || isReturn(opcode));
+        }
+    }
+
+    // The count of the frame slot operands of the instruction.
+    static int getSlotCount(uint8_t opcode) {
+        switch (opcode) {
+        case OpCode::push:
+        case OpCode::store:
+        case OpCode::copy_from_eax:
+        case OpCode::cmp_imm_i32:
+        case OpCode::cmp_imm_u32:
+        case OpCode::inc:
+        case OpCode::dec:
+        case OpCode::add_imm:
+        case OpCode::add_eax:
+        case OpCode::sub_imm:
+        case OpCode::sub_eax:
+            return 1;
+        case OpCode::cmp_i32:
+        case OpCode::cmp_u32:
+        case OpCode::add:
+        case OpCode::sub:
+            return 2;
+        default:
+            return 0;
+        }
+    }
+
+    // The stack depth change of the instruction, in 32-bit slots.
+    static bool getDepthDelta(const vmInstruction & insn, int32_t & delta) {
+        switch (insn.opcode) {
+        case OpCode::push:
+        case OpCode::push_i32:
+        case OpCode::push_i32_0:
+        case OpCode::add_sp_4:
+            delta = 1;
+            return true;
+        case OpCode::push_i64:
+        case OpCode::push_i64_0:
+            delta = 2;
+            return true;
+        case OpCode::pop:
+        case OpCode::pop_i32:
+            delta = -1;
+            return true;
+        case OpCode::pop_i64:
+            delta = -2;
+            return true;
+        case OpCode::add_sp:
+            delta = insn.index / (int32_t)sizeof(uint32_t);
+            return ((insn.index % (int32_t)sizeof(uint32_t)) == 0);
+        default:
+            delta = 0;
+            return true;
+        }
+    }
+
+    //
+    // Check the frame slot index at the stack depth, an argument index
+    // updates the argument count of the function.
+    //
+    bool checkSlot(int32_t index, int32_t depth, int32_t & argCount) const {
+        int32_t frameHeaderSlots = frameHeaderSize_ / (int32_t)sizeof(uint32_t);
+        int32_t arg;
+        if (isForward_) {
+            // The locals are 0, 1, 2 ..., the arguments are below the frame header.
+            if (index >= 0)
+                return (index < depth);
+            arg = -index - frameHeaderSlots - 1;
+        }
+        else {
+            // The locals are -1, -2, -3 ..., the arguments are above the frame header.
+            if (index < 0)
+                return ((-index - 1) < depth);
+            arg = index - frameHeaderSlots;
+        }
+        if (arg < 0)
+            return false;
+        argCount = std::max(argCount, arg + 1);
+        return true;
+    }
+
+    size_t indexOf(const vmInstruction * insn) const {
+        return (size_t)(insn - insns_);
+    }
+
+    size_t findFunction(size_t entry) const {
+        for (size_t n = 0; n < funcs_.size(); ++n) {
+            if (funcs_[n].entry == entry)
+                return n;
+        }
+        return funcs_.size();
+    }
+
+    //
+    // Walk the records of the function, check them and compute the stack
+    // depth, the call targets are appended to the function list.
+    //
+    int analyze(size_t func) {
+        // The last record is the tail sentinel.
+        size_t sentinel = insnCount_ - 1;
+        std::vector<int32_t> depth(insnCount_, -1);
+        int32_t maxDepth = 0;
+        int32_t argCount = 0;
+
+        std::vector<std::pair<size_t, int32_t> > worklist;
+        worklist.push_back(std::make_pair(funcs_[func].entry, 0));
+        while (!worklist.empty()) {
+            size_t index = worklist.back().first;
+            int32_t current = worklist.back().second;
+            worklist.pop_back();
+            if (index >= sentinel)
+                return Error::Verify_Fall_Off_End;
+            if (depth[index] >= 0) {
+                if (depth[index] != current)
+                    return Error::Verify_Stack_Mismatch;
+                continue;
+            }
+            depth[index] = current;
+
+            const vmInstruction & insn = insns_[index];
+            if (!isSupported(insn.opcode))
+                return Error::Verify_Unsupported_OpCode;
+
+            int slotCount = getSlotCount(insn.opcode);
+            if (slotCount >= 1 && !checkSlot(insn.index, current, argCount))
+                return Error::Verify_Invalid_Operand;
+            if (slotCount >= 2 && !checkSlot(insn.index2, current, argCount))
+                return Error::Verify_Invalid_Operand;
+
+            // The cmp reads the condition from the next opcode.
+            if (insn.opcode >= OpCode::cmp_i32 && insn.opcode <= OpCode::cmp_imm_u32) {
+                if (!isCondJump(insns_[index + 1].opcode))
+                    return Error::Verify_Invalid_Operand;
+            }
+
+            int32_t delta;
+            if (!getDepthDelta(insn, delta))
+                return Error::Verify_Invalid_Operand;
+            int32_t next = current + delta;
+            if (next < 0)
+                return Error::Verify_Stack_Underflow;
+            maxDepth = std::max(maxDepth, next);
+
+            if (isReturn(insn.opcode)) {
+                int32_t localSize = 0;
+                if (insn.opcode == OpCode::ret_n_sm || insn.opcode == OpCode::ret_n ||
+                    insn.opcode == OpCode::ret_eax_n)
+                    localSize = insn.index;
+                if (localSize != current * (int32_t)sizeof(uint32_t))
+                    return Error::Verify_Stack_Mismatch;
+            }
+
+            // The branches always have a resolved target.
+            if ((isCall(insn.opcode) || isJump(insn.opcode) || isCondJump(insn.opcode)) &&
+                insn.target == nullptr)
+                return Error::Verify_Invalid_Target;
+
+            if (insn.target != nullptr) {
+                size_t target = indexOf(insn.target);
+                if (target >= sentinel)
+                    return Error::Verify_Fall_Off_End;
+                if (isCall(insn.opcode)) {
+                    // The call entry address must be aligned for 16 bytes.
+                    if ((insn.target->offset % ADDR_ALIGNMENT) != 0)
+                        return Error::Verify_Invalid_Target;
+                    if (findFunction(target) >= funcs_.size()) {
+                        Function callee;
+                        callee.entry = target;
+                        callee.maxDepth = 0;
+                        callee.argCount = 0;
+                        funcs_.push_back(callee);
+                    }
+                }
+                else {
+                    worklist.push_back(std::make_pair(target, next));
+                }
+            }
+            if (isFallThrough(insn.opcode))
+                worklist.push_back(std::make_pair(index + 1, next));
+        }
+
+        funcs_[func].depth.swap(depth);
+        funcs_[func].maxDepth = maxDepth;
+        funcs_[func].argCount = argCount;
+        return Error::Ok;
+    }
+
+    //
+    // The caller must push the arguments of the callee before the call.
+    //
+    int checkCalls(size_t func) const {
+        const Function & f = funcs_[func];
+        for (size_t index = 0; index < f.depth.size(); ++index) {
+            const vmInstruction & insn = insns_[index];
+            if (f.depth[index] < 0 || !isCall(insn.opcode))
+                continue;
+            size_t callee = findFunction(indexOf(insn.target));
+            assert(callee < funcs_.size());
+            if (f.depth[index] < funcs_[callee].argCount)
+                return Error::Verify_Stack_Underflow;
+        }
+        return Error::Ok;
+    }
+
+    int run(const vmDecodedImage & decoded, vmVerifyInfo & info) {
+        Function main;
+        main.entry = indexOf(decoded.entry());
+        main.maxDepth = 0;
+        main.argCount = 0;
+        funcs_.push_back(main);
+
+        for (size_t n = 0; n < funcs_.size(); ++n) {
+            int ec = analyze(n);
+            if (ec != Error::Ok)
+                return ec;
+        }
+
+        int32_t maxDepth = 0;
+        for (size_t n = 0; n < funcs_.size(); ++n) {
+            int ec = checkCalls(n);
+            if (ec != Error::Ok)
+                return ec;
+            maxDepth = std::max(maxDepth, funcs_[n].maxDepth);
+        }
+
+        info.verified = true;
+        info.funcCount = funcs_.size();
+        info.maxStackSize = (size_t)maxDepth * sizeof(uint32_t);
+        info.maxFrameSize = info.maxStackSize + (size_t)frameHeaderSize_;
+        info.entryArgSize = (size_t)funcs_[0].argCount * sizeof(uint32_t);
+        return Error::Ok;
+    }
+
+    Verifier(const vmDecodedImage & decoded, bool isForward, int32_t frameHeaderSize)
+        : insns_(decoded.data()), insnCount_(decoded.size() + 1),
+          isForward_(isForward), frameHeaderSize_(frameHeaderSize) {}
+
+public:
+    ~Verifier() {}
+
+    //
+    // Verify the pre-decoded records of an image that encoded for the stack
+    // layout, the records must not be fused or rewritten yet. The info is
+    // cleared if the verification failed.
+    //
+    template <typename Layout>
+    static int verify(const vmDecodedImage & decoded, vmVerifyInfo & info) {
+        info.clear();
+        if (!decoded.isInited())
+            return Error::Error_NullPtr;
+
+        Verifier verifier(decoded, Layout::kIsForward, Layout::kFrameHeaderSize);
+        int ec = verifier.run(decoded, info);
+        if (ec != Error::Ok)
+            info.clear();
+        return ec;
+    }
+
+    static int verify(const vmDecodedImage & decoded, vmVerifyInfo & info) {
+        return verify<vmDefaultLayout>(decoded, info);
+    }
+};
+
+} // namespace v3
+} // namespace jlang
+
+#endif // JLANG_VM_VERIFIER_H
@@ -0,0 +1,174 @@
+#ifndef JLANG_VM_WORKDEQUE_H
+#define JLANG_VM_WORKDEQUE_H
+
+#if defined(_MSC_VER) && (_MSC_VER >= 1020)
+#pragma once
+#endif
+
+#include "jlang/basic/stddef.h"
+
+#include <stdint.h>
+#include <stddef.h>
+#include <assert.h>
+
+#include <atomic>
+#include <vector>
+#include <type_traits>
+
+namespace jlang {
+
+//
+// The Chase-Lev work-stealing deque, T is a pointer.
+//
+// The owner thread pushes and pops at the bottom, the other threads steal
+// from the top. Only the steal and the pop of the last item synchronize
+// with CAS, the push and the other pops are plain stores. The array grows
+// when it's full, the old arrays are kept until the deque is destroyed,
+// because a thief may still read them.
+//
+// See "Correct and Efficient Work-Stealing for Weak Memory Models",
+// Le, Pop, Cohen and Zappa Nardelli, PPoPP 2013.
+//
+template <typename T>
+class vmWorkDeque {
+public:
+    static_assert(std::is_pointer<T>::value, "The item of vmWorkDeque must be a pointer.");
+
+    static const int64_t kDefaultCapacity = 64;
+
+private:
+    class Array {
+    private:
+        int64_t             capacity_;
+        int64_t             mask_;
+        std::atomic<T> *    items_;
+
+    public:
+        Array(int64_t capacity)
+            : capacity_(capacity), mask_(capacity - 1),
+              items_(new std::atomic<T>[(size_t)capacity]) {
+            // The capacity must be power of 2.
+            assert((capacity & (capacity - 1)) == 0);
+        }
+        ~Array() {
+            delete[] items_;
+        }
+
+        int64_t capacity() const { return capacity_; }
+
+        T get(int64_t index) const {
+            return items_[index & mask_].load(std::memory_order_relaxed);
+        }
+
+        void put(int64_t index, T item) {
+            items_[index & mask_].store(item, std::memory_order_relaxed);
+        }
+
+        Array * grow(int64_t bottom, int64_t top) const {
+            Array * array = new Array(capacity_ * 2);
+            for (int64_t i = top; i < bottom; ++i) {
+                array->put(i, get(i));
+            }
+            return array;
+        }
+    };
+
+    std::atomic<int64_t>    top_;
+    std::atomic<int64_t>    bottom_;
+    std::atomic<Array *>    array_;
+    std::vector<Array *>    retired_;
+
+public:
+    vmWorkDeque(int64_t capacity = kDefaultCapacity)
+        : top_(0), bottom_(0), array_(new Array(capacity)) {}
+
+    ~vmWorkDeque() {
+        delete array_.load(std::memory_order_relaxed);
+        for (size_t i = 0; i < retired_.size(); ++i) {
+            delete retired_[i];
+        }
+    }
+
+    //
+    // The count of the items, it's only a hint when the other threads steal.
+    //
+    size_t size() const {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_relaxed);
+        return (bottom > top) ? (size_t)(bottom - top) : 0;
+    }
+
+    bool empty() const { return (size() == 0); }
+
+    //
+    // Only the owner thread can push().
+    //
+    void push(T item) {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed);
+        int64_t top = top_.load(std::memory_order_acquire);
+        Array * array = array_.load(std::memory_order_relaxed);
+        if (bottom - top > array->capacity() - 1) {
+            retired_.push_back(array);
+            array = array->grow(bottom, top);
+            array_.store(array, std::memory_order_release);
+        }
+        array->put(bottom, item);
+        std::atomic_thread_fence(std::memory_order_release);
+        bottom_.store(bottom + 1, std::memory_order_relaxed);
+    }
+
+    //
+    // Only the owner thread can pop(), it's LIFO. Return nullptr if the
+    // deque is empty.
+    //
+    T pop() {
+        int64_t bottom = bottom_.load(std::memory_order_relaxed) - 1;
+        Array * array = array_.load(std::memory_order_relaxed);
+        bottom_.store(bottom, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t top = top_.load(std::memory_order_relaxed);
+
+        T item = nullptr;
+        if (top <= bottom) {
+            item = array->get(bottom);
+            if (top == bottom) {
+                // The last item, race with the thieves.
+                if (!top_.compare_exchange_strong(top, top + 1,
+                                                  std::memory_order_seq_cst,
+                                                  std::memory_order_relaxed)) {
+                    item = nullptr;
+                }
+                bottom_.store(bottom + 1, std::memory_order_relaxed);
+            }
+        }
+        else {
+            bottom_.store(bottom + 1, std::memory_order_relaxed);
+        }
+        return item;
+    }
+
+    //
+    // Any thread can steal(), it's FIFO. Return nullptr if the deque is
+    // empty or another thread wins the race.
+    //
+    T steal() {
+        int64_t top = top_.load(std::memory_order_acquire);
+        std::atomic_thread_fence(std::memory_order_seq_cst);
+        int64_t bottom = bottom_.load(std::memory_order_acquire);
+        if (top < bottom) {
+            Array * array = array_.load(std::memory_order_acquire);
+            T item = array->get(top);
+            if (!top_.compare_exchange_strong(top, top + 1,
+                                              std::memory_order_seq_cst,
+                                              std::memory_order_relaxed)) {
+                return nullptr;
+            }
+            return item;
+        }
+        return nullptr;
+    }
+};
+
+} // namespace jlang
+
+#endif // JLANG_VM_WORKDEQUE_H
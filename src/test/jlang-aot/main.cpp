@@ -0,0 +1,135 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <string>
+#include <vector>
+
+#include <jlang/vm/Interpreter_v3.h>
+#include <jlang/vm/AotTranslator.h>
+
+using namespace jlang;
+
+//
+// jlang-aot: translate a byte code image to a C++ header.
+//
+// Usage: jlang-aot [options] [image.bin]
+//
+//   -o <file>          Output file, default is stdout.
+//   -n <name>          Namespace of the generated code, default is jlang_aot.
+//   -e <offset>        Entry offset of the image, default is 0.
+//   -i <offset>        Image offset of the input immediate.
+//   --dispatch         Use the computed return-site dispatch for the calls.
+//
+// Without an image file, the built-in fibonacci image of vmBinaryFile is
+// translated, and its input slot (offset 2) becomes the input argument.
+//
+// The .jasm files can't be translated yet, because the Assembler doesn't
+// emit the binary image.
+//
+
+static void print_usage()
+{
+    printf("Usage: jlang-aot [-o file] [-n name] [-e offset] [-i offset] [--dispatch] [image.bin]\n");
+}
+
+static bool read_file(const char * filename, std::vector<unsigned char> & data)
+{
+    FILE * fp = fopen(filename, "rb");
+    if (fp == nullptr)
+        return false;
+
+    unsigned char buf[4096];
+    size_t readBytes;
+    while ((readBytes = fread(buf, 1, sizeof(buf), fp)) > 0) {
+        data.insert(data.end(), buf, buf + readBytes);
+    }
+    fclose(fp);
+    return true;
+}
+
+int main(int argc, char * argv[])
+{
+    v3::vmAotOptions options;
+    const char * imageFile = nullptr;
+    const char * outputFile = nullptr;
+    size_t entryOffset = 0;
+    bool hasInputOffset = false;
+
+    for (int i = 1; i < argc; ++i) {
+        if (strcmp(argv[i], "-o") == 0 && (i + 1) < argc) {
+            outputFile = argv[++i];
+        }
+        else if (strcmp(argv[i], "-n") == 0 && (i + 1) < argc) {
+            options.name = argv[++i];
+        }
+        else if (strcmp(argv[i], "-e") == 0 && (i + 1) < argc) {
+            entryOffset = (size_t)strtoul(argv[++i], nullptr, 0);
+        }
+        else if (strcmp(argv[i], "-i") == 0 && (i + 1) < argc) {
+            options.inputOffset = (int64_t)strtoul(argv[++i], nullptr, 0);
+            hasInputOffset = true;
+        }
+        else if (strcmp(argv[i], "--dispatch") == 0) {
+            options.callMode = v3::vmAotCallMode::Dispatch;
+        }
+        else if (argv[i][0] != '-' && imageFile == nullptr) {
+            imageFile = argv[i];
+        }
+        else {
+            print_usage();
+            return 1;
+        }
+    }
+
+    std::vector<unsigned char> image;
+    if (imageFile != nullptr) {
+        if (!read_file(imageFile, image) || image.empty()) {
+            fprintf(stderr, "jlang-aot: can't read the image file: %s\n", imageFile);
+            return 1;
+        }
+        options.source = imageFile;
+    }
+    else {
+        v3::vmBinaryFile binary;
+        binary.loadFromFile("test.bin");
+        const unsigned char * data = (const unsigned char *)binary.getImagePtr();
+        image.assign(data, data + binary.getImageSize());
+        entryOffset = (size_t)((const unsigned char *)binary.getImageEntry() - data);
+        options.source = "vmBinaryFile (fibonacci)";
+        if (!hasInputOffset)
+            options.inputOffset = 2;
+    }
+
+    v3::vmDecodedImage decoded;
+    int ec = v3::PreDecoder::translate(decoded, image.data(), image.size(),
+                                       entryOffset, nullptr);
+    if (ec != Error::Ok) {
+        fprintf(stderr, "jlang-aot: pre-decode failed, error = %d\n", ec);
+        return 1;
+    }
+
+    std::string source;
+    ec = v3::AotTranslator::translate(decoded, options, source);
+    if (ec != Error::Ok) {
+        fprintf(stderr, "jlang-aot: translate failed, error = %d\n", ec);
+        return 1;
+    }
+
+    if (outputFile != nullptr) {
+        FILE * fp = fopen(outputFile, "wb");
+        if (fp == nullptr) {
+            fprintf(stderr, "jlang-aot: can't write the output file: %s\n", outputFile);
+            return 1;
+        }
+        fwrite(source.c_str(), 1, source.size(), fp);
+        fclose(fp);
+    }
+    else {
+        fwrite(source.c_str(), 1, source.size(), stdout);
+    }
+
+    return 0;
+}
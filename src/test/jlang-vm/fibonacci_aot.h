@@ -0,0 +1,130 @@
+//
+// Generated by jlang-aot from vmBinaryFile (fibonacci), don't edit.
+// Call mode: native.
+//
+#ifndef JLANG_AOT_fibonacci_aot_H
+#define JLANG_AOT_fibonacci_aot_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+namespace fibonacci_aot {
+
+#define AOT_PUSH_FRAME(site) \
+    do { *(unsigned char **)sp = fp; \
+         *(uintptr_t *)(sp + sizeof(void *)) = (uintptr_t)(site); \
+         sp += sizeof(void *) * 2; fp = sp; } while (0)
+#define AOT_POP_FRAME(localSize) \
+    do { sp -= (localSize) + sizeof(void *) * 2; \
+         fp = *(unsigned char **)sp; } while (0)
+#define AOT_RETURN_SITE() \
+    (*(uintptr_t *)(sp + sizeof(void *)))
+#define AOT_SAVE() \
+    do { s.sp = sp; s.fp = fp; s.eax = eax; s.flags = flags; } while (0)
+#define AOT_LOAD() \
+    do { sp = s.sp; fp = s.fp; eax = s.eax; flags = s.flags; } while (0)
+
+struct State {
+    unsigned char * sp;
+    unsigned char * fp;
+    uint32_t        eax;
+    bool            flags;
+    bool            exited;
+    uint32_t        input;
+};
+
+static void func_00000000(State & s);
+static void func_00000010(State & s);
+
+static void func_00000000(State & s)
+{
+    unsigned char * sp;
+    unsigned char * fp;
+    uint32_t eax;
+    bool flags;
+    const uint32_t input = s.input;
+    AOT_LOAD();
+    (void)input;
+
+    // 00000000:  add_sp_4
+    sp += 4;
+    // 00000001:  push_i32
+    *(uint32_t *)sp = input; sp += 4;
+    // 00000006:  call_short
+    AOT_PUSH_FRAME(0);
+    AOT_SAVE(); func_00000010(s); if (s.exited) return; AOT_LOAD();
+    // 00000009:  pop_i32
+    sp -= 4;
+    // 0000000A:  ret
+    AOT_POP_FRAME(0);
+    AOT_SAVE(); return;
+}
+
+static void func_00000010(State & s)
+{
+    unsigned char * sp;
+    unsigned char * fp;
+    uint32_t eax;
+    bool flags;
+    const uint32_t input = s.input;
+    AOT_LOAD();
+    (void)input;
+
+    // 00000010:  cmp_imm_u32
+    flags = (*((uint32_t *)fp + (-5)) < 0x00000003u);
+    // 00000016:  jl_near
+    if (flags) goto L_00000030;
+    // 00000018:  add_sp_4
+    sp += 4;
+    // 00000019:  push
+    *(uint32_t *)sp = *((uint32_t *)fp + (-5)); sp += 4;
+    // 0000001B:  dec
+    *((uint32_t *)fp + (1)) -= 1;
+    // 0000001D:  call_near
+    AOT_PUSH_FRAME(0);
+    AOT_SAVE(); func_00000010(s); if (s.exited) return; AOT_LOAD();
+    // 0000001F:  copy_from_eax
+    *((uint32_t *)fp + (0)) = eax;
+    // 00000021:  dec
+    *((uint32_t *)fp + (1)) -= 1;
+    // 00000023:  call_near
+    AOT_PUSH_FRAME(0);
+    AOT_SAVE(); func_00000010(s); if (s.exited) return; AOT_LOAD();
+    // 00000025:  add_eax
+    eax += *((uint32_t *)fp + (0));
+    // 00000027:  ret_n
+    AOT_POP_FRAME(8);
+    AOT_SAVE(); return;
+L_00000030:
+    // 00000030:  ret_eax
+    eax = 0x00000001u;
+    AOT_POP_FRAME(0);
+    AOT_SAVE(); return;
+}
+
+static inline uint32_t run(void * stack, uint32_t input)
+{
+    State s;
+    unsigned char * sp = (unsigned char *)stack;
+    unsigned char * fp = sp;
+    uint32_t eax = 0;
+    bool flags = false;
+    s.exited = false;
+    s.input = input;
+
+    // Push call program entry.
+    AOT_PUSH_FRAME(0);
+    AOT_SAVE();
+    func_00000000(s);
+    return s.eax;
+}
+
+#undef AOT_SAVE
+#undef AOT_LOAD
+#undef AOT_PUSH_FRAME
+#undef AOT_POP_FRAME
+#undef AOT_RETURN_SITE
+
+} // namespace fibonacci_aot
+
+#endif // JLANG_AOT_fibonacci_aot_H
@@ -5,17 +5,27 @@
 #include <stddef.h>
 #include <stdbool.h>
 #include <inttypes.h>
+#include <math.h>
 #include <time.h>
 
 #include <iostream>
 #include <iomanip>  // std::setw(), std::setfill(), std::setprecision().
+#include <limits>
 #include <sstream>
 #include <string>
 #include <utility>
+#include <vector>
+#include <atomic>
+#include <chrono>
+#include <thread>
 
 #include <jlang/basic/inttypes.h>
 #include <jlang/jlang.h>
 
+#include "jlang-vm/fibonacci_aot.h"
+#include "jlang-vm/fibonacci_aot_dispatch.h"
+#include "jlang-vm/v1_images.h"
+
 #if !defined(_MSC_VER)
 #ifndef scanf_s
 #define scanf_s     scanf
@@ -214,34 +224,1907 @@ void test_Interpreter_inline(const std::string & name)
     printf("\n");
 }
 
-void test_Interpreter_v1()
+template <typename InterpreterTy>
+void test_Interpreter_mode(const std::string & name, const char * mode,
+                           int (InterpreterTy::*runFunc)(vmReturn<> &))
 {
-    test_Interpreter<v1::Interpreter<>>("Interpreter_v1");
+    printf("--------------------------------------------\n");
+    printf("  test_%s()  [%s]\n", name.c_str(), mode);
+    printf("--------------------------------------------\n\n");
+
+    uint32_t n = 1;
+    uint32_t max_n = 40;
+    do {
+        if (n == 0 || n > max_n) {
+            printf("\n");
+            printf("The number must be on range [1-%u].\n\n", max_n);
+        }
+        printf("Please enter a number from 1 to %u.\n", max_n);
+        printf("n = ? ");
+        int r = scanf_s("%u", &n);
+        printf("\n");
+    } while (n > max_n);
+
+    // Run the code in a loop for a while, to warm up the CPU.
+    cpu_warmup(kWarmupMillsecs);
+
+    StopWatch sw;
+
+    InterpreterTy interpreter;
+    vmReturn<> retVal;
+    retVal.setDataType(vmReturn<>::Basic);
+    retVal.setValue(n);
+
+    int ec = interpreter.create();
+
+    sw.start();
+    ec = (interpreter.*runFunc)(retVal);
+    if (ec >= 0) {
+        sw.stop();
+        if (retVal.isValid()) {
+            printf("  fibonacci(%u) = %" PRIuPTR "\n", n, retVal.getValue());
+        }
+    }
+    printf("\n");
+
+    double elapsed_time = sw.getElapsedMillisec();
+    printf("  elapsed time:  %0.3f ms\n", elapsed_time);
+    printf("\n");
 }
 
-void test_Interpreter_v2()
+template <typename InterpreterTy>
+void test_Interpreter_threaded(const std::string & name)
 {
-    test_Interpreter<v2::Interpreter<>>("Interpreter_v2");
+#if USE_COMPUTED_GOTO
+    test_Interpreter_mode<InterpreterTy>(name, "computed goto",
+                                         &InterpreterTy::run_threaded);
+#else
+    test_Interpreter_mode<InterpreterTy>(name, "switch fallback",
+                                         &InterpreterTy::run_threaded);
+#endif
 }
 
-void test_Interpreter_v3()
+template <typename InterpreterTy>
+void test_Interpreter_verified(const std::string & name)
 {
-    test_Interpreter<v3::Interpreter<>>("Interpreter_v3");
+#if USE_COMPUTED_GOTO
+    test_Interpreter_mode<InterpreterTy>(name, "verified, unchecked threaded",
+                                         &InterpreterTy::run_verified);
+#else
+    test_Interpreter_mode<InterpreterTy>(name, "verified, switch fallback",
+                                         &InterpreterTy::run_verified);
+#endif
 }
 
-void test_Interpreter_v3_inline()
+template <typename InterpreterTy>
+void test_Interpreter_predecoded(const std::string & name)
 {
-    test_Interpreter_inline<v3::Interpreter<>>("Interpreter_v3_inline");
+#if USE_COMPUTED_GOTO
+    test_Interpreter_mode<InterpreterTy>(name, "pre-decoded, indirect threaded",
+                                         &InterpreterTy::run_predecoded);
+#else
+    test_Interpreter_mode<InterpreterTy>(name, "pre-decoded, switch",
+                                         &InterpreterTy::run_predecoded);
+#endif
 }
 
-void test_Interpreter_v4()
+template <typename InterpreterTy>
+void test_Interpreter_superinsn(const std::string & name)
 {
-    test_Interpreter<v4::Interpreter<>>("Interpreter_v4");
+    test_Interpreter_mode<InterpreterTy>(name, "pre-decoded, super instructions",
+                                         &InterpreterTy::run_superinsn);
 }
 
-void test_Interpreter_v4_inline()
+template <typename InterpreterTy>
+void test_Interpreter_quickened(const std::string & name)
 {
-    test_Interpreter_inline<v4::Interpreter<>>("Interpreter_v4_inline");
+    test_Interpreter_mode<InterpreterTy>(name, "quickened generic opcodes",
+                                         &InterpreterTy::run_quickened);
+}
+
+template <typename InterpreterTy>
+void test_Interpreter_register(const std::string & name)
+{
+    test_Interpreter_mode<InterpreterTy>(name, "register VM",
+                                         &InterpreterTy::run_register);
+}
+
+template <typename InterpreterTy>
+void test_Interpreter_jit(const std::string & name)
+{
+#if USE_JIT_X86_64
+    test_Interpreter_mode<InterpreterTy>(name, "x86-64 baseline JIT",
+                                         &InterpreterTy::run_jit);
+#endif
+}
+
+template <typename InterpreterTy>
+void test_Interpreter_traced(const std::string & name)
+{
+#if USE_JIT_X86_64
+    test_Interpreter_mode<InterpreterTy>(name, "x86-64 tracing JIT",
+                                         &InterpreterTy::run_traced);
+#endif
+}
+
+//
+// Run the C++ code translated by jlang-aot from the same image, the result
+// must be equal to the interpreter's.
+//
+void test_Interpreter_aot(const std::string & name)
+{
+    printf("--------------------------------------------\n");
+    printf("  test_%s()\n", name.c_str());
+    printf("--------------------------------------------\n\n");
+
+    uint32_t n = 1;
+    uint32_t max_n = 40;
+    do {
+        if (n == 0 || n > max_n) {
+            printf("\n");
+            printf("The number must be on range [1-%u].\n\n", max_n);
+        }
+        printf("Please enter a number from 1 to %u.\n", max_n);
+        printf("n = ? ");
+        int r = scanf_s("%u", &n);
+        printf("\n");
+    } while (n > max_n);
+
+    // Run the code in a loop for a while, to warm up the CPU.
+    cpu_warmup(kWarmupMillsecs);
+
+    v3::Interpreter<> interpreter;
+    vmReturn<> retVal;
+    retVal.setDataType(vmReturn<>::Basic);
+    retVal.setValue(n);
+
+    int ec = interpreter.create();
+    if (ec >= 0) {
+        ec = interpreter.run(retVal);
+    }
+    if (ec < 0) {
+        printf("  run() failed, ec = %d\n\n", ec);
+        return;
+    }
+    uint32_t expected = (uint32_t)retVal.getValue();
+
+    // The same stack size as the interpreter's.
+    std::vector<uint64_t> stack(1024 * 1024);
+
+    StopWatch sw;
+    sw.start();
+    uint32_t result = fibonacci_aot::run(stack.data(), n);
+    sw.stop();
+
+    printf("  [native calls]   fibonacci(%u) = %u%s\n", n, result,
+           (result == expected) ? "" : "  (mismatch)");
+    printf("  elapsed time:  %0.3f ms\n\n", sw.getElapsedMillisec());
+
+    sw.start();
+    result = fibonacci_aot_dispatch::run(stack.data(), n);
+    sw.stop();
+
+    printf("  [return switch]  fibonacci(%u) = %u%s\n", n, result,
+           (result == expected) ? "" : "  (mismatch)");
+    printf("  elapsed time:  %0.3f ms\n\n", sw.getElapsedMillisec());
+}
+
+//
+// Profile the opcode sequences of the script, print the top-K candidates,
+// the measured dispatch counts with and without the super instructions,
+// and the C++ source generated for the candidates.
+//
+void test_SuperInsn_profile(size_t topK = 4, bool printSource = false)
+{
+    printf("--------------------------------------------\n");
+    printf("  test_SuperInsn_profile()  [top-K = %u]\n", (uint32_t)topK);
+    printf("--------------------------------------------\n\n");
+
+    uint32_t n = 1;
+    uint32_t max_n = 30;
+    do {
+        if (n == 0 || n > max_n) {
+            printf("\n");
+            printf("The number must be on range [1-%u].\n\n", max_n);
+        }
+        printf("Please enter a number from 1 to %u.\n", max_n);
+        printf("n = ? ");
+        int r = scanf_s("%u", &n);
+        printf("\n");
+    } while (n > max_n);
+
+    v3::Interpreter<> interpreter;
+    vmReturn<> retVal;
+    v3::vmOpcodeProfile profile;
+    v3::vmOpcodeProfile fusedProfile;
+
+    int ec = interpreter.create();
+    if (ec >= 0) {
+        retVal.setDataType(vmReturn<>::Basic);
+        retVal.setValue(n);
+        ec = interpreter.run_profiled(retVal, profile);
+    }
+    if (ec >= 0) {
+        retVal.setDataType(vmReturn<>::Basic);
+        retVal.setValue(n);
+        ec = interpreter.run_profiled(retVal, fusedProfile, true);
+    }
+    if (ec < 0) {
+        printf("  run_profiled() failed, ec = %d\n\n", ec);
+        return;
+    }
+
+    std::vector<v3::vmSuperInsnCandidate> candidates;
+    profile.select(candidates, topK);
+
+    printf("  %-24s %12s %12s\n", "sequence", "count", "saved");
+    for (size_t i = 0; i < candidates.size(); ++i) {
+        const v3::vmSuperInsnCandidate & candidate = candidates[i];
+        printf("  %-24s %12" PRIu64 " %12" PRIu64 "\n",
+               v3::SuperInsnGenerator::getName(candidate).c_str(),
+               candidate.count, candidate.saved);
+    }
+    printf("\n");
+
+    uint64_t dispatches = profile.getDispatchCount();
+    uint64_t fusedDispatches = fusedProfile.getDispatchCount();
+    printf("  dispatches (base):   %" PRIu64 "\n", dispatches);
+    printf("  dispatches (fused):  %" PRIu64 "\n", fusedDispatches);
+    if (dispatches != 0) {
+        printf("  reduction:           %0.2f %%\n",
+               (double)(dispatches - fusedDispatches) * 100.0 / (double)dispatches);
+    }
+    printf("\n");
+
+    if (printSource) {
+        printf("%s\n", v3::SuperInsnGenerator::generate(candidates).c_str());
+    }
+}
+
+//
+// Compare the dispatch count of the stack machine and the register machine
+// that translated from the same image.
+//
+void test_RegisterVM_profile()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_RegisterVM_profile()\n");
+    printf("--------------------------------------------\n\n");
+
+    uint32_t n = 1;
+    uint32_t max_n = 30;
+    do {
+        if (n == 0 || n > max_n) {
+            printf("\n");
+            printf("The number must be on range [1-%u].\n\n", max_n);
+        }
+        printf("Please enter a number from 1 to %u.\n", max_n);
+        printf("n = ? ");
+        int r = scanf_s("%u", &n);
+        printf("\n");
+    } while (n > max_n);
+
+    v3::Interpreter<> interpreter;
+    vmReturn<> retVal;
+    v3::vmOpcodeProfile profile;
+    uint64_t regDispatches = 0;
+
+    int ec = interpreter.create();
+    if (ec >= 0) {
+        retVal.setDataType(vmReturn<>::Basic);
+        retVal.setValue(n);
+        ec = interpreter.run_profiled(retVal, profile);
+    }
+    if (ec >= 0) {
+        retVal.setDataType(vmReturn<>::Basic);
+        retVal.setValue(n);
+        ec = interpreter.run_register_counted(retVal, regDispatches);
+    }
+    if (ec < 0) {
+        printf("  run failed, ec = %d\n\n", ec);
+        return;
+    }
+
+    const v3::vmRegImage & regImage = interpreter.getRegImage();
+    printf("  records (stack):     %u\n", (uint32_t)regImage.getSourceCount());
+    printf("  records (register):  %u\n", (uint32_t)regImage.size());
+    printf("  functions:           %u\n", (uint32_t)regImage.getFuncCount());
+    printf("\n");
+
+    uint64_t dispatches = profile.getDispatchCount();
+    printf("  dispatches (stack):     %" PRIu64 "\n", dispatches);
+    printf("  dispatches (register):  %" PRIu64 "\n", regDispatches);
+    if (dispatches != 0) {
+        printf("  reduction:              %0.2f %%\n",
+               (double)(dispatches - regDispatches) * 100.0 / (double)dispatches);
+    }
+    printf("\n");
+}
+
+void test_TraceJit_stats()
+{
+#if USE_JIT_X86_64
+    printf("--------------------------------------------\n");
+    printf("  test_TraceJit_stats()\n");
+    printf("--------------------------------------------\n\n");
+
+    v3::Interpreter<> interpreter;
+    vmReturn<> retVal;
+    int ec = interpreter.create();
+    if (ec >= 0) {
+        retVal.setDataType(vmReturn<>::Basic);
+        retVal.setValue(30);
+        ec = interpreter.run_traced(retVal);
+    }
+    if (ec < 0) {
+        printf("  run_traced() failed, ec = %d\n\n", ec);
+        return;
+    }
+
+    const v3::vmTraceStats & stats = interpreter.getTraceStats();
+    printf("  fibonacci(30) = %u\n", (uint32_t)retVal.getValue());
+    printf("\n");
+    printf("  traces compiled:      %u\n", stats.compiled);
+    printf("  traces aborted:       %u\n", stats.aborted);
+    printf("  anchors blacklisted:  %u\n", stats.blacklisted);
+    printf("  native code size:     %u bytes\n", (uint32_t)stats.codeSize);
+    printf("  trace entries:        %" PRIu64 "\n", stats.entries);
+    printf("  interpreted records:  %" PRIu64 "\n", stats.interpreted);
+    printf("\n");
+#endif
+}
+
+//
+// Compare the typed compares (op_cmp<T, Cond>) with the generic compare that
+// switches on the condition jump at runtime, for the edge values of the type.
+//
+template <typename T>
+size_t test_TypedCmp_type(const char * kind)
+{
+    static const T kValues[] = {
+        0, 1, 2, (T)-1, (T)-2,
+        std::numeric_limits<T>::min(), (T)(std::numeric_limits<T>::min() + 1),
+        std::numeric_limits<T>::max(), (T)(std::numeric_limits<T>::max() - 1),
+    };
+    static const size_t kValueCount = sizeof(kValues) / sizeof(kValues[0]);
+    typedef vmFrame<uintptr_t> frame_type;
+
+    size_t cases = 0;
+    size_t mismatches = 0;
+    for (size_t i = 0; i < kValueCount; ++i) {
+        for (size_t j = 0; j < kValueCount; ++j) {
+            T v1 = kValues[i];
+            T v2 = kValues[j];
+#define VM_TYPED_CMP_CHECK(kind, type, cond)                            \
+            if (jlang::op_cmp<type, vmCondType::cond>(v1, v2) !=        \
+                frame_type::getCondition<type>(v1, v2, OpCode::cond))   \
+                mismatches++;                                           \
+            cases++;
+            VM_FOR_EACH_COND(VM_TYPED_CMP_CHECK, kind, T)
+#undef VM_TYPED_CMP_CHECK
+        }
+    }
+    printf("  %-10s %6u cases, %u mismatches\n", kind, (uint32_t)cases, (uint32_t)mismatches);
+    return mismatches;
+}
+
+//
+// The typed compare handlers must give the same results as the generic ones,
+// in the handlers and in the whole programs: the pre-decoded records run the
+// typed handlers, the threaded loop decodes the condition from the image.
+//
+void test_TypedCmp()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_TypedCmp()  [typed vs generic compares]\n");
+    printf("--------------------------------------------\n\n");
+
+    size_t mismatches = 0;
+    mismatches += test_TypedCmp_type<int32_t>("int32");
+    mismatches += test_TypedCmp_type<uint32_t>("uint32");
+    mismatches += test_TypedCmp_type<int64_t>("int64");
+    mismatches += test_TypedCmp_type<uint64_t>("uint64");
+    printf("\n");
+
+    v3::Interpreter<> interpreter;
+    int ec = interpreter.create();
+    if (ec >= 0) {
+        static const uint32_t kMaxInput = 24;
+        size_t runMismatches = 0;
+        for (uint32_t n = 1; n <= kMaxInput; ++n) {
+            vmReturn<> generic, typed;
+            generic.setDataType(vmReturn<>::Basic);
+            generic.setValue(n);
+            typed.setDataType(vmReturn<>::Basic);
+            typed.setValue(n);
+            int ec1 = interpreter.run_threaded(generic);
+            int ec2 = interpreter.run_predecoded(typed);
+            if (ec1 != ec2 || generic.getValue() != typed.getValue()) {
+                printf("  fibonacci(%u): generic = %u (ec = %d), typed = %u (ec = %d)\n",
+                       n, (uint32_t)generic.getValue(), ec1, (uint32_t)typed.getValue(), ec2);
+                runMismatches++;
+            }
+        }
+        printf("  fibonacci(1..%u)  %u mismatches\n", kMaxInput, (uint32_t)runMismatches);
+        mismatches += runMismatches;
+    }
+    else {
+        printf("  create() failed, ec = %d\n", ec);
+    }
+    printf("\n");
+    printf("  %s\n\n", (mismatches == 0 && ec >= 0) ? "passed" : "FAILED");
+}
+
+//
+// Translate a jmp_near of the offset, the rest of the image is exit.
+//
+static int translate_jump(v3::vmDecodedImage & decoded, int8_t offset)
+{
+    unsigned char image[16];
+    memset((void *)image, OpCode::exit, sizeof(image));
+    image[0] = OpCode::jmp_near;
+    image[1] = (unsigned char)offset;
+    return v3::PreDecoder::translate(decoded, image, sizeof(image), 0, nullptr);
+}
+
+//
+// The branch targets out of the image are refused by the pre-decoder, and
+// a branch without the target is refused by the verifier.
+//
+void test_PreDecoder_targets()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_PreDecoder_targets()\n");
+    printf("--------------------------------------------\n\n");
+
+    size_t failures = 0;
+    v3::vmDecodedImage decoded;
+
+    int below = translate_jump(decoded, -10);
+    int beyond = translate_jump(decoded, 14);
+    bool rangeOk = (below == Error::PreDecode_Invalid_Target &&
+                    beyond == Error::PreDecode_Invalid_Target);
+    printf("  range:  %s, %s  %s\n", Error::format((Error::Type)below),
+           Error::format((Error::Type)beyond), rangeOk ? "ok" : "FAILED");
+    if (!rangeOk)
+        failures++;
+
+    v3::vmVerifyInfo info;
+    int translated = translate_jump(decoded, 0);
+    int verified = v3::Verifier::verify<v3::vmDefaultLayout>(decoded, info);
+    decoded.data()->target = nullptr;
+    int noTarget = v3::Verifier::verify<v3::vmDefaultLayout>(decoded, info);
+    bool verifyOk = (translated == Error::Ok && verified == Error::Ok &&
+                     noTarget == Error::Verify_Invalid_Target);
+    printf("  verify: %s, %s  %s\n", Error::format((Error::Type)verified),
+           Error::format((Error::Type)noTarget), verifyOk ? "ok" : "FAILED");
+    if (!verifyOk)
+        failures++;
+
+    printf("\n");
+    printf("  %s\n\n", (failures == 0) ? "passed" : "FAILED");
+}
+
+//
+// Run a built-in v1 test image from its entry, on the image or on the
+// quickened copy of it.
+//
+template <typename ThreadTy>
+int run_v1_image(ThreadTy & thread, const v1_images::vmTestImage & image,
+                 bool quickened, vmReturn<> & retVal)
+{
+    image.attach(thread);
+    retVal.setDataType(vmReturn<>::Basic);
+    retVal.setValue(0);
+    return (quickened ? thread.run_quickened(retVal) : thread.run(retVal));
+}
+
+//
+// The bits of the taken jumps in the condition images, a cmp of v1 and v2
+// of type T, see vmLazyFlags.
+//
+template <typename T>
+uint32_t v1_cond_mask(T v1, T v2)
+{
+    typedef typename std::make_signed<T>::type S;
+    typedef typename std::make_unsigned<T>::type U;
+    S diff = (S)(U)((U)v1 - (U)v2);
+    uint32_t mask = 0;
+    mask |= (v1 == 0 && v2 == 0) ? 0x001 : 0;
+    mask |= (v1 != 0 && v2 != 0) ? 0x002 : 0;
+    mask |= (v1 == v2) ? 0x004 : 0;
+    mask |= (v1 != v2) ? 0x008 : 0;
+    mask |= (v1 < v2)  ? 0x010 : 0;
+    mask |= (v1 <= v2) ? 0x020 : 0;
+    mask |= (v1 > v2)  ? 0x040 : 0;
+    mask |= (v1 >= v2) ? 0x080 : 0;
+    mask |= (diff < 0)  ? 0x100 : 0;
+    mask |= (diff >= 0) ? 0x200 : 0;
+    return mask;
+}
+
+//
+// The result of dec is read as "cmp result, 0", but jnz tests the result
+// only.
+//
+uint32_t v1_dec_mask(int32_t result)
+{
+    uint32_t mask = v1_cond_mask<int32_t>(result, 0);
+    mask &= ~0x002U;
+    mask |= (result != 0) ? 0x002 : 0;
+    return mask;
+}
+
+//
+// The condition jumps evaluate the lazy flags of the cmp or the dec before
+// them, on the generic opcodes and on the quickened ones.
+//
+void test_Interpreter_v1_flags()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_Interpreter_v1_flags()\n");
+    printf("--------------------------------------------\n\n");
+
+    static const uint32_t kValues[] = {
+        0, 1, 2, 5, 0xFFFFFFFFU, 0xFFFFFFFEU, 0x7FFFFFFFU, 0x80000000U, 0x80000001U
+    };
+    static const size_t kValueCount = sizeof(kValues) / sizeof(kValues[0]);
+
+    v1_images::vmTestImage int32Image(v1_images::condInt32Binary);
+    v1_images::vmTestImage uint32Image(v1_images::condUInt32Binary);
+    v1_images::vmTestImage decImage(v1_images::condDecBinary);
+
+    v1::vmThread<> thread;
+    thread.create(64 * 1024);
+
+    size_t cases = 0;
+    size_t mismatches = 0;
+    int ec = Error::Ok;
+    for (int quickened = 0; quickened <= 1; quickened++) {
+        for (size_t i = 0; i < kValueCount; ++i) {
+            for (size_t j = 0; j < kValueCount; ++j) {
+                uint32_t v1 = kValues[i];
+                uint32_t v2 = kValues[j];
+                int32Image.setUInt32(v1_images::kCondInput1, v1);
+                int32Image.setUInt32(v1_images::kCondInput2, v2);
+                uint32Image.setUInt32(v1_images::kCondInput1, v1);
+                uint32Image.setUInt32(v1_images::kCondInput2, v2);
+
+                vmReturn<> retVal;
+                uint32_t expected = v1_cond_mask<int32_t>((int32_t)v1, (int32_t)v2);
+                ec = run_v1_image(thread, int32Image, quickened != 0, retVal);
+                if (ec != Error::Ok || (uint32_t)retVal.getValue() != expected) {
+                    printf("  cmp int32  (0x%08X, 0x%08X): 0x%03X, expected 0x%03X, ec = %d\n",
+                           v1, v2, (uint32_t)retVal.getValue(), expected, ec);
+                    mismatches++;
+                }
+
+                expected = v1_cond_mask<uint32_t>(v1, v2);
+                ec = run_v1_image(thread, uint32Image, quickened != 0, retVal);
+                if (ec != Error::Ok || (uint32_t)retVal.getValue() != expected) {
+                    printf("  cmp uint32 (0x%08X, 0x%08X): 0x%03X, expected 0x%03X, ec = %d\n",
+                           v1, v2, (uint32_t)retVal.getValue(), expected, ec);
+                    mismatches++;
+                }
+                cases += 2;
+            }
+
+            uint32_t v1 = kValues[i];
+            decImage.setUInt32(v1_images::kCondInput1, v1);
+
+            vmReturn<> retVal;
+            uint32_t expected = v1_dec_mask((int32_t)(v1 - 1));
+            ec = run_v1_image(thread, decImage, quickened != 0, retVal);
+            if (ec != Error::Ok || (uint32_t)retVal.getValue() != expected) {
+                printf("  dec 0x%08X: 0x%03X, expected 0x%03X, ec = %d\n",
+                       v1, (uint32_t)retVal.getValue(), expected, ec);
+                mismatches++;
+            }
+            cases++;
+        }
+    }
+    printf("  %u cases, %u mismatches\n\n", (uint32_t)cases, (uint32_t)mismatches);
+    printf("  %s\n\n", (mismatches == 0) ? "passed" : "FAILED");
+}
+
+//
+// The vector instructions of xmm, ymm and zmm on the vectors in the heap,
+// the vload and the vstore out of the heap are rejected.
+//
+void test_Interpreter_v1_vector()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_Interpreter_v1_vector()\n");
+    printf("--------------------------------------------\n\n");
+
+    static const size_t kHeapSize = 4096;
+    static const size_t kVectorBytes = 64;
+    v1_images::vmTestImage images[3] = {
+        v1_images::vmTestImage(v1_images::vectorXmmBinary),
+        v1_images::vmTestImage(v1_images::vectorYmmBinary),
+        v1_images::vmTestImage(v1_images::vectorZmmBinary)
+    };
+    static const char * const kNames[3] = { "xmm", "ymm", "zmm" };
+
+    size_t failures = 0;
+    for (int width = 0; width < 3; width++) {
+        size_t lanes = ((size_t)16 << width) / sizeof(int32_t);
+        for (int quickened = 0; quickened <= 1; quickened++) {
+            v1::vmThread<> thread;
+            thread.vmThreadBase<uintptr_t>::create(false, 64 * 1024, kHeapSize);
+            unsigned char * heap = thread.getHeap().first();
+            int32_t * a = (int32_t *)(heap + kVectorBytes * 0);
+            int32_t * b = (int32_t *)(heap + kVectorBytes * 1);
+            uint32_t * idx = (uint32_t *)(heap + kVectorBytes * 2);
+            int32_t * out0 = (int32_t *)(heap + kVectorBytes * 3);
+            int32_t * out1 = (int32_t *)(heap + kVectorBytes * 4);
+            int32_t * out2 = (int32_t *)(heap + kVectorBytes * 5);
+            // The vector at "bad" runs over the end of the heap.
+            unsigned char * bad = thread.getHeap().last() - 8;
+            memset(bad, 0xA5, 8);
+            for (size_t i = 0; i < lanes; ++i) {
+                a[i] = (int32_t)(i * 7) - 20;
+                b[i] = 9 - (int32_t)(i * 3);
+                idx[i] = (uint32_t)(lanes * 2 - 1 - i);
+            }
+
+            v1_images::vmTestImage & image = images[width];
+            image.setUInt64(v1_images::kVectorA,    (uint64_t)(uintptr_t)a);
+            image.setUInt64(v1_images::kVectorB,    (uint64_t)(uintptr_t)b);
+            image.setUInt64(v1_images::kVectorIdx,  (uint64_t)(uintptr_t)idx);
+            image.setUInt64(v1_images::kVectorOut0, (uint64_t)(uintptr_t)out0);
+            image.setUInt64(v1_images::kVectorOut1, (uint64_t)(uintptr_t)out1);
+            image.setUInt64(v1_images::kVectorOut2, (uint64_t)(uintptr_t)out2);
+            image.setUInt64(v1_images::kVectorBad,  (uint64_t)(uintptr_t)bad);
+
+            vmReturn<> retVal;
+            int ec = run_v1_image(thread, image, quickened != 0, retVal);
+
+            size_t mismatches = 0;
+            for (size_t i = 0; i < lanes; ++i) {
+                if (out0[i] != a[i] * b[i] + 3)
+                    mismatches++;
+                if (out1[i] != ((a[i] > b[i]) ? a[i] : b[i]))
+                    mismatches++;
+                if (out2[i] != a[idx[i] % lanes])
+                    mismatches++;
+            }
+            for (size_t i = 0; i < 8; ++i) {
+                if (bad[i] != 0xA5)
+                    mismatches++;
+            }
+            uint32_t expected = (uint32_t)(3 * lanes);
+            if (ec != Error::Ok || (uint32_t)retVal.getValue() != expected || mismatches != 0) {
+                printf("  %s%s: eax = %u, expected %u, %u mismatches, ec = %d\n",
+                       kNames[width], quickened ? " (quickened)" : "",
+                       (uint32_t)retVal.getValue(), expected, (uint32_t)mismatches, ec);
+                failures++;
+            }
+            else {
+                printf("  %s%s: ok\n", kNames[width], quickened ? " (quickened)" : "");
+            }
+        }
+    }
+    printf("\n");
+    printf("  %s\n\n", (failures == 0) ? "passed" : "FAILED");
+}
+
+//
+// The bulk memory instructions on the heap, the mem_chr out of the heap is
+// rejected.
+//
+void test_Interpreter_v1_memory()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_Interpreter_v1_memory()\n");
+    printf("--------------------------------------------\n\n");
+
+    static const size_t kHeapSize = 4096;
+    v1_images::vmTestImage image(v1_images::memOpsBinary);
+
+    size_t failures = 0;
+    for (int quickened = 0; quickened <= 1; quickened++) {
+        v1::vmThread<> thread;
+        thread.vmThreadBase<uintptr_t>::create(false, 64 * 1024, kHeapSize);
+        unsigned char * heap = thread.getHeap().first();
+        for (size_t i = 0; i < 1000; ++i) {
+            heap[i] = (unsigned char)i;
+        }
+
+        image.setUInt64(v1_images::kMemSetDest,  (uint64_t)(uintptr_t)(heap + 2000));
+        image.setUInt64(v1_images::kMemCopyDest, (uint64_t)(uintptr_t)(heap + 1000));
+        image.setUInt64(v1_images::kMemCopySrc,  (uint64_t)(uintptr_t)heap);
+        image.setUInt64(v1_images::kMemChrPtr,   (uint64_t)(uintptr_t)(heap + 1500));
+        image.setUInt64(v1_images::kMemBadPtr,   (uint64_t)(uintptr_t)(heap + 3000));
+
+        vmReturn<> retVal;
+        int ec = run_v1_image(thread, image, quickened != 0, retVal);
+
+        size_t mismatches = 0;
+        for (size_t i = 0; i < 1000; ++i) {
+            if (heap[1000 + i] != (unsigned char)i)
+                mismatches++;
+            if (heap[2000 + i] != 7)
+                mismatches++;
+        }
+        for (size_t i = 3000; i < kHeapSize; ++i) {
+            if (heap[i] != 0)
+                mismatches++;
+        }
+        if (ec != Error::Ok || (uint32_t)retVal.getValue() != 118 || mismatches != 0) {
+            printf("  %s: eax = %u, expected 118, %u mismatches, ec = %d\n",
+                   quickened ? "quickened" : "generic",
+                   (uint32_t)retVal.getValue(), (uint32_t)mismatches, ec);
+            failures++;
+        }
+        else {
+            printf("  %s: ok\n", quickened ? "quickened" : "generic");
+        }
+    }
+    printf("\n");
+    printf("  %s\n\n", (failures == 0) ? "passed" : "FAILED");
+}
+
+//
+// The natives of nativeCallBinary, see v1_images.h.
+//
+static uint64_t s_nativeRecords[3];
+static int s_nativeBumps = 0;
+
+static uint64_t v1_native_hash(const char * text, size_t len)
+{
+    uint64_t hash = 14695981039346656037ULL;
+    for (size_t i = 0; i < len; ++i) {
+        hash ^= (unsigned char)text[i];
+        hash *= 1099511628211ULL;
+    }
+    return hash;
+}
+
+static double v1_native_hypot(double x, double y)
+{
+    return sqrt(x * x + y * y);
+}
+
+static int32_t v1_native_sum6(int32_t a, int8_t b, uint16_t c, int64_t d, int e, long f)
+{
+    return (int32_t)(a + b + c + d + e + f);
+}
+
+static void v1_native_bump()
+{
+    s_nativeBumps++;
+}
+
+static void v1_native_record(uint32_t slot, uint64_t value)
+{
+    if (slot < sizeof(s_nativeRecords) / sizeof(s_nativeRecords[0]))
+        s_nativeRecords[slot] = value;
+}
+
+//
+// call_native passes r0 .. r5 to the host functions of their signatures,
+// and the call of a native that isn't registered is skipped.
+//
+void test_Interpreter_v1_native()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_Interpreter_v1_native()\n");
+    printf("--------------------------------------------\n\n");
+
+    static const char kText[] = "hello world";
+
+    vmNativeTable natives;
+    bool registered = (natives.add("hash", &v1_native_hash) == 0 &&
+                       natives.add("hypot", &v1_native_hypot) == 1 &&
+                       natives.add("sum6", &v1_native_sum6) == 2 &&
+                       natives.add("bump", &v1_native_bump) == 3 &&
+                       natives.add("record", &v1_native_record) == 4 &&
+                       natives.find("sum6") == 2 &&
+                       natives.find("none") == vmNativeTable::kNotFound);
+
+    v1_images::vmTestImage image(v1_images::nativeCallBinary);
+    image.setUInt64(v1_images::kNativeText, (uint64_t)(uintptr_t)kText);
+
+    double hypot = 5.0;
+    uint64_t hypotBits;
+    memcpy(&hypotBits, &hypot, sizeof(hypotBits));
+    const uint64_t expected[3] = {
+        v1_native_hash(kText, 11),
+        hypotBits,
+        (uint64_t)(int64_t)v1_native_sum6(-5, -1, 2, 1000000000000LL, 7, -3)
+    };
+
+    size_t failures = registered ? 0 : 1;
+    for (int quickened = 0; quickened <= 1; quickened++) {
+        v1::vmThread<> thread;
+        thread.create(64 * 1024);
+        thread.setNativeTable(&natives);
+        memset(s_nativeRecords, 0, sizeof(s_nativeRecords));
+        s_nativeBumps = 0;
+
+        vmReturn<> retVal;
+        int ec = run_v1_image(thread, image, quickened != 0, retVal);
+
+        size_t mismatches = 0;
+        for (size_t i = 0; i < 3; ++i) {
+            if (s_nativeRecords[i] != expected[i]) {
+                printf("  record %u: 0x%016" PRIX64 ", expected 0x%016" PRIX64 "\n",
+                       (uint32_t)i, s_nativeRecords[i], expected[i]);
+                mismatches++;
+            }
+        }
+        if (ec != Error::Ok || (uint32_t)retVal.getValue() != 0x5A ||
+            s_nativeBumps != 2 || mismatches != 0) {
+            printf("  %s: eax = 0x%X, bumps = %d, %u mismatches, ec = %d\n",
+                   quickened ? "quickened" : "generic", (uint32_t)retVal.getValue(),
+                   s_nativeBumps, (uint32_t)mismatches, ec);
+            failures++;
+        }
+        else {
+            printf("  %s: ok\n", quickened ? "quickened" : "generic");
+        }
+    }
+    printf("\n");
+    printf("  %s\n\n", (failures == 0) ? "passed" : "FAILED");
+}
+
+//
+// The fuel and the interrupts stop the loop at its safepoint, the paused
+// context and the context that's out of fuel go on with resumeRun(), the
+// aborted context runs again from the entry.
+//
+void test_Interpreter_v1_safepoint()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_Interpreter_v1_safepoint()\n");
+    printf("--------------------------------------------\n\n");
+
+    static const uint32_t kCount = 100000;
+    static const int64_t kFuel = 10000;
+
+    v1_images::vmTestImage image(v1_images::countLoopBinary);
+    image.setUInt32(v1_images::kLoopCount, kCount);
+
+    size_t failures = 0;
+    for (int quickened = 0; quickened <= 1; quickened++) {
+        const char * mode = quickened ? "quickened" : "generic";
+        v1::vmThread<> thread;
+        thread.create(64 * 1024);
+        vmSafepoint & safepoint = thread.getSafepoint();
+        vmReturn<> retVal;
+
+        // Out of fuel, refill it until the loop is done.
+        safepoint.setFuel(kFuel);
+        int ec = run_v1_image(thread, image, quickened != 0, retVal);
+        uint32_t stops = 0;
+        while (ec == Error::Safepoint_Out_Of_Fuel && safepoint.isSuspended()) {
+            stops++;
+            safepoint.addFuel(kFuel);
+            ec = thread.resumeRun(retVal);
+        }
+        uint32_t expectedStops = (uint32_t)((int64_t)kCount * v1_images::kLoopIterationCost / kFuel);
+        bool fuelOk = (ec == Error::Ok && (uint32_t)retVal.getValue() == kCount &&
+                       stops + 1 >= expectedStops && stops <= expectedStops + 1);
+        printf("  %-9s fuel:  %u stops, eax = %u, ec = %d  %s\n", mode, stops,
+               (uint32_t)retVal.getValue(), ec, fuelOk ? "ok" : "FAILED");
+        safepoint.disableFuel();
+
+        // Pause at the first poll, and go on.
+        safepoint.requestPause();
+        ec = run_v1_image(thread, image, quickened != 0, retVal);
+        bool paused = (ec == Error::Safepoint_Paused && safepoint.isSuspended());
+        ec = thread.resumeRun(retVal);
+        bool pauseOk = (paused && ec == Error::Ok && (uint32_t)retVal.getValue() == kCount);
+        printf("  %-9s pause: eax = %u, ec = %d  %s\n", mode,
+               (uint32_t)retVal.getValue(), ec, pauseOk ? "ok" : "FAILED");
+
+        // Pause, abort, then the aborted context can't be resumed, and it
+        // runs again from the entry.
+        safepoint.requestPause();
+        ec = run_v1_image(thread, image, quickened != 0, retVal);
+        paused = (ec == Error::Safepoint_Paused);
+        safepoint.requestAbort();
+        int ecAbort = thread.resumeRun(retVal);
+        bool aborted = (ecAbort == Error::Safepoint_Aborted && !safepoint.isSuspended());
+        int ecResume = thread.resumeRun(retVal);
+        ec = run_v1_image(thread, image, quickened != 0, retVal);
+        bool abortOk = (paused && aborted && ecResume == Error::Safepoint_Not_Suspended &&
+                        ec == Error::Ok && (uint32_t)retVal.getValue() == kCount);
+        printf("  %-9s abort: ec = %d, %d, rerun eax = %u, ec = %d  %s\n", mode,
+               ecAbort, ecResume, (uint32_t)retVal.getValue(), ec, abortOk ? "ok" : "FAILED");
+
+        if (!fuelOk || !pauseOk || !abortOk)
+            failures++;
+    }
+    printf("\n");
+    printf("  %s\n\n", (failures == 0) ? "passed" : "FAILED");
+}
+
+static std::atomic<bool> s_schedulerRelease(false);
+static std::atomic<uint32_t> s_schedulerBlocked(0);
+static std::atomic<uint32_t> s_schedulerSpawned(0);
+static v1::vmScheduler<> *   s_schedulerSpawner = nullptr;
+static std::vector<v1::vmThread<> *> * s_schedulerChildren = nullptr;
+
+static void v1_sched_nop()
+{
+}
+
+static void v1_sched_sleep()
+{
+    v1::vmScheduler<>::enterBlocking();
+    std::this_thread::sleep_for(std::chrono::microseconds(100));
+    v1::vmScheduler<>::leaveBlocking();
+}
+
+// Block the worker until it's released, or for 5 seconds.
+static void v1_sched_wait()
+{
+    v1::vmScheduler<>::enterBlocking();
+    s_schedulerBlocked++;
+    for (int i = 0; i < 5000 && !s_schedulerRelease.load(); i++) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    v1::vmScheduler<>::leaveBlocking();
+}
+
+// Spawn the children on the worker, they go to its local queue, and the
+// other workers steal them.
+static void v1_sched_spawn()
+{
+    std::vector<v1::vmThread<> *> & children = *s_schedulerChildren;
+    uint32_t index = s_schedulerSpawned.load();
+    for (uint32_t i = 0; i < 8 && index < children.size(); i++, index++) {
+        s_schedulerSpawner->spawn(children[index]);
+    }
+    s_schedulerSpawned.store(index);
+}
+
+static void v1_sched_create(v1::vmThread<> & thread, const v1_images::vmTestImage & image,
+                            vmNativeTable & natives, v1::vmScheduler<> & scheduler,
+                            bool quickened)
+{
+    thread.create(16 * 1024);
+    image.attach(thread);
+    thread.setNativeTable(&natives);
+    thread.setQuickened(quickened);
+    thread.setScheduler(&scheduler);
+}
+
+//
+// The green threads on the workers of vmScheduler: the time slice and the
+// yield opcode preempt them, the blocked workers are replaced by the spare
+// workers, the threads that are spawned on a worker are stolen, and stop()
+// finishes the threads that are left, so they can be spawned again.
+//
+void test_Scheduler()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_Scheduler()\n");
+    printf("--------------------------------------------\n\n");
+
+    static const size_t kWorkers = 4;
+    static const size_t kThreads = 300;
+    static const uint32_t kSpinCount = 20000;
+    static const uint32_t kYieldCount = 50;
+    static const uint32_t kSleepCount = 3;
+
+    vmNativeTable nopNatives, sleepNatives, waitNatives, spawnNatives;
+    nopNatives.add("nop", &v1_sched_nop);
+    sleepNatives.add("sleep", &v1_sched_sleep);
+    waitNatives.add("wait", &v1_sched_wait);
+    spawnNatives.add("spawn", &v1_sched_spawn);
+
+    v1_images::vmTestImage spinImage(v1_images::countLoopBinary);
+    spinImage.setUInt32(v1_images::kLoopCount, kSpinCount);
+    v1_images::vmTestImage yieldImage(v1_images::yieldLoopBinary);
+    yieldImage.setUInt32(v1_images::kYieldLoopCount, kYieldCount);
+    v1_images::vmTestImage sleepImage(v1_images::yieldLoopBinary);
+    sleepImage.setUInt32(v1_images::kYieldLoopCount, kSleepCount);
+    v1_images::vmTestImage onceImage(v1_images::yieldLoopBinary);
+    onceImage.setUInt32(v1_images::kYieldLoopCount, 1);
+    // The count 0 loops 2^32 times, it runs until it's stopped.
+    v1_images::vmTestImage endlessImage(v1_images::countLoopBinary);
+    endlessImage.setUInt32(v1_images::kLoopCount, 0);
+
+    size_t failures = 0;
+    v1::vmScheduler<> scheduler;
+    scheduler.setSlice(4096);
+    scheduler.start(kWorkers);
+
+    // The spinning, the yielding and the sleeping threads.
+    std::vector<v1::vmThread<> *> threads(kThreads);
+    for (size_t i = 0; i < kThreads; i++) {
+        threads[i] = new v1::vmThread<>();
+        if (i % 3 == 0)
+            v1_sched_create(*threads[i], spinImage, nopNatives, scheduler, (i % 2) == 0);
+        else if (i % 3 == 1)
+            v1_sched_create(*threads[i], yieldImage, nopNatives, scheduler, (i % 2) == 0);
+        else
+            v1_sched_create(*threads[i], sleepImage, sleepNatives, scheduler, (i % 2) == 0);
+    }
+
+    StopWatch sw;
+    sw.start();
+    for (size_t i = 0; i < kThreads; i++) {
+        threads[i]->start();
+    }
+    scheduler.waitAll();
+    sw.stop();
+
+    size_t wrong = 0;
+    for (size_t i = 0; i < kThreads; i++) {
+        uint32_t expected = (i % 3 == 0) ? kSpinCount : ((i % 3 == 1) ? kYieldCount : kSleepCount);
+        if (threads[i]->getExitCode() != Error::Ok ||
+            (uint32_t)threads[i]->getReturn().getValue() != expected)
+            wrong++;
+    }
+    printf("  run:     %u threads on %u workers, %u wrong, %0.2f ms  %s\n",
+           (uint32_t)kThreads, (uint32_t)kWorkers, (uint32_t)wrong,
+           sw.getElapsedMillisec(), (wrong == 0) ? "ok" : "FAILED");
+    if (wrong != 0)
+        failures++;
+
+    // The threads that are spawned on a worker.
+    std::vector<v1::vmThread<> *> children(kThreads);
+    for (size_t i = 0; i < kThreads; i++) {
+        children[i] = threads[i];
+        children[i]->setNativeTable(&nopNatives);
+    }
+    s_schedulerChildren = &children;
+    s_schedulerSpawner = &scheduler;
+    s_schedulerSpawned = 0;
+    v1::vmThread<> spawner;
+    v1_images::vmTestImage spawnImage(v1_images::yieldLoopBinary);
+    spawnImage.setUInt32(v1_images::kYieldLoopCount, (uint32_t)(kThreads / 8 + 1));
+    v1_sched_create(spawner, spawnImage, spawnNatives, scheduler, true);
+    spawner.start();
+    scheduler.waitAll();
+    wrong = 0;
+    for (size_t i = 0; i < kThreads; i++) {
+        if (!children[i]->isFinished() || children[i]->getExitCode() != Error::Ok)
+            wrong++;
+    }
+    bool spawnOk = (s_schedulerSpawned.load() == kThreads && wrong == 0 &&
+                    spawner.getExitCode() == Error::Ok);
+    printf("  spawn:   %u threads spawned on the workers, %u wrong  %s\n",
+           s_schedulerSpawned.load(), (uint32_t)wrong, spawnOk ? "ok" : "FAILED");
+    if (!spawnOk)
+        failures++;
+
+    // Block all the workers, the spare workers run the spinning thread.
+    s_schedulerRelease = false;
+    s_schedulerBlocked = 0;
+    std::vector<v1::vmThread<> *> waiters(kWorkers);
+    for (size_t i = 0; i < kWorkers; i++) {
+        waiters[i] = new v1::vmThread<>();
+        v1_sched_create(*waiters[i], onceImage, waitNatives, scheduler, true);
+        waiters[i]->start();
+    }
+    while (s_schedulerBlocked.load() < kWorkers) {
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+    }
+    threads[0]->start();
+    scheduler.join(threads[0]);
+    uint32_t blocking = scheduler.getBlockingCount();
+    s_schedulerRelease = true;
+    scheduler.waitAll();
+    bool spareOk = (blocking == kWorkers && threads[0]->getExitCode() == Error::Ok &&
+                    (uint32_t)threads[0]->getReturn().getValue() == kSpinCount);
+    printf("  blocked: %u workers blocked, eax = %u  %s\n", blocking,
+           (uint32_t)threads[0]->getReturn().getValue(), spareOk ? "ok" : "FAILED");
+    if (!spareOk)
+        failures++;
+
+    // Suspend, resume and stop the endless thread.
+    v1::vmThread<> endless;
+    v1_sched_create(endless, endlessImage, nopNatives, scheduler, true);
+    endless.start();
+    endless.suspend();
+    while (endless.getStatus() != v1::vmThreadStatus::Suspended) {
+        std::this_thread::yield();
+    }
+    endless.resume();
+    endless.stop();
+    scheduler.join(&endless);
+    bool stopOk = (endless.getExitCode() == Error::Safepoint_Aborted);
+    printf("  stop:    exit code = %d  %s\n", endless.getExitCode(), stopOk ? "ok" : "FAILED");
+    if (!stopOk)
+        failures++;
+
+    // Stop the scheduler with a suspended thread and the queued threads,
+    // then spawn them again.
+    endless.start();
+    endless.suspend();
+    while (endless.getStatus() != v1::vmThreadStatus::Suspended) {
+        std::this_thread::yield();
+    }
+    for (size_t i = 0; i < kThreads; i++) {
+        threads[i]->start();
+    }
+    scheduler.stop();
+    scheduler.waitAll();
+    bool dropped = (endless.isFinished() && endless.getExitCode() == Error::Safepoint_Aborted);
+    scheduler.start(kWorkers);
+    for (size_t i = 0; i < kThreads; i++) {
+        threads[i]->start();
+    }
+    scheduler.waitAll();
+    wrong = 0;
+    for (size_t i = 0; i < kThreads; i++) {
+        if (threads[i]->getExitCode() != Error::Ok)
+            wrong++;
+    }
+    bool restartOk = (dropped && wrong == 0);
+    printf("  restart: %u wrong after the restart  %s\n", (uint32_t)wrong,
+           restartOk ? "ok" : "FAILED");
+    if (!restartOk)
+        failures++;
+
+    scheduler.stop();
+    for (size_t i = 0; i < kWorkers; i++) {
+        delete waiters[i];
+    }
+    for (size_t i = 0; i < kThreads; i++) {
+        delete threads[i];
+    }
+    s_schedulerChildren = nullptr;
+    s_schedulerSpawner = nullptr;
+
+    printf("\n");
+    printf("  %s\n\n", (failures == 0) ? "passed" : "FAILED");
+}
+
+void test_Interpreter_v1()
+{
+    test_Interpreter<v1::Interpreter<>>("Interpreter_v1");
+}
+
+void test_Interpreter_v1_quickened()
+{
+    test_Interpreter_quickened<v1::Interpreter<>>("Interpreter_v1_quickened");
+}
+
+void test_Interpreter_v2()
+{
+    test_Interpreter<v2::Interpreter<>>("Interpreter_v2");
+}
+
+void test_Interpreter_v3()
+{
+    test_Interpreter<v3::Interpreter<>>("Interpreter_v3");
+}
+
+void test_Interpreter_v3_threaded()
+{
+    test_Interpreter_threaded<v3::Interpreter<>>("Interpreter_v3_threaded");
+}
+
+void test_Interpreter_v3_verified()
+{
+    test_Interpreter_verified<v3::Interpreter<>>("Interpreter_v3_verified");
+}
+
+void test_Interpreter_v3_tuned()
+{
+    v3::TunedInterpreter<> tuned;
+    int ec = tuned.create();
+    if (ec > 0) {
+        printf("--------------------------------------------\n");
+        printf("  v3::TunedInterpreter  [calibration]\n");
+        printf("--------------------------------------------\n\n");
+        for (size_t i = 0; i < tuned.getVariantCount(); ++i) {
+            printf("  %c [%u] %-40s %0.3f ms\n",
+                   (i == tuned.getSelected()) ? '*' : ' ', (uint32_t)i,
+                   tuned.getVariantName(i), tuned.getTiming(i));
+        }
+        printf("\n");
+    }
+
+    // An unknown variant can't be pinned, the selection is kept.
+    size_t selected = tuned.getSelected();
+    ec = tuned.pin(tuned.getVariantCount());
+    if (ec != Error::Tuned_Variant_Out_Of_Range || tuned.isPinned() ||
+        tuned.getSelected() != selected) {
+        printf("  pin(%u) FAILED, ec = %d\n\n", (uint32_t)tuned.getVariantCount(), ec);
+    }
+
+    test_Interpreter_mode<v3::TunedInterpreter<>>("Interpreter_v3_tuned", "auto-tuned layout",
+                                                  &v3::TunedInterpreter<>::run);
+}
+
+void test_Interpreter_v3_predecoded()
+{
+    test_Interpreter_predecoded<v3::Interpreter<>>("Interpreter_v3_predecoded");
+}
+
+void test_Interpreter_v3_superinsn()
+{
+    test_Interpreter_superinsn<v3::Interpreter<>>("Interpreter_v3_superinsn");
+}
+
+void test_Interpreter_v3_jit()
+{
+    test_Interpreter_jit<v3::Interpreter<>>("Interpreter_v3_jit");
+}
+
+void test_Interpreter_v3_traced()
+{
+    test_Interpreter_traced<v3::Interpreter<>>("Interpreter_v3_traced");
+}
+
+//
+// The deep recursion of the compiled code stops at the VM stack limit,
+// before the host stack overflows, and the code still runs after it.
+//
+void test_JitCompiler_overflow()
+{
+#if USE_JIT_X86_64
+    printf("--------------------------------------------\n");
+    printf("  test_JitCompiler_overflow()\n");
+    printf("--------------------------------------------\n\n");
+
+    static const uint32_t kDeepInput = 10000000;
+    static const uint32_t kInput = 20;
+
+    v3::Interpreter<> interpreter;
+    int ec = interpreter.create();
+    vmReturn<> retVal;
+    retVal.setDataType(vmReturn<>::Basic);
+    retVal.setValue(kDeepInput);
+    int overflow = interpreter.run_jit(retVal);
+    retVal.setValue(kInput);
+    int after = interpreter.run_jit(retVal);
+    bool ok = (ec > 0 && overflow == Error::Jit_Stack_Overflow && after == Error::Ok &&
+               (uint32_t)retVal.getValue() == fibonacci32(kInput));
+    printf("  overflow: %s, then fibonacci(%u) = %u  %s\n",
+           Error::format((Error::Type)overflow), kInput, (uint32_t)retVal.getValue(),
+           ok ? "ok" : "FAILED");
+
+    printf("\n");
+    printf("  %s\n\n", ok ? "passed" : "FAILED");
+#endif
+}
+
+void test_Interpreter_v3_register()
+{
+    test_Interpreter_register<v3::Interpreter<>>("Interpreter_v3_register");
+}
+
+void test_Interpreter_v3_inline()
+{
+    test_Interpreter_inline<v3::Interpreter<>>("Interpreter_v3_inline");
+}
+
+//
+// Run the invocations of the shared fib image on 1 .. hardware_concurrency
+// workers, and print the throughput of the pool. The invocations that are
+// queued when the pool is stopped are done with Error::Pool_Stopped.
+//
+void test_ExecutionPool()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_ExecutionPool()\n");
+    printf("--------------------------------------------\n\n");
+
+    static const size_t kJobs = 20000;
+    static const uint32_t kMaxInput = 20;
+
+    size_t maxWorkers = std::thread::hardware_concurrency();
+    if (maxWorkers == 0)
+        maxWorkers = 1;
+
+    std::vector<v3::vmInvocation<>> jobs(kJobs);
+    for (size_t i = 0; i < kJobs; i++) {
+        jobs[i].setInput(1 + (uint32_t)(i % kMaxInput));
+    }
+
+    typedef v3::vmFibonacciImage<v3::ExecutionPool<>::layout_type> image_type;
+
+    size_t failures = 0;
+    for (size_t workers = 1; workers <= maxWorkers; workers++) {
+        v3::ExecutionPool<> pool;
+        int ec = pool.start(&image_type::kBinary[0], image_type::kImageSize,
+                            image_type::kFuncOffset, workers);
+        if (ec != Error::Ok) {
+            printf("  workers = %-2u  start: ec = %d  FAILED\n", (uint32_t)workers, ec);
+            failures++;
+            continue;
+        }
+        pool.resetStats();
+        pool.submit(jobs.data(), jobs.size());
+        pool.waitAll();
+        v3::vmPoolStats stats = pool.getStats();
+
+        size_t wrong = 0;
+        for (size_t i = 0; i < kJobs; i++) {
+            if (jobs[i].getErrorCode() != Error::Ok ||
+                (uint32_t)jobs[i].getReturn().getValue() != fibonacci32(jobs[i].getInput()))
+                wrong++;
+        }
+        printf("  workers = %-2u  completed = %" PRIu64 ", %0.0f jobs/s, utilization = %0.2f, "
+               "%u wrong  %s\n", (uint32_t)stats.workers, stats.completed,
+               stats.throughput(), stats.utilization(), (uint32_t)wrong,
+               (wrong == 0) ? "ok" : "FAILED");
+        if (wrong != 0)
+            failures++;
+    }
+
+    // Stop the pool with the queued invocations.
+    v3::ExecutionPool<> pool;
+    pool.start(USE_FIBONACCI_IMAGE, 1);
+    pool.submit(jobs.data(), jobs.size());
+    pool.stop();
+    size_t completed = 0, stopped = 0;
+    for (size_t i = 0; i < kJobs; i++) {
+        int ec = pool.wait(&jobs[i]);
+        if (ec == Error::Ok)
+            completed++;
+        else if (ec == Error::Pool_Stopped)
+            stopped++;
+    }
+    pool.waitAll();
+    bool stopOk = (completed + stopped == kJobs);
+    printf("  stop:         %u completed, %u stopped  %s\n",
+           (uint32_t)completed, (uint32_t)stopped, stopOk ? "ok" : "FAILED");
+    if (!stopOk)
+        failures++;
+
+    // The entry out of the image.
+    v3::ExecutionPool<> badPool;
+    int badEc = badPool.start(&image_type::kBinary[0], image_type::kImageSize,
+                              image_type::kImageSize, 1);
+    bool badOk = (badEc == Error::Pool_Invalid_Entry && !badPool.isStarted());
+    printf("  bad entry:    ec = %d  %s\n", badEc, badOk ? "ok" : "FAILED");
+    if (!badOk)
+        failures++;
+
+    // The invocations on the one context after the overflow of its stack.
+    v3::ExecutionPool<> reusePool;
+    reusePool.start(USE_FIBONACCI_IMAGE, 1, 65536);
+    v3::vmInvocation<> reuseJobs[3];
+    reuseJobs[0].setInput(kMaxInput);
+    reuseJobs[1].setInput(1000000);
+    reuseJobs[2].setInput(kMaxInput);
+    reusePool.submit(reuseJobs, 3);
+    reusePool.waitAll();
+    bool reuseOk = (reuseJobs[1].getErrorCode() == Error::StackGuard_Overflow);
+    for (size_t i = 0; i < 3; i += 2) {
+        if (reuseJobs[i].getErrorCode() != Error::Ok ||
+            (uint32_t)reuseJobs[i].getReturn().getValue() != fibonacci32(kMaxInput))
+            reuseOk = false;
+    }
+    printf("  overflow:     ec = %d, fibonacci(%u) = %u after it  %s\n",
+           reuseJobs[1].getErrorCode(), kMaxInput,
+           (uint32_t)reuseJobs[2].getReturn().getValue(), reuseOk ? "ok" : "FAILED");
+    if (!reuseOk)
+        failures++;
+
+    printf("\n");
+    printf("  %s\n\n", (failures == 0) ? "passed" : "FAILED");
+}
+
+static int run_pooled_context(v3::ExecutionContext<> * context, uint32_t n, uint32_t & result)
+{
+    vmReturn<> retVal;
+    retVal.setDataType(vmReturn<>::Basic);
+    // The frame of fib(n), a pad slot and n.
+    context->clearArgs();
+    context->pushArg(0);
+    context->pushArg(n);
+    int ec = context->run_predecoded(retVal);
+    result = (uint32_t)retVal.getValue();
+    return ec;
+}
+
+//
+// The requests on the pooled contexts against the fresh contexts, and the
+// trim() that runs beside acquire() and release().
+//
+void test_ContextPool()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_ContextPool()\n");
+    printf("--------------------------------------------\n\n");
+
+    static const size_t kContexts = 4;
+    static const size_t kRequests = 20000;
+    static const size_t kFreshRequests = 200;
+    static const uint32_t kInput = 12;
+
+    v3::vmSharedImage image;
+    image.loadBuiltin<v3::vmDefaultLayout>(USE_FIBONACCI_IMAGE);
+    image.freeze();
+
+    v3::vmContextPool<> pool;
+    int ec = pool.create(image.data(), image.size(), image.entry(), kContexts);
+    size_t failures = 0;
+    uint32_t expected = fibonacci32(kInput);
+    uint32_t result = 0;
+
+    // The pooled contexts.
+    size_t wrong = 0;
+    StopWatch sw;
+    sw.start();
+    for (size_t i = 0; i < kRequests; i++) {
+        v3::ExecutionContext<> * context = pool.acquire();
+        if (run_pooled_context(context, kInput, result) != Error::Ok || result != expected)
+            wrong++;
+        pool.release(context);
+    }
+    sw.stop();
+    double pooledTime = sw.getElapsedMillisec() * 1000.0 / kRequests;
+
+    // The contexts that are created per request.
+    sw.start();
+    for (size_t i = 0; i < kFreshRequests; i++) {
+        v3::ExecutionContext<> context;
+        context.setImageInfo(image.data(), image.size(), image.entry());
+        context.create();
+        context.predecode();
+        if (run_pooled_context(&context, kInput, result) != Error::Ok || result != expected)
+            wrong++;
+    }
+    sw.stop();
+    double freshTime = sw.getElapsedMillisec() * 1000.0 / kFreshRequests;
+
+    v3::vmContextPoolStats stats = pool.getStats();
+    bool runOk = (ec == Error::Ok && wrong == 0 && stats.created == kContexts && stats.misses == 0);
+    printf("  run:   pooled %0.2f us/req, fresh %0.2f us/req, %u wrong, "
+           "%u created, %u misses  %s\n", pooledTime, freshTime, (uint32_t)wrong,
+           (uint32_t)stats.created, (uint32_t)stats.misses, runOk ? "ok" : "FAILED");
+    printf("         verify: %s\n", Error::format((Error::Type)stats.verifyResult));
+    if (!runOk)
+        failures++;
+
+    // Trim all the pages, the trimmed contexts still run.
+    pool.setKeepSize(0);
+    size_t trimmed = pool.trim();
+    wrong = 0;
+    for (size_t i = 0; i < kContexts * 2; i++) {
+        v3::ExecutionContext<> * context = pool.acquire();
+        if (run_pooled_context(context, kInput, result) != Error::Ok || result != expected)
+            wrong++;
+        pool.release(context);
+    }
+    stats = pool.getStats();
+    bool trimOk = (trimmed > 0 && wrong == 0 && stats.highWater > 0);
+    printf("  trim:  %u bytes trimmed, high-water = %u, %u wrong  %s\n",
+           (uint32_t)trimmed, (uint32_t)stats.highWater, (uint32_t)wrong,
+           trimOk ? "ok" : "FAILED");
+    if (!trimOk)
+        failures++;
+
+    // trim() beside acquire() never leaves the pool without idle contexts.
+    std::atomic<bool> trimming(true);
+    std::thread trimmer([&pool, &trimming] {
+        while (trimming.load()) {
+            pool.trim();
+        }
+    });
+    wrong = 0;
+    for (size_t i = 0; i < kRequests; i++) {
+        v3::ExecutionContext<> * context = pool.acquire();
+        if (run_pooled_context(context, kInput, result) != Error::Ok || result != expected)
+            wrong++;
+        pool.release(context);
+    }
+    trimming = false;
+    trimmer.join();
+    stats = pool.getStats();
+    bool concurrentOk = (wrong == 0 && stats.created == kContexts && stats.misses == 0);
+    printf("  race:  %u wrong, %u created, %u misses  %s\n", (uint32_t)wrong,
+           (uint32_t)stats.created, (uint32_t)stats.misses, concurrentOk ? "ok" : "FAILED");
+    if (!concurrentOk)
+        failures++;
+
+    printf("\n");
+    printf("  %s\n\n", (failures == 0) ? "passed" : "FAILED");
+}
+
+//
+// Push the frames of kDepth calls by push_callstack() from a small growable
+// stack, and pop them back. The saved fp of every frame must be rebased when
+// the stack moves, so the pops come back to the frames that were pushed.
+//
+template <typename Layout>
+static bool test_growable_callstack(const v3::vmSharedImage & image)
+{
+    typedef v3::ExecutionContext<uintptr_t, Layout> context_type;
+    typedef typename context_type::vmStackPtr       vmStackPtr;
+    typedef typename context_type::vmFramePtr       vmFramePtr;
+
+    static const uint32_t kDepth = 1000;
+
+    context_type context;
+    context.setImageInfo(image.data(), image.size(), image.entry());
+    context.createGrowable(256, 256 * 1024);
+    context.predecode();
+    if (context.verify() != Error::Ok)
+        return false;
+    size_t initialCapacity = context.getStackCapacity();
+
+    vmStackPtr sp(context.getStackTop());
+    vmFramePtr fp(context.getStackTop());
+    std::vector<uint64_t> frames;
+
+    // The entry frame returns to nullptr, like the entry frame of a run.
+    context.template push_callstack<true>(sp, fp, nullptr);
+    frames.push_back(context.getStackOffset(fp.ptr()));
+    for (uint32_t i = 1; i <= kDepth; i++) {
+        sp.push_UInt32(i);
+        context.template push_callstack<true>(sp, fp, (void *)(uintptr_t)i);
+        frames.push_back(context.getStackOffset(fp.ptr()));
+    }
+
+    bool ok = (context.getStackCapacity() > initialCapacity);
+    for (uint32_t i = kDepth; i >= 1; i--) {
+        void * returnIP = context.pop_callstack(sp, fp);
+        uint32_t arg = sp.pop_UInt32();
+        if (returnIP != (void *)(uintptr_t)i || arg != i ||
+            context.getStackOffset(fp.ptr()) != frames[i - 1])
+            ok = false;
+    }
+    return ok;
+}
+
+//
+// The growable stack starts small and grows on the calls of the pre-decoded
+// loop, the other loops refuse it.
+//
+void test_Interpreter_v3_growable()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_Interpreter_v3_growable()\n");
+    printf("--------------------------------------------\n\n");
+
+    static const uint32_t kInputs[] = { 5, 12, 20, 25 };
+
+    v3::vmSharedImage image;
+    image.loadBuiltin<v3::vmDefaultLayout>(USE_FIBONACCI_IMAGE);
+    image.freeze();
+    size_t failures = 0;
+    uint32_t result = 0;
+
+    // The unverified image can't grow the stack.
+    v3::ExecutionContext<> context;
+    context.setImageInfo(image.data(), image.size(), image.entry());
+    context.createGrowable(256, 64 * 1024);
+    context.predecode();
+    int unverified = run_pooled_context(&context, 5, result);
+
+    // The verified image grows the stack as fib() goes deeper.
+    int verified = context.verify();
+    size_t initialCapacity = context.getStackCapacity();
+    size_t wrong = 0;
+    for (size_t i = 0; i < sizeof(kInputs) / sizeof(kInputs[0]); i++) {
+        if (run_pooled_context(&context, kInputs[i], result) != Error::Ok ||
+            result != fibonacci32(kInputs[i]))
+            wrong++;
+    }
+    bool growOk = (unverified == Error::Stack_Grow_Unverified && verified == Error::Ok &&
+                   wrong == 0 && context.getStackCapacity() > initialCapacity);
+    printf("  grow:     %u -> %u bytes, %u wrong  %s\n", (uint32_t)initialCapacity,
+           (uint32_t)context.getStackCapacity(), (uint32_t)wrong, growOk ? "ok" : "FAILED");
+    if (!growOk)
+        failures++;
+
+    // The entry function can't run without its arguments.
+    vmReturn<> retVal;
+    retVal.setDataType(vmReturn<>::Basic);
+    context.clearArgs();
+    int noArgs = context.run_predecoded(retVal);
+    // The other loops don't grow the stack.
+    context.pushArg(0);
+    context.pushArg(5);
+    int notGrowable = context.run_threaded(retVal);
+    bool refuseOk = (noArgs == Error::Verify_Stack_Underflow &&
+                     notGrowable == Error::Stack_Not_Growable);
+    printf("  refuse:   %s, %s  %s\n", Error::format((Error::Type)noArgs),
+           Error::format((Error::Type)notGrowable), refuseOk ? "ok" : "FAILED");
+    if (!refuseOk)
+        failures++;
+
+#if USE_VM_STACK_GUARD
+    // Beyond the max size, the run stops and the context runs again after
+    // the reset.
+    int overflow = run_pooled_context(&context, 100000, result);
+    context.reset();
+    int after = run_pooled_context(&context, 20, result);
+    bool overflowOk = (overflow == Error::StackGuard_Overflow && after == Error::Ok &&
+                       result == fibonacci32(20));
+    printf("  overflow: %s, then fibonacci(20) = %u  %s\n",
+           Error::format((Error::Type)overflow), result, overflowOk ? "ok" : "FAILED");
+    if (!overflowOk)
+        failures++;
+#endif
+
+    // The frames are rebased on the full frame header, the compact frame
+    // header saves the distances.
+    v3::vmSharedImage compactImage;
+    compactImage.loadBuiltin<v3::vmStackLayout<true, true> >(USE_FIBONACCI_IMAGE);
+    compactImage.freeze();
+    bool fullOk = test_growable_callstack<v3::vmDefaultLayout>(image);
+    bool compactOk = test_growable_callstack<v3::vmStackLayout<true, true> >(compactImage);
+    printf("  rebase:   full frame %s, compact frame %s\n",
+           fullOk ? "ok" : "FAILED", compactOk ? "ok" : "FAILED");
+    if (!fullOk || !compactOk)
+        failures++;
+
+    printf("\n");
+    printf("  %s\n\n", (failures == 0) ? "passed" : "FAILED");
+}
+
+//
+// Run fib() from the restored arg frame of the snapshot, and compare the
+// restored heap with the saved one.
+//
+static bool run_restored_context(const v3::vmSharedImage & image, const v3::vmSnapshot & snapshot,
+                                 const std::vector<unsigned char> & heap, uint32_t expected)
+{
+    v3::ExecutionContext<> context;
+    context.setImageInfo(image.data(), image.size(), image.entry());
+    context.create();
+    context.predecode();
+    if (context.restoreSnapshot(snapshot) != Error::Ok)
+        return false;
+
+    vmReturn<> retVal;
+    retVal.setDataType(vmReturn<>::Basic);
+    bool ok = true;
+    // The arg frame stays for the next runs.
+    for (int i = 0; i < 2; i++) {
+        if (context.run_predecoded(retVal) != Error::Ok || (uint32_t)retVal.getValue() != expected)
+            ok = false;
+    }
+    vmHeap<uintptr_t> & restored = context.getHeap();
+    return (ok && restored.capacity() == heap.size() &&
+            memcmp((const void *)restored.first(), (const void *)heap.data(), heap.size()) == 0);
+}
+
+//
+// Stop the run half way by the fuel, and resume the snapshot of it in the
+// fresh contexts, from memory and from a file. The resumed run costs only
+// the fuel that's left of the whole run, the prefix isn't run again.
+//
+template <typename Layout>
+static bool test_paused_snapshot(const char * name, uint32_t input)
+{
+    typedef v3::ExecutionContext<uintptr_t, Layout> context_type;
+    static const int64_t kFuel = (int64_t)1 << 40;
+    static const char * kFileName = "jlang_vm_paused.bin";
+
+    v3::vmSharedImage image;
+    image.loadBuiltin<Layout>(USE_FIBONACCI_IMAGE);
+    image.freeze();
+    uint32_t expected = fibonacci32(input);
+    vmReturn<> retVal;
+    retVal.setDataType(vmReturn<>::Basic);
+
+    context_type full;
+    full.setImageInfo(image.data(), image.size(), image.entry());
+    full.create();
+    full.pushArg(0);
+    full.pushArg(input);
+    full.getSafepoint().setFuel(kFuel);
+    int fullEc = full.run_pausable(retVal);
+    bool ok = (fullEc == Error::Ok && (uint32_t)retVal.getValue() == expected);
+    int64_t fullCost = kFuel - full.getSafepoint().getFuel();
+    int64_t prefixFuel = fullCost / 2;
+
+    context_type context;
+    context.setImageInfo(image.data(), image.size(), image.entry());
+    context.create();
+    context.pushArg(0);
+    context.pushArg(input);
+    context.getSafepoint().setFuel(prefixFuel);
+    int paused = context.run_pausable(retVal);
+    v3::vmSnapshot snapshot;
+    int saved = context.saveSnapshot(snapshot);
+    ok = ok && (paused == Error::Safepoint_Out_Of_Fuel && saved == Error::Ok &&
+                snapshot.header().ipOffset != v3::vmSnapshotHeader::kNullOffset);
+
+    v3::vmSnapshot loaded;
+    int written = snapshot.saveToFile(kFileName);
+    int read = loaded.loadFromFile(kFileName);
+    ok = ok && (written == Error::Ok && read == Error::Ok);
+
+    int64_t resumedCost = -1;
+    const v3::vmSnapshot * blobs[] = { &snapshot, &loaded };
+    for (size_t i = 0; i < 2 && ok; i++) {
+        context_type restored;
+        restored.setImageInfo(image.data(), image.size(), image.entry());
+        restored.create();
+        int restoredEc = restored.restoreSnapshot(*blobs[i]);
+        restored.getSafepoint().setFuel(kFuel);
+        int resumed = restored.resume(retVal);
+        resumedCost = kFuel - restored.getSafepoint().getFuel();
+        ok = (restoredEc == Error::Ok && resumed == Error::Ok &&
+              (uint32_t)retVal.getValue() == expected &&
+              resumedCost > 0 && resumedCost <= fullCost - prefixFuel);
+
+        // The arg frame stays for the next run.
+        restored.getSafepoint().disableFuel();
+        ok = ok && (restored.run_pausable(retVal) == Error::Ok &&
+                    (uint32_t)retVal.getValue() == expected);
+    }
+    loaded.clear();
+    ::remove(kFileName);
+
+    // The frames out of the stack aren't restored.
+    v3::vmSnapshot corrupt;
+    std::vector<unsigned char> blob(snapshot.data(), snapshot.data() + snapshot.size());
+    ((v3::vmSnapshotHeader *)blob.data())->fpOffset = 0;
+    corrupt.assign(blob.data(), blob.size());
+    context_type other;
+    other.setImageInfo(image.data(), image.size(), image.entry());
+    other.create();
+    int invalid = other.restoreSnapshot(corrupt);
+    ok = ok && (invalid == Error::Snapshot_Invalid && !other.isSuspended());
+
+    printf("  paused:   %-13s fibonacci(%u), resumed %" PRId64 " of %" PRId64 " units  %s\n",
+           name, input, resumedCost, fullCost, ok ? "ok" : "FAILED");
+    return ok;
+}
+
+//
+// The snapshot caches the arg frame and the heap of a context, or its
+// paused run, they're restored in the fresh contexts from memory and from
+// a file.
+//
+void test_Interpreter_v3_snapshot()
+{
+    printf("--------------------------------------------\n");
+    printf("  test_Interpreter_v3_snapshot()\n");
+    printf("--------------------------------------------\n\n");
+
+    static const uint32_t kInput = 20;
+    static const size_t kHeapSize = 16384;
+    static const char * kFileName = "jlang_vm_snapshot.bin";
+
+    v3::vmSharedImage image;
+    image.loadBuiltin<v3::vmDefaultLayout>(USE_FIBONACCI_IMAGE);
+    image.freeze();
+    size_t failures = 0;
+    uint32_t expected = fibonacci32(kInput);
+
+    v3::ExecutionContext<> context;
+    context.setImageInfo(image.data(), image.size(), image.entry());
+    context.create();
+    context.predecode();
+    context.pushArg(0);
+    context.pushArg(kInput);
+    context.createHeap(kHeapSize);
+    std::vector<unsigned char> heap(kHeapSize, 0);
+    for (size_t i = 0; i < kHeapSize / 2; i++) {
+        heap[i] = (unsigned char)(i * 7 + 1);
+    }
+    memcpy((void *)context.getHeap().first(), (const void *)heap.data(), kHeapSize);
+
+    // The run before the save doesn't change the arg frame.
+    vmReturn<> retVal;
+    retVal.setDataType(vmReturn<>::Basic);
+    context.run_predecoded(retVal);
+
+    v3::vmSnapshot snapshot;
+    int saved = context.saveSnapshot(snapshot);
+    bool memoryOk = (saved == Error::Ok && snapshot.header().heapUsed == kHeapSize / 2 &&
+                     run_restored_context(image, snapshot, heap, expected));
+    printf("  memory:   %u bytes, fibonacci(%u)  %s\n", (uint32_t)snapshot.size(),
+           kInput, memoryOk ? "ok" : "FAILED");
+    if (!memoryOk)
+        failures++;
+
+    // The stack section of the file is mapped onto the stack.
+    v3::vmSnapshot loaded;
+    int written = snapshot.saveToFile(kFileName);
+    int read = loaded.loadFromFile(kFileName);
+    bool fileOk = (written == Error::Ok && read == Error::Ok && loaded.size() == snapshot.size() &&
+                   run_restored_context(image, loaded, heap, expected));
+    loaded.clear();
+    ::remove(kFileName);
+    printf("  file:     %s, %s  %s\n", Error::format((Error::Type)written),
+           Error::format((Error::Type)read), fileOk ? "ok" : "FAILED");
+    if (!fileOk)
+        failures++;
+
+    // The snapshot doesn't restore into the context of another image.
+    v3::vmSharedImage fastImage;
+    fastImage.loadBuiltin<v3::vmDefaultLayout>(USE_FIBONACCI_IMAGE_FAST);
+    fastImage.freeze();
+    v3::ExecutionContext<> other;
+    other.setImageInfo(fastImage.data(), fastImage.size(), fastImage.entry());
+    other.create();
+    int mismatch = other.restoreSnapshot(snapshot);
+    bool mismatchOk = (mismatch == Error::Snapshot_Image_Mismatch);
+    printf("  mismatch: %s  %s\n", Error::format((Error::Type)mismatch),
+           mismatchOk ? "ok" : "FAILED");
+    if (!mismatchOk)
+        failures++;
+
+    if (!test_paused_snapshot<v3::vmStackLayout<true, false> >("full frame", kInput))
+        failures++;
+    if (!test_paused_snapshot<v3::vmStackLayout<true, true> >("compact frame", kInput))
+        failures++;
+    if (!test_paused_snapshot<v3::vmStackLayout<false, false> >("backward", kInput))
+        failures++;
+
+    printf("\n");
+    printf("  %s\n\n", (failures == 0) ? "passed" : "FAILED");
+}
+
+void test_Interpreter_v4()
+{
+    test_Interpreter<v4::Interpreter<>>("Interpreter_v4");
+}
+
+void test_Interpreter_v4_threaded()
+{
+    test_Interpreter_threaded<v4::Interpreter<>>("Interpreter_v4_threaded");
+}
+
+void test_Interpreter_v5()
+{
+#if USE_INTERPRETER_V5
+    std::string name = "Interpreter_v5_";
+    name += v5::Interpreter<>::getDispatchMode();
+    test_Interpreter<v5::Interpreter<>>(name);
+#endif
+}
+
+void test_Interpreter_v4_inline()
+{
+    test_Interpreter_inline<v4::Interpreter<>>("Interpreter_v4_inline");
+}
+
+//
+// The recursion beyond the stack stops on the guard region, and the same
+// interpreter runs again after it.
+//
+template <typename InterpreterTy>
+bool test_StackGuard_overflow(const char * name)
+{
+    static const uint32_t kDeepInput = 10000000;
+    static const uint32_t kInput = 20;
+
+    InterpreterTy interpreter;
+    vmReturn<> retVal;
+    retVal.setDataType(vmReturn<>::Basic);
+    interpreter.create();
+
+    retVal.setValue(kDeepInput);
+    int overflow = interpreter.run(retVal);
+    retVal.setValue(kInput);
+    int after = interpreter.run(retVal);
+    bool ok = (overflow == Error::StackGuard_Overflow && after == Error::Ok &&
+               (uint32_t)retVal.getValue() == fibonacci32(kInput));
+    printf("  %-16s %s, then fibonacci(%u) = %u  %s\n", name,
+           Error::format((Error::Type)overflow), kInput,
+           (uint32_t)retVal.getValue(), ok ? "ok" : "FAILED");
+    return ok;
+}
+
+void test_StackGuard()
+{
+#if USE_VM_STACK_GUARD
+    printf("--------------------------------------------\n");
+    printf("  test_StackGuard()\n");
+    printf("--------------------------------------------\n\n");
+
+    size_t failures = 0;
+    if (!test_StackGuard_overflow<v1::Interpreter<>>("Interpreter_v1"))
+        failures++;
+    if (!test_StackGuard_overflow<v4::Interpreter<>>("Interpreter_v4"))
+        failures++;
+#if USE_INTERPRETER_V5
+    if (!test_StackGuard_overflow<v5::Interpreter<>>("Interpreter_v5"))
+        failures++;
+#endif
+
+    printf("\n");
+    printf("  %s\n\n", (failures == 0) ? "passed" : "FAILED");
+#endif
 }
 
 void test_Assembler()
@@ -313,9 +2196,38 @@ int main(int argc, char * argv[])
     //test_Interpreter_v4_inline();
     test_Interpreter_v3_inline();
     test_Interpreter_v4();
+    test_Interpreter_v4_threaded();
     test_Interpreter_v3();
+    test_Interpreter_v3_threaded();
+    test_Interpreter_v3_verified();
+    test_Interpreter_v3_tuned();
+    test_Interpreter_v3_predecoded();
+    test_Interpreter_v3_superinsn();
+    test_Interpreter_v3_jit();
+    test_JitCompiler_overflow();
+    test_Interpreter_v3_traced();
+    test_Interpreter_aot("Interpreter_v3_aot");
+    test_Interpreter_v3_register();
+    test_ExecutionPool();
+    test_ContextPool();
+    test_Interpreter_v3_growable();
+    test_Interpreter_v3_snapshot();
+    test_SuperInsn_profile();
+    test_RegisterVM_profile();
+    test_TraceJit_stats();
+    test_TypedCmp();
+    test_PreDecoder_targets();
+    test_Interpreter_v5();
+    test_StackGuard();
     //test_Interpreter_v2();
-    //test_Interpreter_v1();
+    test_Interpreter_v1();
+    test_Interpreter_v1_flags();
+    test_Interpreter_v1_vector();
+    test_Interpreter_v1_memory();
+    test_Interpreter_v1_native();
+    test_Interpreter_v1_safepoint();
+    test_Scheduler();
+    test_Interpreter_v1_quickened();
 
     printf("\n");
     System::pause();
@@ -0,0 +1,412 @@
+//
+// The built-in v1 test images, they test the opcode families of the v1
+// interpreter, see main.cpp. The inputs of an image are patched into its
+// immediates at the offsets given with it.
+//
+#ifndef JLANG_VM_TEST_V1_IMAGES_H
+#define JLANG_VM_TEST_V1_IMAGES_H
+
+#include <stdint.h>
+#include <stddef.h>
+#include <string.h>
+
+#include <jlang/vm/Interpreter_v1.h>
+
+namespace v1_images {
+
+using namespace jlang;
+
+//
+// A copy of a built-in image, the immediates are patched in the copy.
+//
+class vmTestImage {
+private:
+    vmBinImage image_;
+
+public:
+    vmTestImage() {}
+    template <size_t N>
+    vmTestImage(const unsigned char (&binary)[N], size_t entryOffset = 0) {
+        load(binary, N, entryOffset);
+    }
+    ~vmTestImage() {}
+
+    void load(const unsigned char * binary, size_t size, size_t entryOffset = 0) {
+        image_.allocate(size);
+        if (image_.data()) {
+            memcpy(image_.data(), (const void *)binary, size);
+        }
+        image_.setEntryOffset(entryOffset);
+    }
+
+    void setUInt16(size_t offset, uint16_t value) {
+        memcpy((char *)image_.data() + offset, &value, sizeof(value));
+    }
+
+    void setUInt32(size_t offset, uint32_t value) {
+        memcpy((char *)image_.data() + offset, &value, sizeof(value));
+    }
+
+    void setUInt64(size_t offset, uint64_t value) {
+        memcpy((char *)image_.data() + offset, &value, sizeof(value));
+    }
+
+    template <typename ThreadTy>
+    void attach(ThreadTy & thread) const {
+        thread.setImageInfo(image_.data(), image_.size(), image_.entry());
+    }
+};
+
+//
+// The condition jumps, the image sets a bit in eax for every jump that's
+// taken. The blocks are tested in the order of OpCode::jz .. OpCode::jns:
+//
+//   bit 0: jz, bit 1: jnz, bit 2: je, bit 3: jne, bit 4: jl,
+//   bit 5: jle, bit 6: jg, bit 7: jge, bit 8: js, bit 9: jns
+//
+// Every block reads the flags of its own cmp (or dec), and each one is
+// 21 bytes, the dec block has no data type:
+//
+//   +00:   load edx, bit
+//   +06:   cmp ebx, ecx            (or: move ecx, ebx; dec ecx)
+//   +0B:   jcc +06 (near)
+//   +0E:   jmp +07 (near)
+//   +11:   add eax, edx
+//
+#define V1_COND_BLOCK(cond, bit, dataType) \
+    OpCode::load, vmReg::edx, ((bit) & 0xFF), ((bit) >> 8), 0x00, 0x00, \
+    OpCode::cmp,  vmComboType::Reg_Reg, (dataType), vmReg::ebx, vmReg::ecx, \
+    OpCode::cond, vmJumpType::Near, 0x06, \
+    OpCode::jmp,  vmJumpType::Near, 0x07, \
+    OpCode::add,  vmComboType::Reg_Reg, vmReg::eax, vmReg::edx
+
+#define V1_DEC_BLOCK(cond, bit, dataType) \
+    OpCode::load, vmReg::edx, ((bit) & 0xFF), ((bit) >> 8), 0x00, 0x00, \
+    OpCode::move, vmReg::ecx, vmReg::ebx, \
+    OpCode::dec,  vmReg::ecx, \
+    OpCode::cond, vmJumpType::Near, 0x06, \
+    OpCode::jmp,  vmJumpType::Near, 0x07, \
+    OpCode::add,  vmComboType::Reg_Reg, vmReg::eax, vmReg::edx
+
+#define V1_COND_BLOCKS(BLOCK, dataType) \
+    /* 00000012: */ BLOCK(jz,  0x001, dataType), \
+    /* 00000027: */ BLOCK(jnz, 0x002, dataType), \
+    /* 0000003C: */ BLOCK(je,  0x004, dataType), \
+    /* 00000051: */ BLOCK(jne, 0x008, dataType), \
+    /* 00000066: */ BLOCK(jl,  0x010, dataType), \
+    /* 0000007B: */ BLOCK(jle, 0x020, dataType), \
+    /* 00000090: */ BLOCK(jg,  0x040, dataType), \
+    /* 000000A5: */ BLOCK(jge, 0x080, dataType), \
+    /* 000000BA: */ BLOCK(js,  0x100, dataType), \
+    /* 000000CF: */ BLOCK(jns, 0x200, dataType)
+
+// The offsets of the inputs, ebx and ecx.
+static const size_t kCondInput1 = 0x08;
+static const size_t kCondInput2 = 0x0E;
+
+#define V1_COND_IMAGE_HEAD() \
+    /* 00000000:    load eax, 0x00000000 (uint32) */ \
+    OpCode::load, vmReg::eax, 0x00, 0x00, 0x00, 0x00, \
+    /* 00000006:    load ebx, input1 (uint32) */ \
+    OpCode::load, vmReg::ebx, 0x00, 0x00, 0x00, 0x00, \
+    /* 0000000C:    load ecx, input2 (uint32) */ \
+    OpCode::load, vmReg::ecx, 0x00, 0x00, 0x00, 0x00
+
+// cmp ebx, ecx (int32)
+static const unsigned char condInt32Binary[] = {
+    V1_COND_IMAGE_HEAD(),
+    V1_COND_BLOCKS(V1_COND_BLOCK, vmDataType::Int32),
+    // 000000E4:    ret
+    OpCode::ret
+};
+
+// cmp ebx, ecx (uint32)
+static const unsigned char condUInt32Binary[] = {
+    V1_COND_IMAGE_HEAD(),
+    V1_COND_BLOCKS(V1_COND_BLOCK, vmDataType::UInt32),
+    // 000000E4:    ret
+    OpCode::ret
+};
+
+// move ecx, ebx; dec ecx, the input2 is not used.
+static const unsigned char condDecBinary[] = {
+    V1_COND_IMAGE_HEAD(),
+    V1_COND_BLOCKS(V1_DEC_BLOCK, 0),
+    // 000000E4:    ret
+    OpCode::ret
+};
+
+#undef V1_COND_IMAGE_HEAD
+#undef V1_COND_BLOCKS
+#undef V1_DEC_BLOCK
+#undef V1_COND_BLOCK
+
+//
+// The vector instructions on the int32 lanes of xmm, ymm or zmm, the
+// vectors are in the heap, 64 bytes apart:
+//
+//   out0 = a * b + 3
+//   out1 = (a > b) ? a : b
+//   out2 = a[idx[i] % lanes]
+//
+// The load and the store of the vector at "bad" must be rejected, it's
+// not in the heap, so eax is the sum of the splat of 3.
+//
+static const size_t kVectorA    = 0x02;
+static const size_t kVectorB    = 0x0C;
+static const size_t kVectorIdx  = 0x16;
+static const size_t kVectorOut0 = 0x20;
+static const size_t kVectorOut1 = 0x2A;
+static const size_t kVectorOut2 = 0x34;
+static const size_t kVectorBad  = 0x3E;
+
+#define V1_VECTOR_BINARY(v) \
+    /* 00000000:    load rsi, a (uint64) */ \
+    OpCode::load, vmReg::rsi, 0, 0, 0, 0, 0, 0, 0, 0, \
+    /* 0000000A:    load rdx, b (uint64) */ \
+    OpCode::load, vmReg::rdx, 0, 0, 0, 0, 0, 0, 0, 0, \
+    /* 00000014:    load r8, idx (uint64) */ \
+    OpCode::load, vmReg::r8,  0, 0, 0, 0, 0, 0, 0, 0, \
+    /* 0000001E:    load rdi, out0 (uint64) */ \
+    OpCode::load, vmReg::rdi, 0, 0, 0, 0, 0, 0, 0, 0, \
+    /* 00000028:    load rbx, out1 (uint64) */ \
+    OpCode::load, vmReg::rbx, 0, 0, 0, 0, 0, 0, 0, 0, \
+    /* 00000032:    load r9, out2 (uint64) */ \
+    OpCode::load, vmReg::r9,  0, 0, 0, 0, 0, 0, 0, 0, \
+    /* 0000003C:    load rbp, bad (uint64) */ \
+    OpCode::load, vmReg::rbp, 0, 0, 0, 0, 0, 0, 0, 0, \
+    /* 00000046:    load ecx, 0x00000003 (uint32) */ \
+    OpCode::load, vmReg::ecx, 0x03, 0x00, 0x00, 0x00, \
+    /* 0000004C:    vload v0, [rsi] */ \
+    OpCode::vload,  vmReg::v##mm0, vmReg::rsi, \
+    /* 0000004F:    vload v1, [rdx] */ \
+    OpCode::vload,  vmReg::v##mm1, vmReg::rdx, \
+    /* 00000052:    vload v7, [r8] */ \
+    OpCode::vload,  vmReg::v##mm7, vmReg::r8, \
+    /* 00000055:    valu mul.i32 v2, v0, v1 */ \
+    OpCode::valu,   vmVecOp::Mul, vmLaneType::Int32, \
+                    vmReg::v##mm2, vmReg::v##mm0, vmReg::v##mm1, \
+    /* 0000005B:    vsplat i32 v3, ecx */ \
+    OpCode::vsplat, vmLaneType::Int32, vmReg::v##mm3, vmReg::ecx, \
+    /* 0000005F:    valu add.i32 v2, v2, v3 */ \
+    OpCode::valu,   vmVecOp::Add, vmLaneType::Int32, \
+                    vmReg::v##mm2, vmReg::v##mm2, vmReg::v##mm3, \
+    /* 00000065:    vstore [rdi], v2 */ \
+    OpCode::vstore, vmReg::rdi, vmReg::v##mm2, \
+    /* 00000068:    vcmp gt.i32 v4, v0, v1 */ \
+    OpCode::vcmp,   vmVecCmp::Gt, vmLaneType::Int32, \
+                    vmReg::v##mm4, vmReg::v##mm0, vmReg::v##mm1, \
+    /* 0000006E:    vblend v5, v4, v0, v1 */ \
+    OpCode::vblend, vmReg::v##mm5, vmReg::v##mm4, vmReg::v##mm0, vmReg::v##mm1, \
+    /* 00000073:    vstore [rbx], v5 */ \
+    OpCode::vstore, vmReg::rbx, vmReg::v##mm5, \
+    /* 00000076:    vshuffle i32 v6, v0, v7 */ \
+    OpCode::vshuffle, vmLaneType::Int32, vmReg::v##mm6, vmReg::v##mm0, vmReg::v##mm7, \
+    /* 0000007B:    vstore [r9], v6 */ \
+    OpCode::vstore, vmReg::r9, vmReg::v##mm6, \
+    /* 0000007E:    vsplat i32 v6, ecx */ \
+    OpCode::vsplat, vmLaneType::Int32, vmReg::v##mm6, vmReg::ecx, \
+    /* 00000082:    vload v6, [rbp] */ \
+    OpCode::vload,  vmReg::v##mm6, vmReg::rbp, \
+    /* 00000085:    vstore [rbp], v2 */ \
+    OpCode::vstore, vmReg::rbp, vmReg::v##mm2, \
+    /* 00000088:    vreduce add.i32 eax, v6 */ \
+    OpCode::vreduce, vmVecOp::Add, vmLaneType::Int32, vmReg::eax, vmReg::v##mm6, \
+    /* 0000008D:    ret */ \
+    OpCode::ret
+
+static const unsigned char vectorXmmBinary[] = { V1_VECTOR_BINARY(x) };
+static const unsigned char vectorYmmBinary[] = { V1_VECTOR_BINARY(y) };
+static const unsigned char vectorZmmBinary[] = { V1_VECTOR_BINARY(z) };
+
+#undef V1_VECTOR_BINARY
+
+//
+// The bulk memory instructions on the heap, heap[0 .. 1000) is filled by
+// the test:
+//
+//   heap[2000 .. 3000) = 7                     (mem_set)
+//   heap[1000 .. 2000) = heap[0 .. 1000)       (mem_copy)
+//   edx = cmp heap[1000 ..], heap[0 ..]        (mem_cmp, 0)
+//   rbx = find 7 in heap[1500 .. 3500)         (mem_chr, 19)
+//
+// The mem_chr of heap[3000 .. 5000) must be rejected, it's not in the
+// heap, so rbp keeps 99. eax is ebx + ebp + edx, it's 118.
+//
+static const size_t kMemSetDest  = 0x02;
+static const size_t kMemCopyDest = 0x24;
+static const size_t kMemCopySrc  = 0x2E;
+static const size_t kMemChrPtr   = 0x41;
+static const size_t kMemBadPtr   = 0x5A;
+
+static const unsigned char memOpsBinary[] = {
+    // 00000000:    load rdi, heap + 2000 (uint64)
+    OpCode::load, vmReg::rdi, 0, 0, 0, 0, 0, 0, 0, 0,
+    // 0000000A:    load rax, 0x0000000000000007 (uint64)
+    OpCode::load, vmReg::rax, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 00000014:    load rcx, 0x00000000000003E8 (uint64)
+    OpCode::load, vmReg::rcx, 0xE8, 0x03, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 0000001E:    mem_set [rdi], rax, rcx
+    OpCode::mem_set,  vmReg::rdi, vmReg::rax, vmReg::rcx,
+
+    // 00000022:    load rdi, heap + 1000 (uint64)
+    OpCode::load, vmReg::rdi, 0, 0, 0, 0, 0, 0, 0, 0,
+    // 0000002C:    load rsi, heap (uint64)
+    OpCode::load, vmReg::rsi, 0, 0, 0, 0, 0, 0, 0, 0,
+    // 00000036:    mem_copy [rdi], [rsi], rcx
+    OpCode::mem_copy, vmReg::rdi, vmReg::rsi, vmReg::rcx,
+    // 0000003A:    mem_cmp edx, [rdi], [rsi], rcx
+    OpCode::mem_cmp,  vmReg::edx, vmReg::rdi, vmReg::rsi, vmReg::rcx,
+
+    // 0000003F:    load rsi, heap + 1500 (uint64)
+    OpCode::load, vmReg::rsi, 0, 0, 0, 0, 0, 0, 0, 0,
+    // 00000049:    load rcx, 0x00000000000007D0 (uint64)
+    OpCode::load, vmReg::rcx, 0xD0, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 00000053:    mem_chr rbx, [rsi], rax, rcx
+    OpCode::mem_chr,  vmReg::rbx, vmReg::rsi, vmReg::rax, vmReg::rcx,
+
+    // 00000058:    load rsi, heap + 3000 (uint64)
+    OpCode::load, vmReg::rsi, 0, 0, 0, 0, 0, 0, 0, 0,
+    // 00000062:    load rbp, 0x0000000000000063 (uint64)
+    OpCode::load, vmReg::rbp, 0x63, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 0000006C:    mem_chr rbp, [rsi], rax, rcx
+    OpCode::mem_chr,  vmReg::rbp, vmReg::rsi, vmReg::rax, vmReg::rcx,
+
+    // 00000071:    move eax, ebx
+    OpCode::move, vmReg::eax, vmReg::ebx,
+    // 00000074:    add eax, ebp
+    OpCode::add,  vmComboType::Reg_Reg, vmReg::eax, vmReg::ebp,
+    // 00000078:    add eax, edx
+    OpCode::add,  vmComboType::Reg_Reg, vmReg::eax, vmReg::edx,
+    // 0000007C:    ret
+    OpCode::ret
+};
+
+//
+// The native calls, the natives must be registered in this order:
+//
+//   0: hash(const char * text, size_t len)
+//   1: hypot(double x, double y)
+//   2: sum6(int32_t, int8_t, uint16_t, int64_t, int, long)
+//   3: bump()
+//   4: record(uint32_t slot, uint64_t value)
+//
+// The results of hash, hypot and sum6 are passed to record(), the extra
+// bits of the int8_t and the uint16_t arguments must be dropped. The call
+// of the native 99 that's not registered is skipped, so eax is 0x5A.
+//
+static const size_t kNativeText = 0x02;
+
+static const unsigned char nativeCallBinary[] = {
+    // 00000000:    load r0, text (uint64)
+    OpCode::load, vmReg::r0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 0000000A:    load r1, 0x000000000000000B (uint64)
+    OpCode::load, vmReg::r1, 0x0B, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 00000014:    call_native 0 (hash)
+    OpCode::call_native, 0x00, 0x00,
+    // 00000017:    move r1, rax
+    OpCode::move, vmReg::r1, vmReg::rax,
+    // 0000001A:    load r0, 0x0000000000000000 (uint64)
+    OpCode::load, vmReg::r0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 00000024:    call_native 4 (record)
+    OpCode::call_native, 0x04, 0x00,
+
+    // 00000027:    load r0, 3.0 (double)
+    OpCode::load, vmReg::r0, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x08, 0x40,
+    // 00000031:    load r1, 4.0 (double)
+    OpCode::load, vmReg::r1, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x10, 0x40,
+    // 0000003B:    call_native 1 (hypot)
+    OpCode::call_native, 0x01, 0x00,
+    // 0000003E:    move r1, rax
+    OpCode::move, vmReg::r1, vmReg::rax,
+    // 00000041:    load r0, 0x0000000000000001 (uint64)
+    OpCode::load, vmReg::r0, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 0000004B:    call_native 4 (record)
+    OpCode::call_native, 0x04, 0x00,
+
+    // 0000004E:    load r0, -5 (int64)
+    OpCode::load, vmReg::r0, 0xFB, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    // 00000058:    load r1, 0x00000000000001FF (uint64), it's -1 (int8)
+    OpCode::load, vmReg::r1, 0xFF, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 00000062:    load r2, 0x0000000000010002 (uint64), it's 2 (uint16)
+    OpCode::load, vmReg::r2, 0x02, 0x00, 0x01, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 0000006C:    load r3, 0x000000E8D4A51000 (uint64)
+    OpCode::load, vmReg::r3, 0x00, 0x10, 0xA5, 0xD4, 0xE8, 0x00, 0x00, 0x00,
+    // 00000076:    load r4, 0x0000000000000007 (uint64)
+    OpCode::load, vmReg::r4, 0x07, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 00000080:    load r5, -3 (int64)
+    OpCode::load, vmReg::r5, 0xFD, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF, 0xFF,
+    // 0000008A:    call_native 2 (sum6)
+    OpCode::call_native, 0x02, 0x00,
+    // 0000008D:    move r1, rax
+    OpCode::move, vmReg::r1, vmReg::rax,
+    // 00000090:    load r0, 0x0000000000000002 (uint64)
+    OpCode::load, vmReg::r0, 0x02, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    // 0000009A:    call_native 4 (record)
+    OpCode::call_native, 0x04, 0x00,
+
+    // 0000009D:    call_native 3 (bump)
+    OpCode::call_native, 0x03, 0x00,
+    // 000000A0:    call_native 3 (bump)
+    OpCode::call_native, 0x03, 0x00,
+    // 000000A3:    load eax, 0x0000005A (uint32)
+    OpCode::load, vmReg::eax, 0x5A, 0x00, 0x00, 0x00,
+    // 000000A9:    call_native 99 (not registered)
+    OpCode::call_native, 0x63, 0x00,
+    // 000000AC:    ret
+    OpCode::ret
+};
+
+//
+// The counting loop, eax is the count of the iterations. The backward
+// jnz is the safepoint of the loop, every iteration costs 5 units of fuel.
+//
+static const size_t kLoopCount = 0x08;
+static const int32_t kLoopIterationCost = 5;
+
+static const unsigned char countLoopBinary[] = {
+    // 00000000:    load eax, 0x00000000 (uint32)
+    OpCode::load, vmReg::eax, 0x00, 0x00, 0x00, 0x00,
+    // 00000006:    load ecx, count (uint32)
+    OpCode::load, vmReg::ecx, 0x00, 0x00, 0x00, 0x00,
+    // 0000000C:    inc eax
+    OpCode::inc,  vmReg::eax,
+    // 0000000E:    dec ecx
+    OpCode::dec,  vmReg::ecx,
+    // 00000010:    jnz 0x0000000C (short offset 0xFFFC)
+    OpCode::jnz,  vmJumpType::Short, 0xFC, 0xFF,
+    // 00000014:    ret
+    OpCode::ret
+};
+
+//
+// The loop of the green threads, eax is the count of the iterations. Every
+// iteration yields, then calls the native 0 that takes no arguments, the
+// native may block the worker or spawn the other threads.
+//
+static const size_t kYieldLoopCount = 0x08;
+
+static const unsigned char yieldLoopBinary[] = {
+    // 00000000:    load edx, 0x00000000 (uint32)
+    OpCode::load, vmReg::edx, 0x00, 0x00, 0x00, 0x00,
+    // 00000006:    load ecx, count (uint32)
+    OpCode::load, vmReg::ecx, 0x00, 0x00, 0x00, 0x00,
+    // 0000000C:    inc edx
+    OpCode::inc,  vmReg::edx,
+    // 0000000E:    yield
+    OpCode::yield,
+    // 0000000F:    call_native 0
+    OpCode::call_native, 0x00, 0x00,
+    // 00000012:    dec ecx
+    OpCode::dec,  vmReg::ecx,
+    // 00000014:    jnz 0x0000000C (short offset 0xFFF8)
+    OpCode::jnz,  vmJumpType::Short, 0xF8, 0xFF,
+    // 00000018:    move eax, edx
+    OpCode::move, vmReg::eax, vmReg::edx,
+    // 0000001B:    ret
+    OpCode::ret
+};
+
+} // namespace v1_images
+
+#endif // JLANG_VM_TEST_V1_IMAGES_H